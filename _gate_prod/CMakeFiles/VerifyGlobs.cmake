@@ -0,0 +1,45 @@
+# CMAKE generated file: DO NOT EDIT!
+# Generated by CMake Version 3.25
+cmake_policy(SET CMP0009 NEW)
+
+# MY_SOURCES at CMakeLists.txt:31 (file)
+file(GLOB_RECURSE NEW_GLOB LIST_DIRECTORIES false "/root/repo/src/*.cpp")
+set(OLD_GLOB
+  "/root/repo/src/BVH.cpp"
+  "/root/repo/src/Benchmark.cpp"
+  "/root/repo/src/BlueNoise.cpp"
+  "/root/repo/src/Camera.cpp"
+  "/root/repo/src/Checkpoint.cpp"
+  "/root/repo/src/DynamicResolution.cpp"
+  "/root/repo/src/Environment.cpp"
+  "/root/repo/src/FrameBudget.cpp"
+  "/root/repo/src/GpuState.cpp"
+  "/root/repo/src/ImageFile.cpp"
+  "/root/repo/src/ImageWriter.cpp"
+  "/root/repo/src/JobSystem.cpp"
+  "/root/repo/src/Lights.cpp"
+  "/root/repo/src/Model.cpp"
+  "/root/repo/src/Offline.cpp"
+  "/root/repo/src/ReadbackRing.cpp"
+  "/root/repo/src/RenderTargets.cpp"
+  "/root/repo/src/Scene.cpp"
+  "/root/repo/src/Shader.cpp"
+  "/root/repo/src/Termination.cpp"
+  "/root/repo/src/TiledImageWriter.cpp"
+  "/root/repo/src/Window.cpp"
+  "/root/repo/src/cpu/CpuDispatch.cpp"
+  "/root/repo/src/cpu/Denoiser.cpp"
+  "/root/repo/src/cpu/Integrator.cpp"
+  "/root/repo/src/cpu/KernelsAVX2.cpp"
+  "/root/repo/src/cpu/KernelsAVX512.cpp"
+  "/root/repo/src/cpu/KernelsSSE42.cpp"
+  "/root/repo/src/cpu/KernelsScalar.cpp"
+  "/root/repo/src/cpu/PathGuide.cpp"
+  "/root/repo/src/cpu/RadianceCache.cpp"
+  "/root/repo/src/main.cpp"
+  "/root/repo/src/misc/Logger.cpp"
+  )
+if(NOT "${NEW_GLOB}" STREQUAL "${OLD_GLOB}")
+  message("-- GLOB mismatch!")
+  file(TOUCH_NOCREATE "/root/repo/_gate_prod/CMakeFiles/cmake.verify_globs")
+endif()
@@ -0,0 +1,53 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/src/BVH.cpp" "CMakeFiles/raytracer.dir/src/BVH.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/BVH.cpp.o.d"
+  "/root/repo/src/Benchmark.cpp" "CMakeFiles/raytracer.dir/src/Benchmark.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/Benchmark.cpp.o.d"
+  "/root/repo/src/BlueNoise.cpp" "CMakeFiles/raytracer.dir/src/BlueNoise.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/BlueNoise.cpp.o.d"
+  "/root/repo/src/Camera.cpp" "CMakeFiles/raytracer.dir/src/Camera.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/Camera.cpp.o.d"
+  "/root/repo/src/Checkpoint.cpp" "CMakeFiles/raytracer.dir/src/Checkpoint.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/Checkpoint.cpp.o.d"
+  "/root/repo/src/DynamicResolution.cpp" "CMakeFiles/raytracer.dir/src/DynamicResolution.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/DynamicResolution.cpp.o.d"
+  "/root/repo/src/Environment.cpp" "CMakeFiles/raytracer.dir/src/Environment.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/Environment.cpp.o.d"
+  "/root/repo/src/FrameBudget.cpp" "CMakeFiles/raytracer.dir/src/FrameBudget.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/FrameBudget.cpp.o.d"
+  "/root/repo/src/GpuState.cpp" "CMakeFiles/raytracer.dir/src/GpuState.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/GpuState.cpp.o.d"
+  "/root/repo/src/ImageFile.cpp" "CMakeFiles/raytracer.dir/src/ImageFile.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/ImageFile.cpp.o.d"
+  "/root/repo/src/ImageWriter.cpp" "CMakeFiles/raytracer.dir/src/ImageWriter.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/ImageWriter.cpp.o.d"
+  "/root/repo/src/JobSystem.cpp" "CMakeFiles/raytracer.dir/src/JobSystem.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/JobSystem.cpp.o.d"
+  "/root/repo/src/Lights.cpp" "CMakeFiles/raytracer.dir/src/Lights.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/Lights.cpp.o.d"
+  "/root/repo/src/Model.cpp" "CMakeFiles/raytracer.dir/src/Model.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/Model.cpp.o.d"
+  "/root/repo/src/Offline.cpp" "CMakeFiles/raytracer.dir/src/Offline.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/Offline.cpp.o.d"
+  "/root/repo/src/ReadbackRing.cpp" "CMakeFiles/raytracer.dir/src/ReadbackRing.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/ReadbackRing.cpp.o.d"
+  "/root/repo/src/RenderTargets.cpp" "CMakeFiles/raytracer.dir/src/RenderTargets.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/RenderTargets.cpp.o.d"
+  "/root/repo/src/Scene.cpp" "CMakeFiles/raytracer.dir/src/Scene.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/Scene.cpp.o.d"
+  "/root/repo/src/Shader.cpp" "CMakeFiles/raytracer.dir/src/Shader.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/Shader.cpp.o.d"
+  "/root/repo/src/Termination.cpp" "CMakeFiles/raytracer.dir/src/Termination.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/Termination.cpp.o.d"
+  "/root/repo/src/TiledImageWriter.cpp" "CMakeFiles/raytracer.dir/src/TiledImageWriter.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/TiledImageWriter.cpp.o.d"
+  "/root/repo/src/Window.cpp" "CMakeFiles/raytracer.dir/src/Window.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/Window.cpp.o.d"
+  "/root/repo/src/cpu/CpuDispatch.cpp" "CMakeFiles/raytracer.dir/src/cpu/CpuDispatch.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/cpu/CpuDispatch.cpp.o.d"
+  "/root/repo/src/cpu/Denoiser.cpp" "CMakeFiles/raytracer.dir/src/cpu/Denoiser.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/cpu/Denoiser.cpp.o.d"
+  "/root/repo/src/cpu/Integrator.cpp" "CMakeFiles/raytracer.dir/src/cpu/Integrator.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/cpu/Integrator.cpp.o.d"
+  "/root/repo/src/cpu/KernelsAVX2.cpp" "CMakeFiles/raytracer.dir/src/cpu/KernelsAVX2.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/cpu/KernelsAVX2.cpp.o.d"
+  "/root/repo/src/cpu/KernelsAVX512.cpp" "CMakeFiles/raytracer.dir/src/cpu/KernelsAVX512.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/cpu/KernelsAVX512.cpp.o.d"
+  "/root/repo/src/cpu/KernelsSSE42.cpp" "CMakeFiles/raytracer.dir/src/cpu/KernelsSSE42.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/cpu/KernelsSSE42.cpp.o.d"
+  "/root/repo/src/cpu/KernelsScalar.cpp" "CMakeFiles/raytracer.dir/src/cpu/KernelsScalar.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/cpu/KernelsScalar.cpp.o.d"
+  "/root/repo/src/cpu/PathGuide.cpp" "CMakeFiles/raytracer.dir/src/cpu/PathGuide.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/cpu/PathGuide.cpp.o.d"
+  "/root/repo/src/cpu/RadianceCache.cpp" "CMakeFiles/raytracer.dir/src/cpu/RadianceCache.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/cpu/RadianceCache.cpp.o.d"
+  "/root/repo/src/main.cpp" "CMakeFiles/raytracer.dir/src/main.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/main.cpp.o.d"
+  "/root/repo/src/misc/Logger.cpp" "CMakeFiles/raytracer.dir/src/misc/Logger.cpp.o" "gcc" "CMakeFiles/raytracer.dir/src/misc/Logger.cpp.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  "/root/repo/_gate_prod/libs/glfw/src/CMakeFiles/glfw.dir/DependInfo.cmake"
+  "/root/repo/_gate_prod/libs/glad/CMakeFiles/glad.dir/DependInfo.cmake"
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
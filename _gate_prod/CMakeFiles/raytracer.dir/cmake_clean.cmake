@@ -0,0 +1,75 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/raytracer.dir/src/BVH.cpp.o"
+  "CMakeFiles/raytracer.dir/src/BVH.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/Benchmark.cpp.o"
+  "CMakeFiles/raytracer.dir/src/Benchmark.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/BlueNoise.cpp.o"
+  "CMakeFiles/raytracer.dir/src/BlueNoise.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/Camera.cpp.o"
+  "CMakeFiles/raytracer.dir/src/Camera.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/Checkpoint.cpp.o"
+  "CMakeFiles/raytracer.dir/src/Checkpoint.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/DynamicResolution.cpp.o"
+  "CMakeFiles/raytracer.dir/src/DynamicResolution.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/Environment.cpp.o"
+  "CMakeFiles/raytracer.dir/src/Environment.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/FrameBudget.cpp.o"
+  "CMakeFiles/raytracer.dir/src/FrameBudget.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/GpuState.cpp.o"
+  "CMakeFiles/raytracer.dir/src/GpuState.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/ImageFile.cpp.o"
+  "CMakeFiles/raytracer.dir/src/ImageFile.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/ImageWriter.cpp.o"
+  "CMakeFiles/raytracer.dir/src/ImageWriter.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/JobSystem.cpp.o"
+  "CMakeFiles/raytracer.dir/src/JobSystem.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/Lights.cpp.o"
+  "CMakeFiles/raytracer.dir/src/Lights.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/Model.cpp.o"
+  "CMakeFiles/raytracer.dir/src/Model.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/Offline.cpp.o"
+  "CMakeFiles/raytracer.dir/src/Offline.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/ReadbackRing.cpp.o"
+  "CMakeFiles/raytracer.dir/src/ReadbackRing.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/RenderTargets.cpp.o"
+  "CMakeFiles/raytracer.dir/src/RenderTargets.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/Scene.cpp.o"
+  "CMakeFiles/raytracer.dir/src/Scene.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/Shader.cpp.o"
+  "CMakeFiles/raytracer.dir/src/Shader.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/Termination.cpp.o"
+  "CMakeFiles/raytracer.dir/src/Termination.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/TiledImageWriter.cpp.o"
+  "CMakeFiles/raytracer.dir/src/TiledImageWriter.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/Window.cpp.o"
+  "CMakeFiles/raytracer.dir/src/Window.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/cpu/CpuDispatch.cpp.o"
+  "CMakeFiles/raytracer.dir/src/cpu/CpuDispatch.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/cpu/Denoiser.cpp.o"
+  "CMakeFiles/raytracer.dir/src/cpu/Denoiser.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/cpu/Integrator.cpp.o"
+  "CMakeFiles/raytracer.dir/src/cpu/Integrator.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/cpu/KernelsAVX2.cpp.o"
+  "CMakeFiles/raytracer.dir/src/cpu/KernelsAVX2.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/cpu/KernelsAVX512.cpp.o"
+  "CMakeFiles/raytracer.dir/src/cpu/KernelsAVX512.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/cpu/KernelsSSE42.cpp.o"
+  "CMakeFiles/raytracer.dir/src/cpu/KernelsSSE42.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/cpu/KernelsScalar.cpp.o"
+  "CMakeFiles/raytracer.dir/src/cpu/KernelsScalar.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/cpu/PathGuide.cpp.o"
+  "CMakeFiles/raytracer.dir/src/cpu/PathGuide.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/cpu/RadianceCache.cpp.o"
+  "CMakeFiles/raytracer.dir/src/cpu/RadianceCache.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/main.cpp.o"
+  "CMakeFiles/raytracer.dir/src/main.cpp.o.d"
+  "CMakeFiles/raytracer.dir/src/misc/Logger.cpp.o"
+  "CMakeFiles/raytracer.dir/src/misc/Logger.cpp.o.d"
+  "raytracer"
+  "raytracer.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/raytracer.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/glad.dir/src/glad.c.o"
+  "CMakeFiles/glad.dir/src/glad.c.o.d"
+  "libglad.a"
+  "libglad.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/glad.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,34 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/libs/glfw/src/context.c" "libs/glfw/src/CMakeFiles/glfw.dir/context.c.o" "gcc" "libs/glfw/src/CMakeFiles/glfw.dir/context.c.o.d"
+  "/root/repo/libs/glfw/src/egl_context.c" "libs/glfw/src/CMakeFiles/glfw.dir/egl_context.c.o" "gcc" "libs/glfw/src/CMakeFiles/glfw.dir/egl_context.c.o.d"
+  "/root/repo/libs/glfw/src/init.c" "libs/glfw/src/CMakeFiles/glfw.dir/init.c.o" "gcc" "libs/glfw/src/CMakeFiles/glfw.dir/init.c.o.d"
+  "/root/repo/libs/glfw/src/input.c" "libs/glfw/src/CMakeFiles/glfw.dir/input.c.o" "gcc" "libs/glfw/src/CMakeFiles/glfw.dir/input.c.o.d"
+  "/root/repo/libs/glfw/src/monitor.c" "libs/glfw/src/CMakeFiles/glfw.dir/monitor.c.o" "gcc" "libs/glfw/src/CMakeFiles/glfw.dir/monitor.c.o.d"
+  "/root/repo/libs/glfw/src/null_init.c" "libs/glfw/src/CMakeFiles/glfw.dir/null_init.c.o" "gcc" "libs/glfw/src/CMakeFiles/glfw.dir/null_init.c.o.d"
+  "/root/repo/libs/glfw/src/null_joystick.c" "libs/glfw/src/CMakeFiles/glfw.dir/null_joystick.c.o" "gcc" "libs/glfw/src/CMakeFiles/glfw.dir/null_joystick.c.o.d"
+  "/root/repo/libs/glfw/src/null_monitor.c" "libs/glfw/src/CMakeFiles/glfw.dir/null_monitor.c.o" "gcc" "libs/glfw/src/CMakeFiles/glfw.dir/null_monitor.c.o.d"
+  "/root/repo/libs/glfw/src/null_window.c" "libs/glfw/src/CMakeFiles/glfw.dir/null_window.c.o" "gcc" "libs/glfw/src/CMakeFiles/glfw.dir/null_window.c.o.d"
+  "/root/repo/libs/glfw/src/osmesa_context.c" "libs/glfw/src/CMakeFiles/glfw.dir/osmesa_context.c.o" "gcc" "libs/glfw/src/CMakeFiles/glfw.dir/osmesa_context.c.o.d"
+  "/root/repo/libs/glfw/src/platform.c" "libs/glfw/src/CMakeFiles/glfw.dir/platform.c.o" "gcc" "libs/glfw/src/CMakeFiles/glfw.dir/platform.c.o.d"
+  "/root/repo/libs/glfw/src/posix_module.c" "libs/glfw/src/CMakeFiles/glfw.dir/posix_module.c.o" "gcc" "libs/glfw/src/CMakeFiles/glfw.dir/posix_module.c.o.d"
+  "/root/repo/libs/glfw/src/posix_thread.c" "libs/glfw/src/CMakeFiles/glfw.dir/posix_thread.c.o" "gcc" "libs/glfw/src/CMakeFiles/glfw.dir/posix_thread.c.o.d"
+  "/root/repo/libs/glfw/src/posix_time.c" "libs/glfw/src/CMakeFiles/glfw.dir/posix_time.c.o" "gcc" "libs/glfw/src/CMakeFiles/glfw.dir/posix_time.c.o.d"
+  "/root/repo/libs/glfw/src/vulkan.c" "libs/glfw/src/CMakeFiles/glfw.dir/vulkan.c.o" "gcc" "libs/glfw/src/CMakeFiles/glfw.dir/vulkan.c.o.d"
+  "/root/repo/libs/glfw/src/window.c" "libs/glfw/src/CMakeFiles/glfw.dir/window.c.o" "gcc" "libs/glfw/src/CMakeFiles/glfw.dir/window.c.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
@@ -3,8 +3,51 @@ in vec2 uv;
 out vec4 fragColor;
 
 uniform sampler2D uTexture;
+uniform sampler2D uVariance;   // pixel statistics, camera samples in w
+uniform sampler2D uAlbedo;     // first-hit AOVs, see raytracer.comp
+uniform sampler2D uNormalDepth;
+uniform usampler2D uId;
+uniform int displayMode;       // 0: the image, 1: camera samples per pixel, 2: albedo, 3: normal, 4: distance, 5: ID
+uniform float maxSamples;      // what a pixel traced every frame has
+uniform vec2 uRenderScale;     // share of the images that was traced, from the bottom left
+
+// A colour per object and primitive, black for the sky.
+vec3 idColor(uvec2 id) {
+    if (id.x == 0u)
+        return vec3(0.0);
+    uint h = id.x * 0x9e3779b9u ^ id.y * 0x85ebca6bu;
+    h = (h ^ (h >> 16)) * 0x7feb352du;
+    h ^= h >> 15;
+    return vec3(uvec3(h, h >> 8, h >> 16) & 0xffu) / 255.0;
+}
 
 void main() {
-    fragColor = texture(uTexture, uv);
+    // scaled up with the linear filter main.cpp binds then, kept half a texel inside what was traced
+    vec2 texel = uv * uRenderScale;
+    if (uRenderScale.x < 1.0 || uRenderScale.y < 1.0)
+        texel = min(texel, uRenderScale - 0.5 / vec2(textureSize(uTexture, 0)));
+    if (displayMode == 1) {
+        // blue for none, through green, to red for every frame
+        float share = clamp(texture(uVariance, texel).w / maxSamples, 0.0, 1.0);
+        fragColor = vec4(clamp(2.0 * share - 1.0, 0.0, 1.0), 1.0 - abs(2.0 * share - 1.0), clamp(1.0 - 2.0 * share, 0.0, 1.0), 1.0);
+        return;
+    }
+    if (displayMode == 3) {
+        vec3 normal = texture(uNormalDepth, texel).xyz;
+        fragColor = vec4(dot(normal, normal) > 0.0 ? normalize(normal) * 0.5 + 0.5 : vec3(0.0), 1.0);
+        return;
+    }
+    if (displayMode == 4) {
+        // nearer is brighter, the sky is black
+        float distance = texture(uNormalDepth, texel).w;
+        fragColor = vec4(vec3(distance > 0.0 ? 1.0 / (1.0 + 0.1 * distance) : 0.0), 1.0);
+        return;
+    }
+    if (displayMode == 5) {
+        fragColor = vec4(idColor(texture(uId, texel).xy), 1.0);
+        return;
+    }
+    // colours are linear, the albedo as much as the image
+    fragColor = displayMode == 2 ? vec4(texture(uAlbedo, texel).rgb, 1.0) : texture(uTexture, texel);
     fragColor.rgb = pow(fragColor.rgb, vec3(1.0/2.2));
 }
\ No newline at end of file
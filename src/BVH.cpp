@@ -2,6 +2,10 @@
 
 #include <cstdio>
 #include <cfloat>
+#include <utility>
+
+#include "JobSystem.h"
+#include "cpu/Kernels.h"
 
 namespace raytracer {
     BVH::BVH(std::vector<vec3>& vertices, const std::vector<unsigned int>& indices): verticies(vertices), indices(indices)  {
@@ -16,35 +20,60 @@ namespace raytracer {
         assert(indices.size() % 3 == 0);
         assert(triangleIndexes.size() == indices.size()/3);
 
-        nodes.reserve(triCount * 2);
-        nodes.emplace_back();
+        // per-triangle bounds and centroids, padded to vec4 so the SIMD kernels can load them directly
+        triangleMins.resize(triCount);
+        triangleMaxs.resize(triCount);
+        triangleCenters.resize(triCount);
+        JobSystem::parallelFor(0, triCount, 4096, [&](size_t t) {
+            vec3 c, tmin, tmax;
+            if (!triCenterMinMax(verticies, indices, static_cast<uint32_t>(t), c, tmin, tmax)) {
+                fprintf(stderr, "bad triId=%zu idx=%zu v=%zu\n", t, indices.size(), verticies.size());
+                c = vec3(0.0f);
+                tmin = vec3(FLT_MAX);
+                tmax = vec3(-FLT_MAX);
+            }
+            triangleMins[t] = vec4(tmin, 0.0f);
+            triangleMaxs[t] = vec4(tmax, 0.0f);
+            triangleCenters[t] = vec4(c, 0.0f);
+        });
+
+        // a leaf never holds less than one triangle, so 2n - 1 nodes is an upper bound
+        nodes.resize(std::max(1u, triCount * 2));
+        nodesUsed = 1;
 
         auto& root = nodes[0];
         root.triIndex_triCount_childIndex = uvec4(0, triCount, -1.0f, 0.f);
         updateNodeBounds(0);
-        split(0, 0);
+
+        TaskGroup group;
+        split(0, 0, group);
+        group.wait();
+
+        nodes.resize(nodesUsed);
+        relayout();
     }
 
     void BVH::updateNodeBounds(uint32_t nodeIndex) {
         const auto first = nodes[nodeIndex].triIndex_triCount_childIndex.x;
         const auto count = nodes[nodeIndex].triIndex_triCount_childIndex.y;
 
-        vec3 min( FLT_MAX), max(-FLT_MAX);
-        for (uint32_t i = 0; i < count; ++i) {
-            const uint32_t triId = triangleIndexes[first + i];
-            vec3 c, tmin, tmax;
-            if (!triCenterMinMax(verticies, indices, triId, c, tmin, tmax)) {
-                fprintf(stderr, "bad triId=%u first=%u count=%u idx=%zu v=%zu\n", triId, first, count, indices.size(), verticies.size());
-                continue;
-            }
-            min = glm::min(min, tmin);
-            max = glm::max(max, tmax);
-        }
-        nodes[nodeIndex].min = vec4(min, 0.0f);
-        nodes[nodeIndex].max = vec4(max, 0.0f);
+        const Kernels& kernels = Kernels::get();
+        using Bounds = std::pair<vec4, vec4>;
+        const auto bounds = JobSystem::parallelReduce(first, first + count, 16384, Bounds(vec4(FLT_MAX), vec4(-FLT_MAX)),
+            [&](size_t begin, size_t end) {
+                Bounds chunk;
+                kernels.triangleBounds(triangleMins.data(), triangleMaxs.data(), triangleIndexes.data() + begin, end - begin,
+                                       chunk.first, chunk.second);
+                return chunk;
+            },
+            [](const Bounds& a, const Bounds& b) {
+                return Bounds(glm::min(a.first, b.first), glm::max(a.second, b.second));
+            });
+        nodes[nodeIndex].min = vec4(vec3(bounds.first), 0.0f);
+        nodes[nodeIndex].max = vec4(vec3(bounds.second), 0.0f);
     }
 
-    void BVH::split(uint32_t nodeIdx, int depth) {
+    void BVH::split(uint32_t nodeIdx, int depth, TaskGroup& group) {
         constexpr int maxDepth = 32;
         if (depth > maxDepth)
             return;
@@ -67,9 +96,7 @@ namespace raytracer {
 
         uint32_t i = first, j = first + count - 1;
         while (i <= j) {
-            vec3 c, min, max;
-            triCenterMinMax(verticies, indices, triangleIndexes[i], c, min, max);
-            if (c[axis] < splitPos)
+            if (triangleCenters[triangleIndexes[i]][axis] < splitPos)
                 ++i;
             else {
                 std::swap(triangleIndexes[i], triangleIndexes[j]);
@@ -91,10 +118,8 @@ namespace raytracer {
         const uint32_t leftFirst  = first;
         const uint32_t rightFirst = first + leftCount;
 
-        const auto leftIndex  = static_cast<uint32_t>(nodes.size());
-        nodes.emplace_back();
-        const auto rightIndex = static_cast<uint32_t>(nodes.size());
-        nodes.emplace_back();
+        const uint32_t leftIndex  = nodesUsed.fetch_add(2);
+        const uint32_t rightIndex = leftIndex + 1;
 
         nodes[nodeIdx].triIndex_triCount_childIndex = uvec4(leftFirst, 0.0f, leftIndex, 0.0f);
         nodes[leftIndex].triIndex_triCount_childIndex = uvec4(leftFirst, leftCount, -1.0f, 0.0f);
@@ -103,7 +128,46 @@ namespace raytracer {
         updateNodeBounds(leftIndex);
         updateNodeBounds(rightIndex);
 
-        split(leftIndex, depth + 1);
-        split(rightIndex, depth + 1);
+        // subtrees own disjoint triangle ranges, so big ones can be built on other workers
+        constexpr uint32_t parallelSplitThreshold = 4096;
+        for (const uint32_t child : { leftIndex, rightIndex }) {
+            if (nodes[child].triIndex_triCount_childIndex.y >= parallelSplitThreshold)
+                group.run([this, child, depth, &group] { split(child, depth + 1, group); });
+            else
+                split(child, depth + 1, group);
+        }
+    }
+
+    // Node indices are handed out in whatever order the workers get to them, so renumber the tree
+    // depth-first to get the same layout on every run and keep subtrees close together in memory.
+    void BVH::relayout() {
+        if (nodes.size() < 3)
+            return;
+
+        std::vector<BVHNode> ordered(nodes.size());
+        ordered[0] = nodes[0];
+        uint32_t used = 1;
+
+        std::vector<std::pair<uint32_t, uint32_t>> stack; // old index, new index
+        stack.emplace_back(0, 0);
+        while (!stack.empty()) {
+            const auto [oldIndex, newIndex] = stack.back();
+            stack.pop_back();
+
+            const BVHNode& node = nodes[oldIndex];
+            if (node.triIndex_triCount_childIndex.y > 0)
+                continue;
+
+            const uint32_t oldLeft = node.triIndex_triCount_childIndex.z;
+            const uint32_t newLeft = used;
+            used += 2;
+            ordered[newIndex].triIndex_triCount_childIndex.z = newLeft;
+            ordered[newLeft] = nodes[oldLeft];
+            ordered[newLeft + 1] = nodes[oldLeft + 1];
+
+            stack.emplace_back(oldLeft + 1, newLeft + 1);
+            stack.emplace_back(oldLeft, newLeft);
+        }
+        nodes.swap(ordered);
     }
 }
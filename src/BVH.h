@@ -1,4 +1,5 @@
 ﻿#pragma once
+#include <atomic>
 #include <vector>
 #include "glm/glm.hpp"
 
@@ -6,6 +7,7 @@ using namespace glm;
 
 namespace raytracer {
     struct BVHNode;
+    class TaskGroup;
 
     class BVH {
     public:
@@ -40,13 +42,17 @@ namespace raytracer {
         }
 
         void updateNodeBounds(uint32_t nodeIndex);
-        void split(uint32_t nodeIdx, int depth = 0);
+        void split(uint32_t nodeIdx, int depth, TaskGroup& group);
+        void relayout();
 
         const std::vector<vec3>& verticies;
         const std::vector<uint32_t>& indices;
         std::vector<uint32_t> triangleIndexes;
+        std::vector<vec4> triangleMins;
+        std::vector<vec4> triangleMaxs;
+        std::vector<vec4> triangleCenters;
         std::vector<BVHNode> nodes;
-        int nodesUsed;
+        std::atomic<uint32_t> nodesUsed;
     };
 
     struct BVHNode {
@@ -0,0 +1,1587 @@
+﻿#include "Benchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <thread>
+#include <tuple>
+
+#include "stb_image.h"
+
+#include "Checkpoint.h"
+#include "DynamicResolution.h"
+#include "FrameBudget.h"
+#include "ImageFile.h"
+#include "ImageWriter.h"
+#include "JobSystem.h"
+#include "Lights.h"
+#include "Scene.h"
+#include "TiledImageWriter.h"
+#include "cpu/CpuDispatch.h"
+#include "cpu/Denoiser.h"
+#include "cpu/Integrator.h"
+#include "misc/Logger.h"
+
+namespace raytracer {
+    template<typename F>
+    static double bestOf(int runs, F&& fn) {
+        double best = 1e30;
+        for (int i = 0; i < runs; ++i) {
+            const auto start = std::chrono::high_resolution_clock::now();
+            fn();
+            best = std::min(best, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count());
+        }
+        return best;
+    }
+
+    // FNV-1a over the raw bytes, to compare images exactly
+    static uint64_t checksum(const void* data, size_t size) {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < size; ++i)
+            hash = (hash ^ static_cast<const uint8_t*>(data)[i]) * 1099511628211ull;
+        return hash;
+    }
+
+    static double rootMeanSquareError(const std::vector<vec4>& image, const std::vector<vec4>& reference) {
+        double sum = 0.0;
+        for (size_t i = 0; i < image.size(); ++i) {
+            const vec3 difference = vec3(image[i]) - vec3(reference[i]);
+            sum += dot(difference, difference);
+        }
+        return std::sqrt(sum / (3.0 * static_cast<double>(image.size())));
+    }
+
+    // RMSE of what the window shows, where everything brighter than white is white; lights would
+    // drown out the rest otherwise.
+    static double displayedError(const std::vector<vec4>& image, const std::vector<vec4>& reference) {
+        double sum = 0.0;
+        for (size_t i = 0; i < image.size(); ++i) {
+            const vec3 difference = clamp(vec3(image[i]), 0.0f, 1.0f) - clamp(vec3(reference[i]), 0.0f, 1.0f);
+            sum += dot(difference, difference);
+        }
+        return std::sqrt(sum / (3.0 * static_cast<double>(image.size())));
+    }
+
+    // The average of frameCount frames. The sample indices start past anything the benchmarks render,
+    // so the reference's noise is uncorrelated with the images compared against it. Each frame is
+    // rendered over black, which it replaces outright since black carries no samples.
+    static std::vector<vec4> renderReference(const Integrator& integrator, const View& view, FrameSettings settings,
+                                             uint32_t frameCount) {
+        constexpr uint32_t frameOffset = 1u << 24;
+        const size_t pixelCount = static_cast<size_t>(view.resolution.x) * view.resolution.y;
+        std::vector<vec4> reference(pixelCount, vec4(0.0f)), frame(pixelCount);
+        for (uint32_t i = 0; i < frameCount; ++i) {
+            settings.frameIndex = frameOffset + i;
+            std::fill(frame.begin(), frame.end(), vec4(0.0f));
+            integrator.render(view, settings, frame.data());
+            const float scale = 1.0f / static_cast<float>(frameCount);
+            for (size_t p = 0; p < pixelCount; ++p)
+                reference[p] += frame[p] * scale;
+        }
+        return reference;
+    }
+
+    static double meanLuminance(const std::vector<vec4>& image) {
+        double sum = 0.0;
+        for (const vec4& pixel : image)
+            sum += (pixel.r + pixel.g + pixel.b) / 3.0;
+        return sum / static_cast<double>(image.size());
+    }
+
+    // The default sky gradient plus a sun 0.5 degrees wide and tens of thousands of times brighter, the
+    // kind of spike real captures have. It sits behind the benchmark camera, so it only shows as light.
+    // A few percent of per-texel noise, like a photographed sky, keeps run-length coding from collapsing it.
+    static vec3 getSyntheticSky(vec3 direction, uint32_t texel) {
+        const vec3 sun = normalize(vec3(0.5f, 0.6f, 0.6f));
+        if (dot(direction, sun) > std::cos(0.0044f))
+            return vec3(50000.0f, 47000.0f, 42000.0f);
+        const float grain = 0.97f + 0.06f * Sampling::toFloat(Sampling::hash(texel));
+        return mix(vec3(1.0f), vec3(0.5f, 0.7f, 1.0f), 0.5f * (direction.y + 1.0f)) * grain;
+    }
+
+    static std::vector<float> renderSyntheticSky(uint32_t width, uint32_t height) {
+        std::vector<float> rgb(3 * static_cast<size_t>(width) * height);
+        JobSystem::parallelFor(0, height, 8, [&](size_t y) {
+            for (uint32_t x = 0; x < width; ++x) {
+                const vec2 uv((static_cast<float>(x) + 0.5f) / static_cast<float>(width),
+                              (static_cast<float>(y) + 0.5f) / static_cast<float>(height));
+                const vec3 radiance = getSyntheticSky(Environment::fromUV(uv), static_cast<uint32_t>(y * width + x));
+                std::memcpy(&rgb[3 * (y * width + x)], &radiance.x, sizeof(radiance));
+            }
+        });
+        return rgb;
+    }
+
+    // Writes texels as a run-length coded Radiance file, the way capture tools do: runs of four or
+    // more equal bytes become runs, the rest literals.
+    static bool writeRadiance(const std::string& path, uint32_t width, uint32_t height, const std::vector<uint32_t>& texels) {
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        if (!file)
+            return false;
+        std::fprintf(file, "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y %u +X %u\n", height, width);
+
+        std::vector<uint8_t> plane(width), line;
+        for (uint32_t y = 0; y < height; ++y) {
+            line.assign({ 2, 2, static_cast<uint8_t>(width >> 8), static_cast<uint8_t>(width & 0xff) });
+            for (int channel = 0; channel < 4; ++channel) {
+                for (uint32_t x = 0; x < width; ++x)
+                    plane[x] = static_cast<uint8_t>(texels[static_cast<size_t>(y) * width + x] >> (8 * channel));
+
+                auto runAt = [&](uint32_t x) {
+                    uint32_t run = 1;
+                    while (x + run < width && run < 127 && plane[x + run] == plane[x])
+                        ++run;
+                    return run;
+                };
+                for (uint32_t x = 0; x < width;) {
+                    const uint32_t run = runAt(x);
+                    if (run >= 4) {
+                        line.push_back(static_cast<uint8_t>(128 + run));
+                        line.push_back(plane[x]);
+                        x += run;
+                        continue;
+                    }
+                    const uint32_t first = x;
+                    while (x < width && x - first < 128 && (x == first || runAt(x) < 4))
+                        ++x;
+                    line.push_back(static_cast<uint8_t>(x - first));
+                    line.insert(line.end(), plane.begin() + first, plane.begin() + x);
+                }
+            }
+            std::fwrite(line.data(), 1, line.size(), file);
+        }
+        return std::fclose(file) == 0;
+    }
+
+    // The benchmark camera: a few units in front of the default scene, looking down -z.
+    static View getBenchmarkView(uvec2 resolution) {
+        const vec3 forward(0.0f, 0.0f, -1.0f), up(0.0f, 1.0f, 0.0f), right = cross(forward, up);
+        return { vec3(0.0f, 1.0f, 8.0f), mat3(right, cross(right, forward), forward),
+                 200.0f * static_cast<float>(resolution.y) / 240.0f, resolution };
+    }
+
+    // The enclosed room lit only by confetti: randomly oriented triangles in a layer under the whole
+    // ceiling, with the same total area and so the same total power at every count. Lights not built yet.
+    static Scene createConfettiScene(uint32_t lightCount, std::mt19937& rng) {
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::vector<vec3> vertices, normals;
+        std::vector<uint32_t> indices;
+        const float side = std::sqrt(8.0f / (std::sqrt(3.0f) * static_cast<float>(lightCount)));
+        for (uint32_t i = 0; i < lightCount; ++i) {
+            const vec3 center(-5.5f + 11.0f * unit(rng), 4.0f + 0.8f * unit(rng), -9.5f + 19.0f * unit(rng));
+            const float z = 1.0f - 2.0f * unit(rng), a = 6.28318530718f * unit(rng), r = std::sqrt(1.0f - z * z);
+            const vec3 normal(r * std::cos(a), r * std::sin(a), z);
+            const vec3 tangent = normalize(cross(normal, std::abs(normal.x) > 0.5f ? vec3(0, 1, 0) : vec3(1, 0, 0)));
+            const vec3 bitangent = cross(normal, tangent);
+            for (int corner = 0; corner < 3; ++corner) {
+                const float angle = 2.0943951f * static_cast<float>(corner);
+                vertices.push_back(center + side * 0.57735f * (tangent * std::cos(angle) + bitangent * std::sin(angle)));
+                normals.push_back(normal);
+                indices.push_back(static_cast<uint32_t>(vertices.size()) - 1);
+            }
+        }
+
+        Scene scene = Scene::createEnclosed();
+        scene.spheres[1].emissiveColor_strength = vec4(0.0f);
+        const Material confetti { vec3(0.75f), 0, vec3(1.0f, 0.9f, 0.8f), 4.0f };
+        scene.addModel(Model(std::move(vertices), std::move(normals), std::move(indices),
+                             Transform { vec3(0), vec3(0), vec3(1) }, confetti));
+        return scene;
+    }
+
+    // Looking down at the floor of the confetti room, so the noise is all in the light sampling and none
+    // in hitting confetti.
+    static View getFloorView(uvec2 resolution) {
+        const vec3 forward = normalize(vec3(0.0f, -1.0f, -0.4f)), right(1.0f, 0.0f, 0.0f);
+        return { vec3(0.0f, 3.0f, 4.0f), mat3(right, cross(right, forward), forward),
+                 200.0f * static_cast<float>(resolution.y) / 240.0f, resolution };
+    }
+
+    // The default objects in the enclosed room, lit through a window 2 by 1.5 units high up in one wall
+    // by the sky and by the emissive sphere, moved outside and made a small sun. The mirror ball is made
+    // diffuse, so its caustics don't drown out what guiding changes. Next-event estimation
+    // only reaches the patch the sun shines on; everything else is lit from there, and paths have to
+    // find the patch or the window by bouncing.
+    static Scene createWindowScene() {
+        const vec3 halfExtent(6.0f, 3.0f, 10.0f);
+        std::vector<vec3> vertices, normals;
+        std::vector<uint32_t> indices;
+        auto addWall = [&](int axis, float side, vec2 min, vec2 max) {
+            vec3 normal(0.0f);
+            normal[axis] = -side;
+            const int u = (axis + 1) % 3, v = (axis + 2) % 3;
+            const auto first = static_cast<uint32_t>(vertices.size());
+            for (int corner = 0; corner < 4; ++corner) {
+                vec3 position(0.0f);
+                position[axis] = side * halfExtent[axis];
+                position[u] = corner & 1 ? max.x : min.x;
+                position[v] = corner & 2 ? max.y : min.y;
+                vertices.push_back(position);
+                normals.push_back(normal);
+            }
+            indices.insert(indices.end(), { first, first + 1, first + 3, first, first + 3, first + 2 });
+        };
+        for (int axis = 0; axis < 3; ++axis) {
+            const int u = (axis + 1) % 3, v = (axis + 2) % 3;
+            addWall(axis, -1.0f, -vec2(halfExtent[u], halfExtent[v]), vec2(halfExtent[u], halfExtent[v]));
+            if (axis != 0)
+                addWall(axis, 1.0f, -vec2(halfExtent[u], halfExtent[v]), vec2(halfExtent[u], halfExtent[v]));
+        }
+        // the +x wall around the window, in (y, z)
+        addWall(0, 1.0f, vec2(-3.0f, -10.0f), vec2(0.5f, 10.0f));
+        addWall(0, 1.0f, vec2(2.0f, -10.0f), vec2(3.0f, 10.0f));
+        addWall(0, 1.0f, vec2(0.5f, -10.0f), vec2(2.0f, -1.0f));
+        addWall(0, 1.0f, vec2(0.5f, 1.0f), vec2(2.0f, 10.0f));
+
+        Scene scene = Scene::createDefault();
+        scene.spheres.pop_back();
+        scene.spheres[0].color_smoothness.w = 0.0f;
+        scene.spheres[1].pos_radius = vec4(9.0f, 3.25f, 0.0f, 0.75f);
+        scene.spheres[1].emissiveColor_strength = vec4(1.0f, 0.9f, 0.8f, 60.0f);
+        const Material walls { vec3(0.75f), 0 };
+        scene.addModel(Model(std::move(vertices), std::move(normals), std::move(indices),
+                             Transform { vec3(0, 2, 0), vec3(0), vec3(1) }, walls));
+        scene.buildLights();
+        return scene;
+    }
+
+    int Benchmark::run(const std::string& suite) {
+        const bool all = suite == "all";
+        bool found = false;
+        bool passed = true;
+
+        if (all || suite == "jobs") {
+            jobSpawnOverhead();
+            jobScaling();
+            found = true;
+        }
+        if (all || suite == "kernels") {
+            cpuKernels();
+            found = true;
+        }
+        if (all || suite == "integrator") {
+            integratorSpecialization();
+            found = true;
+        }
+        if (all || suite == "determinism") {
+            passed = renderDeterminism() && passed;
+            found = true;
+        }
+        if (all || suite == "samplers") {
+            samplerConvergence();
+            found = true;
+        }
+        if (all || suite == "roulette") {
+            russianRoulette();
+            found = true;
+        }
+        if (all || suite == "nee") {
+            nextEventEstimation();
+            found = true;
+        }
+        if (all || suite == "lighttree") {
+            lightTreeScaling();
+            found = true;
+        }
+        if (all || suite == "restir") {
+            reservoirResampling();
+            found = true;
+        }
+        if (all || suite == "cache") {
+            radianceCaching();
+            found = true;
+        }
+        if (all || suite == "guiding") {
+            pathGuiding();
+            found = true;
+        }
+        if (all || suite == "adaptive") {
+            adaptiveSampling();
+            found = true;
+        }
+        if (all || suite == "reprojection") {
+            temporalReprojection();
+            found = true;
+        }
+        if (all || suite == "dynamic") {
+            dynamicResolution();
+            found = true;
+        }
+        if (all || suite == "budget") {
+            passed = frameBudget() && passed;
+            found = true;
+        }
+        if (all || suite == "aovs") {
+            passed = firstHitAovs() && passed;
+            found = true;
+        }
+        if (all || suite == "denoise") {
+            denoising();
+            found = true;
+        }
+        if (all || suite == "environment") {
+            environmentLoading();
+            found = true;
+        }
+        if (all || suite == "resume") {
+            passed = checkpointResume() && passed;
+            found = true;
+        }
+        if (all || suite == "tiles") {
+            passed = tiledRendering() && passed;
+            found = true;
+        }
+        if (all || suite == "images") {
+            passed = imageWriting() && passed;
+            found = true;
+        }
+
+        if (!found) {
+            ERR("Unknown benchmark suite '%s'.", suite.c_str());
+            return 1;
+        }
+        return passed ? 0 : 1;
+    }
+
+    void Benchmark::jobSpawnOverhead() {
+        constexpr int taskCount = 200000;
+        std::atomic<int> counter{0};
+
+        printf("== job system: spawn overhead (%u workers) ==\n", JobSystem::getWorkerCount());
+
+        const double flat = bestOf(5, [&] {
+            TaskGroup group;
+            for (int i = 0; i < taskCount; ++i)
+                group.run([&counter] { counter.fetch_add(1, std::memory_order_relaxed); });
+            group.wait();
+        });
+        printf("flat spawn+wait      %8.1f ns/task\n", flat * 1e9 / taskCount);
+
+        // every task spawns its two children, like a recursive divide and conquer would
+        constexpr int depth = 17;
+        const double nested = bestOf(5, [&] {
+            TaskGroup group;
+            std::function<void(int)> spawn = [&](int level) {
+                counter.fetch_add(1, std::memory_order_relaxed);
+                if (level == 0)
+                    return;
+                group.run([&spawn, level] { spawn(level - 1); });
+                group.run([&spawn, level] { spawn(level - 1); });
+            };
+            group.run([&spawn] { spawn(depth); });
+            group.wait();
+        });
+        printf("nested spawn+wait    %8.1f ns/task\n", nested * 1e9 / ((2 << depth) - 1));
+
+        const double forLoop = bestOf(5, [&] {
+            JobSystem::parallelFor(0, taskCount, 1, [&counter](size_t) {
+                counter.fetch_add(1, std::memory_order_relaxed);
+            });
+        });
+        printf("parallelFor grain=1  %8.1f ns/item\n", forLoop * 1e9 / taskCount);
+
+        const double continuation = bestOf(5, [&] {
+            for (int i = 0; i < taskCount / 100; ++i) {
+                TaskGroup group;
+                group.run([&counter] { counter.fetch_add(1, std::memory_order_relaxed); });
+                group.then([&counter] { counter.fetch_add(1, std::memory_order_relaxed); });
+                group.wait();
+            }
+        });
+        printf("run+then+wait        %8.1f ns/group\n", continuation * 1e9 / (taskCount / 100));
+    }
+
+    void Benchmark::jobScaling() {
+        const unsigned previousWorkers = JobSystem::getWorkerCount();
+        const unsigned hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+
+        constexpr size_t itemCount = 1 << 15;
+        auto work = [](size_t begin, size_t end) {
+            double sum = 0.0;
+            for (size_t i = begin; i < end; ++i) {
+                double x = static_cast<double>(i);
+                for (int k = 0; k < 256; ++k)
+                    x = std::sqrt(x * 1.0001 + k);
+                sum += x;
+            }
+            return sum;
+        };
+
+        printf("== job system: parallelReduce scaling (%u hardware threads) ==\n", hardwareThreads);
+        printf("workers      time   speedup  efficiency\n");
+
+        double baseline = 0.0;
+        for (unsigned workers = 1; workers <= 64; workers *= 2) {
+            if (workers > hardwareThreads) {
+                printf("%7u   skipped, only %u hardware threads\n", workers, hardwareThreads);
+                continue;
+            }
+
+            JobSystem::init(workers);
+            double result = 0.0;
+            const double time = bestOf(3, [&] {
+                result = JobSystem::parallelReduce(0, itemCount, 64, 0.0, work, std::plus<double>());
+            });
+            if (workers == 1)
+                baseline = time;
+            printf("%7u %8.2fms %8.2fx %10.0f%%   (checksum %.6e)\n", workers, time * 1e3, baseline / time,
+                   100.0 * baseline / time / workers, result);
+        }
+
+        JobSystem::init(previousWorkers);
+    }
+
+    void Benchmark::cpuKernels() {
+        std::mt19937 rng(1234);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        auto randomVec = [&] { return vec3(unit(rng), unit(rng), unit(rng)); };
+
+        constexpr size_t triCount = 1 << 20;
+        std::vector<vec4> triMins(triCount), triMaxs(triCount);
+        std::vector<uint32_t> ids(triCount);
+        std::vector<Triangle> triangles(triCount);
+        for (size_t i = 0; i < triCount; ++i) {
+            const vec3 a = randomVec() * 10.0f, b = a + randomVec() * 0.5f, c = a + randomVec() * 0.5f;
+            triangles[i] = { vec4(a, 0), vec4(b, 0), vec4(c, 0), vec4(0), vec4(0), vec4(0) };
+            triMins[i] = vec4(glm::min(a, glm::min(b, c)), 0);
+            triMaxs[i] = vec4(glm::max(a, glm::max(b, c)), 0);
+            ids[i] = static_cast<uint32_t>(i);
+        }
+        std::shuffle(ids.begin(), ids.end(), rng);
+
+        constexpr size_t rayCount = 1 << 16;
+        std::vector<KernelRay> rays(rayCount);
+        for (auto& ray : rays)
+            ray = KernelRay::make(randomVec() * 12.0f, normalize(randomVec()));
+
+        std::vector<BVHNode> boxes(2 * 1024);
+        for (size_t i = 0; i < boxes.size(); ++i) {
+            const vec3 center = randomVec() * 10.0f;
+            boxes[i] = { vec4(center - 1.0f, 0), vec4(center + 1.0f, 0), uvec4(0) };
+        }
+
+        constexpr size_t pixelCount = 3840 * 2160;
+        std::vector<float> image(4 * pixelCount);
+        for (auto& value : image)
+            value = 0.6f + 0.6f * unit(rng);
+        std::vector<uint8_t> converted(4 * pixelCount), reference(4 * pixelCount);
+        getScalarKernels().convertToRgba8(image.data(), reference.data(), pixelCount);
+
+        printf("== cpu kernels (active: %s) ==\n", CpuDispatch::getName(CpuDispatch::getActiveIsa()));
+        printf("isa        bounds Mtri/s   box pairs M/s   triangles Mtri/s   rgba8 Mpix/s   matches scalar\n");
+
+        for (int i = 0; i < static_cast<int>(Isa::Count); ++i) {
+            const auto isa = static_cast<Isa>(i);
+            if (!CpuDispatch::isSupported(isa)) {
+                printf("%-8s   not supported by this CPU\n", CpuDispatch::getName(isa));
+                continue;
+            }
+            const Kernels& kernels = CpuDispatch::getKernels(isa);
+            bool matches = true;
+
+            vec4 min, max;
+            const double bounds = bestOf(5, [&] {
+                kernels.triangleBounds(triMins.data(), triMaxs.data(), ids.data(), triCount, min, max);
+            });
+
+            float entrySum = 0.0f;
+            const double boxPairs = bestOf(5, [&] {
+                for (size_t r = 0; r < rayCount; ++r) {
+                    float entry[2];
+                    const size_t pair = (r * 2) % boxes.size();
+                    kernels.intersectBoxPair(rays[r], &boxes[pair], 1e30f, entry);
+                    entrySum += std::isinf(entry[0]) ? 0.0f : entry[0];
+                }
+            });
+
+            // leaf-sized batches, like a BVH traversal would see them
+            constexpr uint32_t batch = 16;
+            std::vector<TriangleHit> hits(rayCount);
+            const double tris = bestOf(3, [&] {
+                for (size_t r = 0; r < rayCount; ++r) {
+                    TriangleHit hit = { INFINITY, 0, 0, 0 };
+                    for (uint32_t b = 0; b < 256; b += batch) {
+                        if (kernels.intersectTriangles(rays[r], &triangles[(r * 256 + b) % triCount], batch, 1e-4f, hit))
+                            hit.index += b;
+                    }
+                    hits[r] = hit;
+                }
+            });
+            if (isa != Isa::Scalar) {
+                const Kernels& scalar = getScalarKernels();
+                for (size_t r = 0; r < rayCount && matches; r += 97) {
+                    TriangleHit a = { INFINITY, 0, 0, 0 }, b = a;
+                    kernels.intersectTriangles(rays[r], &triangles[(r * 256) % triCount], 256, 1e-4f, a);
+                    scalar.intersectTriangles(rays[r], &triangles[(r * 256) % triCount], 256, 1e-4f, b);
+                    matches = !memcmp(&a, &b, sizeof(a));
+                }
+            }
+
+            const double convert = bestOf(3, [&] {
+                kernels.convertToRgba8(image.data(), converted.data(), pixelCount);
+            });
+            matches = matches && converted == reference;
+
+            printf("%-8s %16.1f %15.1f %18.1f %14.1f   %s\n", CpuDispatch::getName(isa),
+                   triCount / bounds * 1e-6, rayCount / boxPairs * 1e-6, rayCount * 256.0 / tris * 1e-6,
+                   pixelCount / convert * 1e-6, matches ? "yes" : "NO");
+        }
+    }
+
+    void Benchmark::integratorSpecialization() {
+        const Scene defaultScene = Scene::createDefault();
+
+        // the default scene uses every feature, so strip some to get scenes that profit from specializing
+        Scene diffuseSpheres = defaultScene;
+        diffuseSpheres.meshes.clear();
+        for (Sphere& sphere : diffuseSpheres.spheres) {
+            sphere.color_smoothness.w = 0.0f;
+            sphere.emissiveColor_strength = vec4(0.0f);
+        }
+        diffuseSpheres.buildLights();
+        Scene meshOnly = defaultScene;
+        meshOnly.spheres.clear();
+        meshOnly.buildLights();
+        Scene noEmission = defaultScene;
+        for (Sphere& sphere : noEmission.spheres)
+            sphere.emissiveColor_strength = vec4(0.0f);
+        noEmission.buildLights();
+
+        const std::pair<const char*, const Scene*> scenes[] = {
+            { "default", &defaultScene },
+            { "diffuse spheres", &diffuseSpheres },
+            { "mesh only", &meshOnly },
+            { "no emission", &noEmission },
+        };
+
+        const View view = getBenchmarkView(uvec2(320, 240));
+        const size_t pixelCount = static_cast<size_t>(view.resolution.x) * view.resolution.y;
+        constexpr uint32_t frameCount = 8;
+
+        printf("== cpu integrator: specialized vs generic (%ux%u, %u frames, %u workers) ==\n", view.resolution.x,
+               view.resolution.y, frameCount, JobSystem::getWorkerCount());
+        printf("scene              features   generic ms/frame   specialized ms/frame   speedup   mean generic/specialized\n");
+
+        for (const auto& [name, scene] : scenes) {
+            double luminance[2] = {};
+            double frameTime[2] = {};
+            for (int specialize = 0; specialize < 2; ++specialize) {
+                const Integrator integrator(*scene, specialize != 0);
+                std::vector<vec4> accumulation(pixelCount);
+                frameTime[specialize] = bestOf(5, [&] {
+                    std::fill(accumulation.begin(), accumulation.end(), vec4(0.0f));
+                    for (uint32_t frame = 0; frame < frameCount; ++frame)
+                        integrator.render(view, { frame, 1, 48 }, accumulation.data());
+                }) / frameCount;
+
+                luminance[specialize] = meanLuminance(accumulation);
+            }
+
+            printf("%-18s 0x%-7x %17.2f %22.2f %8.2fx   %.4f / %.4f\n", name, scene->getFeatures(), frameTime[0] * 1e3,
+                   frameTime[1] * 1e3, frameTime[0] / frameTime[1], luminance[0], luminance[1]);
+        }
+    }
+
+    bool Benchmark::renderDeterminism() {
+        const unsigned previousWorkers = JobSystem::getWorkerCount();
+        const Isa previousIsa = CpuDispatch::getActiveIsa();
+        const Scene scene = Scene::createDefault();
+        const Integrator integrator(scene);
+
+        const View view = getBenchmarkView(uvec2(160, 120));
+        std::vector<vec4> accumulation(static_cast<size_t>(view.resolution.x) * view.resolution.y);
+
+        printf("== cpu render determinism (%ux%u, 4 frames) ==\n", view.resolution.x, view.resolution.y);
+        printf("workers  isa         checksum\n");
+
+        // oversubscribing is fine here, the point is a different split of the rows
+        uint64_t reference = 0;
+        bool identical = true;
+        for (const unsigned workers : { 1u, 2u, 3u, 8u }) {
+            JobSystem::init(workers);
+            for (int i = 0; i < static_cast<int>(Isa::Count); ++i) {
+                const auto isa = static_cast<Isa>(i);
+                if (!CpuDispatch::isSupported(isa))
+                    continue;
+                CpuDispatch::init(isa);
+
+                std::fill(accumulation.begin(), accumulation.end(), vec4(0.0f));
+                for (uint32_t frame = 0; frame < 4; ++frame)
+                    integrator.render(view, { frame, 2, 48 }, accumulation.data());
+
+                const uint64_t hash = checksum(accumulation.data(), accumulation.size() * sizeof(vec4));
+                if (workers == 1 && isa == Isa::Scalar)
+                    reference = hash;
+                identical = identical && hash == reference;
+                printf("%7u  %-8s  %016llx%s\n", workers, CpuDispatch::getName(isa), static_cast<unsigned long long>(hash),
+                       hash == reference ? "" : "  MISMATCH");
+            }
+        }
+        printf("accumulation buffers %s\n", identical ? "bit-identical" : "DIFFER");
+
+        JobSystem::init(previousWorkers);
+        CpuDispatch::init(previousIsa);
+        return identical;
+    }
+
+    void Benchmark::samplerConvergence() {
+        const Scene scene = Scene::createDefault();
+        const Integrator integrator(scene);
+        const View view = getBenchmarkView(uvec2(128, 96));
+        const size_t pixelCount = static_cast<size_t>(view.resolution.x) * view.resolution.y;
+
+        constexpr uint32_t referenceFrames = 1024, referenceSamples = 2;
+        const std::vector<vec4> reference = renderReference(integrator, view,
+            { 0, referenceSamples, 48, SamplerType::Independent }, referenceFrames);
+
+        constexpr uint32_t maxSamples = 256;
+        constexpr int samplerCount = static_cast<int>(SamplerType::Count);
+        std::vector<double> errors[samplerCount];
+        for (int s = 0; s < samplerCount; ++s) {
+            std::vector<vec4> accumulation(pixelCount, vec4(0.0f));
+            for (uint32_t i = 0; i < maxSamples; ++i) {
+                integrator.render(view, { i, 1, 48, static_cast<SamplerType>(s) }, accumulation.data());
+                errors[s].push_back(rootMeanSquareError(accumulation, reference));
+            }
+        }
+
+        printf("== sampler convergence (%ux%u, RMSE against %u spp) ==\n", view.resolution.x, view.resolution.y,
+               referenceFrames * referenceSamples);
+        printf("spp ");
+        for (int s = 0; s < samplerCount; ++s)
+            printf(" %12s", Sampling::getName(static_cast<SamplerType>(s)));
+        printf("\n");
+        for (uint32_t spp = 1; spp <= maxSamples; spp *= 2) {
+            printf("%3u ", spp);
+            for (int s = 0; s < samplerCount; ++s)
+                printf(" %12.5f", errors[s][spp - 1]);
+            printf("\n");
+        }
+
+        for (const uint32_t targetSpp : { 16u, 64u, 256u }) {
+            const double target = errors[static_cast<int>(SamplerType::Independent)][targetSpp - 1];
+            printf("spp to RMSE %.5f (independent @ %u):", target, targetSpp);
+            for (int s = 0; s < samplerCount; ++s) {
+                const auto reached = std::find_if(errors[s].begin(), errors[s].end(), [&](double e) { return e <= target; });
+                printf(" %s=%zu", Sampling::getName(static_cast<SamplerType>(s)),
+                       static_cast<size_t>(reached - errors[s].begin()) + 1);
+            }
+            printf("\n");
+        }
+    }
+
+    void Benchmark::russianRoulette() {
+        const std::pair<const char*, Scene> scenes[] = {
+            { "default", Scene::createDefault() },
+            { "enclosed", Scene::createEnclosed() },
+        };
+        const View view = getBenchmarkView(uvec2(64, 48));
+        constexpr uint32_t frameCount = 16, referenceFrames = 256;
+        constexpr int maxBounces = 48;
+
+        printf("== russian roulette (%ux%u, %u spp, RMSE against %u spp, %u workers) ==\n", view.resolution.x,
+               view.resolution.y, frameCount, referenceFrames * 2, JobSystem::getWorkerCount());
+        printf("scene      roulette   path length   ms/frame   mean luminance     RMSE   relative efficiency\n");
+
+        for (const auto& [name, scene] : scenes) {
+            const Integrator integrator(scene);
+            const std::vector<vec4> reference = renderReference(integrator, view, { 0, 2, maxBounces }, referenceFrames);
+            printf("%-10s reference %41.4f\n", name, meanLuminance(reference));
+
+            // efficiency is 1 / (error^2 * time), relative to rendering without roulette
+            double baseline = 0.0;
+            for (const int rouletteDepth : { maxBounces + 1, 5, 3, 1 }) {
+                const FrameSettings settings = { 0, 1, maxBounces, SamplerType::Sobol, rouletteDepth };
+                std::vector<vec4> accumulation(reference.size());
+                RenderStats stats;
+                const double time = bestOf(3, [&] {
+                    stats = {};
+                    std::fill(accumulation.begin(), accumulation.end(), vec4(0.0f));
+                    for (uint32_t frame = 0; frame < frameCount; ++frame) {
+                        FrameSettings frameSettings = settings;
+                        frameSettings.frameIndex = frame;
+                        const RenderStats frameStats = integrator.render(view, frameSettings, accumulation.data());
+                        stats.paths += frameStats.paths;
+                        stats.segments += frameStats.segments;
+                    }
+                }) / frameCount;
+
+                const double error = rootMeanSquareError(accumulation, reference);
+                const double efficiency = 1.0 / (error * error * time);
+                if (rouletteDepth > maxBounces)
+                    baseline = efficiency;
+
+                char depth[32];
+                if (rouletteDepth > maxBounces)
+                    snprintf(depth, sizeof(depth), "off");
+                else
+                    snprintf(depth, sizeof(depth), "depth %d", rouletteDepth);
+                printf("%-10s %-8s %13.2f %10.2f %16.4f %8.5f %20.2fx\n", name, depth, stats.getAveragePathLength(),
+                       time * 1e3, meanLuminance(accumulation), error, efficiency / baseline);
+            }
+        }
+    }
+
+    void Benchmark::nextEventEstimation() {
+        // the enclosed room lit by suzanne instead of the sphere, so triangle lights get sampled too
+        Scene meshLight = Scene::createEnclosed();
+        meshLight.spheres[1].emissiveColor_strength = vec4(0.0f);
+        meshLight.meshes[0].emissiveColor_strength = vec4(1.0f, 0.8f, 0.6f, 2.0f);
+        meshLight.buildLights();
+
+        // the default scene under a sky with a sun, sampled along with the sphere light
+        Scene environment = Scene::createDefault();
+        const std::vector<float> sky = renderSyntheticSky(2048, 1024);
+        environment.environment.setPixels(2048, 1024, sky.data());
+
+        const std::pair<const char*, Scene> scenes[] = {
+            { "default", Scene::createDefault() },
+            { "enclosed", Scene::createEnclosed() },
+            { "mesh light", std::move(meshLight) },
+            { "environment", std::move(environment) },
+        };
+        const View view = getBenchmarkView(uvec2(64, 48));
+        constexpr uint32_t frameCount = 64, referenceFrames = 256;
+
+        printf("== next-event estimation (%ux%u, RMSE against %u spp, %u workers) ==\n", view.resolution.x,
+               view.resolution.y, referenceFrames * 2, JobSystem::getWorkerCount());
+        printf("scene        lights  nee   ms/frame   mean luminance   RMSE @16   RMSE @64   spp to match off @64\n");
+
+        for (const auto& [name, scene] : scenes) {
+            const Integrator integrator(scene);
+            const std::vector<vec4> reference = renderReference(integrator, view, { 0, 2, 48 }, referenceFrames);
+            const auto lightCount = std::count_if(scene.lights.lights.begin(), scene.lights.lights.end(),
+                                                  [](const Light& light) { return LightSet::getWeight(light) > 0.0f; });
+
+            std::vector<double> errors[2];
+            for (int nee = 0; nee < 2; ++nee) {
+                FrameSettings settings;
+                settings.samplesPerPixel = 1;
+                settings.nextEventEstimation = nee != 0;
+
+                std::vector<vec4> accumulation(reference.size(), vec4(0.0f));
+                const auto start = std::chrono::high_resolution_clock::now();
+                for (uint32_t frame = 0; frame < frameCount; ++frame) {
+                    settings.frameIndex = frame;
+                    integrator.render(view, settings, accumulation.data());
+                    errors[nee].push_back(rootMeanSquareError(accumulation, reference));
+                }
+                const double time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+                printf("%-12s %6zu  %-4s %9.2f %16.4f %10.5f %10.5f", name, static_cast<size_t>(lightCount), nee ? "on" : "off",
+                       time * 1e3 / frameCount, meanLuminance(accumulation), errors[nee][15], errors[nee][frameCount - 1]);
+                if (nee) {
+                    const double target = errors[0][frameCount - 1];
+                    const auto reached = std::find_if(errors[1].begin(), errors[1].end(), [&](double e) { return e <= target; });
+                    if (reached != errors[1].end())
+                        printf(" %22zu", static_cast<size_t>(reached - errors[1].begin()) + 1);
+                    else
+                        printf(" %22s", "> 64");
+                }
+                printf("\n");
+            }
+        }
+    }
+
+    void Benchmark::lightTreeScaling() {
+        std::mt19937 rng(4321);
+
+        printf("== light tree: many emissive triangles (64x48, 16 spp, independent sampler, %u workers) ==\n",
+               JobSystem::getWorkerCount());
+        printf("triangles   build ms   selection   ms/frame   mean luminance      noise\n");
+
+        const View view = getFloorView(uvec2(64, 48));
+        const size_t pixelCount = static_cast<size_t>(view.resolution.x) * view.resolution.y;
+        constexpr uint32_t frameCount = 16;
+
+        for (const uint32_t lightCount : { 1000u, 10000u, 100000u }) {
+            Scene scene = createConfettiScene(lightCount, rng);
+            const double buildTime = bestOf(1, [&] { scene.buildLights(); });
+            const Integrator integrator(scene);
+
+            for (const bool lightTree : { false, true }) {
+                FrameSettings settings;
+                settings.samplesPerPixel = 1;
+                settings.maxBounces = 1;
+                settings.sampler = SamplerType::Independent;
+                settings.lightTree = lightTree;
+
+                std::vector<vec4> accumulation(pixelCount, vec4(0.0f));
+                const double time = bestOf(1, [&] {
+                    for (uint32_t frame = 0; frame < frameCount; ++frame) {
+                        settings.frameIndex = frame;
+                        integrator.render(view, settings, accumulation.data());
+                    }
+                }) / frameCount;
+                // a second render from unrelated sample indices: the RMS of the difference over sqrt(2) is
+                // the noise of either, without needing a converged reference
+                const std::vector<vec4> other = renderReference(integrator, view, settings, frameCount);
+
+                printf("%9u %10.1f   %-9s %10.2f %16.4f %10.5f\n", lightCount, buildTime * 1e3, lightTree ? "tree" : "weight",
+                       time * 1e3, meanLuminance(accumulation), rootMeanSquareError(accumulation, other) / std::sqrt(2.0));
+            }
+        }
+    }
+
+    void Benchmark::reservoirResampling() {
+        Scene meshLight = Scene::createEnclosed();
+        meshLight.spheres[1].emissiveColor_strength = vec4(0.0f);
+        meshLight.meshes[0].emissiveColor_strength = vec4(1.0f, 0.8f, 0.6f, 2.0f);
+        meshLight.buildLights();
+        std::mt19937 rng(4321);
+        Scene confetti = createConfettiScene(10000, rng);
+        confetti.buildLights();
+
+        const uvec2 resolution(128, 96);
+        const std::tuple<const char*, Scene, View> scenes[] = {
+            { "mesh light", std::move(meshLight), getBenchmarkView(resolution) },
+            { "confetti", std::move(confetti), getFloorView(resolution) },
+        };
+        constexpr uint32_t frameCount = 32, referenceFrames = 256;
+
+        printf("== reservoir resampling: direct light only (%ux%u, 1 spp, RMSE against %u spp, %u workers) ==\n",
+               resolution.x, resolution.y, referenceFrames, JobSystem::getWorkerCount());
+        printf("scene        lights  mode      ms/frame  mean luminance (ref)   RMSE @1  RMSE @%u   RMSE at equal time\n", frameCount);
+
+        for (const auto& [name, scene, view] : scenes) {
+            const Integrator integrator(scene);
+            FrameSettings settings;
+            settings.samplesPerPixel = 1;
+            settings.maxBounces = 1;
+            const std::vector<vec4> reference = renderReference(integrator, view, settings, referenceFrames);
+            const auto lightCount = std::count_if(scene.lights.lights.begin(), scene.lights.lights.end(),
+                                                  [](const Light& light) { return LightSet::getWeight(light) > 0.0f; });
+
+            // seconds since the first frame and error, after every frame
+            std::vector<std::pair<double, double>> progress[2];
+            for (int restir = 0; restir < 2; ++restir) {
+                settings.restir = restir != 0;
+                ReservoirBuffers reservoirs;
+                std::vector<vec4> accumulation(reference.size(), vec4(0.0f));
+                double time = 0.0;
+                for (uint32_t frame = 0; frame < frameCount; ++frame) {
+                    settings.frameIndex = frame;
+                    time += bestOf(1, [&] { integrator.render(view, settings, accumulation.data(), { .reservoirs = &reservoirs }); });
+                    progress[restir].emplace_back(time, rootMeanSquareError(accumulation, reference));
+                }
+
+                // ReSTIR against every NEE frame it got as far as in the same time
+                printf("%-12s %6zu  %-7s %10.2f %10.4f (%.4f) %9.5f %9.5f", name, static_cast<size_t>(lightCount),
+                       restir ? "restir" : "nee", time * 1e3 / frameCount, meanLuminance(accumulation),
+                       meanLuminance(reference), progress[restir].front().second, progress[restir].back().second);
+                if (restir) {
+                    const double budget = progress[0].back().first;
+                    auto last = progress[1].begin();
+                    while (last + 1 != progress[1].end() && (last + 1)->first <= budget)
+                        ++last;
+                    printf("   %.5f after %zu frames", last->second, static_cast<size_t>(last - progress[1].begin()) + 1);
+                }
+                printf("\n");
+            }
+        }
+    }
+
+    void Benchmark::radianceCaching() {
+        const std::pair<const char*, Scene> scenes[] = {
+            { "default", Scene::createDefault() },
+            { "enclosed", Scene::createEnclosed() },
+        };
+        const View view = getBenchmarkView(uvec2(64, 48));
+        constexpr uint32_t frameCount = 32, referenceFrames = 256;
+
+        printf("== radiance cache (%ux%u, %u spp, RMSE against %u spp of full paths, %u workers) ==\n", view.resolution.x,
+               view.resolution.y, frameCount, referenceFrames * 2, JobSystem::getWorkerCount());
+        printf("scene      cache     path length   ms/frame   mean luminance     bias     RMSE    cells\n");
+
+        for (const auto& [name, scene] : scenes) {
+            const Integrator integrator(scene);
+            const std::vector<vec4> reference = renderReference(integrator, view, { 0, 2 }, referenceFrames);
+            const double referenceLuminance = meanLuminance(reference);
+            printf("%-10s reference %41.4f\n", name, referenceLuminance);
+
+            // a fresh cache for every depth, so the first frames pay for filling it
+            for (const int depth : { -1, 1, 2, 3 }) {
+                FrameSettings settings;
+                settings.samplesPerPixel = 1;
+                settings.radianceCache = depth >= 0;
+                settings.radianceCacheDepth = depth;
+                RadianceCache cache;
+                std::vector<vec4> accumulation(reference.size(), vec4(0.0f));
+                RenderStats stats;
+                const double time = bestOf(1, [&] {
+                    for (uint32_t frame = 0; frame < frameCount; ++frame) {
+                        settings.frameIndex = frame;
+                        const RenderStats frameStats = integrator.render(view, settings, accumulation.data(), { .cache = &cache });
+                        stats.paths += frameStats.paths;
+                        stats.segments += frameStats.segments;
+                    }
+                }) / frameCount;
+
+                char mode[32];
+                if (depth < 0)
+                    snprintf(mode, sizeof(mode), "off");
+                else
+                    snprintf(mode, sizeof(mode), "depth %d", depth);
+                const double luminance = meanLuminance(accumulation);
+                printf("%-10s %-8s %12.2f %10.2f %16.4f %7.1f%% %8.5f %8zu\n", name, mode, stats.getAveragePathLength(),
+                       time * 1e3, luminance, 100.0 * (luminance / referenceLuminance - 1.0),
+                       rootMeanSquareError(accumulation, reference), depth < 0 ? size_t(0) : cache.getCellCount());
+            }
+        }
+    }
+
+    void Benchmark::pathGuiding() {
+        const Scene scene = createWindowScene();
+        const Integrator integrator(scene);
+        const View view = getBenchmarkView(uvec2(128, 96));
+        constexpr uint32_t frameCount = 128, referenceFrames = 512;
+
+        printf("== path guiding: room lit through a window (%ux%u, 1 spp per frame, RMSE against %u spp, %u workers) ==\n",
+               view.resolution.x, view.resolution.y, referenceFrames * 2, JobSystem::getWorkerCount());
+        const std::vector<vec4> reference = renderReference(integrator, view, { 0, 2 }, referenceFrames);
+        printf("guiding   ms/frame   mean luminance   RMSE @16   RMSE @%u   iterations   leaves   nodes\n", frameCount);
+
+        std::vector<double> errors[2], times[2];
+        for (int guiding = 0; guiding < 2; ++guiding) {
+            FrameSettings settings;
+            settings.samplesPerPixel = 1;
+            settings.pathGuiding = guiding != 0;
+            PathGuide guide(scene);
+            std::vector<vec4> accumulation(reference.size(), vec4(0.0f));
+            // the time includes learning, between frames
+            const auto start = std::chrono::high_resolution_clock::now();
+            for (uint32_t frame = 0; frame < frameCount; ++frame) {
+                settings.frameIndex = frame;
+                integrator.render(view, settings, accumulation.data(), { .guide = &guide });
+                times[guiding].push_back(std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count());
+                errors[guiding].push_back(rootMeanSquareError(accumulation, reference));
+            }
+
+            printf("%-8s %9.2f %16.4f %10.5f %10.5f", guiding ? "on" : "off", times[guiding].back() * 1e3 / frameCount,
+                   meanLuminance(accumulation), errors[guiding][15], errors[guiding].back());
+            if (guiding)
+                printf(" %12u %8zu %7zu\n", guide.getIteration(), guide.getLeafCount(), guide.getDirectionalNodeCount());
+            else
+                printf("\n");
+        }
+
+        // how long each takes to get as close as the unguided image does at its last frame
+        const double target = errors[0].back();
+        const auto reached = std::find_if(errors[1].begin(), errors[1].end(), [&](double e) { return e <= target; });
+        if (reached != errors[1].end()) {
+            const double time = times[1][reached - errors[1].begin()];
+            printf("time to RMSE %.5f: %.0f ms unguided, %.0f ms guided (%.2fx)\n", target, times[0].back() * 1e3,
+                   time * 1e3, times[0].back() / time);
+        } else {
+            printf("time to RMSE %.5f: %.0f ms unguided, guided doesn't get there in %u frames\n", target,
+                   times[0].back() * 1e3, frameCount);
+        }
+    }
+
+    // Every threshold gets the camera samples the uniform render took, whatever number of frames that is.
+    void Benchmark::adaptiveSampling() {
+        const Scene scene = Scene::createDefault();
+        const Integrator integrator(scene);
+        const View view = getBenchmarkView(uvec2(128, 96));
+        const size_t pixelCount = static_cast<size_t>(view.resolution.x) * view.resolution.y;
+        constexpr uint32_t frameCount = 64, referenceFrames = 512;
+
+        printf("== adaptive sampling (%ux%u, %u spp on average, RMSE against %u spp, %u workers) ==\n", view.resolution.x,
+               view.resolution.y, frameCount, referenceFrames * 2, JobSystem::getWorkerCount());
+        const std::vector<vec4> reference = renderReference(integrator, view, { 0, 2 }, referenceFrames);
+        printf("threshold   frames   ms/frame   samples/pixel: mean   min..max   converged       RMSE\n");
+
+        const uint64_t budget = frameCount * pixelCount;
+        for (const float threshold : { 0.0f, 0.05f, 0.02f, 0.01f }) {
+            FrameSettings settings;
+            settings.samplesPerPixel = 1;
+            settings.adaptiveSampling = threshold > 0.0f;
+            settings.adaptiveThreshold = threshold;
+            std::vector<vec4> accumulation(pixelCount, vec4(0.0f)), variance(pixelCount, vec4(0.0f));
+            uint64_t samples = 0;
+            uint32_t frame = 0;
+            const auto start = std::chrono::high_resolution_clock::now();
+            // a cap in case every pixel converges before the budget is spent
+            for (; samples < budget && frame < 16 * frameCount; ++frame) {
+                settings.frameIndex = frame;
+                samples += integrator.render(view, settings, accumulation.data(), { .variance = variance.data() }).paths;
+            }
+            const double time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+            float fewest = INFINITY, most = 0.0f;
+            size_t converged = 0;
+            for (const vec4& statistics : variance) {
+                fewest = std::min(fewest, statistics.w);
+                most = std::max(most, statistics.w);
+                converged += Adaptive::isConverged(statistics, settings);
+            }
+            char name[16];
+            snprintf(name, sizeof(name), threshold > 0.0f ? "%.2f" : "off", threshold);
+            printf("%-9s %8u %10.2f %21.1f %6.0f..%-6.0f %8.1f%% %10.5f\n", name, frame, time * 1e3 / frame,
+                   static_cast<double>(samples) / static_cast<double>(pixelCount), fewest, most,
+                   100.0 * static_cast<double>(converged) / static_cast<double>(pixelCount),
+                   rootMeanSquareError(accumulation, reference));
+        }
+    }
+
+    // The camera stands still for a while, then strafes and turns by about two pixels a frame, one
+    // sample per pixel each. The last view's error is set against how many frames a camera that stood
+    // there all along takes to get as close, over the whole image and over the pixels that were carried
+    // over; the rest, newly uncovered, on an edge or in the mirror, have that frame's sample alone. The
+    // error is of the image as the window shows it, where the light's edges would drown out the rest.
+    void Benchmark::temporalReprojection() {
+        const Scene scene = Scene::createDefault();
+        const Integrator integrator(scene);
+        const View start = getBenchmarkView(uvec2(128, 96));
+        const size_t pixelCount = static_cast<size_t>(start.resolution.x) * start.resolution.y;
+        constexpr uint32_t stillFrames = 32, movingFrames = 32, referenceFrames = 512;
+        auto getView = [&](uint32_t step) {
+            const float angle = 0.0125f * static_cast<float>(step);
+            const mat3 yaw(std::cos(angle), 0.0f, -std::sin(angle), 0.0f, 1.0f, 0.0f, std::sin(angle), 0.0f, std::cos(angle));
+            View view = start;
+            view.position.x += 0.1f * static_cast<float>(step);
+            view.rotation = yaw * start.rotation;
+            return view;
+        };
+        const View last = getView(movingFrames);
+
+        printf("== temporal reprojection (%ux%u, %u still frames then %u moving ones at 1 spp, RMSE in the last view against %u spp, %u workers) ==\n",
+               start.resolution.x, start.resolution.y, stillFrames, movingFrames, referenceFrames * 2, JobSystem::getWorkerCount());
+        const std::vector<vec4> reference = renderReference(integrator, last, { 0, 2 }, referenceFrames);
+        // the error of the pixels in mask, or of all of them
+        auto getError = [&](const std::vector<vec4>& image, const std::vector<bool>* mask) {
+            double sum = 0.0;
+            size_t count = 0;
+            for (size_t i = 0; i < pixelCount; ++i) {
+                if (mask && !(*mask)[i])
+                    continue;
+                const vec3 difference = clamp(vec3(image[i]), 0.0f, 1.0f) - clamp(vec3(reference[i]), 0.0f, 1.0f);
+                sum += dot(difference, difference);
+                ++count;
+            }
+            return count ? std::sqrt(sum / (3.0 * static_cast<double>(count))) : 0.0;
+        };
+
+        FrameSettings settings;
+        settings.samplesPerPixel = 1;
+        std::vector<std::vector<vec4>> still;
+        {
+            std::vector<vec4> accumulation(pixelCount, vec4(0.0f));
+            for (uint32_t frame = 0; frame < stillFrames + movingFrames; ++frame) {
+                settings.frameIndex = frame;
+                integrator.render(last, settings, accumulation.data());
+                still.push_back(accumulation);
+            }
+        }
+        // frames the still camera needs to get as close, or more than it has
+        auto getStillFrames = [&](double error, const std::vector<bool>* mask) {
+            std::string frames;
+            for (size_t frame = 0; frame < still.size() && frames.empty(); ++frame) {
+                if (getError(still[frame], mask) <= error)
+                    frames = std::to_string(frame + 1);
+            }
+            return frames.empty() ? ">" + std::to_string(still.size()) : frames;
+        };
+
+        printf("mode        ms/frame   reproject ms   carried   samples/pixel       RMSE   still frames   RMSE carried   still frames\n");
+        for (const bool reprojection : { false, true }) {
+            std::vector<vec4> accumulation(pixelCount, vec4(0.0f));
+            ReprojectionBuffers buffers;
+            double renderTime = 0.0, reprojectTime = 0.0;
+            for (uint32_t frame = 0; frame < stillFrames + movingFrames; ++frame) {
+                const View view = getView(frame < stillFrames ? 0 : frame - stillFrames + 1);
+                const bool moved = frame == 0 || frame >= stillFrames;
+                if (reprojection && moved)
+                    reprojectTime += bestOf(1, [&] { integrator.reproject(view, accumulation.data(), buffers); });
+                else if (moved)
+                    std::fill(accumulation.begin(), accumulation.end(), vec4(0.0f));
+                settings.frameIndex = frame;
+                renderTime += bestOf(1, [&] { integrator.render(view, settings, accumulation.data()); });
+            }
+
+            // pixels carried into the last view have more than its one sample
+            std::vector<bool> carried(pixelCount);
+            size_t carriedCount = 0;
+            double samples = 0.0;
+            for (size_t i = 0; i < pixelCount; ++i) {
+                carried[i] = accumulation[i].w > 1.0f;
+                carriedCount += carried[i];
+                samples += accumulation[i].w;
+            }
+            const double error = getError(accumulation, nullptr);
+            printf("%-10s %9.2f %14.2f %8.1f%% %15.1f %10.5f %14s", reprojection ? "reproject" : "reset",
+                   renderTime * 1e3 / (stillFrames + movingFrames), reprojectTime * 1e3 / (movingFrames + 1),
+                   100.0 * static_cast<double>(carriedCount) / static_cast<double>(pixelCount),
+                   samples / static_cast<double>(pixelCount), error, getStillFrames(error, nullptr).c_str());
+            if (carriedCount) {
+                const double carriedError = getError(accumulation, &carried);
+                printf(" %14.5f %14s\n", carriedError, getStillFrames(carriedError, &carried).c_str());
+            } else {
+                printf(" %14s %14s\n", "-", "-");
+            }
+        }
+    }
+
+    // The controller of --frame-time against the CPU integrator: a camera moving for a while with the
+    // target at a share of what a full frame takes, then standing still. Frame times are measured, so
+    // the scales it settles on depend on the machine, the frame times it reaches shouldn't.
+    void Benchmark::dynamicResolution() {
+        const Scene scene = Scene::createDefault();
+        const Integrator integrator(scene);
+        const uvec2 windowSize(320, 240);
+        constexpr uint32_t movingFrames = 40, maxStillFrames = 1000;
+        std::vector<vec4> accumulation(static_cast<size_t>(windowSize.x) * windowSize.y, vec4(0.0f));
+        FrameSettings settings;
+        settings.samplesPerPixel = 1;
+
+        const double fullFrame = bestOf(3, [&] { integrator.render(getBenchmarkView(windowSize), settings, accumulation.data()); });
+        printf("== dynamic resolution (%ux%u, %u moving frames then still ones at 1 spp, %.2f ms a full frame, %u workers) ==\n",
+               windowSize.x, windowSize.y, movingFrames, fullFrame * 1e3, JobSystem::getWorkerCount());
+        printf("target ms   settled ms   scale   changes   frames to settle   full again after\n");
+        for (const double share : { 0.6, 0.4, 0.2 }) {
+            DynamicResolution controller(share * fullFrame);
+            double lastFrame = 0.0, settledTime = 0.0, stillTime = 0.0;
+            uint32_t changes = 0, settledFrames = 0, lastChange = 0, frame = 0;
+            float scale = 1.0f, movingScale = 1.0f;
+            for (; frame < movingFrames + maxStillFrames; ++frame) {
+                const bool moving = frame < movingFrames;
+                if (!moving)
+                    stillTime += lastFrame;
+                const float lastScale = scale;
+                scale = controller.update(moving, lastFrame);
+                if (scale != lastScale) {
+                    std::fill(accumulation.begin(), accumulation.end(), vec4(0.0f));
+                    if (moving) {
+                        ++changes;
+                        lastChange = frame;
+                    }
+                }
+                if (!moving && scale == 1.0f)
+                    break;
+                View view = getBenchmarkView(controller.apply(windowSize));
+                view.position.x += 0.02f * static_cast<float>(std::min(frame, movingFrames));
+                settings.frameIndex = frame;
+                lastFrame = bestOf(1, [&] { integrator.render(view, settings, accumulation.data()); });
+                // the second half of the move, by when it should have found its scale
+                if (moving && frame >= movingFrames / 2) {
+                    settledTime += lastFrame;
+                    ++settledFrames;
+                    movingScale = scale;
+                }
+            }
+            printf("%9.2f %12.2f %6.0f%% %9u %18u %9.0f ms, %u frames\n", share * fullFrame * 1e3,
+                   settledTime * 1e3 / settledFrames, 100.0f * movingScale, changes, lastChange + 1,
+                   stillTime * 1e3, frame - movingFrames);
+        }
+    }
+
+    // The controller of --frame-budget against the CPU integrator with a still camera, for a few
+    // budgets against a pass a frame. Presenting a frame is taken to cost a fixed time, added to what
+    // was measured rather than waited out. Every run traces the same number of passes, and the image
+    // has to come out the same however they were spread over frames.
+    bool Benchmark::frameBudget() {
+        const Scene scene = Scene::createDefault();
+        const Integrator integrator(scene);
+        const View view = getBenchmarkView(uvec2(80, 60));
+        const size_t pixelCount = static_cast<size_t>(view.resolution.x) * view.resolution.y;
+        constexpr uint32_t totalPasses = 512;
+        constexpr double presentSeconds = 4e-3;
+        FrameSettings settings;
+        settings.samplesPerPixel = 2;
+
+        printf("== frame budget (%ux%u, %u passes at %d spp, %.0f ms to present a frame, %u workers) ==\n",
+               view.resolution.x, view.resolution.y, totalPasses, settings.samplesPerPixel, presentSeconds * 1e3,
+               JobSystem::getWorkerCount());
+        printf("budget ms   frames   passes/frame   ms/frame   Msamples/s\n");
+        uint64_t reference = 0;
+        bool identical = true;
+        for (const double budget : { 0.0, 0.0167, 0.033, 0.1 }) {
+            FrameBudget controller(budget);
+            std::vector<vec4> accumulation(pixelCount, vec4(0.0f));
+            uint32_t frameIndex = 0, frames = 0, passes = 0;
+            double seconds = 0.0;
+            while (frameIndex < totalPasses) {
+                passes = std::min(controller.getPasses(false), totalPasses - frameIndex);
+                const double traced = bestOf(1, [&] {
+                    for (uint32_t pass = 0; pass < passes; ++pass) {
+                        settings.frameIndex = frameIndex++;
+                        integrator.render(view, settings, accumulation.data());
+                    }
+                });
+                controller.addPassTime(passes, traced);
+                controller.finishFrame(passes, traced + presentSeconds);
+                seconds += traced + presentSeconds;
+                ++frames;
+            }
+            const uint64_t hash = checksum(accumulation.data(), accumulation.size() * sizeof(vec4));
+            if (budget == 0.0)
+                reference = hash;
+            identical = identical && hash == reference;
+            char label[16];
+            std::snprintf(label, sizeof(label), budget > 0.0 ? "%.0f" : "off", budget * 1e3);
+            printf("%9s %8u %14u %10.2f %12.2f\n", label, frames, controller.getPasses(false), seconds * 1e3 / frames,
+                   static_cast<double>(totalPasses) * pixelCount * settings.samplesPerPixel / seconds * 1e-6);
+        }
+        printf("image %s\n", identical ? "bit-identical" : "DIFFERS");
+        return identical;
+    }
+
+    // What writing the first-hit AOVs costs a frame, and that the image comes out bit for bit the same.
+    bool Benchmark::firstHitAovs() {
+        const Scene scene = Scene::createDefault();
+        const Integrator integrator(scene);
+        const View view = getBenchmarkView(uvec2(320, 240));
+        const size_t pixelCount = static_cast<size_t>(view.resolution.x) * view.resolution.y;
+        constexpr uint32_t frames = 8;
+
+        printf("== first-hit AOVs (%ux%u, %u frames at 1 spp, %u workers) ==\n", view.resolution.x, view.resolution.y,
+               frames, JobSystem::getWorkerCount());
+        FrameSettings settings;
+        settings.samplesPerPixel = 1;
+        AovBuffers aovs;
+        uint64_t hashes[2] = {};
+        double times[2] = { 1e30, 1e30 };
+        // taking turns, so neither gets the warmer caches or clocks
+        for (int round = 0; round < 5; ++round) {
+            for (int withAovs = 0; withAovs < 2; ++withAovs) {
+                std::vector<vec4> accumulation(pixelCount, vec4(0.0f));
+                aovs.clear();
+                times[withAovs] = std::min(times[withAovs], bestOf(1, [&] {
+                    for (uint32_t frame = 0; frame < frames; ++frame) {
+                        settings.frameIndex = frame;
+                        integrator.render(view, settings, accumulation.data(), { .aovs = withAovs ? &aovs : nullptr });
+                    }
+                }) / frames);
+                hashes[withAovs] = checksum(accumulation.data(), accumulation.size() * sizeof(vec4));
+            }
+        }
+
+        size_t sky = 0, objects = 0;
+        std::vector<bool> seen(scene.spheres.size() + scene.meshes.size() + 1);
+        for (const uvec2 id : aovs.id) {
+            sky += id.x == 0;
+            objects += !seen[id.x];
+            seen[id.x] = true;
+        }
+        const bool identical = hashes[0] == hashes[1];
+        printf("without AOVs %8.2f ms a frame\n", times[0] * 1e3);
+        printf("with AOVs    %8.2f ms a frame, %+.1f%%, %zu bytes a pixel\n", times[1] * 1e3,
+               100.0 * (times[1] / times[0] - 1.0), 2 * sizeof(vec4) + sizeof(uvec2));
+        printf("image %s, %.1f%% sky, %zu objects seen\n", identical ? "bit-identical" : "DIFFERS",
+               100.0 * static_cast<double>(sky) / static_cast<double>(pixelCount), objects - (sky ? 1 : 0));
+        return identical;
+    }
+
+    // One sample per pixel a frame, denoised at every power of two. The raw image's error over the same
+    // snapshots tells how many samples it needs to match the denoised one: interpolated in log-log
+    // between them, or past the last one extrapolated as falling with 1/sqrt(samples), marked ~.
+    void Benchmark::denoising() {
+        const Scene scene = Scene::createDefault();
+        const Integrator integrator(scene);
+        const View view = getBenchmarkView(uvec2(160, 120));
+        const size_t pixelCount = static_cast<size_t>(view.resolution.x) * view.resolution.y;
+        constexpr uint32_t maxSamples = 256, referenceFrames = 1024;
+
+        printf("== a-trous denoising (%ux%u, %d iterations, RMSE of the displayed image against %u spp, %u workers) ==\n",
+               view.resolution.x, view.resolution.y, Denoiser::iterations, referenceFrames * 2, JobSystem::getWorkerCount());
+        const std::vector<vec4> reference = renderReference(integrator, view, { 0, 2 }, referenceFrames);
+
+        FrameSettings settings;
+        settings.samplesPerPixel = 1;
+        std::vector<vec4> accumulation(pixelCount, vec4(0.0f)), denoised(pixelCount);
+        AovBuffers aovs;
+        Denoiser denoiser;
+        std::vector<double> samples, rawErrors, denoisedErrors;
+        double denoiseTime = 0.0;
+        for (uint32_t frame = 0; frame < maxSamples; ++frame) {
+            settings.frameIndex = frame;
+            integrator.render(view, settings, accumulation.data(), { .aovs = &aovs });
+            if ((frame + 1) & frame)
+                continue;
+            denoiseTime = bestOf(3, [&] { denoiser.denoise(accumulation.data(), aovs, view.resolution, denoised.data()); });
+            samples.push_back(frame + 1);
+            rawErrors.push_back(displayedError(accumulation, reference));
+            denoisedErrors.push_back(displayedError(denoised, reference));
+        }
+
+        auto getRawSamples = [&](double error) {
+            char text[32];
+            if (error >= rawErrors.front()) {
+                std::snprintf(text, sizeof(text), "<%.0f", samples.front());
+                return std::string(text);
+            }
+            for (size_t k = 1; k < samples.size(); ++k) {
+                if (error < rawErrors[k])
+                    continue;
+                const double t = std::log(rawErrors[k - 1] / error) / std::log(rawErrors[k - 1] / rawErrors[k]);
+                std::snprintf(text, sizeof(text), "%.1f", samples[k - 1] * std::pow(samples[k] / samples[k - 1], t));
+                return std::string(text);
+            }
+            const double last = rawErrors.back() / error;
+            std::snprintf(text, sizeof(text), "~%.0f", samples.back() * last * last);
+            return std::string(text);
+        };
+        printf("spp    raw RMSE   denoised RMSE   raw spp to match\n");
+        for (size_t k = 0; k < samples.size(); ++k) {
+            printf("%3.0f %11.5f %15.5f %18s\n", samples[k], rawErrors[k], denoisedErrors[k],
+                   getRawSamples(denoisedErrors[k]).c_str());
+        }
+        printf("CPU denoise: %.2f ms a frame, %.1f ms per megapixel\n", denoiseTime * 1e3,
+               denoiseTime * 1e3 * 1e6 / static_cast<double>(pixelCount));
+    }
+
+    void Benchmark::environmentLoading() {
+        printf("== environment map: load and sampling tables (%u workers) ==\n", JobSystem::getWorkerCount());
+        printf("size              file MB    load ms   stb_image ms   sampling blocks\n");
+
+        const std::filesystem::path path = std::filesystem::temp_directory_path() / "raytracer-bench-environment.hdr";
+        for (const uint32_t width : { 2048u, 8192u, 16384u }) {
+            const uint32_t height = width / 2;
+            {
+                // the sky as texels straight away, the float image of a 16K map would not fit next to them
+                std::vector<uint32_t> texels(static_cast<size_t>(width) * height);
+                JobSystem::parallelFor(0, height, 8, [&](size_t y) {
+                    for (uint32_t x = 0; x < width; ++x) {
+                        const vec2 uv((static_cast<float>(x) + 0.5f) / static_cast<float>(width),
+                                      (static_cast<float>(y) + 0.5f) / static_cast<float>(height));
+                        texels[y * width + x] = Environment::encode(getSyntheticSky(Environment::fromUV(uv),
+                                                                                    static_cast<uint32_t>(y * width + x)));
+                    }
+                });
+                if (!writeRadiance(path.string(), width, height, texels)) {
+                    ERR("Could not write %s.", path.string().c_str());
+                    return;
+                }
+            }
+
+            Environment environment;
+            const double load = bestOf(1, [&] { environment.load(path.string()); });
+            const double stb = bestOf(1, [&] {
+                int w, h, channels;
+                stbi_image_free(stbi_loadf(path.string().c_str(), &w, &h, &channels, 3));
+            });
+            printf("%5ux%-5u %13.1f %10.1f %14.1f %11ux%u\n", width, height,
+                   static_cast<double>(std::filesystem::file_size(path)) / (1 << 20), load * 1e3, stb * 1e3,
+                   environment.blocksX, environment.blocksY);
+        }
+        std::filesystem::remove(path);
+    }
+
+    // Renders frames in one go, and again stopping part of the way to save a checkpoint through a
+    // CheckpointWriter, loading it into fresh buffers and going on from the frame it says, the way
+    // --resume does. The accumulation and the pixel statistics must come out the same to the bit.
+    bool Benchmark::checkpointResume() {
+        const Scene scene = Scene::createDefault();
+        const Integrator integrator(scene);
+        const View view = getBenchmarkView(uvec2(120, 90));
+        const size_t pixelCount = static_cast<size_t>(view.resolution.x) * view.resolution.y;
+        constexpr uint32_t frames = 12, stopFrame = 5;
+
+        printf("== checkpoint and resume (%ux%u, %u frames, stopped after %u, %u workers) ==\n", view.resolution.x,
+               view.resolution.y, frames, stopFrame, JobSystem::getWorkerCount());
+        printf("adaptive   checkpoint MB   save ms   load ms   accumulation   statistics\n");
+        const std::string path = (std::filesystem::temp_directory_path() / "raytracer-bench-checkpoint.bin").string();
+
+        ImageWriter imageWriter;
+        bool identical = true;
+        for (const bool adaptive : { false, true }) {
+            FrameSettings settings;
+            settings.adaptiveSampling = adaptive;
+            settings.adaptiveMinSamples = 4;
+            settings.adaptiveThreshold = 0.1f;
+            const auto render = [&](uint32_t first, uint32_t end, std::vector<vec4>& accumulation, std::vector<vec4>& variance) {
+                for (uint32_t frame = first; frame < end; ++frame) {
+                    settings.frameIndex = frame;
+                    integrator.render(view, settings, accumulation.data(), { .variance = variance.data() });
+                }
+            };
+
+            std::vector<vec4> accumulation(pixelCount, vec4(0.0f)), variance(pixelCount, vec4(0.0f));
+            render(0, frames, accumulation, variance);
+
+            std::vector<vec4> stoppedAccumulation(pixelCount, vec4(0.0f)), stoppedVariance(pixelCount, vec4(0.0f));
+            render(0, stopFrame, stoppedAccumulation, stoppedVariance);
+            Checkpoint checkpoint;
+            checkpoint.resolution = view.resolution;
+            checkpoint.frameIndex = checkpoint.frameCount = stopFrame;
+            checkpoint.settingsKey = Checkpoint::getSettingsKey(settings);
+            checkpoint.hasVariance = true;
+            bool saved = false;
+            const double save = bestOf(1, [&] {
+                CheckpointWriter writer(imageWriter);
+                writer.save(path, checkpoint, stoppedAccumulation.data(), stoppedVariance.data());
+                saved = writer.wait();
+            });
+
+            Checkpoint loaded;
+            std::vector<vec4> resumedAccumulation, resumedVariance;
+            bool resumed = false;
+            const double load = bestOf(1, [&] { resumed = loaded.load(path, resumedAccumulation, resumedVariance); });
+            resumed = saved && resumed && loaded.resolution == view.resolution && loaded.hasVariance &&
+                      loaded.settingsKey == Checkpoint::getSettingsKey(settings);
+            if (resumed)
+                render(loaded.frameIndex, frames, resumedAccumulation, resumedVariance);
+
+            const bool sameAccumulation = resumed && resumedAccumulation == accumulation;
+            const bool sameStatistics = resumed && resumedVariance == variance;
+            identical = identical && sameAccumulation && sameStatistics;
+            printf("%-8s %15.2f %9.2f %9.2f   %-12s   %s\n", adaptive ? "yes" : "no",
+                   saved ? static_cast<double>(std::filesystem::file_size(path)) / (1 << 20) : 0.0, save * 1e3, load * 1e3,
+                   !resumed ? "NOT RESUMED" : sameAccumulation ? "identical" : "DIFFERS",
+                   !resumed ? "" : sameStatistics ? "identical" : "DIFFER");
+        }
+        std::filesystem::remove(path);
+        return identical;
+    }
+
+    // Renders an image in one go and in tiles the way --tile does, each tile its own frames from the
+    // first on and streamed through a TiledImageWriter, and compares the two PFM files byte for byte.
+    // The size is no multiple of the tile size, so the last row and column of tiles are cut short.
+    bool Benchmark::tiledRendering() {
+        const Scene scene = Scene::createDefault();
+        const Integrator integrator(scene);
+        const View view = getBenchmarkView(uvec2(157, 113));
+        const size_t pixelCount = static_cast<size_t>(view.resolution.x) * view.resolution.y;
+        constexpr uint32_t tileSize = 32, frames = 8;
+        const uvec2 tiles = (view.resolution + tileSize - 1u) / tileSize;
+
+        printf("== tiled rendering (%ux%u, %ux%u tiles of %u, %u frames, %u workers) ==\n", view.resolution.x,
+               view.resolution.y, tiles.x, tiles.y, tileSize, frames, JobSystem::getWorkerCount());
+        printf("sampler       adaptive   whole ms   tiled ms   files\n");
+        const std::filesystem::path directory = std::filesystem::temp_directory_path();
+        const std::string wholePath = (directory / "raytracer-bench-whole.pfm").string();
+        const std::string tiledPath = (directory / "raytracer-bench-tiled.pfm").string();
+        const auto readAll = [](const std::string& path) {
+            std::vector<char> bytes(std::filesystem::file_size(path));
+            std::FILE* file = std::fopen(path.c_str(), "rb");
+            const size_t read = file ? std::fread(bytes.data(), 1, bytes.size(), file) : 0;
+            if (file)
+                std::fclose(file);
+            bytes.resize(read);
+            return bytes;
+        };
+
+        ImageWriter imageWriter;
+        bool identical = true;
+        for (int s = 0; s < static_cast<int>(SamplerType::Count); ++s) {
+            for (const bool adaptive : { false, true }) {
+                FrameSettings settings;
+                settings.sampler = static_cast<SamplerType>(s);
+                settings.adaptiveSampling = adaptive;
+                settings.adaptiveMinSamples = 4;
+                settings.adaptiveThreshold = 0.1f;
+
+                std::vector<vec4> accumulation(pixelCount, vec4(0.0f)), variance(pixelCount, vec4(0.0f));
+                const double whole = bestOf(1, [&] {
+                    for (uint32_t frame = 0; frame < frames; ++frame) {
+                        settings.frameIndex = frame;
+                        integrator.render(view, settings, accumulation.data(), { .variance = variance.data() });
+                    }
+                });
+                bool written = ImageFile::writePfm(wholePath, view.resolution, 3, &accumulation[0].x, 4);
+
+                const double tiled = bestOf(1, [&] {
+                    TiledImageWriter writer(imageWriter, tiledPath, view.resolution);
+                    View tileView = view;
+                    tileView.imageSize = view.resolution;
+                    for (uint32_t tile = 0; tile < tiles.x * tiles.y; ++tile) {
+                        tileView.tileOffset = uvec2(tile % tiles.x, tile / tiles.x) * tileSize;
+                        tileView.resolution = min(uvec2(tileSize), view.resolution - tileView.tileOffset);
+                        const size_t tilePixels = static_cast<size_t>(tileView.resolution.x) * tileView.resolution.y;
+                        std::vector<vec4> tileAccumulation(tilePixels, vec4(0.0f)), tileVariance(tilePixels, vec4(0.0f));
+                        for (uint32_t frame = 0; frame < frames; ++frame) {
+                            settings.frameIndex = frame;
+                            integrator.render(tileView, settings, tileAccumulation.data(), { .variance = tileVariance.data() });
+                        }
+                        writer.write(tileView.tileOffset, tileView.resolution, std::move(tileAccumulation));
+                    }
+                    written = writer.finish() && written;
+                });
+
+                const bool same = written && readAll(wholePath) == readAll(tiledPath);
+                identical = identical && same;
+                printf("%-12s  %-8s %9.1f %10.1f   %s\n", Sampling::getName(settings.sampler), adaptive ? "yes" : "no",
+                       whole * 1e3, tiled * 1e3, !written ? "NOT WRITTEN" : same ? "identical" : "DIFFER");
+            }
+        }
+        std::filesystem::remove(wholePath);
+        std::filesystem::remove(tiledPath);
+        return identical;
+    }
+
+    // A 4K frame in every format, saved on this thread and then as a stream of frames queued on the
+    // writer as fast as a render loop could hand them over. The image is a gradient with noise on it,
+    // as a few samples a pixel have, which is the hard case for QOI.
+    bool Benchmark::imageWriting() {
+        const uvec2 size(3840, 2160);
+        const size_t pixelCount = static_cast<size_t>(size.x) * size.y;
+        constexpr uint32_t streamedFrames = 8;
+
+        printf("== image writing (%ux%u, %u frames streamed to a writer of 2 threads and 4 places) ==\n", size.x, size.y,
+               streamedFrames);
+        std::vector<vec4> image(pixelCount);
+        JobSystem::parallelFor(0, size.y, 8, [&](size_t y) {
+            std::mt19937 rng(static_cast<uint32_t>(y));
+            std::uniform_real_distribution<float> noise(0.9f, 1.1f);
+            for (uint32_t x = 0; x < size.x; ++x) {
+                const vec3 gradient(static_cast<float>(x) / size.x, static_cast<float>(y) / size.y, 0.5f);
+                image[y * size.x + x] = vec4(gradient * vec3(noise(rng), noise(rng), noise(rng)) * 1.5f, 16.0f);
+            }
+        });
+        std::vector<uint8_t> rgba8(4 * pixelCount);
+        Kernels::get().convertToRgba8(&image[0].x, rgba8.data(), pixelCount);
+
+        printf("format   file MB    save ms   streamed fps   longest write() us   dropped\n");
+        const std::filesystem::path directory = std::filesystem::temp_directory_path();
+        bool decodes = true;
+        for (const auto format : { ImageWriter::Format::Pfm, ImageWriter::Format::Exr, ImageWriter::Format::Png,
+                                   ImageWriter::Format::Qoi }) {
+            const std::string extension = ImageWriter::getExtension(format);
+            const std::string path = (directory / ("raytracer-bench-image" + extension)).string();
+            bool saved = true;
+            const double save = bestOf(1, [&] { saved = ImageWriter::save({ path, size, &image[0].x }); });
+            if (!saved) {
+                ERR("Could not write %s.", path.c_str());
+                return false;
+            }
+            const double megabytes = static_cast<double>(std::filesystem::file_size(path)) / (1 << 20);
+            if (format == ImageWriter::Format::Png) {
+                int w, h, channels;
+                uint8_t* decoded = stbi_load(path.c_str(), &w, &h, &channels, 3);
+                bool matches = decoded && w == static_cast<int>(size.x) && h == static_cast<int>(size.y);
+                for (size_t i = 0; matches && i < pixelCount; ++i) {
+                    // stb_image has the top row first
+                    const size_t x = i % size.x, y = size.y - 1 - i / size.x;
+                    matches = std::memcmp(&decoded[i * 3], &rgba8[(y * size.x + x) * 4], 3) == 0;
+                }
+                stbi_image_free(decoded);
+                decodes = decodes && matches;
+            }
+            std::filesystem::remove(path);
+
+            // every frame a file of its own, removed once written, so only what is in flight takes disk space
+            double longestWrite = 0.0;
+            uint64_t written;
+            const double stream = bestOf(1, [&] {
+                ImageWriter writer(2, 4);
+                for (uint32_t frame = 0; frame < streamedFrames; ++frame) {
+                    ImageWriter::Image queued = { (directory / ("raytracer-bench-stream-" + std::to_string(frame) + extension)).string(),
+                                                  size, &image[0].x };
+                    queued.done = [path = queued.path](bool) { std::filesystem::remove(path); };
+                    longestWrite = std::max(longestWrite, bestOf(1, [&] { writer.write(std::move(queued)); }));
+                }
+                writer.wait();
+                written = writer.getWrittenJobs();
+            });
+            printf("%-6s %9.1f %10.1f %14.1f %20.1f %9llu\n", extension.c_str() + 1, megabytes, save * 1e3,
+                   static_cast<double>(written) / stream, longestWrite * 1e6,
+                   static_cast<unsigned long long>(streamedFrames - written));
+        }
+        printf("PNG %s\n", decodes ? "decodes to the converted image" : "DOES NOT decode to the converted image");
+        return decodes;
+    }
+}
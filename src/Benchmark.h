@@ -0,0 +1,40 @@
+﻿#pragma once
+#include <string>
+
+namespace raytracer {
+    // Headless micro-benchmarks, selected with --bench <suite>. Results are printed to stdout.
+    class Benchmark {
+    public:
+        // Runs one suite, or every suite for "all". Returns the process exit code.
+        static int run(const std::string& suite);
+
+    private:
+        static void jobSpawnOverhead();
+        static void jobScaling();
+        static void cpuKernels();
+        static void integratorSpecialization();
+        // Returns false if the image changed with the worker count or kernel ISA.
+        static bool renderDeterminism();
+        static void samplerConvergence();
+        static void russianRoulette();
+        static void nextEventEstimation();
+        static void lightTreeScaling();
+        static void reservoirResampling();
+        static void radianceCaching();
+        static void pathGuiding();
+        static void adaptiveSampling();
+        static void temporalReprojection();
+        static void dynamicResolution();
+        // Returns false if how the passes fell on frames changed the image.
+        static bool frameBudget();
+        static bool firstHitAovs();
+        static void denoising();
+        static void environmentLoading();
+        // Returns false if a render resumed from a checkpoint differs from one that never stopped.
+        static bool checkpointResume();
+        // Returns false if a tiled render's file differs from the one rendered in one go.
+        static bool tiledRendering();
+        // Returns false if a PNG doesn't decode to what Kernels::convertToRgba8 made of the image.
+        static bool imageWriting();
+    };
+}
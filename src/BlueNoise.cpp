@@ -0,0 +1,138 @@
+﻿#include "BlueNoise.h"
+
+#include <chrono>
+#include <cmath>
+
+#include "misc/Logger.h"
+
+namespace raytracer {
+    namespace {
+        constexpr uint32_t texelCount = BlueNoise::size * BlueNoise::size;
+
+        uint32_t hash(uint32_t x) {
+            x ^= x >> 16;
+            x *= 0x7feb352du;
+            x ^= x >> 15;
+            x *= 0x846ca68bu;
+            x ^= x >> 16;
+            return x;
+        }
+
+        // Gaussian energy of a binary pattern on the torus, updated as points come and go.
+        class EnergyField {
+        public:
+            EnergyField(): kernel(texelCount), energy(texelCount, 0.0f), pattern(texelCount, false) {
+                constexpr float sigma = 1.9f;
+                for (uint32_t y = 0; y < BlueNoise::size; ++y) {
+                    for (uint32_t x = 0; x < BlueNoise::size; ++x) {
+                        const float dx = static_cast<float>(std::min(x, BlueNoise::size - x));
+                        const float dy = static_cast<float>(std::min(y, BlueNoise::size - y));
+                        kernel[y * BlueNoise::size + x] = std::exp(-(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+                    }
+                }
+            }
+
+            bool isSet(uint32_t index) const {
+                return pattern[index];
+            }
+
+            void set(uint32_t index, bool value) {
+                if (pattern[index] == value)
+                    return;
+                pattern[index] = value;
+
+                const float sign = value ? 1.0f : -1.0f;
+                const uint32_t px = index % BlueNoise::size, py = index / BlueNoise::size;
+                for (uint32_t y = 0; y < BlueNoise::size; ++y) {
+                    const uint32_t ky = ((y - py) & (BlueNoise::size - 1)) * BlueNoise::size;
+                    for (uint32_t x = 0; x < BlueNoise::size; ++x)
+                        energy[y * BlueNoise::size + x] += sign * kernel[ky + ((x - px) & (BlueNoise::size - 1))];
+                }
+            }
+
+            // the set point with the most neighbours
+            uint32_t findTightestCluster() const {
+                uint32_t best = 0;
+                float bestEnergy = -1.0f;
+                for (uint32_t i = 0; i < texelCount; ++i) {
+                    if (pattern[i] && energy[i] > bestEnergy) {
+                        bestEnergy = energy[i];
+                        best = i;
+                    }
+                }
+                return best;
+            }
+
+            // the free texel farthest from everything
+            uint32_t findLargestVoid() const {
+                uint32_t best = 0;
+                float bestEnergy = INFINITY;
+                for (uint32_t i = 0; i < texelCount; ++i) {
+                    if (!pattern[i] && energy[i] < bestEnergy) {
+                        bestEnergy = energy[i];
+                        best = i;
+                    }
+                }
+                return best;
+            }
+
+        private:
+            std::vector<float> kernel;
+            std::vector<float> energy;
+            std::vector<bool> pattern;
+        };
+    }
+
+    const BlueNoise& BlueNoise::get() {
+        static const BlueNoise blueNoise;
+        return blueNoise;
+    }
+
+    BlueNoise::BlueNoise(): values(texelCount) {
+        const auto start = std::chrono::high_resolution_clock::now();
+
+        // a tenth of the texels at hashed positions, then relaxed until it is evenly spread
+        EnergyField initial;
+        uint32_t initialCount = 0;
+        for (uint32_t i = 0; initialCount < texelCount / 10; ++i) {
+            const uint32_t index = hash(i) % texelCount;
+            if (!initial.isSet(index)) {
+                initial.set(index, true);
+                ++initialCount;
+            }
+        }
+        while (true) {
+            const uint32_t cluster = initial.findTightestCluster();
+            initial.set(cluster, false);
+            const uint32_t gap = initial.findLargestVoid();
+            initial.set(gap, true);
+            if (gap == cluster)
+                break;
+        }
+
+        std::vector<uint32_t> ranks(texelCount);
+
+        // ranks below the initial pattern: take out the tightest cluster first
+        EnergyField field = initial;
+        for (uint32_t rank = initialCount; rank-- > 0;) {
+            const uint32_t cluster = field.findTightestCluster();
+            field.set(cluster, false);
+            ranks[cluster] = rank;
+        }
+
+        // and above it: fill the largest void first
+        field = initial;
+        for (uint32_t rank = initialCount; rank < texelCount; ++rank) {
+            const uint32_t gap = field.findLargestVoid();
+            field.set(gap, true);
+            ranks[gap] = rank;
+        }
+
+        constexpr uint32_t step = 0x100000000ull / texelCount;
+        for (uint32_t i = 0; i < texelCount; ++i)
+            values[i] = ranks[i] * step + step / 2;
+
+        DEBUG("Generated %ux%u blue noise in %.1f ms.", size, size,
+              std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+    }
+}
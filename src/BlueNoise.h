@@ -0,0 +1,23 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace raytracer {
+    // Tileable blue-noise mask made with void-and-cluster (Ulichney, 1993). Every texel holds its
+    // rank spread over the whole uint32 range, so samplers can offset it with wrapping integer
+    // math and get the same values on the CPU and in raytracer.comp.
+    class BlueNoise {
+    public:
+        static constexpr uint32_t size = 64;
+
+        static const BlueNoise& get();
+
+        const uint32_t* data() const { return values.data(); }
+        size_t getCount() const { return values.size(); }
+    private:
+        BlueNoise();
+
+        std::vector<uint32_t> values;
+    };
+}
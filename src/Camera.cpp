@@ -1,4 +1,8 @@
 ﻿#include "Camera.h"
+
+#include <cmath>
+#include <numbers>
+
 #include "glm/gtc/matrix_transform.hpp"
 
 namespace raytracer {
@@ -7,6 +11,10 @@ namespace raytracer {
         updateCameraVectors();
     }
 
+    float Camera::getFocalLength(uint32_t height) {
+        return static_cast<float>(tan(45.0 / 180.0 * std::numbers::pi)) * 0.5f * static_cast<float>(height);
+    }
+
     void Camera::update(float dt, GLFWwindow* window) {
         lastPosition = position;
 
@@ -42,6 +50,18 @@ namespace raytracer {
         lastEulerRotation = eulerRotation;
     }
 
+    void Camera::setPose(glm::vec3 position, glm::vec2 eulerRotation, GLFWwindow* window) {
+        this->position = lastPosition = position;
+        this->eulerRotation = lastEulerRotation = eulerRotation;
+        updateCameraVectors();
+        if (window) {
+            double mx, my;
+            glfwGetCursorPos(window, &mx, &my);
+            lastMousePosition = glm::vec2(mx, my);
+        }
+        hasMoved = false;
+    }
+
     glm::mat3 Camera::getViewMatrix() {
         return { right, up, forward };
     }
@@ -12,6 +12,11 @@ namespace raytracer {
         glm::mat3 getViewMatrix();
 
         glm::vec3 getPosition() const { return position; }
+        // In pixels, of an image height pixels tall; the field of view is the same for every size.
+        static float getFocalLength(uint32_t height);
+        // Puts the camera somewhere without that counting as a move. With a window the mouse is taken
+        // to be where it is now, so the next update doesn't turn the camera by all of it.
+        void setPose(glm::vec3 position, glm::vec2 eulerRotation, GLFWwindow* window = nullptr);
 
         bool hasMoved = false;
         glm::vec2 eulerRotation;
@@ -0,0 +1,125 @@
+﻿#include "Checkpoint.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+
+namespace raytracer {
+    namespace {
+        constexpr char magic[4] = { 'R', 'T', 'C', 'K' };
+        constexpr uint32_t version = 2;
+
+        // as it is on disk, little-endian like ImageFile's maps
+        struct FileHeader {
+            char magic[4];
+            uint32_t version;
+            uint32_t width, height;
+            uint32_t frameIndex, frameCount;
+            uint64_t totalSamples;
+            double seconds;
+            float camera[5];        // position, then yaw and pitch
+            uint32_t settingsKey;
+            uint32_t hasVariance;
+            uint32_t sceneKey;
+            uint32_t gpu;
+            uint32_t accumFormat;
+        };
+        static_assert(sizeof(FileHeader) == 80);
+    }
+
+    uint32_t Checkpoint::getSettingsKey(const FrameSettings& settings) {
+        const uint32_t flags = settings.nextEventEstimation | settings.lightTree << 1 | settings.restir << 2 |
+                               settings.radianceCache << 3 | settings.pathGuiding << 4 | settings.adaptiveSampling << 5 |
+                               settings.reprojection << 6;
+        uint32_t threshold;
+        std::memcpy(&threshold, &settings.adaptiveThreshold, sizeof(threshold));
+        uint32_t key = 0;
+        for (const uint32_t value : { static_cast<uint32_t>(settings.samplesPerPixel), static_cast<uint32_t>(settings.maxBounces),
+                                      static_cast<uint32_t>(settings.sampler), static_cast<uint32_t>(settings.rouletteDepth),
+                                      static_cast<uint32_t>(settings.radianceCacheDepth), settings.adaptiveMinSamples,
+                                      threshold, flags })
+            key = Sampling::hashCombine(key, value);
+        return key;
+    }
+
+    uint32_t Checkpoint::getSceneKey(const Scene& scene, const std::string& environmentPath) {
+        uint32_t key = 0;
+        for (const char c : environmentPath)
+            key = Sampling::hashCombine(key, static_cast<unsigned char>(c));
+        for (const size_t count : { scene.spheres.size(), scene.triangles.size(), scene.meshes.size(),
+                                    scene.lights.lights.size(), scene.environment.getTexelCount() })
+            key = Sampling::hashCombine(key, static_cast<uint32_t>(count));
+        return key;
+    }
+
+    bool Checkpoint::save(const std::string& path, const vec4* accumulation, const vec4* variance) const {
+        const FileHeader header = {
+            { magic[0], magic[1], magic[2], magic[3] }, version, resolution.x, resolution.y, frameIndex, frameCount,
+            totalSamples, seconds,
+            { cameraPosition.x, cameraPosition.y, cameraPosition.z, cameraRotation.x, cameraRotation.y },
+            settingsKey, hasVariance ? 1u : 0u, source.sceneKey, source.gpu ? 1u : 0u, source.accumFormat
+        };
+        const std::string temporary = path + ".tmp";
+        std::FILE* file = std::fopen(temporary.c_str(), "wb");
+        if (!file)
+            return false;
+        const size_t pixels = static_cast<size_t>(resolution.x) * resolution.y;
+        bool written = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+                       std::fwrite(accumulation, sizeof(vec4), pixels, file) == pixels;
+        if (hasVariance)
+            written = written && std::fwrite(variance, sizeof(vec4), pixels, file) == pixels;
+        written = std::fclose(file) == 0 && written;
+        std::error_code error;
+        if (written)
+            std::filesystem::rename(temporary, path, error);
+        return written && !error;
+    }
+
+    bool Checkpoint::load(const std::string& path, std::vector<vec4>& accumulation, std::vector<vec4>& variance) {
+        std::FILE* file = std::fopen(path.c_str(), "rb");
+        if (!file)
+            return false;
+        FileHeader header;
+        bool read = std::fread(&header, sizeof(header), 1, file) == 1 && std::memcmp(header.magic, magic, sizeof(magic)) == 0 &&
+                    header.version == version;
+        if (read) {
+            resolution = uvec2(header.width, header.height);
+            frameIndex = header.frameIndex;
+            frameCount = header.frameCount;
+            totalSamples = header.totalSamples;
+            seconds = header.seconds;
+            cameraPosition = vec3(header.camera[0], header.camera[1], header.camera[2]);
+            cameraRotation = vec2(header.camera[3], header.camera[4]);
+            settingsKey = header.settingsKey;
+            source = { header.sceneKey, header.gpu != 0, header.accumFormat };
+            hasVariance = header.hasVariance != 0;
+            const size_t pixels = static_cast<size_t>(resolution.x) * resolution.y;
+            accumulation.resize(pixels);
+            variance.resize(hasVariance ? pixels : 0);
+            read = std::fread(accumulation.data(), sizeof(vec4), pixels, file) == pixels &&
+                   std::fread(variance.data(), sizeof(vec4), variance.size(), file) == variance.size();
+        }
+        std::fclose(file);
+        return read;
+    }
+
+    void CheckpointWriter::save(const std::string& path, const Checkpoint& checkpoint, const vec4* accumulation,
+                                const vec4* variance) {
+        wait();
+        // a checkpoint isn't dropped, it waits for room in the writer's queue
+        auto saved = std::make_shared<std::promise<bool>>();
+        saving = saved->get_future();
+        writer.submit([=] { return checkpoint.save(path, accumulation, variance); },
+                      [saved](bool written) { saved->set_value(written); }, true);
+    }
+
+    bool CheckpointWriter::isBusy() const {
+        return saving.valid() && saving.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+    }
+
+    bool CheckpointWriter::wait() {
+        return !saving.valid() || saving.get();
+    }
+}
@@ -0,0 +1,68 @@
+﻿#pragma once
+#include <cstdint>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "ImageWriter.h"
+#include "cpu/Integrator.h"
+#include "glm/glm.hpp"
+using namespace glm;
+
+namespace raytracer {
+    // What a progressive render needs to go on exactly where it stopped: the accumulation, vec4s with
+    // the samples in w as far as its format counts them (1 from r11g11b10f), the pixel statistics where
+    // they are kept, and the counters that number the next frame's samples. What is learned along the
+    // way, resampling history, the radiance cache and the path guide, is not kept and is learned again.
+    struct Checkpoint {
+        // What rendered the frames besides the settings. The images only go on in a render of the same
+        // scene on the same backend, whose accumulation rounds and counts samples alike.
+        struct Source {
+            uint32_t sceneKey = 0;      // getSceneKey
+            bool gpu = false;           // the backend
+            uint32_t accumFormat = 0;   // the GL internal format the GPU accumulated in, 0 on the CPU
+        };
+
+        uvec2 resolution = uvec2(0);
+        uint32_t frameIndex = 0;    // of the next frame
+        uint32_t frameCount = 0;
+        uint64_t totalSamples = 0;
+        double seconds = 0.0;       // rendered so far, which a time budget counts on from
+        vec3 cameraPosition = vec3(0.0f);
+        vec2 cameraRotation = vec2(0.0f); // Camera::eulerRotation
+        uint32_t settingsKey = 0;   // getSettingsKey of the frames, only the same settings go on with it
+        Source source;
+        bool hasVariance = false;
+
+        // Of the settings that change what a frame adds, so a checkpoint isn't resumed with others.
+        static uint32_t getSettingsKey(const FrameSettings& settings);
+        // Of the scene: the path of its environment map, --env, and how many objects, lights and texels
+        // it has. The objects are those of Scene::createDefault, so their counts tell it from an edit.
+        static uint32_t getSceneKey(const Scene& scene, const std::string& environmentPath);
+
+        // Writes a compact binary file of the header and the pixels, resolution of them in either, to
+        // a temporary file first that then replaces path, so a render killed while saving keeps its last
+        // checkpoint. variance is ignored without hasVariance.
+        bool save(const std::string& path, const vec4* accumulation, const vec4* variance) const;
+        // Reads back what save() wrote, false if path is no checkpoint or it is cut short.
+        bool load(const std::string& path, std::vector<vec4>& accumulation, std::vector<vec4>& variance);
+    };
+
+    // Saves checkpoints through an ImageWriter while the render goes on. One is saved at a time.
+    class CheckpointWriter {
+    public:
+        explicit CheckpointWriter(ImageWriter& writer): writer(writer) { }
+        ~CheckpointWriter() { wait(); }
+        CheckpointWriter(const CheckpointWriter&) = delete;
+        CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+        // Starts saving; the pixels must stay as they are until isBusy() says it is done.
+        void save(const std::string& path, const Checkpoint& checkpoint, const vec4* accumulation, const vec4* variance);
+        bool isBusy() const;
+        // Waits for the checkpoint being saved, false if it could not be. True with nothing to wait for.
+        bool wait();
+    private:
+        ImageWriter& writer;
+        std::future<bool> saving;
+    };
+}
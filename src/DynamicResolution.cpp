@@ -0,0 +1,40 @@
+﻿#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace raytracer {
+    namespace {
+        constexpr double smoothing = 0.25;  // weight of the newest frame
+    }
+
+    float DynamicResolution::update(bool moving, double lastFrameSeconds) {
+        if (!isEnabled())
+            return 1.0f;
+
+        // the last frame ran at the scale it was given
+        if (lastFrameSeconds > 0.0) {
+            const double fullFrame = lastFrameSeconds / (static_cast<double>(scale) * scale);
+            fullFrameSeconds = measured ? mix(fullFrameSeconds, fullFrame, smoothing) : fullFrame;
+            frameSeconds = measured ? mix(frameSeconds, lastFrameSeconds, smoothing) : lastFrameSeconds;
+            measured = true;
+        }
+
+        sinceMoved = moving ? 0.0 : sinceMoved + lastFrameSeconds;
+        if (sinceMoved >= stillSeconds || !measured) {
+            scale = 1.0f;
+            return scale;
+        }
+        if (!moving)
+            return scale;
+
+        const auto wanted = static_cast<float>(std::sqrt(targetSeconds / fullFrameSeconds));
+        if (std::abs(wanted - scale) >= step)
+            scale = std::clamp(std::floor(wanted / step) * step, minScale, 1.0f);
+        return scale;
+    }
+
+    uvec2 DynamicResolution::apply(uvec2 size) const {
+        return max(uvec2(vec2(size) * scale + 0.5f), uvec2(1));
+    }
+}
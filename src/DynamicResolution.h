@@ -0,0 +1,43 @@
+﻿#pragma once
+#include <cstdint>
+
+#include "glm/glm.hpp"
+using namespace glm;
+
+namespace raytracer {
+    // Picks how much of the window to trace while the camera moves, so that frames take about
+    // targetSeconds, and gives full resolution back once it stands still. Frame time is taken to
+    // follow the pixel count: the time per pixel at full resolution is tracked on every frame, still
+    // ones included, so the first moving frame already starts at about the right scale. The scale
+    // steps in sixteenths of the window and only moves when it is a step or more off, since every
+    // change starts the image over.
+    class DynamicResolution {
+    public:
+        static constexpr float minScale = 0.25f;       // of the window's width and height
+        static constexpr float step = 1.0f / 16.0f;
+        static constexpr double stillSeconds = 0.2;     // before full resolution comes back, so pauses between mouse moves don't restart the image
+
+        explicit DynamicResolution(double targetSeconds = 0.0): targetSeconds(targetSeconds) { }
+
+        bool isEnabled() const { return targetSeconds > 0.0; }
+
+        // Called once a frame before tracing, with how long the last one took; returns the scale to
+        // trace this one at. Always 1 while disabled.
+        float update(bool moving, double lastFrameSeconds);
+
+        // The part of a window size to trace, at least a pixel.
+        uvec2 apply(uvec2 size) const;
+
+        float getScale() const { return scale; }
+        double getTargetSeconds() const { return targetSeconds; }
+        // Smoothed over the last frames, for the stats.
+        double getFrameSeconds() const { return frameSeconds; }
+    private:
+        double targetSeconds;
+        float scale = 1.0f;
+        double fullFrameSeconds = 0.0;  // what a frame would take at scale 1, smoothed
+        double frameSeconds = 0.0;
+        double sinceMoved = 0.0;
+        bool measured = false;
+    };
+}
@@ -0,0 +1,372 @@
+﻿#include "Environment.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "JobSystem.h"
+#include "misc/Logger.h"
+
+namespace raytracer {
+    namespace {
+        constexpr float pi = 3.14159265359f;
+
+        // 2^(e - 136) for every RGBE exponent, with 0 for black
+        const std::array<float, 256>& getRgbeScales() {
+            static const std::array<float, 256> scales = [] {
+                std::array<float, 256> table{};
+                for (int e = 1; e < 256; ++e)
+                    table[e] = std::ldexp(1.0f, e - 136);
+                return table;
+            }();
+            return scales;
+        }
+
+        // Vose's method: buckets below the average are topped up from one above it, which then
+        // continues with what is left. small and large are scratch space.
+        void buildAliasTable(const double* weights, uint32_t count, double total, AliasEntry* table,
+                             std::vector<double>& scaled, std::vector<uint32_t>& small, std::vector<uint32_t>& large) {
+            scaled.resize(count);
+            small.clear();
+            large.clear();
+            for (uint32_t i = 0; i < count; ++i) {
+                table[i] = { 1.0f, i, total > 0.0 ? static_cast<float>(weights[i] / total) : 0.0f };
+                scaled[i] = total > 0.0 ? weights[i] * count / total : 1.0;
+                (scaled[i] < 1.0 ? small : large).push_back(i);
+            }
+
+            while (!small.empty() && !large.empty()) {
+                const uint32_t below = small.back(), above = large.back();
+                small.pop_back();
+                large.pop_back();
+                table[below].threshold = static_cast<float>(scaled[below]);
+                table[below].alias = above;
+                scaled[above] = scaled[above] + scaled[below] - 1.0;
+                (scaled[above] < 1.0 ? small : large).push_back(above);
+            }
+            // whatever is left is 1 up to rounding and keeps its default of never taking the alias
+        }
+
+        // Picks a bucket with u and hands back what is left of it as a fresh uniform number.
+        uint32_t sampleAlias(const AliasEntry* table, uint32_t count, float u, float& remainder) {
+            const float scaled = u * static_cast<float>(count);
+            const uint32_t index = std::min(static_cast<uint32_t>(scaled), count - 1);
+            const float fraction = scaled - static_cast<float>(index);
+            const AliasEntry& entry = table[index];
+            if (fraction < entry.threshold) {
+                remainder = std::min(fraction / entry.threshold, 0x1.fffffep-1f);
+                return index;
+            }
+            remainder = std::min((fraction - entry.threshold) / (1.0f - entry.threshold), 0x1.fffffep-1f);
+            return entry.alias;
+        }
+
+        struct FileData {
+            std::unique_ptr<uint8_t[]> bytes;
+            size_t size = 0;
+        };
+
+        // In chunks on every worker, copying a large file out of the OS cache is a good part of the load.
+        bool readFile(const std::string& path, FileData& file) {
+            std::error_code error;
+            const auto size = std::filesystem::file_size(path, error);
+            if (error || size == 0)
+                return false;
+
+            file.size = static_cast<size_t>(size);
+            file.bytes = std::make_unique_for_overwrite<uint8_t[]>(file.size);
+            std::atomic<bool> complete = true;
+            JobSystem::parallelForRange(0, file.size, size_t(32) << 20, [&](size_t first, size_t end) {
+                std::ifstream in(path, std::ios::binary);
+                in.seekg(static_cast<std::streamoff>(first));
+                if (!in.read(reinterpret_cast<char*>(file.bytes.get() + first), static_cast<std::streamsize>(end - first)))
+                    complete = false;
+            });
+            return complete;
+        }
+
+        bool isNewRleScanline(const uint8_t* data, size_t remaining, uint32_t width) {
+            return width >= 8 && width < 32768 && remaining >= 4 && data[0] == 2 && data[1] == 2 && (data[2] & 0x80) == 0;
+        }
+
+        // Radiance RGBE, the layout every HDR capture tool writes: header lines up to a blank one,
+        // "-Y height +X width", then one scanline after another, run-length coded per channel. Only
+        // the end of a scanline says where the next starts, so one pass walks the run headers to find
+        // them and the scanlines are then decoded in parallel. Returns false for anything it doesn't
+        // handle, which stb_image then gets to try.
+        bool loadRadiance(const FileData& file, Environment& environment) {
+            const uint8_t* data = file.bytes.get();
+            const size_t size = file.size;
+            if (size < 2 || data[0] != '#' || data[1] != '?')
+                return false;
+
+            size_t position = 0;
+            auto readLine = [&](std::string& line) {
+                line.clear();
+                while (position < size && data[position] != '\n')
+                    line.push_back(static_cast<char>(data[position++]));
+                return position++ < size;
+            };
+
+            std::string line;
+            while (readLine(line) && !line.empty()) {
+                if (line.rfind("FORMAT=", 0) == 0 && line != "FORMAT=32-bit_rle_rgbe")
+                    return false;
+            }
+            int height = 0, width = 0;
+            if (!readLine(line) || std::sscanf(line.c_str(), "-Y %d +X %d", &height, &width) != 2 || width <= 0 || height <= 0)
+                return false;
+
+            const auto w = static_cast<uint32_t>(width), h = static_cast<uint32_t>(height);
+            std::vector<size_t> offsets(h);
+            for (uint32_t y = 0; y < h; ++y) {
+                // a truncated file ends before its scanlines do, the last literal run may have gone past it
+                if (position >= size)
+                    return false;
+                offsets[y] = position;
+                if (!isNewRleScanline(data + position, size - position, w)) {
+                    if (size - position < 4 * static_cast<size_t>(w))
+                        return false;
+                    position += 4 * static_cast<size_t>(w);
+                    continue;
+                }
+                if ((static_cast<uint32_t>(data[position + 2]) << 8 | data[position + 3]) != w)
+                    return false;
+                position += 4;
+                for (int channel = 0; channel < 4; ++channel) {
+                    for (uint32_t x = 0; x < w;) {
+                        if (position >= size)
+                            return false;
+                        const uint32_t code = data[position++];
+                        const uint32_t count = code > 128 ? code - 128 : code;
+                        if (count == 0 || x + count > w)
+                            return false;
+                        position += code > 128 ? 1 : count;
+                        x += count;
+                    }
+                }
+            }
+            if (position > size)
+                return false;
+
+            environment.width = w;
+            environment.height = h;
+            environment.texels = std::make_unique_for_overwrite<uint32_t[]>(static_cast<size_t>(w) * h);
+            JobSystem::parallelForRange(0, h, 16, [&](size_t first, size_t end) {
+                std::vector<uint8_t> channels(4 * static_cast<size_t>(w));
+                for (size_t y = first; y < end; ++y) {
+                    const uint8_t* in = data + offsets[y];
+                    uint32_t* out = environment.texels.get() + y * w;
+                    if (!isNewRleScanline(in, size - offsets[y], w)) {
+                        for (uint32_t x = 0; x < w; ++x, in += 4)
+                            out[x] = in[0] | in[1] << 8 | in[2] << 16 | static_cast<uint32_t>(in[3]) << 24;
+                        continue;
+                    }
+
+                    in += 4;
+                    for (int channel = 0; channel < 4; ++channel) {
+                        uint8_t* plane = channels.data() + channel * w;
+                        for (uint32_t x = 0; x < w;) {
+                            const uint32_t code = *in++;
+                            if (code > 128) {
+                                std::memset(plane + x, *in++, code - 128);
+                                x += code - 128;
+                            } else {
+                                std::memcpy(plane + x, in, code);
+                                in += code;
+                                x += code;
+                            }
+                        }
+                    }
+                    for (uint32_t x = 0; x < w; ++x) {
+                        out[x] = channels[x] | channels[w + x] << 8 | channels[2 * w + x] << 16 |
+                                 static_cast<uint32_t>(channels[3 * w + x]) << 24;
+                    }
+                }
+            });
+            return true;
+        }
+    }
+
+    bool Environment::load(const std::string& path) {
+        const auto start = std::chrono::high_resolution_clock::now();
+        FileData file;
+        if (!readFile(path, file)) {
+            ERR("Failed to read environment %s!", path.c_str());
+            return false;
+        }
+
+        if (!loadRadiance(file, *this)) {
+            int w = 0, h = 0, channels = 0;
+            float* rgb = stbi_loadf_from_memory(file.bytes.get(), static_cast<int>(file.size), &w, &h, &channels, 3);
+            if (!rgb) {
+                ERR("Failed to load environment %s!: %s", path.c_str(), stbi_failure_reason());
+                return false;
+            }
+            file = {};
+            setPixels(static_cast<uint32_t>(w), static_cast<uint32_t>(h), rgb);
+            stbi_image_free(rgb);
+        } else {
+            file = {};
+            buildDistribution();
+        }
+
+        const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        INFO("Loaded environment %s (%ux%u, %ux%u sampling blocks) in %.0f ms.", path.c_str(), width, height, blocksX,
+             blocksY, seconds * 1e3);
+        return true;
+    }
+
+    void Environment::setPixels(uint32_t w, uint32_t h, const float* rgb) {
+        width = w;
+        height = h;
+        texels = std::make_unique_for_overwrite<uint32_t[]>(static_cast<size_t>(w) * h);
+        JobSystem::parallelFor(0, getTexelCount(), 1 << 16, [&](size_t i) {
+            texels[i] = encode(vec3(rgb[3 * i], rgb[3 * i + 1], rgb[3 * i + 2]));
+        });
+        buildDistribution();
+    }
+
+    void Environment::buildDistribution() {
+        // about 2K blocks across, enough to resolve the sun while keeping the tables a few MB
+        blockShift = 0;
+        while ((width >> blockShift) > 2048)
+            ++blockShift;
+        const uint32_t blockSize = 1u << blockShift;
+        blocksX = (width + blockSize - 1) >> blockShift;
+        blocksY = (height + blockSize - 1) >> blockShift;
+
+        const std::array<float, 256>& scales = getRgbeScales();
+        std::vector<double> weights(static_cast<size_t>(blocksX) * blocksY, 0.0), rowWeights(blocksY, 0.0);
+        JobSystem::parallelFor(0, blocksY, 4, [&](size_t by) {
+            double* row = weights.data() + by * blocksX;
+            const uint32_t end = std::min(height, static_cast<uint32_t>(by + 1) << blockShift);
+            for (uint32_t y = static_cast<uint32_t>(by) << blockShift; y < end; ++y) {
+                // texels shrink toward the poles
+                const float sinTheta = std::sin(pi * (static_cast<float>(y) + 0.5f) / static_cast<float>(height));
+                const uint32_t* texel = texels.get() + static_cast<size_t>(y) * width;
+                for (uint32_t x = 0; x < width; ++x) {
+                    const uint32_t rgbe = texel[x];
+                    const float luminance = 0.2126f * static_cast<float>(rgbe & 0xff) + 0.7152f * static_cast<float>(rgbe >> 8 & 0xff) +
+                                            0.0722f * static_cast<float>(rgbe >> 16 & 0xff);
+                    row[x >> blockShift] += luminance * scales[rgbe >> 24] * sinTheta;
+                }
+            }
+            for (uint32_t bx = 0; bx < blocksX; ++bx)
+                rowWeights[by] += row[bx];
+        });
+
+        double total = 0.0;
+        for (const double weight : rowWeights)
+            total += weight;
+
+        blocks.resize(weights.size());
+        JobSystem::parallelForRange(0, blocksY, 16, [&](size_t first, size_t end) {
+            std::vector<double> scaled;
+            std::vector<uint32_t> small, large;
+            for (size_t by = first; by < end; ++by) {
+                // thresholds come from the row alone, pmf is of the block overall
+                AliasEntry* table = blocks.data() + by * blocksX;
+                buildAliasTable(weights.data() + by * blocksX, blocksX, rowWeights[by], table, scaled, small, large);
+                for (uint32_t bx = 0; bx < blocksX; ++bx)
+                    table[bx].pmf = total > 0.0 ? static_cast<float>(weights[by * blocksX + bx] / total) : 0.0f;
+            }
+        });
+
+        std::vector<double> scaled;
+        std::vector<uint32_t> small, large;
+        rows.resize(blocksY);
+        buildAliasTable(rowWeights.data(), blocksY, total, rows.data(), scaled, small, large);
+    }
+
+    vec3 Environment::lookup(vec3 direction) const {
+        const vec2 uv = toUV(direction);
+        const uint32_t x = std::min(static_cast<uint32_t>(uv.x * static_cast<float>(width)), width - 1);
+        const uint32_t y = std::min(static_cast<uint32_t>(uv.y * static_cast<float>(height)), height - 1);
+        return decode(texels[static_cast<size_t>(y) * width + x]);
+    }
+
+    float Environment::getPdf(vec3 direction) const {
+        const float sinTheta = std::sqrt(std::max(0.0f, 1.0f - direction.y * direction.y));
+        if (sinTheta <= 0.0f)
+            return 0.0f;
+
+        const vec2 uv = toUV(direction);
+        const uint32_t x = std::min(static_cast<uint32_t>(uv.x * static_cast<float>(width)), width - 1);
+        const uint32_t y = std::min(static_cast<uint32_t>(uv.y * static_cast<float>(height)), height - 1);
+        const uint32_t bx = x >> blockShift, by = y >> blockShift;
+        const uint32_t blockWidth = std::min(width, (bx + 1) << blockShift) - (bx << blockShift);
+        const uint32_t blockHeight = std::min(height, (by + 1) << blockShift) - (by << blockShift);
+        const float texelsPerBlock = static_cast<float>(blockWidth) * static_cast<float>(blockHeight);
+        // from block probability to density over the image, then over the sphere
+        return blocks[by * blocksX + bx].pmf * static_cast<float>(width) * static_cast<float>(height) / texelsPerBlock /
+               (2.0f * pi * pi * sinTheta);
+    }
+
+    bool Environment::sample(vec2 u, vec3& direction, vec3& radiance, float& pdf) const {
+        vec2 inBlock;
+        const uint32_t by = sampleAlias(rows.data(), blocksY, u.y, inBlock.y);
+        const uint32_t bx = sampleAlias(blocks.data() + static_cast<size_t>(by) * blocksX, blocksX, u.x, inBlock.x);
+        const float pmf = blocks[by * blocksX + bx].pmf;
+        if (pmf <= 0.0f)
+            return false;
+
+        const uint32_t firstX = bx << blockShift, firstY = by << blockShift;
+        const uint32_t blockWidth = std::min(width, firstX + (1u << blockShift)) - firstX;
+        const uint32_t blockHeight = std::min(height, firstY + (1u << blockShift)) - firstY;
+        const vec2 uv = (vec2(firstX, firstY) + inBlock * vec2(blockWidth, blockHeight)) / vec2(width, height);
+        const float sinTheta = std::sin(pi * uv.y);
+        if (sinTheta <= 0.0f)
+            return false;
+
+        direction = fromUV(uv);
+        const uint32_t x = firstX + std::min(static_cast<uint32_t>(inBlock.x * static_cast<float>(blockWidth)), blockWidth - 1);
+        const uint32_t y = firstY + std::min(static_cast<uint32_t>(inBlock.y * static_cast<float>(blockHeight)), blockHeight - 1);
+        radiance = decode(texels[static_cast<size_t>(y) * width + x]);
+        pdf = pmf * static_cast<float>(width) * static_cast<float>(height) /
+              (static_cast<float>(blockWidth) * static_cast<float>(blockHeight)) / (2.0f * pi * pi * sinTheta);
+        return true;
+    }
+
+    vec3 Environment::decode(uint32_t rgbe) {
+        const uint32_t exponent = rgbe >> 24;
+        if (exponent == 0)
+            return vec3(0.0f);
+        const float scale = std::ldexp(1.0f, static_cast<int>(exponent) - 136);
+        return vec3(static_cast<float>(rgbe & 0xff), static_cast<float>(rgbe >> 8 & 0xff),
+                    static_cast<float>(rgbe >> 16 & 0xff)) * scale;
+    }
+
+    uint32_t Environment::encode(vec3 rgb) {
+        const float maximum = std::max(rgb.r, std::max(rgb.g, rgb.b));
+        if (!(maximum >= 1e-32f))
+            return 0;
+        int exponent;
+        const float scale = std::frexp(maximum, &exponent) * 256.0f / maximum;
+        if (exponent > 127)
+            return 0xffffffffu;
+        const uvec3 mantissa = uvec3(max(rgb, vec3(0.0f)) * scale);
+        return mantissa.r | mantissa.g << 8 | mantissa.b << 16 | static_cast<uint32_t>(exponent + 128) << 24;
+    }
+
+    vec2 Environment::toUV(vec3 direction) {
+        return vec2(std::atan2(direction.x, -direction.z) * (0.5f / pi) + 0.5f,
+                    std::acos(std::clamp(direction.y, -1.0f, 1.0f)) / pi);
+    }
+
+    vec3 Environment::fromUV(vec2 uv) {
+        const float phi = 2.0f * pi * (uv.x - 0.5f), theta = pi * uv.y;
+        const float sinTheta = std::sin(theta);
+        return vec3(sinTheta * std::sin(phi), std::cos(theta), -sinTheta * std::cos(phi));
+    }
+}
@@ -0,0 +1,62 @@
+﻿#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+using namespace glm;
+
+namespace raytracer {
+    // One bucket of an alias table (Vose, "A Linear Algorithm for Generating Random Numbers with a
+    // Given Distribution", 1991), in the layout of the environment distribution buffer.
+    struct AliasEntry {
+        float threshold;    // a uniform pick of this bucket keeps it below this, else takes alias
+        uint32_t alias;
+        float pmf;          // probability of ending up in this bucket, either way
+    };
+
+    // Equirectangular HDR environment. Texels stay RGBE, as they come out of a Radiance file, so the
+    // CPU and raytracer.comp decode the same bits and a 16K map is 512 MB instead of 2 GB.
+    //
+    // Importance sampling picks a block of texels in proportion to luminance times sin(theta) with
+    // two alias table lookups, one over block rows and one within the row, then a uniform point
+    // inside the block. Large maps use blocks of several texels so the tables stay small.
+    struct Environment {
+        uint32_t width = 0, height = 0;
+        // RGBE, red in the low byte, shared by copies of the scene. Left uninitialized until decoded,
+        // zeroing half a gigabyte up front would take longer than decoding into it.
+        std::shared_ptr<uint32_t[]> texels;
+
+        uint32_t blockShift = 0;        // log2 of the block size in texels
+        uint32_t blocksX = 0, blocksY = 0;
+        std::vector<AliasEntry> rows;   // blocksY entries
+        std::vector<AliasEntry> blocks; // blocksX entries per block row
+
+        bool isLoaded() const { return width > 0; }
+        size_t getTexelCount() const { return static_cast<size_t>(width) * height; }
+
+        // Radiance .hdr files are decoded in parallel by scanline, anything else goes through
+        // stb_image. Builds the sampling tables too, so the map can be used right away.
+        bool load(const std::string& path);
+        // Takes over linear RGB floats, width * height * 3 of them, and builds the tables.
+        void setPixels(uint32_t width, uint32_t height, const float* rgb);
+
+        vec3 lookup(vec3 direction) const;
+
+        // Solid angle pdf of sample() returning direction.
+        float getPdf(vec3 direction) const;
+
+        // Picks a direction in proportion to the radiance arriving from it. Fails for a black map.
+        bool sample(vec2 u, vec3& direction, vec3& radiance, float& pdf) const;
+
+        static vec3 decode(uint32_t rgbe);
+        static uint32_t encode(vec3 rgb);
+        // Directions map to u = atan2(x, -z) / 2pi + 1/2 and v = acos(y) / pi, so -z is in the middle
+        // of the image and +y along its top edge.
+        static vec2 toUV(vec3 direction);
+        static vec3 fromUV(vec2 uv);
+    private:
+        void buildDistribution();
+    };
+}
@@ -0,0 +1,34 @@
+﻿#include "FrameBudget.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace raytracer {
+    namespace {
+        constexpr double smoothing = 0.25;  // weight of the newest measurement
+    }
+
+    uint32_t FrameBudget::getPasses(bool moving) const {
+        if (!isEnabled() || moving || passSeconds <= 0.0)
+            return 1;
+        const double passes = std::floor((budgetSeconds - overheadSeconds) / passSeconds);
+        return static_cast<uint32_t>(std::clamp(passes, 1.0, static_cast<double>(maxPasses)));
+    }
+
+    void FrameBudget::addPassTime(uint32_t passes, double seconds) {
+        if (passes == 0 || seconds <= 0.0)
+            return;
+        const double pass = seconds / passes;
+        passSeconds = passSeconds > 0.0 ? passSeconds + (pass - passSeconds) * smoothing : pass;
+    }
+
+    void FrameBudget::finishFrame(uint32_t passes, double seconds) {
+        if (!isEnabled() || seconds <= 0.0)
+            return;
+        frameSeconds = frameSeconds > 0.0 ? frameSeconds + (seconds - frameSeconds) * smoothing : seconds;
+        if (passSeconds <= 0.0)
+            return;
+        const double overhead = std::max(seconds - passes * passSeconds, 0.0);
+        overheadSeconds += (overhead - overheadSeconds) * smoothing;
+    }
+}
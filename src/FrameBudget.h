@@ -0,0 +1,38 @@
+﻿#pragma once
+#include <cstdint>
+
+namespace raytracer {
+    // Picks how many accumulation passes to trace before presenting a frame, so that frames with a
+    // still camera take about budgetSeconds however cheap or heavy a pass is. Frame time is taken as an
+    // overhead, the display pass, the denoiser and presenting, plus the passes times what one costs;
+    // both are tracked, and the passes are what fits in the budget after the overhead. The samples
+    // per pixel of a pass stay as they are, which keeps the numbering of the samples, and so the image,
+    // the same however the passes fall on frames.
+    class FrameBudget {
+    public:
+        static constexpr uint32_t maxPasses = 64;
+
+        explicit FrameBudget(double budgetSeconds = 0.0): budgetSeconds(budgetSeconds) { }
+
+        bool isEnabled() const { return budgetSeconds > 0.0; }
+
+        // Passes to trace this frame: one while disabled, while the camera moves, where the frame
+        // should show it as soon as it can, and until a pass has been measured.
+        uint32_t getPasses(bool moving) const;
+
+        // What passes cost, measured on the CPU or by GPU timer queries that come back frames later.
+        void addPassTime(uint32_t passes, double seconds);
+        // Called once a frame after presenting, with the passes it traced and how long it took.
+        void finishFrame(uint32_t passes, double seconds);
+
+        double getBudgetSeconds() const { return budgetSeconds; }
+        // Smoothed over the last frames, for the stats.
+        double getFrameSeconds() const { return frameSeconds; }
+        double getPassSeconds() const { return passSeconds; }
+    private:
+        double budgetSeconds;
+        double passSeconds = 0.0;
+        double overheadSeconds = 0.0;
+        double frameSeconds = 0.0;
+    };
+}
@@ -0,0 +1,251 @@
+﻿#include "GpuState.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "BlueNoise.h"
+#include "misc/Logger.h"
+
+namespace raytracer {
+    // A buffer of bytes at binding that stays the same for the whole render.
+    static GLuint createStaticBuffer(GLuint binding, const void* data, size_t bytes) {
+        GLuint buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(bytes), data, GL_STATIC_DRAW);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffer);
+        return buffer;
+    }
+
+    std::string GpuState::selectAccumulationFormat(std::string format, bool reprojection) {
+        if (format == "r11g11b10f" && reprojection) {
+            WARN("Reprojection carries samples over in the alpha, which r11g11b10f has no room for; using rgba16f.");
+            format = "rgba16f";
+        }
+        if (format == "rgba16f") {
+            accumFormat = RenderTargets::rgba16f;
+            accumExactSamples = false;
+            return "#define ACCUM_FORMAT rgba16f\n#define ACCUM_SAMPLES 1\n#define ACCUM_EXACT_SAMPLES 0\n"
+                   "#define ACCUM_MANTISSA vec3(10.0)\n";
+        }
+        if (format == "r11g11b10f") {
+            accumFormat = RenderTargets::r11g11b10f;
+            accumExactSamples = false;
+            return "#define ACCUM_FORMAT r11f_g11f_b10f\n#define ACCUM_SAMPLES 0\n#define ACCUM_EXACT_SAMPLES 0\n"
+                   "#define ACCUM_MANTISSA vec3(6.0, 6.0, 5.0)\n";
+        }
+        if (format != "rgba32f")
+            WARN("Unknown accumulation format '%s', using rgba32f.", format.c_str());
+        return "";
+    }
+
+    void GpuState::uploadScene(const Scene& scene) {
+        sphereSSBO = createStaticBuffer(0, scene.spheres.data(), scene.spheres.size() * sizeof(Sphere));
+        triangleSSBO = createStaticBuffer(1, scene.triangles.data(), scene.triangles.size() * sizeof(Triangle));
+        meshSSBO = createStaticBuffer(2, scene.meshes.data(), scene.meshes.size() * sizeof(MeshInfo));
+        nodeSSBO = createStaticBuffer(3, scene.nodes.data(), scene.nodes.size() * sizeof(BVHNode));
+        const BlueNoise& blueNoise = BlueNoise::get();
+        blueNoiseSSBO = createStaticBuffer(4, blueNoise.data(), blueNoise.getCount() * sizeof(uint32_t));
+
+        const LightSet& lights = scene.lights;
+        const Light noLight{};
+        lightSSBO = createStaticBuffer(5, lights.lights.empty() ? &noLight : lights.lights.data(),
+                                       std::max<size_t>(lights.lights.size(), 1) * sizeof(Light));
+        const LightNode noLightNode{};
+        lightNodeSSBO = createStaticBuffer(6, lights.nodes.empty() ? &noLightNode : lights.nodes.data(),
+                                           std::max<size_t>(lights.nodes.size(), 1) * sizeof(LightNode));
+        INFO("%zu lights for next-event estimation, %zu light tree nodes.", lights.lights.size(), lights.nodes.size());
+
+        // rows then blocks, as raytracer.comp indexes them
+        const Environment& environment = scene.environment;
+        std::vector<AliasEntry> environmentAlias = environment.rows;
+        environmentAlias.insert(environmentAlias.end(), environment.blocks.begin(), environment.blocks.end());
+        if (environmentAlias.empty())
+            environmentAlias.push_back({});
+        const uint32_t noTexel = 0;
+        environmentSSBO = createStaticBuffer(7, environment.isLoaded() ? environment.texels.get() : &noTexel,
+                                             std::max<size_t>(environment.getTexelCount(), 1) * sizeof(uint32_t));
+        environmentAliasSSBO = createStaticBuffer(8, environmentAlias.data(), environmentAlias.size() * sizeof(AliasEntry));
+    }
+
+    void GpuState::createBuffers(const FrameSettings& settings) {
+        glGenBuffers(1, &reservoirSSBO);
+        glGenBuffers(1, &reservoirHistorySSBO);
+        glGenBuffers(1, &tileSSBO);
+        glGenBuffers(1, &radianceCacheSSBO);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, radianceCacheSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER,
+                     (settings.radianceCache ? RadianceCache::capacity : 1) * sizeof(RadianceCacheEntry), nullptr,
+                     GL_DYNAMIC_COPY);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    }
+
+    void GpuState::setUniforms(Shader& shader, const Scene& scene, const FrameSettings& settings, bool trackVariance,
+                               bool useAovs) const {
+        const LightSet& lights = scene.lights;
+        const Environment& environment = scene.environment;
+        shader.useCompute();
+        shader.setInt("maxBounces", settings.maxBounces, true);
+        shader.setInt("rouletteDepth", settings.rouletteDepth, true);
+        shader.setInt("samplesPerPixel", settings.samplesPerPixel, true);
+        shader.setInt("samplerType", static_cast<int>(settings.sampler), true);
+        shader.setBool("nextEventEstimation", settings.nextEventEstimation, true);
+        shader.setBool("lightTree", settings.lightTree, true);
+        shader.setBool("restir", settings.restir, true);
+        shader.setBool("radianceCache", settings.radianceCache, true);
+        shader.setInt("radianceCacheDepth", settings.radianceCacheDepth, true);
+        shader.setBool("radianceCacheResolve", false, true);
+        shader.setBool("trackVariance", trackVariance, true);
+        shader.setBool("adaptiveSampling", settings.adaptiveSampling, true);
+        shader.setBool("adaptiveClassify", false, true);
+        shader.setFloat("adaptiveThreshold", settings.adaptiveThreshold, true);
+        shader.setFloat("adaptiveMinSamples", static_cast<float>(settings.adaptiveMinSamples), true);
+        shader.setBool("reproject", false, true);
+        shader.setBool("aovs", useAovs, true);
+        shader.setInt("lightCount", lights.totalWeight > 0.0f ? static_cast<int>(lights.lights.size()) : 0, true);
+        shader.setFloat("totalLightWeight", lights.totalWeight, true);
+        shader.setUIVector2("environmentSize", environment.width, environment.height, true);
+        shader.setUIVector2("environmentBlocks", environment.blocksX, environment.blocksY, true);
+        shader.setUInt("environmentBlockShift", environment.blockShift, true);
+        shader.setFloat("environmentProbability", scene.getEnvironmentSampleProbability(), true);
+    }
+
+    void GpuState::bind() const {
+        glBindImageTexture(0, accumTexture, 0, GL_FALSE, 0, GL_READ_WRITE, accumFormat.internalFormat);
+        glBindImageTexture(1, varianceTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+        glBindImageTexture(5, albedoTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+        glBindImageTexture(6, normalDepthTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+        glBindImageTexture(7, idTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG32UI);
+        const GLuint buffers[] = { sphereSSBO, triangleSSBO, meshSSBO, nodeSSBO, blueNoiseSSBO, lightSSBO, lightNodeSSBO,
+                                   environmentSSBO, environmentAliasSSBO, reservoirSSBO, reservoirHistorySSBO,
+                                   radianceCacheSSBO, tileSSBO };
+        for (GLuint binding = 0; binding < std::size(buffers); ++binding)
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffers[binding]);
+    }
+
+    void GpuState::traceFrame(Shader& shader, const FrameSettings& settings, uvec2 size, uint32_t frameIndex,
+                              uint32_t frameCount) {
+        const GLuint gx = (size.x + 7u) / 8u;
+        const GLuint gy = (size.y + 7u) / 8u;
+        shader.setUInt("renderedFrames", static_cast<int>(frameIndex), true);
+        shader.setBool("restirHistory", reservoirHistoryValid, true);
+        // camera samples since the render last started over, see raytracer.comp
+        if (!accumExactSamples)
+            shader.setFloat("accumulatedSamples", static_cast<float>(frameCount * settings.samplesPerPixel), true);
+        if (settings.adaptiveSampling) {
+            // lists the tiles with a pixel left to trace, every pass below runs over just those
+            const uint32_t groups[3] = { 0, 1, 1 };
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, tileSSBO);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(groups), groups);
+            shader.setBool("adaptiveClassify", true, true);
+            glDispatchCompute(gx, gy, 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+            shader.setBool("adaptiveClassify", false, true);
+            glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, tileSSBO);
+        }
+
+        // resampling takes three passes, each reading what the one before wrote for other pixels
+        const int resamplingPasses = settings.restir ? 3 : 1;
+        for (int restirPass = 0; restirPass < resamplingPasses; ++restirPass) {
+            shader.setInt("restirPass", restirPass, true);
+            if (settings.adaptiveSampling)
+                glDispatchComputeIndirect(0);
+            else
+                glDispatchCompute(gx, gy, 1);
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+        }
+        reservoirHistoryValid = settings.restir;
+
+        // what the paths added to the cache shows from the next frame on
+        if (settings.radianceCache) {
+            shader.setBool("radianceCacheResolve", true, true);
+            glDispatchCompute(RadianceCache::capacity / 64u, 1, 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+            shader.setBool("radianceCacheResolve", false, true);
+        }
+    }
+
+    void GpuState::resizeAccumulation(uvec2 size) {
+        renderTargets.resize(accumTexture, size, accumFormat);
+    }
+
+    void GpuState::resizeReprojection(uvec2 size) {
+        renderTargets.resize(historyTexture, size, accumFormat);
+        for (GLuint* texture : { &geometryTexture, &historyGeometryTexture })
+            renderTargets.resize(*texture, size, RenderTargets::rgba32f);
+    }
+
+    void GpuState::resizeAovs(uvec2 size) {
+        renderTargets.resize(albedoTexture, size, RenderTargets::rgba32f);
+        renderTargets.resize(normalDepthTexture, size, RenderTargets::rgba32f);
+        renderTargets.resize(idTexture, size, RenderTargets::rg32ui);
+    }
+
+    void GpuState::resizeDenoiser(uvec2 size) {
+        for (GLuint& texture : denoiseTextures)
+            renderTargets.resize(texture, size, RenderTargets::rgba32f);
+    }
+
+    void GpuState::resizeVariance(uvec2 size) {
+        renderTargets.resize(varianceTexture, size, RenderTargets::rgba32f);
+        const size_t tiles = static_cast<size_t>((size.x + 7) / 8) * ((size.y + 7) / 8);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, tileSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>((5 + tiles) * sizeof(uint32_t)), nullptr, GL_DYNAMIC_COPY);
+    }
+
+    void GpuState::resizeReservoirs(uvec2 size) {
+        const size_t count = pixelReservoirs ? static_cast<size_t>(size.x) * size.y : 1;
+        for (const GLuint buffer : { reservoirSSBO, reservoirHistorySSBO }) {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(count * sizeof(Reservoir)), nullptr, GL_DYNAMIC_COPY);
+        }
+        reservoirHistoryValid = false;
+    }
+
+    bool GpuState::resize(uvec2 size) {
+        if (targetSize == size)
+            return false;
+        targetSize = size;
+        resizeAccumulation(size);
+        if (reservoirSSBO)
+            resizeReservoirs(size);
+        if (tileSSBO)
+            resizeVariance(size);
+        if (historyTexture)
+            resizeReprojection(size);
+        if (albedoTexture)
+            resizeAovs(size);
+        if (denoiseTextures[0])
+            resizeDenoiser(size);
+        renderTargets.trim();
+        return true;
+    }
+
+    void GpuState::clearStatistics() const {
+        const float zero[4] = {0,0,0,0};
+        if (varianceTexture)
+            glClearTexImage(varianceTexture, 0, GL_RGBA, GL_FLOAT, zero);
+        for (const GLuint texture : { albedoTexture, normalDepthTexture }) {
+            if (texture)
+                glClearTexImage(texture, 0, GL_RGBA, GL_FLOAT, zero);
+        }
+        if (idTexture)
+            glClearTexImage(idTexture, 0, GL_RG_INTEGER, GL_UNSIGNED_INT, nullptr);
+        if (tileSSBO) {
+            const uint32_t header[5] = { 0, 1, 1, 0, 0 };
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, tileSSBO);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(header), header);
+        }
+    }
+
+    void GpuState::clearAccumulation() const {
+        const float zero[4] = {0,0,0,0};
+        if (accumTexture)
+            glClearTexImage(accumTexture, 0, GL_RGBA, GL_FLOAT, zero);
+    }
+
+    void GpuState::logRenderTargets() const {
+        INFO("Render targets: %.1f MiB in use, %.1f MiB pooled, %zu textures.", renderTargets.getUsedBytes() / 1048576.0,
+             renderTargets.getPooledBytes() / 1048576.0, renderTargets.getTextureCount());
+    }
+}
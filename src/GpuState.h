@@ -0,0 +1,95 @@
+﻿#pragma once
+#include <cstdint>
+#include <string>
+
+#include "RenderTargets.h"
+#include "Scene.h"
+#include "Shader.h"
+#include "cpu/Integrator.h"
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+using namespace glm;
+
+namespace raytracer {
+    // The GL objects of a render on the GPU, where raytracer.comp has them: the scene's buffers, uploaded
+    // once, and the images and buffers of a pixel each, sized together. The window's loop, its
+    // checkpoints and captures share one. Everything here is for the thread with the GL context.
+    struct GpuState {
+        RenderTargets renderTargets;    // every image below, the buffers are kept by hand
+        uvec2 targetSize = uvec2(0);    // what the images were last sized for
+        RenderTargets::Format accumFormat = RenderTargets::rgba32f; // and historyTexture's
+        bool accumExactSamples = true;  // whether its alpha counts the samples exactly, see raytracer.comp
+        bool pixelReservoirs = false;   // one reservoir per pixel, for resampling, a placeholder otherwise
+        bool reservoirHistoryValid = false;
+
+        // the scene, bindings 0 to 8
+        GLuint sphereSSBO = 0;
+        GLuint triangleSSBO = 0;
+        GLuint meshSSBO = 0;
+        GLuint nodeSSBO = 0;
+        GLuint blueNoiseSSBO = 0;
+        GLuint lightSSBO = 0;
+        GLuint lightNodeSSBO = 0;
+        GLuint environmentSSBO = 0;
+        GLuint environmentAliasSSBO = 0;
+        // 9 to 12
+        GLuint reservoirSSBO = 0;
+        GLuint reservoirHistorySSBO = 0;
+        GLuint radianceCacheSSBO = 0;
+        GLuint tileSSBO = 0;            // the adaptive tile list and sample counter, see clearStatistics
+
+        GLuint accumTexture = 0;
+        GLuint varianceTexture = 0;
+        GLuint historyTexture = 0;
+        GLuint geometryTexture = 0;
+        GLuint historyGeometryTexture = 0;
+        GLuint albedoTexture = 0;
+        GLuint normalDepthTexture = 0;
+        GLuint idTexture = 0;
+        GLuint denoiseTextures[2] = {};  // the filter's passes take turns writing them, the last one the second
+
+        // Sets accumFormat for --accum-format and returns the defines raytracer.comp needs for it. Half
+        // floats halve the accumulation's traffic; their alpha counts samples exactly only up to 2048, so
+        // the weights follow the pass's 32 bit counts, see raytracer.comp. R11G11B10F quarters it, but has
+        // no alpha for the samples reprojection carries over.
+        std::string selectAccumulationFormat(std::string format, bool reprojection);
+        // Uploads the scene. The lights and the environment are never empty, so their buffers can be
+        // bound without any.
+        void uploadScene(const Scene& scene);
+        // Creates the buffers the shader has whatever it is set to; the radiance cache's is only as
+        // large as the cache with settings.radianceCache. The per pixel ones get a size from resize*.
+        void createBuffers(const FrameSettings& settings);
+        // Sets the uniforms that stay the same for the whole render.
+        void setUniforms(Shader& shader, const Scene& scene, const FrameSettings& settings, bool trackVariance,
+                         bool useAovs) const;
+        // Binds every image and buffer where raytracer.comp has them, but the reprojection history.
+        void bind() const;
+        // Traces a frame of the bottom left size of the images with the shader in use and bound: lists
+        // the tiles left to trace with adaptive sampling, then the resampling passes, then resolves what
+        // the paths added to the radiance cache. frameCount is of the frames since the render last
+        // started over, see raytracer.comp. Adaptive frames are counted on the GPU, see clearStatistics.
+        void traceFrame(Shader& shader, const FrameSettings& settings, uvec2 size, uint32_t frameIndex,
+                        uint32_t frameCount);
+
+        void resizeAccumulation(uvec2 size);
+        // The last view's accumulation and the surfaces of both views, swapped with the live ones on every move.
+        void resizeReprojection(uvec2 size);
+        // The first-hit AOVs the raytracer fills, see AovBuffers.
+        void resizeAovs(uvec2 size);
+        void resizeDenoiser(uvec2 size);
+        // Pixel statistics next to the accumulation, and room for a list entry per 8x8 tile after the
+        // header of the tile buffer.
+        void resizeVariance(uvec2 size);
+        // See pixelReservoirs. The history goes with the old size.
+        void resizeReservoirs(uvec2 size);
+        // Sizes everything the render has for size. Nothing is reallocated while the size stays the
+        // same, and the old size's images are let go of; false if it did.
+        bool resize(uvec2 size);
+
+        // Clears the statistics, the AOVs and the tile buffer, whose header is the indirect dispatch of
+        // no tiles followed by the 64 bit sample counter of adaptive frames.
+        void clearStatistics() const;
+        void clearAccumulation() const;
+        void logRenderTargets() const;
+    };
+}
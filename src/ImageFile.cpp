@@ -0,0 +1,52 @@
+﻿#include "ImageFile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <vector>
+
+namespace raytracer {
+    bool ImageFile::writePfm(const std::string& path, uvec2 resolution, int channels, const float* data, size_t stride) {
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        if (!file)
+            return false;
+        // a negative scale says little-endian
+        std::fprintf(file, "%s\n%u %u\n-1.0\n", channels == 1 ? "Pf" : "PF", resolution.x, resolution.y);
+        std::vector<float> row(static_cast<size_t>(resolution.x) * channels);
+        bool written = true;
+        for (uint32_t y = 0; y < resolution.y && written; ++y) {
+            const float* pixel = data + static_cast<size_t>(y) * resolution.x * stride;
+            for (uint32_t x = 0; x < resolution.x; ++x, pixel += stride) {
+                for (int c = 0; c < channels; ++c)
+                    row[static_cast<size_t>(x) * channels + c] = pixel[c];
+            }
+            written = std::fwrite(row.data(), sizeof(float), row.size(), file) == row.size();
+        }
+        return std::fclose(file) == 0 && written;
+    }
+
+    bool ImageFile::writeAovs(const std::string& path, uvec2 resolution, const vec4* albedo, const vec4* normalDepth,
+                              const uvec2* id) {
+        const size_t pixels = static_cast<size_t>(resolution.x) * resolution.y;
+        std::vector<vec3> ids(pixels);
+        std::transform(id, id + pixels, ids.begin(), [](uvec2 value) { return vec3(value, 0.0f); });
+        const struct {
+            const char* name;
+            int channels;
+            const float* data;
+            size_t stride;
+        } images[] = {
+            { "albedo", 3, &albedo[0].x, 4 },
+            { "normal", 3, &normalDepth[0].x, 4 },
+            { "depth", 1, &normalDepth[0].w, 4 },
+            { "id", 3, &ids[0].x, 3 },
+        };
+        bool written = true;
+        for (const auto& image : images) {
+            std::filesystem::path imagePath = path;
+            imagePath.replace_extension(std::string(image.name) + ".pfm");
+            written = writePfm(imagePath.string(), resolution, image.channels, image.data, image.stride) && written;
+        }
+        return written;
+    }
+}
@@ -0,0 +1,21 @@
+﻿#pragma once
+#include <cstddef>
+#include <string>
+
+#include "glm/glm.hpp"
+using namespace glm;
+
+namespace raytracer {
+    // Writing images out to disk.
+    class ImageFile {
+    public:
+        // Writes a little-endian Portable Float Map: the first channels (1 or 3) of every pixel, pixels
+        // stride floats apart, resolution.x of them to a row and the bottom row first, as the
+        // accumulation has them. The floats are kept as they are, so AOVs and HDR colour survive.
+        static bool writePfm(const std::string& path, uvec2 resolution, int channels, const float* data, size_t stride);
+        // Writes the first-hit AOVs in the layout of AovBuffers next to an image at path, as
+        // <name>.albedo.pfm, .normal.pfm, .depth.pfm and .id.pfm; false if any of them could not be.
+        static bool writeAovs(const std::string& path, uvec2 resolution, const vec4* albedo, const vec4* normalDepth,
+                              const uvec2* id);
+    };
+}
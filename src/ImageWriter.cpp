@@ -0,0 +1,366 @@
+﻿#include "ImageWriter.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+#include "ImageFile.h"
+#include "cpu/Kernels.h"
+#include "misc/Utility.h"
+
+namespace raytracer {
+    namespace {
+        // Every format below but PFM has the top row first.
+        const float* getRow(const ImageWriter::Image& image, uint32_t topRow) {
+            return image.rgba + static_cast<size_t>(image.size.y - 1 - topRow) * image.size.x * 4;
+        }
+
+        void putLittle32(std::vector<uint8_t>& out, uint32_t value) {
+            for (int i = 0; i < 4; ++i)
+                out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+
+        void putBig32(std::vector<uint8_t>& out, uint32_t value) {
+            for (int i = 3; i >= 0; --i)
+                out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+
+        // Rounds to the nearest half float, ties to even, the way F16C does but a few times slower than
+        // it rather than the dozens of glm::packHalf1x16 (after Giesen's float_to_half_fast3_rtne).
+        uint16_t toHalf(float value) {
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            const uint32_t sign = bits >> 16 & 0x8000;
+            bits &= 0x7fffffff;
+            if (bits >= (127 + 16) << 23)                      // too large for a half, or infinite or NaN
+                return static_cast<uint16_t>(sign | (bits > 255u << 23 ? 0x7e00 : 0x7c00));
+            if (bits < 113 << 23) {                             // a denormal half: the float adds rounding it
+                constexpr uint32_t magicBits = ((127 - 15) + (23 - 10) + 1) << 23;
+                float magic;
+                std::memcpy(&magic, &magicBits, sizeof(magic));
+                const float sum = std::fabs(value) + magic;
+                std::memcpy(&bits, &sum, sizeof(bits));
+                return static_cast<uint16_t>(sign | (bits - magicBits));
+            }
+            bits += ((15u - 127u) << 23) + 0xfff + (bits >> 13 & 1);
+            return static_cast<uint16_t>(sign | bits >> 13);
+        }
+
+        // Uncompressed scanline OpenEXR of half-float B, G and R channels, the minimum of attributes
+        // the format requires.
+        bool writeExr(const ImageWriter::Image& image) {
+            const uint32_t width = image.size.x, height = image.size.y;
+            std::vector<uint8_t> header = { 0x76, 0x2f, 0x31, 0x01, 2, 0, 0, 0 };
+            const auto attribute = [&](const char* name, const char* type, const std::vector<uint8_t>& value) {
+                header.insert(header.end(), name, name + std::strlen(name) + 1);
+                header.insert(header.end(), type, type + std::strlen(type) + 1);
+                putLittle32(header, static_cast<uint32_t>(value.size()));
+                header.insert(header.end(), value.begin(), value.end());
+            };
+            const auto values = [](std::initializer_list<uint32_t> words) {
+                std::vector<uint8_t> bytes;
+                for (const uint32_t word : words)
+                    putLittle32(bytes, word);
+                return bytes;
+            };
+            std::vector<uint8_t> channels;
+            for (const char* name : { "B", "G", "R" }) {
+                channels.push_back(static_cast<uint8_t>(name[0]));
+                channels.push_back(0);
+                // half, not linear, reserved, one sample per pixel both ways
+                const std::vector<uint8_t> description = values({ 1, 0, 1, 1 });
+                channels.insert(channels.end(), description.begin(), description.end());
+            }
+            channels.push_back(0);
+            uint32_t one, zero = 0;
+            const float unit = 1.0f;
+            std::memcpy(&one, &unit, sizeof(one));
+            const std::vector<uint8_t> window = values({ 0, 0, width - 1, height - 1 });
+            attribute("channels", "chlist", channels);
+            attribute("compression", "compression", { 0 });
+            attribute("dataWindow", "box2i", window);
+            attribute("displayWindow", "box2i", window);
+            attribute("lineOrder", "lineOrder", { 0 });
+            attribute("pixelAspectRatio", "float", values({ one }));
+            attribute("screenWindowCenter", "v2f", values({ zero, zero }));
+            attribute("screenWindowWidth", "float", values({ one }));
+            header.push_back(0);
+
+            // every line is its y, its size and the channels one after the other
+            const uint32_t lineBytes = width * 3 * sizeof(uint16_t);
+            const uint64_t firstLine = header.size() + static_cast<uint64_t>(height) * sizeof(uint64_t);
+            for (uint32_t y = 0; y < height; ++y) {
+                const uint64_t offset = firstLine + static_cast<uint64_t>(y) * (8 + lineBytes);
+                putLittle32(header, static_cast<uint32_t>(offset));
+                putLittle32(header, static_cast<uint32_t>(offset >> 32));
+            }
+
+            std::FILE* file = std::fopen(image.path.c_str(), "wb");
+            if (!file)
+                return false;
+            bool written = std::fwrite(header.data(), 1, header.size(), file) == header.size();
+            std::vector<uint8_t> line;
+            for (uint32_t y = 0; y < height && written; ++y) {
+                line.clear();
+                putLittle32(line, y);
+                putLittle32(line, lineBytes);
+                line.resize(8 + lineBytes);
+                const float* row = getRow(image, y);
+                for (uint32_t x = 0; x < width; ++x) {
+                    for (int channel = 0; channel < 3; ++channel) {
+                        const uint16_t half = toHalf(row[4 * x + 2 - channel]);
+                        uint8_t* bytes = &line[8 + 2 * (static_cast<size_t>(channel) * width + x)];
+                        bytes[0] = static_cast<uint8_t>(half);
+                        bytes[1] = static_cast<uint8_t>(half >> 8);
+                    }
+                }
+                written = std::fwrite(line.data(), 1, line.size(), file) == line.size();
+            }
+            return std::fclose(file) == 0 && written;
+        }
+
+        uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size) {
+            static const std::array<uint32_t, 256> table = [] {
+                std::array<uint32_t, 256> t{};
+                for (uint32_t i = 0; i < 256; ++i) {
+                    uint32_t value = i;
+                    for (int bit = 0; bit < 8; ++bit)
+                        value = value & 1 ? 0xedb88320u ^ (value >> 1) : value >> 1;
+                    t[i] = value;
+                }
+                return t;
+            }();
+            crc = ~crc;
+            for (size_t i = 0; i < size; ++i)
+                crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+            return ~crc;
+        }
+
+        void putPngChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data) {
+            putBig32(out, static_cast<uint32_t>(data.size()));
+            const size_t start = out.size();
+            out.insert(out.end(), type, type + 4);
+            out.insert(out.end(), data.begin(), data.end());
+            putBig32(out, crc32(0, out.data() + start, out.size() - start));
+        }
+
+        // 8-bit RGB PNG. Without a deflate implementation at hand the lines are stored in
+        // uncompressed deflate blocks, which keeps encoding about as cheap as copying; QOI is the
+        // format for small files.
+        bool writePng(const ImageWriter::Image& image, const std::vector<uint8_t>& rgba8) {
+            const uint32_t width = image.size.x, height = image.size.y;
+            const size_t lineBytes = 1 + static_cast<size_t>(width) * 3;
+            std::vector<uint8_t> lines(lineBytes * height);
+            for (uint32_t y = 0; y < height; ++y) {
+                uint8_t* line = &lines[y * lineBytes];
+                const uint8_t* pixel = &rgba8[static_cast<size_t>(height - 1 - y) * width * 4];
+                *line++ = 0;    // no filter
+                for (uint32_t x = 0; x < width; ++x, pixel += 4, line += 3)
+                    std::memcpy(line, pixel, 3);
+            }
+
+            constexpr size_t maxBlock = 65535;
+            std::vector<uint8_t> stream = { 0x78, 0x01 };
+            stream.reserve(lines.size() + lines.size() / maxBlock * 5 + 16);
+            uint32_t a = 1, b = 0;
+            for (size_t start = 0; start < lines.size(); start += maxBlock) {
+                const size_t size = std::min(maxBlock, lines.size() - start);
+                const uint16_t length = static_cast<uint16_t>(size);
+                stream.push_back(start + size == lines.size() ? 1 : 0);
+                stream.push_back(static_cast<uint8_t>(length));
+                stream.push_back(static_cast<uint8_t>(length >> 8));
+                stream.push_back(static_cast<uint8_t>(~length));
+                stream.push_back(static_cast<uint8_t>(~length >> 8));
+                stream.insert(stream.end(), lines.begin() + static_cast<ptrdiff_t>(start),
+                              lines.begin() + static_cast<ptrdiff_t>(start + size));
+                // Adler-32, the sums reduced every 5552 bytes, the most b takes without overflowing
+                for (size_t chunk = start; chunk < start + size; chunk += 5552) {
+                    for (size_t i = chunk; i < std::min(chunk + 5552, start + size); ++i) {
+                        a += lines[i];
+                        b += a;
+                    }
+                    a %= 65521;
+                    b %= 65521;
+                }
+            }
+            putBig32(stream, b << 16 | a);
+
+            std::vector<uint8_t> header;
+            putBig32(header, width);
+            putBig32(header, height);
+            header.insert(header.end(), { 8, 2, 0, 0, 0 }); // 8 bits of RGB, deflate, no filters, no interlacing
+            std::vector<uint8_t> file = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+            file.reserve(stream.size() + 64);
+            putPngChunk(file, "IHDR", header);
+            putPngChunk(file, "IDAT", stream);
+            putPngChunk(file, "IEND", {});
+            return Utils::writeFile(image.path.c_str(), reinterpret_cast<const char*>(file.data()), file.size());
+        }
+
+        // The Quite OK Image format (Szablewski, 2021), RGB.
+        bool writeQoi(const ImageWriter::Image& image, const std::vector<uint8_t>& rgba8) {
+            const uint32_t width = image.size.x, height = image.size.y;
+            std::vector<uint8_t> out = { 'q', 'o', 'i', 'f' };
+            out.reserve(static_cast<size_t>(width) * height * 2);
+            putBig32(out, width);
+            putBig32(out, height);
+            out.insert(out.end(), { 3, 0 });    // RGB, sRGB
+
+            std::array<uint32_t, 64> seen{};
+            uint8_t previous[4] = { 0, 0, 0, 255 };
+            uint32_t run = 0;
+            for (uint32_t y = 0; y < height; ++y) {
+                const uint8_t* pixel = &rgba8[static_cast<size_t>(height - 1 - y) * width * 4];
+                for (uint32_t x = 0; x < width; ++x, pixel += 4) {
+                    if (std::memcmp(pixel, previous, 4) == 0) {
+                        if (++run == 62 || (y == height - 1 && x == width - 1)) {
+                            out.push_back(static_cast<uint8_t>(0xc0 | (run - 1)));
+                            run = 0;
+                        }
+                        continue;
+                    }
+                    if (run > 0) {
+                        out.push_back(static_cast<uint8_t>(0xc0 | (run - 1)));
+                        run = 0;
+                    }
+                    const uint8_t r = pixel[0], g = pixel[1], b = pixel[2], alpha = pixel[3];
+                    const uint32_t hash = (r * 3 + g * 5 + b * 7 + alpha * 11) % 64;
+                    uint32_t packed;
+                    std::memcpy(&packed, pixel, 4);
+                    if (seen[hash] == packed) {
+                        out.push_back(static_cast<uint8_t>(hash));
+                    } else {
+                        seen[hash] = packed;
+                        // differences wrap around, as bytes do
+                        const int dr = static_cast<int8_t>(r - previous[0]);
+                        const int dg = static_cast<int8_t>(g - previous[1]);
+                        const int db = static_cast<int8_t>(b - previous[2]);
+                        const int drg = dr - dg, dbg = db - dg;
+                        if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                            out.push_back(static_cast<uint8_t>(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+                        } else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7) {
+                            out.push_back(static_cast<uint8_t>(0x80 | (dg + 32)));
+                            out.push_back(static_cast<uint8_t>((drg + 8) << 4 | (dbg + 8)));
+                        } else {
+                            out.insert(out.end(), { 0xfe, r, g, b });
+                        }
+                    }
+                    std::memcpy(previous, pixel, 4);
+                }
+            }
+            out.insert(out.end(), { 0, 0, 0, 0, 0, 0, 0, 1 });
+            return Utils::writeFile(image.path.c_str(), reinterpret_cast<const char*>(out.data()), out.size());
+        }
+    }
+
+    ImageWriter::ImageWriter(unsigned threads, size_t maxQueued):
+        threads(std::max(threads, 1u)), maxQueued(std::max<size_t>(maxQueued, 1)) {
+    }
+
+    ImageWriter::~ImageWriter() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        changed.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    std::optional<ImageWriter::Format> ImageWriter::getFormat(const std::string& path) {
+        std::string extension = std::filesystem::path(path).extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+                       [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+        for (const Format format : { Format::Pfm, Format::Exr, Format::Png, Format::Qoi }) {
+            if (extension == getExtension(format))
+                return format;
+        }
+        return std::nullopt;
+    }
+
+    const char* ImageWriter::getExtension(Format format) {
+        switch (format) {
+            case Format::Pfm: return ".pfm";
+            case Format::Exr: return ".exr";
+            case Format::Png: return ".png";
+            case Format::Qoi: return ".qoi";
+        }
+        return "";
+    }
+
+    bool ImageWriter::save(const Image& image) {
+        const std::optional<Format> format = getFormat(image.path);
+        if (!format || image.size.x == 0 || image.size.y == 0)
+            return false;
+        bool written;
+        if (*format == Format::Pfm) {
+            written = ImageFile::writePfm(image.path, image.size, 3, image.rgba, 4);
+        } else if (*format == Format::Exr) {
+            written = writeExr(image);
+        } else {
+            std::vector<uint8_t> rgba8(static_cast<size_t>(image.size.x) * image.size.y * 4);
+            Kernels::get().convertToRgba8(image.rgba, rgba8.data(), static_cast<size_t>(image.size.x) * image.size.y);
+            written = *format == Format::Png ? writePng(image, rgba8) : writeQoi(image, rgba8);
+        }
+        if (image.albedo && image.normalDepth && image.id)
+            written = ImageFile::writeAovs(image.path, image.size, image.albedo, image.normalDepth, image.id) && written;
+        return written;
+    }
+
+    bool ImageWriter::submit(std::function<bool()> job, std::function<void(bool written)> done, bool wait) {
+        {
+            std::unique_lock lock(mutex);
+            if (workers.empty()) {
+                for (unsigned i = 0; i < threads; ++i)
+                    workers.emplace_back(&ImageWriter::run, this);
+            }
+            if (wait)
+                changed.wait(lock, [&] { return queue.size() < maxQueued; });
+            if (queue.size() >= maxQueued) {
+                ++rejectedJobs;
+                return false;
+            }
+            queue.push_back({ std::move(job), std::move(done) });
+        }
+        changed.notify_all();
+        return true;
+    }
+
+    bool ImageWriter::write(Image image, bool wait) {
+        std::function<void(bool written)> done = std::move(image.done);
+        return submit([image = std::move(image)] { return save(image); }, std::move(done), wait);
+    }
+
+    void ImageWriter::wait() {
+        std::unique_lock lock(mutex);
+        changed.wait(lock, [&] { return queue.empty() && busyWorkers == 0; });
+    }
+
+    void ImageWriter::run() {
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock lock(mutex);
+                changed.wait(lock, [&] { return stopping || !queue.empty(); });
+                if (queue.empty())
+                    return;
+                job = std::move(queue.front());
+                queue.pop_front();
+                ++busyWorkers;
+            }
+            changed.notify_all();
+            const bool written = job.write();
+            ++(written ? writtenJobs : failedJobs);
+            if (job.done)
+                job.done(written);
+            {
+                std::lock_guard lock(mutex);
+                --busyWorkers;
+            }
+            changed.notify_all();
+        }
+    }
+}
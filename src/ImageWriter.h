@@ -0,0 +1,83 @@
+﻿#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "glm/glm.hpp"
+using namespace glm;
+
+namespace raytracer {
+    // The stage that writes files off the render thread, the one place besides the JobSystem with
+    // threads of its own: they spend their time blocked in the file system, which would stall the
+    // workers that trace. Captured frames, the tiles of tiled renders and checkpoints all queue their
+    // writes here. Jobs wait in a queue of bounded length, and one that finds it full is turned away
+    // rather than making whoever renders wait, unless they ask to. The threads start with the first
+    // job.
+    //
+    // Images are saved in the format the extension of their path names: .pfm and .exr keep the colour
+    // as it is, in floats and in half floats, .png and .qoi take it as display.frag shows it,
+    // gamma-encoded to 8 bits by Kernels::convertToRgba8.
+    class ImageWriter {
+    public:
+        enum class Format { Pfm, Exr, Png, Qoi };
+
+        struct Image {
+            std::string path;
+            uvec2 size = uvec2(0);
+            const float* rgba = nullptr;    // size of RGBA pixels, the bottom row first as the accumulation has them
+            // the first-hit AOVs, saved next to the image as ImageFile::writeAovs does where given
+            const vec4* albedo = nullptr;
+            const vec4* normalDepth = nullptr;
+            const uvec2* id = nullptr;
+            // called on a worker once the pixels aren't read any more, with whether all of it was saved
+            std::function<void(bool written)> done;
+        };
+
+        explicit ImageWriter(unsigned threads = 2, size_t maxQueued = 8);
+        ~ImageWriter();
+        ImageWriter(const ImageWriter&) = delete;
+        ImageWriter& operator=(const ImageWriter&) = delete;
+
+        static std::optional<Format> getFormat(const std::string& path);
+        static const char* getExtension(Format format);
+        // Saves an image on the calling thread, done is not called.
+        static bool save(const Image& image);
+
+        // Queues a job that writes a file and returns whether it could, false if the queue is full and
+        // it shouldn't wait. done is called on the worker after the job, only for a job that was queued.
+        bool submit(std::function<bool()> job, std::function<void(bool written)> done = {}, bool wait = false);
+        // Queues save(image) with image.done as the job's done.
+        bool write(Image image, bool wait = false);
+        // Waits for every queued job to be done.
+        void wait();
+
+        uint64_t getWrittenJobs() const { return writtenJobs; }
+        uint64_t getFailedJobs() const { return failedJobs; }
+        uint64_t getRejectedJobs() const { return rejectedJobs; }
+    private:
+        struct Job {
+            std::function<bool()> write;
+            std::function<void(bool written)> done;
+        };
+
+        void run();
+
+        unsigned threads;
+        size_t maxQueued;
+        std::deque<Job> queue;
+        uint32_t busyWorkers = 0;
+        bool stopping = false;
+        std::atomic<uint64_t> writtenJobs = 0, failedJobs = 0, rejectedJobs = 0;
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::vector<std::thread> workers;
+    };
+}
@@ -0,0 +1,273 @@
+﻿#include "JobSystem.h"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <thread>
+
+#include "misc/Logger.h"
+
+namespace raytracer {
+    struct Task {
+        std::function<void()> fn;
+        TaskGroup* group;
+        bool isContinuation;
+    };
+
+    namespace {
+        // Chase-Lev deque: the owning worker pushes and pops at the bottom, thieves take from the top.
+        class WorkStealingDeque {
+        public:
+            static constexpr int64_t capacity = 8192;
+
+            bool push(Task* task) {
+                const int64_t b = bottom.load(std::memory_order_relaxed);
+                const int64_t t = top.load(std::memory_order_acquire);
+                if (b - t >= capacity)
+                    return false;
+                buffer[b & (capacity - 1)].store(task, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return true;
+            }
+
+            Task* pop() {
+                const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+                bottom.store(b, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                int64_t t = top.load(std::memory_order_relaxed);
+                if (t > b) {
+                    bottom.store(b + 1, std::memory_order_relaxed);
+                    return nullptr;
+                }
+
+                Task* task = buffer[b & (capacity - 1)].load(std::memory_order_relaxed);
+                if (t == b) {
+                    // last element, race against thieves for it
+                    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                        task = nullptr;
+                    bottom.store(b + 1, std::memory_order_relaxed);
+                }
+                return task;
+            }
+
+            Task* steal() {
+                int64_t t = top.load(std::memory_order_acquire);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                const int64_t b = bottom.load(std::memory_order_acquire);
+                if (t >= b)
+                    return nullptr;
+
+                Task* task = buffer[t & (capacity - 1)].load(std::memory_order_relaxed);
+                if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                    return nullptr;
+                return task;
+            }
+
+        private:
+            alignas(64) std::atomic<int64_t> top{0};
+            alignas(64) std::atomic<int64_t> bottom{0};
+            std::atomic<Task*> buffer[capacity]{};
+        };
+
+        std::vector<std::unique_ptr<WorkStealingDeque>> deques;
+        std::vector<std::thread> threads;
+        unsigned workerCount = 0;
+
+        // tasks submitted from threads outside the pool
+        std::mutex injectionMutex;
+        std::deque<Task*> injectionQueue;
+
+        std::atomic<int> queuedTasks{0};
+        std::atomic<int> sleepingWorkers{0};
+        std::atomic<bool> quit{false};
+        std::mutex sleepMutex;
+        std::condition_variable wakeCondition;
+
+        thread_local int workerIndex = -1;
+    }
+
+    static void enqueue(Task* task) {
+        if (workerIndex < 0 || !deques[workerIndex]->push(task)) {
+            std::lock_guard lock(injectionMutex);
+            injectionQueue.push_back(task);
+        }
+
+        queuedTasks.fetch_add(1);
+        if (sleepingWorkers.load() > 0) {
+            std::lock_guard lock(sleepMutex);
+            wakeCondition.notify_one();
+        }
+    }
+
+    static Task* findTask() {
+        Task* task = nullptr;
+        if (workerIndex >= 0)
+            task = deques[workerIndex]->pop();
+
+        if (!task) {
+            std::lock_guard lock(injectionMutex);
+            if (!injectionQueue.empty()) {
+                task = injectionQueue.front();
+                injectionQueue.pop_front();
+            }
+        }
+
+        if (!task) {
+            const unsigned start = workerIndex >= 0 ? static_cast<unsigned>(workerIndex) + 1 : 0;
+            for (unsigned i = 0; i < workerCount && !task; ++i) {
+                const unsigned victim = (start + i) % workerCount;
+                if (static_cast<int>(victim) != workerIndex)
+                    task = deques[victim]->steal();
+            }
+        }
+
+        if (task)
+            queuedTasks.fetch_sub(1);
+        return task;
+    }
+
+    void JobSystem::execute(Task* task) {
+        task->fn();
+        task->group->onTaskFinished(task->isContinuation);
+        delete task;
+    }
+
+    void JobSystem::workerLoop(int index) {
+        workerIndex = index;
+        while (!quit.load(std::memory_order_acquire)) {
+            if (Task* task = findTask()) {
+                execute(task);
+                continue;
+            }
+
+            bool found = false;
+            for (int spin = 0; spin < 64 && !found; ++spin) {
+                std::this_thread::yield();
+                found = queuedTasks.load(std::memory_order_relaxed) > 0;
+            }
+            if (found)
+                continue;
+
+            std::unique_lock lock(sleepMutex);
+            sleepingWorkers.fetch_add(1);
+            wakeCondition.wait(lock, [] { return quit.load() || queuedTasks.load() > 0; });
+            sleepingWorkers.fetch_sub(1);
+        }
+        workerIndex = -1;
+    }
+
+    void JobSystem::init(unsigned count) {
+        if (workerCount > 0)
+            shutdown();
+
+        if (count == 0)
+            count = std::max(1u, std::thread::hardware_concurrency());
+        workerCount = count;
+
+        quit = false;
+        for (unsigned i = 0; i < count; ++i)
+            deques.push_back(std::make_unique<WorkStealingDeque>());
+        workerIndex = 0;
+        for (unsigned i = 1; i < count; ++i)
+            threads.emplace_back(workerLoop, static_cast<int>(i));
+
+        INFO("Job system started with %u workers.", count);
+    }
+
+    void JobSystem::shutdown() {
+        if (workerCount == 0)
+            return;
+
+        while (runPendingTask()) { }
+
+        {
+            std::lock_guard lock(sleepMutex);
+            quit = true;
+        }
+        wakeCondition.notify_all();
+        for (auto& thread : threads)
+            thread.join();
+
+        threads.clear();
+        deques.clear();
+        workerCount = 0;
+        workerIndex = -1;
+    }
+
+    unsigned JobSystem::getWorkerCount() {
+        return workerCount;
+    }
+
+    int JobSystem::getWorkerIndex() {
+        return workerIndex;
+    }
+
+    void JobSystem::submit(TaskGroup& group, std::function<void()> fn) {
+        group.onTaskSubmitted();
+        auto* task = new Task{std::move(fn), &group, false};
+        if (workerCount == 0) {
+            // not initialized (tools, early startup): run inline
+            execute(task);
+            return;
+        }
+        enqueue(task);
+    }
+
+    bool JobSystem::runPendingTask() {
+        if (workerCount == 0)
+            return false;
+        Task* task = findTask();
+        if (!task)
+            return false;
+        execute(task);
+        return true;
+    }
+
+    void TaskGroup::onTaskSubmitted() {
+        pending.fetch_add(1, std::memory_order_relaxed);
+        bodyPending.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void TaskGroup::onTaskFinished(bool isContinuation) {
+        if (!isContinuation && bodyPending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::vector<std::function<void()>> next;
+            {
+                std::lock_guard lock(continuationMutex);
+                next.swap(continuations);
+            }
+            // each continuation inherits the slot its then() reserved, so pending cannot hit zero in between
+            for (std::function<void()>& fn : next) {
+                auto* task = new Task{std::move(fn), this, true};
+                if (workerCount == 0)
+                    JobSystem::execute(task);
+                else
+                    enqueue(task);
+            }
+        }
+        pending.fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    void TaskGroup::then(std::function<void()> fn) {
+        std::unique_lock lock(continuationMutex);
+        pending.fetch_add(1, std::memory_order_relaxed);
+        if (bodyPending.load(std::memory_order_acquire) > 0) {
+            continuations.push_back(std::move(fn));
+            return;
+        }
+        lock.unlock();
+
+        auto* task = new Task{std::move(fn), this, true};
+        if (workerCount == 0)
+            JobSystem::execute(task);
+        else
+            enqueue(task);
+    }
+
+    void TaskGroup::wait() {
+        while (pending.load(std::memory_order_acquire) != 0) {
+            if (!JobSystem::runPendingTask())
+                std::this_thread::yield();
+        }
+    }
+}
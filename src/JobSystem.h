@@ -0,0 +1,121 @@
+﻿#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace raytracer {
+    class TaskGroup;
+    struct Task;
+
+    // Shared worker pool for every CPU subsystem. The worker count is fixed by init() at startup;
+    // nothing else in the engine is supposed to spawn its own threads, but for the ImageWriter's, which
+    // block in file writes instead of computing and would hold up the workers that trace if they ran
+    // here. Everything that writes files off the render thread goes through that one stage.
+    class JobSystem {
+    public:
+        // workerCount includes the calling thread, which becomes worker 0. 0 picks hardware_concurrency.
+        static void init(unsigned workerCount = 0);
+        static void shutdown();
+
+        static unsigned getWorkerCount();
+        // Index of the calling thread inside the pool, or -1 for threads the pool does not own.
+        static int getWorkerIndex();
+
+        static void submit(TaskGroup& group, std::function<void()> fn);
+        // Runs one pending task on the calling thread. Returns false if there was nothing to do.
+        static bool runPendingTask();
+
+        template<typename F>
+        static void parallelForRange(size_t begin, size_t end, size_t grain, F&& fn);
+        template<typename F>
+        static void parallelFor(size_t begin, size_t end, size_t grain, F&& fn);
+        // Chunks are combined in index order, so the result does not depend on the worker count
+        // as long as grain stays the same.
+        template<typename T, typename Map, typename Combine>
+        static T parallelReduce(size_t begin, size_t end, size_t grain, T identity, Map&& map, Combine&& combine);
+
+    private:
+        friend class TaskGroup;
+        static void execute(Task* task);
+        static void workerLoop(int index);
+    };
+
+    class TaskGroup {
+    public:
+        TaskGroup() = default;
+        ~TaskGroup() { wait(); }
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+
+        void run(std::function<void()> fn) { JobSystem::submit(*this, std::move(fn)); }
+        // Scheduled once every task run() so far has finished, or right away if none is running.
+        // then() may be called any number of times; every continuation is kept and scheduled, in no
+        // particular order among themselves, and wait() waits for all of them.
+        void then(std::function<void()> fn);
+        // Helps executing pending tasks until the group is done.
+        void wait();
+        bool isDone() const { return pending.load(std::memory_order_acquire) == 0; }
+
+    private:
+        friend class JobSystem;
+        void onTaskSubmitted();
+        void onTaskFinished(bool isContinuation);
+
+        std::atomic<int> pending{0};
+        std::atomic<int> bodyPending{0};
+        std::mutex continuationMutex;
+        std::vector<std::function<void()>> continuations;
+    };
+
+    template<typename F>
+    void JobSystem::parallelForRange(size_t begin, size_t end, size_t grain, F&& fn) {
+        if (end <= begin)
+            return;
+        if (grain == 0)
+            grain = 1;
+        if (end - begin <= grain || getWorkerCount() <= 1) {
+            fn(begin, end);
+            return;
+        }
+
+        TaskGroup group;
+        for (size_t chunkBegin = begin; chunkBegin < end; chunkBegin += grain) {
+            const size_t chunkEnd = std::min(end, chunkBegin + grain);
+            group.run([&fn, chunkBegin, chunkEnd] { fn(chunkBegin, chunkEnd); });
+        }
+        group.wait();
+    }
+
+    template<typename F>
+    void JobSystem::parallelFor(size_t begin, size_t end, size_t grain, F&& fn) {
+        parallelForRange(begin, end, grain, [&fn](size_t chunkBegin, size_t chunkEnd) {
+            for (size_t i = chunkBegin; i < chunkEnd; ++i)
+                fn(i);
+        });
+    }
+
+    template<typename T, typename Map, typename Combine>
+    T JobSystem::parallelReduce(size_t begin, size_t end, size_t grain, T identity, Map&& map, Combine&& combine) {
+        if (end <= begin)
+            return identity;
+        if (grain == 0)
+            grain = 1;
+
+        const size_t chunkCount = (end - begin + grain - 1) / grain;
+        std::vector<T> partials(chunkCount, identity);
+        parallelForRange(0, chunkCount, 1, [&](size_t chunkBegin, size_t chunkEnd) {
+            for (size_t chunk = chunkBegin; chunk < chunkEnd; ++chunk) {
+                const size_t first = begin + chunk * grain;
+                partials[chunk] = map(first, std::min(end, first + grain));
+            }
+        });
+
+        T result = identity;
+        for (const T& partial : partials)
+            result = combine(result, partial);
+        return result;
+    }
+}
@@ -0,0 +1,168 @@
+﻿#include "Lights.h"
+
+#include <algorithm>
+#include <bit>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+#include "misc/Logger.h"
+
+namespace raytracer {
+    namespace {
+        constexpr float pi = 3.14159265359f;
+
+        struct Cone {
+            vec3 axis;
+            float angle;
+        };
+
+        // Smallest cone around both, flipping b where that helps since triangles emit both ways.
+        Cone mergeCones(Cone a, Cone b) {
+            if (dot(a.axis, b.axis) < 0.0f)
+                b.axis = -b.axis;
+            if (b.angle > a.angle)
+                std::swap(a, b);
+
+            const float between = std::acos(std::clamp(dot(a.axis, b.axis), -1.0f, 1.0f));
+            if (std::min(between + b.angle, pi) <= a.angle)
+                return a;
+
+            const float angle = 0.5f * (a.angle + between + b.angle);
+            if (angle >= pi)
+                return { a.axis, pi };
+
+            // rotate a's axis toward b's until the new cone touches both
+            const float rotation = angle - a.angle;
+            const vec3 side = b.axis - a.axis * dot(a.axis, b.axis);
+            if (dot(side, side) < 1e-12f)
+                return { a.axis, angle };
+            const vec3 axis = a.axis * std::cos(rotation) + normalize(side) * std::sin(rotation);
+            return { normalize(axis), angle };
+        }
+
+        class TreeBuilder {
+        public:
+            TreeBuilder(std::vector<Light>& lights, std::vector<LightNode>& nodes): lights(lights), nodes(nodes) {
+                const size_t count = lights.size();
+                ids.resize(count);
+                mins.resize(count);
+                maxs.resize(count);
+                cones.resize(count);
+                for (size_t i = 0; i < count; ++i) {
+                    const Light& light = lights[i];
+                    ids[i] = static_cast<uint32_t>(i);
+                    if (light.posA_radius.w > 0.0f) {
+                        mins[i] = vec3(light.posA_radius) - light.posA_radius.w;
+                        maxs[i] = vec3(light.posA_radius) + light.posA_radius.w;
+                        cones[i] = { vec3(0.0f, 0.0f, 1.0f), pi };
+                    } else {
+                        const vec3 a(light.posA_radius), b(light.posB_cdf), c(light.posC_trail);
+                        mins[i] = glm::min(a, glm::min(b, c));
+                        maxs[i] = glm::max(a, glm::max(b, c));
+                        const vec3 normal = cross(b - a, c - a);
+                        cones[i] = dot(normal, normal) > 0.0f ? Cone{ normalize(normal), 0.0f } : Cone{ vec3(0.0f, 0.0f, 1.0f), pi };
+                    }
+                }
+            }
+
+            void build() {
+                nodes.clear();
+                nodes.reserve(2 * lights.size());
+                nodes.emplace_back();
+                build(0, 0, lights.size(), 0, 0);
+            }
+
+        private:
+            void build(uint32_t nodeIndex, size_t begin, size_t end, uint32_t trail, int depth) {
+                vec3 min(FLT_MAX), max(-FLT_MAX), centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+                float weight = 0.0f;
+                Cone cone = cones[ids[begin]];
+                for (size_t i = begin; i < end; ++i) {
+                    const uint32_t id = ids[i];
+                    min = glm::min(min, mins[id]);
+                    max = glm::max(max, maxs[id]);
+                    centroidMin = glm::min(centroidMin, 0.5f * (mins[id] + maxs[id]));
+                    centroidMax = glm::max(centroidMax, 0.5f * (mins[id] + maxs[id]));
+                    weight += LightSet::getWeight(lights[id]);
+                    if (i > begin)
+                        cone = mergeCones(cone, cones[id]);
+                }
+
+                LightNode node = { vec4(min, weight), vec4(max, cone.angle), vec4(cone.axis, 0.0f), uvec4(0) };
+                if (end - begin == 1) {
+                    node.child_light.y = ids[begin] + 1;
+                    lights[ids[begin]].posC_trail.w = std::bit_cast<float>(trail);
+                    nodes[nodeIndex] = node;
+                    return;
+                }
+
+                // median split on the widest centroid axis keeps the depth at log2(count), so a
+                // trail always fits 32 bits
+                const vec3 extent = centroidMax - centroidMin;
+                const int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+                const size_t middle = begin + (end - begin) / 2;
+                std::nth_element(ids.begin() + begin, ids.begin() + middle, ids.begin() + end, [&](uint32_t a, uint32_t b) {
+                    return mins[a][axis] + maxs[a][axis] < mins[b][axis] + maxs[b][axis];
+                });
+
+                const auto firstChild = static_cast<uint32_t>(nodes.size());
+                node.child_light.x = firstChild;
+                nodes[nodeIndex] = node;
+                nodes.emplace_back();
+                nodes.emplace_back();
+                build(firstChild, begin, middle, trail, depth + 1);
+                build(firstChild + 1, middle, end, trail | 1u << depth, depth + 1);
+            }
+
+            std::vector<Light>& lights;
+            std::vector<LightNode>& nodes;
+            std::vector<uint32_t> ids;
+            std::vector<vec3> mins, maxs;
+            std::vector<Cone> cones;
+        };
+    }
+
+    void LightSet::build() {
+        totalWeight = 0.0f;
+        nodes.clear();
+        if (lights.empty())
+            return;
+
+        for (Light& light : lights) {
+            totalWeight += getWeight(light);
+            light.posB_cdf.w = totalWeight;
+        }
+        if (totalWeight <= 0.0f)
+            return;
+        for (Light& light : lights)
+            light.posB_cdf.w /= totalWeight;
+        lights.back().posB_cdf.w = 1.0f;
+
+        const auto start = std::chrono::high_resolution_clock::now();
+        TreeBuilder(lights, nodes).build();
+        const double time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        if (lights.size() > 1000)
+            DEBUG("Built light tree over %zu lights in %.1f ms.", lights.size(), time);
+    }
+
+    float LightSet::getWeight(const Light& light) {
+        const float luminance = dot(vec3(light.emission), vec3(0.2126f, 0.7152f, 0.0722f));
+        if (light.posA_radius.w > 0.0f)
+            return luminance * 4.0f * pi * light.posA_radius.w * light.posA_radius.w;
+        return luminance * length(cross(vec3(light.posB_cdf) - vec3(light.posA_radius), vec3(light.posC_trail) - vec3(light.posA_radius)));
+    }
+
+    Light LightSet::makeSphereLight(const Sphere& sphere) {
+        const vec4& emission = sphere.emissiveColor_strength;
+        return { sphere.pos_radius, vec4(0.0f), vec4(0.0f), vec4(vec3(emission) * emission.w, 0.0f) };
+    }
+
+    Light LightSet::makeTriangleLight(const MeshInfo& mesh, const Triangle& triangle) {
+        const mat3 rotation(mesh.rotation);
+        const vec3 position(mesh.pos);
+        const vec4& emission = mesh.emissiveColor_strength;
+        return { vec4(rotation * vec3(triangle.posA) + position, 0.0f), vec4(rotation * vec3(triangle.posB) + position, 0.0f),
+                 vec4(rotation * vec3(triangle.posC) + position, 0.0f), vec4(vec3(emission) * emission.w, 0.0f) };
+    }
+}
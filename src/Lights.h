@@ -0,0 +1,41 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "Model.h"
+
+namespace raytracer {
+    // An emissive sphere or mesh triangle in world space, in the layout of the light buffer.
+    struct Light {
+        vec4 posA_radius;   // sphere center and radius, or the first triangle corner with radius 0
+        vec4 posB_cdf;      // w: probability of picking this light or one before it by weight alone
+        vec4 posC_trail;    // w: uint bits, the branches down the light tree to this light (1 = second child)
+        vec4 emission;      // emitted radiance, w unused
+    };
+
+    // Light tree node: bounds, summed weight and a cone around every emitter normal below it, enough
+    // to bound what the subtree adds at a shading point (Conty Estevez and Kulla, "Importance Sampling
+    // of Many Lights with Adaptive Tree Splitting", 2018).
+    struct LightNode {
+        vec4 min_weight;
+        vec4 max_coneAngle;     // w: half angle of the normal cone, pi if light leaves in every direction
+        vec4 axis;              // normal cone axis, triangles emit along both ends
+        uvec4 child_light;      // x: first of two adjacent children, y: light index + 1 for leaves, 0 otherwise
+    };
+
+    // The emitters of a scene. Every sphere is a light, so light i is sphere i and dark spheres just get
+    // zero weight, followed by the triangles of each emissive mesh from MeshInfo::firstLightIndex on.
+    struct LightSet {
+        std::vector<Light> lights;
+        std::vector<LightNode> nodes;
+        float totalWeight = 0.0f;
+
+        // Fills in the CDF and trails and builds the tree over lights.
+        void build();
+
+        // Luminance times emitting area. Triangles emit from both sides.
+        static float getWeight(const Light& light);
+        static Light makeSphereLight(const Sphere& sphere);
+        static Light makeTriangleLight(const MeshInfo& mesh, const Triangle& triangle);
+    };
+}
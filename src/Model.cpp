@@ -11,6 +11,7 @@
 #include "glm/common.hpp"
 #include "glm/vec2.hpp"
 #include "glm/ext/matrix_transform.hpp"
+#include "JobSystem.h"
 #include "misc/Logger.h"
 
 namespace raytracer {
@@ -33,40 +34,63 @@ namespace raytracer {
 
         const aiMesh *model = scene->mMeshes[0];
 
-        vertices.clear();
-        vertices.reserve(model->mNumVertices);
-        normals.clear();
-        normals.reserve(model->mNumVertices);
+        vertices.resize(model->mNumVertices);
+        normals.resize(model->mNumVertices);
 
-        for (unsigned i = 0; i < model->mNumVertices; ++i) {
-            vertices.emplace_back(model->mVertices[i].x, model->mVertices[i].y, model->mVertices[i].z);
-            normals.emplace_back(model->mNormals[i].x, model->mNormals[i].y, model->mNormals[i].z);
-        }
-
-        triangles.clear();
-        triangles.reserve(model->mNumFaces);
+        JobSystem::parallelFor(0, model->mNumVertices, 4096, [&](size_t i) {
+            vertices[i] = vec3(model->mVertices[i].x, model->mVertices[i].y, model->mVertices[i].z);
+            normals[i] = vec3(model->mNormals[i].x, model->mNormals[i].y, model->mNormals[i].z);
+        });
 
+        // faces that did not triangulate are dropped, so find each triangle's output slot up front
+        std::vector<uint32_t> faceOffsets(model->mNumFaces);
+        uint32_t triCount = 0;
         for (unsigned f = 0; f < model->mNumFaces; ++f) {
+            faceOffsets[f] = triCount;
+            if (model->mFaces[f].mNumIndices == 3)
+                ++triCount;
+        }
+
+        indices.resize(triCount * 3ull);
+        JobSystem::parallelFor(0, model->mNumFaces, 4096, [&](size_t f) {
             const aiFace &face = model->mFaces[f];
             if (face.mNumIndices != 3)
-                continue;
+                return;
+
+            const uint32_t t = faceOffsets[f];
+            indices[3 * t + 0] = face.mIndices[0];
+            indices[3 * t + 1] = face.mIndices[1];
+            indices[3 * t + 2] = face.mIndices[2];
+        });
+
+        build(transform, material);
+    }
+
+    Model::Model(std::vector<vec3> vertices, std::vector<vec3> normals, std::vector<uint32_t> indices, Transform transform,
+                 Material material): meshInfo(), vertices(std::move(vertices)), indices(std::move(indices)),
+                                     normals(std::move(normals)) {
+        build(transform, material);
+    }
 
-            const unsigned i0 = face.mIndices[0];
-            const unsigned i1 = face.mIndices[1];
-            const unsigned i2 = face.mIndices[2];
-            indices.push_back(i0);
-            indices.push_back(i1);
-            indices.push_back(i2);
+    void Model::build(Transform transform, const Material& material) {
+        const size_t triCount = indices.size() / 3;
+        triangles.resize(triCount);
+        JobSystem::parallelFor(0, triCount, 4096, [&](size_t t) {
+            const uint32_t i0 = indices[3 * t + 0];
+            const uint32_t i1 = indices[3 * t + 1];
+            const uint32_t i2 = indices[3 * t + 2];
 
             vec3 p0 = vertices[i0], p1 = vertices[i1], p2 = vertices[i2];
             vec3 n0 = normals[i0], n1 = normals[i1], n2 = normals[i2];
 
-            Triangle tri = {
+            triangles[t] = {
                 vec4(p0, 0.0f), vec4(p1, 0.0f), vec4(p2, 0.0f),
                 vec4(n0, 0.0f), vec4(n1, 0.0f), vec4(n2, 0.0f)
             };
-            triangles.push_back(tri);
-        }
+        });
+
+        if (triangles.empty())
+            return;
 
         auto bvh = BVH(vertices, indices);
         nodes = bvh.getNodes();
@@ -74,8 +98,9 @@ namespace raytracer {
 
         std::vector<Triangle> trianglesReordered;
         trianglesReordered.resize(triangles.size());
-        for (size_t i = 0; i < order.size(); ++i)
+        JobSystem::parallelFor(0, order.size(), 4096, [&](size_t i) {
             trianglesReordered[i] = triangles[order[i]];
+        });
         triangles.swap(trianglesReordered);
 
         auto rotMat = mat4(1.0f);
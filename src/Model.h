@@ -25,8 +25,8 @@ namespace raytracer {
     struct MeshInfo {
         uint32_t firstTriangleIndex;
         uint32_t numTriangles;
-        uint32_t _pad0;
-        uint32_t _pad1;
+        uint32_t rootNodeIndex;
+        uint32_t firstLightIndex;   // set by Scene::buildLights for emissive meshes
         vec4 color_smoothness;
         vec4 emissiveColor_strength;
         vec4 pos;
@@ -51,12 +51,17 @@ namespace raytracer {
     class Model {
     public:
         explicit Model(const char* filename, Transform transform, Material material);
+        // Procedural geometry: one normal per vertex, three indices per triangle.
+        Model(std::vector<vec3> vertices, std::vector<vec3> normals, std::vector<uint32_t> indices, Transform transform,
+              Material material);
         ~Model();
 
         void addTriangles(std::vector<Triangle>& triangles) const;
         void addMesh(std::vector<MeshInfo>& meshes) const;
         void addNodes(std::vector<BVHNode>& nodes) const;
     private:
+        void build(Transform transform, const Material& material);
+
         MeshInfo meshInfo;
         std::vector<vec3> vertices;
         std::vector<uint32_t> indices;
@@ -0,0 +1,347 @@
+﻿#include "Offline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+
+#include "GpuState.h"
+#include "TiledImageWriter.h"
+#include "Window.h"
+#include "cpu/Denoiser.h"
+#include "glm/gtc/type_ptr.hpp"
+#include "misc/Logger.h"
+
+namespace raytracer {
+    Checkpoint Offline::describeCheckpoint(const RenderProgress& progress, const Camera& camera, uvec2 resolution,
+                                           const FrameSettings& settings, const Checkpoint::Source& source,
+                                           bool hasVariance) {
+        Checkpoint checkpoint;
+        checkpoint.resolution = resolution;
+        checkpoint.frameIndex = progress.frameIndex;
+        checkpoint.frameCount = progress.frameCount;
+        checkpoint.totalSamples = progress.totalSamples;
+        checkpoint.seconds = progress.getSeconds();
+        checkpoint.cameraPosition = camera.getPosition();
+        checkpoint.cameraRotation = camera.eulerRotation;
+        checkpoint.settingsKey = Checkpoint::getSettingsKey(settings);
+        checkpoint.source = source;
+        checkpoint.hasVariance = hasVariance;
+        return checkpoint;
+    }
+
+    bool Offline::loadCheckpoint(const Options& options, uvec2 resolution, const FrameSettings& settings,
+                                 const Checkpoint::Source& source, Checkpoint& checkpoint, std::vector<vec4>& accumulation, std::vector<vec4>& variance,
+                                 RenderProgress& progress, Camera& camera, GLFWwindow* window) {
+        if (!checkpoint.load(options.checkpoint, accumulation, variance)) {
+            ERR("Could not read a checkpoint from %s.", options.checkpoint.c_str());
+            return false;
+        }
+        if (checkpoint.resolution != resolution) {
+            ERR("%s is of a %ux%u render, this one is %ux%u.", options.checkpoint.c_str(), checkpoint.resolution.x,
+                checkpoint.resolution.y, resolution.x, resolution.y);
+            return false;
+        }
+        if (checkpoint.settingsKey != Checkpoint::getSettingsKey(settings)) {
+            ERR("%s was rendered with other settings.", options.checkpoint.c_str());
+            return false;
+        }
+        if (checkpoint.source.sceneKey != source.sceneKey) {
+            ERR("%s is of another scene.", options.checkpoint.c_str());
+            return false;
+        }
+        if (checkpoint.source.gpu != source.gpu) {
+            ERR("%s was rendered on the %s, this render is on the %s.", options.checkpoint.c_str(),
+                checkpoint.source.gpu ? "GPU" : "CPU", source.gpu ? "GPU" : "CPU");
+            return false;
+        }
+        // the small formats weigh samples by counts rgba32f keeps in the alpha, see raytracer.comp
+        if (checkpoint.source.accumFormat != source.accumFormat) {
+            ERR("%s was accumulated in another --accum-format.", options.checkpoint.c_str());
+            return false;
+        }
+        camera.setPose(checkpoint.cameraPosition, checkpoint.cameraRotation, window);
+        progress.frameIndex = checkpoint.frameIndex;
+        progress.frameCount = checkpoint.frameCount;
+        progress.totalSamples = checkpoint.totalSamples;
+        progress.start = std::chrono::steady_clock::now() -
+                         std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(checkpoint.seconds));
+        INFO("Resuming %s at frame %u: %.1f samples per pixel after %.1f s.", options.checkpoint.c_str(), checkpoint.frameIndex,
+             static_cast<double>(progress.totalSamples) / (static_cast<double>(resolution.x) * resolution.y), checkpoint.seconds);
+        return true;
+    }
+
+    // Renders the image in square tiles, each until the policy ends it with the time budget shared among
+    // them, and streams every finished tile to --output. Only the tile being rendered and the ones the
+    // writer has not got to yet are in memory, whatever the size of the image. The tiles are rendered as
+    // parts of the whole image, so they put together the same image as rendering it in one go would,
+    // except that resampling neighbours are looked for within the tile. renderTile renders them on the
+    // device, which the log names.
+    int Offline::renderTiled(View view, TerminationPolicy policy, const Options& options, ImageWriter& imageWriter,
+                             const char* device, uint32_t features, const TileRenderer& renderTile) {
+        const uvec2 resolution = view.resolution;
+        const uint32_t tileSize = options.tileSize;
+        const uvec2 tiles = (resolution + tileSize - 1u) / tileSize;
+        const uint32_t tileCount = tiles.x * tiles.y;
+        TiledImageWriter writer(imageWriter, options.output, resolution);
+        if (!writer.isOpen()) {
+            ERR("Could not create %s for %ux%u pixels.", options.output.c_str(), resolution.x, resolution.y);
+            return 1;
+        }
+        policy.seconds /= tileCount;
+        view.imageSize = resolution;
+        INFO("Rendering %ux%u on the %s in %u tiles of %u pixels (scene features 0x%x).", resolution.x, resolution.y,
+             device, tileCount, tileSize, features);
+
+        RenderProgress progress;
+        progress.restart();
+        float worstError = 0.0f;
+        for (uint32_t tile = 0; tile < tileCount; ++tile) {
+            view.tileOffset = uvec2(tile % tiles.x, tile / tiles.x) * tileSize;
+            view.resolution = min(uvec2(tileSize), resolution - view.tileOffset);
+            std::vector<vec4> accumulation;
+            const TileRender render = renderTile(view, policy, accumulation);
+            progress.frameCount += render.frames;
+            progress.totalSamples += render.samples;
+            worstError = std::max(worstError, render.error);
+            writer.write(view.tileOffset, view.resolution, std::move(accumulation));
+        }
+        const bool written = writer.finish();
+
+        const double pixelCount = static_cast<double>(resolution.x) * resolution.y;
+        printf("== tiled headless render ==\n");
+        printf("%ux%u in %u tiles, %u frames, %.1f samples per pixel (%llu in all), %.2f s, worst tile's estimated error %.3f%%\n",
+               resolution.x, resolution.y, tileCount, progress.frameCount,
+               static_cast<double>(progress.totalSamples) / pixelCount, static_cast<unsigned long long>(progress.totalSamples),
+               progress.getSeconds(), 100.0 * worstError);
+        if (!written) {
+            ERR("Could not write %s.", options.output.c_str());
+            return 1;
+        }
+        printf("saved %s\n", options.output.c_str());
+        return 0;
+    }
+
+    // The tiles on the CPU. The reservoirs and statistics are a tile's, the radiance cache and the path
+    // guide learn across all of them.
+    int Offline::renderCpuTiled(const Scene& scene, const View& view, FrameSettings settings,
+                                const TerminationPolicy& policy, const Options& options, ImageWriter& imageWriter) {
+        const Integrator integrator(scene);
+        const auto cache = settings.radianceCache ? std::make_unique<RadianceCache>() : nullptr;
+        const auto guide = settings.pathGuiding ? std::make_unique<PathGuide>(scene) : nullptr;
+        std::vector<vec4> variance;
+        ReservoirBuffers reservoirs;
+        return renderTiled(view, policy, options, imageWriter, "CPU", integrator.getFeatures(),
+                           [&](const View& tile, const TerminationPolicy& tilePolicy, std::vector<vec4>& accumulation) {
+            const size_t pixelCount = static_cast<size_t>(tile.resolution.x) * tile.resolution.y;
+            accumulation.assign(pixelCount, vec4(0));
+            variance.assign(pixelCount, vec4(0));
+            reservoirs.historyValid = false;
+            const auto start = std::chrono::steady_clock::now();
+            TileRender render;
+            for (const char* reason = nullptr; !reason; ++render.frames) {
+                settings.frameIndex = render.frames;
+                const uint64_t paths = integrator.render(tile, settings, accumulation.data(),
+                                                         { &reservoirs, cache.get(), guide.get(), variance.data() }).paths;
+                render.samples += paths;
+                const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                render.error = Adaptive::estimateError(variance.data(), pixelCount);
+                reason = paths == 0 ? "every pixel converged"
+                                    : tilePolicy.check(static_cast<double>(render.samples) / static_cast<double>(pixelCount),
+                                                       seconds, render.error);
+            }
+            return render;
+        });
+    }
+
+    // The tiles on the GPU, in the context of a window that is never shown. Every tile is traced into
+    // the images of the largest, from the pool, cleared for it; the scene and the radiance cache stay
+    // for all of them. The GPU is only waited for where the policy needs it: for the sample counter of
+    // adaptive frames, the statistics of a noise threshold and the frames of a time budget.
+    int Offline::renderGpuTiled(const Scene& scene, const View& view, const FrameSettings& settings,
+                                const TerminationPolicy& policy, const Options& options, ImageWriter& imageWriter) {
+        const Window window(1, 1, "Raytracer", false, false);
+        if (!window.getWindow())
+            return 1;
+        GpuState gpu;
+        // the camera stands still, nothing is reprojected
+        Shader shader("resources/shaders/raytracer.comp", gpu.selectAccumulationFormat(options.accumFormat, false));
+        gpu.pixelReservoirs = settings.restir;
+        gpu.uploadScene(scene);
+        gpu.createBuffers(settings);
+        gpu.resize(min(uvec2(options.tileSize), view.resolution));
+        gpu.setUniforms(shader, scene, settings, true, false);
+        shader.setMatrix3x3("cameraRotation", glm::value_ptr(view.rotation), true);
+        shader.setVector3("cameraPosition", view.position.x, view.position.y, view.position.z, true);
+        shader.setFloat("uFocalLength", view.focalLength, true);
+        shader.setUIVector2("imageSize", view.resolution.x, view.resolution.y, true);
+        gpu.bind();
+
+        const int result = renderTiled(view, policy, options, imageWriter, "GPU", scene.getFeatures(),
+                                       [&](const View& tile, const TerminationPolicy& tilePolicy, std::vector<vec4>& accumulation) {
+            const uvec2 size = tile.resolution;
+            const size_t pixelCount = static_cast<size_t>(size.x) * size.y;
+            gpu.clearAccumulation();
+            gpu.clearStatistics();
+            gpu.reservoirHistoryValid = false;
+            shader.setUIVector2("uResolution", size.x, size.y, true);
+            shader.setUIVector2("tileOffset", tile.tileOffset.x, tile.tileOffset.y, true);
+            std::vector<vec4> variance(pixelCount);
+            const auto estimateError = [&] {
+                glGetTextureSubImage(gpu.varianceTexture, 0, 0, 0, 0, static_cast<GLsizei>(size.x), static_cast<GLsizei>(size.y),
+                                     1, GL_RGBA, GL_FLOAT, static_cast<GLsizei>(pixelCount * sizeof(vec4)), variance.data());
+                return Adaptive::estimateError(variance.data(), pixelCount);
+            };
+
+            const auto start = std::chrono::steady_clock::now();
+            TileRender render;
+            for (const char* reason = nullptr; !reason; ++render.frames) {
+                gpu.traceFrame(shader, settings, size, render.frames, render.frames);
+                uint64_t samples = render.samples + pixelCount * settings.samplesPerPixel;
+                if (settings.adaptiveSampling) {
+                    uint32_t counter[2];
+                    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gpu.tileSSBO);
+                    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 3 * sizeof(uint32_t), sizeof(counter), counter);
+                    samples = counter[0] | static_cast<uint64_t>(counter[1]) << 32;
+                } else if (tilePolicy.seconds > 0.0) {
+                    glFinish();
+                }
+                if (tilePolicy.noiseThreshold > 0.0f)
+                    render.error = estimateError();
+                // a counter that stood still, only adaptive frames can leave it
+                const bool converged = samples == render.samples;
+                render.samples = samples;
+                const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                reason = converged ? "every pixel converged"
+                                   : tilePolicy.check(static_cast<double>(samples) / static_cast<double>(pixelCount), seconds,
+                                                      render.error);
+            }
+            if (tilePolicy.noiseThreshold <= 0.0f)
+                render.error = estimateError();
+            accumulation.resize(pixelCount);
+            glGetTextureSubImage(gpu.accumTexture, 0, 0, 0, 0, static_cast<GLsizei>(size.x), static_cast<GLsizei>(size.y), 1,
+                                 GL_RGBA, GL_FLOAT, static_cast<GLsizei>(pixelCount * sizeof(vec4)), accumulation.data());
+            return render;
+        });
+        // while there is a context to delete them in
+        gpu.renderTargets.clear();
+        return result;
+    }
+
+    int Offline::render(const Scene& scene, FrameSettings settings, TerminationPolicy policy, const Options& options,
+                        ImageWriter& imageWriter) {
+        if (!policy.isSet()) {
+            policy.samplesPerPixel = 64.0;
+            WARN("Nothing would end a headless render, stopping at %.0f samples per pixel.", policy.samplesPerPixel);
+        }
+        const Checkpoint::Source source = { Checkpoint::getSceneKey(scene, options.environment), false, 0 };
+        const uvec2 resolution(options.width, options.height);
+        const size_t pixelCount = static_cast<size_t>(resolution.x) * resolution.y;
+        Camera camera(10, 0.08f);
+        RenderProgress progress;
+        progress.restart();
+        std::vector<vec4> accumulation, variance;
+        Checkpoint checkpoint;
+        // before the view, the checkpoint has the camera
+        if (options.resume && options.tileSize == 0 &&
+            !loadCheckpoint(options, resolution, settings, source, checkpoint, accumulation, variance, progress, camera))
+            return 1;
+        const View view = { camera.getPosition(), camera.getViewMatrix(), Camera::getFocalLength(resolution.y), resolution };
+        if (!options.output.empty() && !ImageWriter::getFormat(options.output)) {
+            ERR("Can't tell the format of --output %s, expected .pfm, .exr, .png or .qoi.", options.output.c_str());
+            return 1;
+        }
+        if (options.tileSize > 0) {
+            if (options.output.empty()) {
+                ERR("--tile streams the image to --output, which wasn't given.");
+                return 1;
+            }
+            if (ImageWriter::getFormat(options.output) != ImageWriter::Format::Pfm) {
+                ERR("--tile streams the image to a .pfm, not %s.", options.output.c_str());
+                return 1;
+            }
+            if (options.denoise || options.saveAovs)
+                WARN("--denoise and --aovs need the whole image, tiled renders go without them.");
+            if (!options.checkpoint.empty())
+                WARN("Tiled renders aren't checkpointed, their finished tiles are on disk already.");
+            return options.backend != "cpu" ? renderGpuTiled(scene, view, settings, policy, options, imageWriter)
+                                            : renderCpuTiled(scene, view, settings, policy, options, imageWriter);
+        }
+        const Integrator integrator(scene);
+        const auto cache = settings.radianceCache ? std::make_unique<RadianceCache>() : nullptr;
+        const auto guide = settings.pathGuiding ? std::make_unique<PathGuide>(scene) : nullptr;
+        accumulation.resize(pixelCount, vec4(0));
+        variance.resize(pixelCount, vec4(0));
+        ReservoirBuffers reservoirs;
+        AovBuffers aovs;
+        const bool useAovs = options.denoise || options.saveAovs;
+        if (options.saveAovs && options.output.empty())
+            WARN("--aovs saves next to --output, which wasn't given.");
+        INFO("Rendering %ux%u on the CPU without a window (scene features 0x%x).", resolution.x, resolution.y,
+             integrator.getFeatures());
+
+        double seconds = checkpoint.seconds, lastCheckpoint = checkpoint.seconds;
+        // copies of the images for the writer to save from while the render goes on
+        CheckpointWriter writer(imageWriter);
+        std::vector<vec4> savedAccumulation, savedVariance;
+        const char* reason = nullptr;
+        while (!reason) {
+            settings.frameIndex = progress.frameIndex;
+            const RenderBuffers buffers = { &reservoirs, cache.get(), guide.get(), variance.data(), useAovs ? &aovs : nullptr };
+            const uint64_t paths = integrator.render(view, settings, accumulation.data(), buffers).paths;
+            progress.totalSamples += paths;
+            ++progress.frameIndex;
+            ++progress.frameCount;
+            seconds = progress.getSeconds();
+            progress.estimatedError = Adaptive::estimateError(variance.data(), pixelCount);
+            reason = paths == 0 ? "every pixel converged"
+                                : policy.check(static_cast<double>(progress.totalSamples) / static_cast<double>(pixelCount),
+                                               seconds, progress.estimatedError);
+            if (!reason && !options.checkpoint.empty() && seconds - lastCheckpoint >= options.checkpointSeconds &&
+                !writer.isBusy()) {
+                savedAccumulation = accumulation;
+                savedVariance = variance;
+                writer.save(options.checkpoint, describeCheckpoint(progress, camera, resolution, settings, source, true),
+                            savedAccumulation.data(), savedVariance.data());
+                lastCheckpoint = seconds;
+            }
+        }
+
+        printf("== headless render, stopped by the %s ==\n", reason);
+        printf("%ux%u, %u frames, %.1f samples per pixel (%llu in all), %.2f s, estimated error %.3f%%\n", resolution.x,
+               resolution.y, progress.frameIndex, static_cast<double>(progress.totalSamples) / static_cast<double>(pixelCount),
+               static_cast<unsigned long long>(progress.totalSamples), seconds, 100.0 * progress.estimatedError);
+        // the last one as the render ended, which a --resume with a larger budget goes on from
+        if (!options.checkpoint.empty()) {
+            writer.wait();
+            if (!describeCheckpoint(progress, camera, resolution, settings, source, true)
+                     .save(options.checkpoint, accumulation.data(), variance.data())) {
+                ERR("Could not save the checkpoint %s.", options.checkpoint.c_str());
+                return 1;
+            }
+            printf("checkpoint saved to %s\n", options.checkpoint.c_str());
+        }
+        if (options.denoise) {
+            Denoiser denoiser;
+            std::vector<vec4> denoised(pixelCount);
+            const auto start = std::chrono::steady_clock::now();
+            denoiser.denoise(accumulation.data(), aovs, resolution, denoised.data());
+            printf("denoised in %.1f ms\n", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            accumulation.swap(denoised);
+        }
+        if (!options.output.empty()) {
+            ImageWriter::Image image = { options.output, resolution, &accumulation[0].x };
+            if (options.saveAovs) {
+                image.albedo = aovs.albedo.data();
+                image.normalDepth = aovs.normalDepth.data();
+                image.id = aovs.id.data();
+            }
+            if (!ImageWriter::save(image)) {
+                ERR("Could not write %s%s.", options.output.c_str(), options.saveAovs ? " and its AOVs" : "");
+                return 1;
+            }
+            printf("saved %s%s\n", options.output.c_str(), options.saveAovs ? " and its AOVs" : "");
+        }
+        return 0;
+    }
+}
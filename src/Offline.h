@@ -0,0 +1,55 @@
+﻿#pragma once
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "Camera.h"
+#include "Checkpoint.h"
+#include "ImageWriter.h"
+#include "Scene.h"
+#include "Termination.h"
+#include "cpu/Integrator.h"
+#include "misc/Options.h"
+#include "glm/glm.hpp"
+using namespace glm;
+
+namespace raytracer {
+    // Renders without a window, and the checkpoints every render goes on from with --resume.
+    class Offline {
+    public:
+        // Renders the starting view of --size on the CPU until the policy ends it, then prints what it
+        // took. With --denoise the final image goes through the Denoiser once, --output saves it and
+        // --aovs the AOVs next to it. With --tile the image is rendered in tiles streamed to --output, on
+        // the GPU unless --backend is cpu; settings must be for the backend that renders them.
+        static int render(const Scene& scene, FrameSettings settings, TerminationPolicy policy, const Options& options,
+                          ImageWriter& imageWriter);
+
+        // The progress and camera of the render so far, for a checkpoint of its images at resolution.
+        static Checkpoint describeCheckpoint(const RenderProgress& progress, const Camera& camera, uvec2 resolution,
+                                             const FrameSettings& settings, const Checkpoint::Source& source,
+                                             bool hasVariance);
+        // Reads --checkpoint for --resume, puts the camera where it was and takes over the progress; false,
+        // having said why, if it isn't a checkpoint of this render. A window keeps the mouse from turning
+        // the camera, see Camera::setPose.
+        static bool loadCheckpoint(const Options& options, uvec2 resolution, const FrameSettings& settings,
+                                   const Checkpoint::Source& source, Checkpoint& checkpoint, std::vector<vec4>& accumulation, std::vector<vec4>& variance,
+                                   RenderProgress& progress, Camera& camera, GLFWwindow* window = nullptr);
+    private:
+        // What rendering a tile took.
+        struct TileRender {
+            uint64_t samples = 0;
+            uint32_t frames = 0;
+            float error = 0.0f;     // estimated when it ended
+        };
+        // Renders the view, a tile of the image, until the policy ends it, into the accumulation.
+        using TileRenderer = std::function<TileRender(const View& tile, const TerminationPolicy& policy,
+                                                      std::vector<vec4>& accumulation)>;
+
+        static int renderTiled(View view, TerminationPolicy policy, const Options& options, ImageWriter& imageWriter,
+                               const char* device, uint32_t features, const TileRenderer& renderTile);
+        static int renderCpuTiled(const Scene& scene, const View& view, FrameSettings settings,
+                                  const TerminationPolicy& policy, const Options& options, ImageWriter& imageWriter);
+        static int renderGpuTiled(const Scene& scene, const View& view, const FrameSettings& settings,
+                                  const TerminationPolicy& policy, const Options& options, ImageWriter& imageWriter);
+    };
+}
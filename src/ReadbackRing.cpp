@@ -0,0 +1,159 @@
+﻿#include "ReadbackRing.h"
+
+#include <cstring>
+
+namespace raytracer {
+    bool ReadbackRing::read(uvec2 size, const std::vector<Image>& images, uint64_t tag) {
+        Slot& slot = slots[next];
+        if (slot.state.load(std::memory_order_acquire) != Free) {
+            ++droppedReads;
+            return false;
+        }
+
+        const size_t pixels = static_cast<size_t>(size.x) * size.y;
+        size_t bytes = 0;
+        for (const Image& image : images)
+            bytes += pixels * image.format.bytesPerPixel;
+        // grown only, one buffer of the largest size serves every size below it
+        if (bytes > slot.bytes) {
+            if (slot.buffer) {
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                glDeleteBuffers(1, &slot.buffer);
+            }
+            const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glGenBuffers(1, &slot.buffer);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            glBufferStorage(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(bytes), nullptr, flags);
+            slot.mapping = static_cast<const char*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(bytes), flags));
+            slot.bytes = bytes;
+        }
+
+        // the images were written by shaders, which a read through a buffer has to wait for
+        glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        slot.readback.size = size;
+        slot.readback.tag = tag;
+        slot.readback.images.clear();
+        size_t offset = 0;
+        for (const Image& image : images) {
+            const size_t imageBytes = pixels * image.format.bytesPerPixel;
+            glGetTextureSubImage(image.texture, 0, 0, 0, 0, static_cast<GLsizei>(size.x), static_cast<GLsizei>(size.y), 1,
+                                 image.format.format, image.format.type, static_cast<GLsizei>(imageBytes),
+                                 reinterpret_cast<void*>(offset));
+            slot.readback.images.push_back(slot.mapping + offset);
+            offset += imageBytes;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.state.store(Reading, std::memory_order_relaxed);
+        next = (next + 1) % slotCount;
+        return true;
+    }
+
+    ReadbackRing::Readback* ReadbackRing::poll(bool wait) {
+        Slot& slot = slots[oldest];
+        if (slot.state.load(std::memory_order_relaxed) != Reading)
+            return nullptr;
+        const GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? GL_TIMEOUT_IGNORED : 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            return nullptr;
+        glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+        slot.state.store(HandedOut, std::memory_order_relaxed);
+        oldest = (oldest + 1) % slotCount;
+        return &slot.readback;
+    }
+
+    void ReadbackRing::release(const Readback* readback) {
+        for (Slot& slot : slots) {
+            if (&slot.readback == readback)
+                slot.state.store(Free, std::memory_order_release);
+        }
+    }
+
+    void ReadbackRing::clear() {
+        for (Slot& slot : slots) {
+            if (slot.fence)
+                glDeleteSync(slot.fence);
+            if (slot.buffer) {
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                glDeleteBuffers(1, &slot.buffer);
+            }
+            slot.buffer = 0;
+            slot.bytes = 0;
+            slot.mapping = nullptr;
+            slot.fence = nullptr;
+            slot.state.store(Free, std::memory_order_relaxed);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        next = oldest = 0;
+    }
+
+    void CheckpointReadback::start(const Checkpoint& described, GLuint accumulation, GLuint variance, GLuint counter,
+                                   GLintptr counterOffset) {
+        const uvec2 size = described.resolution;
+        const size_t imageBytes = static_cast<size_t>(size.x) * size.y * sizeof(vec4);
+        const size_t neededBytes = 2 * imageBytes + sizeof(uint64_t);
+        if (neededBytes != bytes) {
+            clear();
+            const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+            glBufferStorage(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(neededBytes), nullptr, flags);
+            mapping = static_cast<const char*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(neededBytes), flags));
+            bytes = neededBytes;
+        }
+        glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+        glGetTextureSubImage(accumulation, 0, 0, 0, 0, static_cast<GLsizei>(size.x), static_cast<GLsizei>(size.y), 1, GL_RGBA,
+                             GL_FLOAT, static_cast<GLsizei>(imageBytes), nullptr);
+        if (described.hasVariance) {
+            glGetTextureSubImage(variance, 0, 0, 0, 0, static_cast<GLsizei>(size.x), static_cast<GLsizei>(size.y), 1, GL_RGBA,
+                                 GL_FLOAT, static_cast<GLsizei>(imageBytes), reinterpret_cast<void*>(imageBytes));
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        hasCounter = counter != 0;
+        if (hasCounter) {
+            glBindBuffer(GL_COPY_READ_BUFFER, counter);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, counterOffset,
+                                static_cast<GLintptr>(2 * imageBytes), sizeof(uint64_t));
+        }
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+        checkpoint = described;
+    }
+
+    bool CheckpointReadback::save(const std::string& path, bool wait) {
+        if (!fence)
+            return false;
+        const GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? GL_TIMEOUT_IGNORED : 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            return false;
+        glDeleteSync(fence);
+        fence = nullptr;
+        const size_t pixelCount = static_cast<size_t>(checkpoint.resolution.x) * checkpoint.resolution.y;
+        if (hasCounter)
+            std::memcpy(&checkpoint.totalSamples, mapping + 2 * pixelCount * sizeof(vec4), sizeof(uint64_t));
+        const vec4* images = reinterpret_cast<const vec4*>(mapping);
+        writer.save(path, checkpoint, images, images + pixelCount);
+        return true;
+    }
+
+    void CheckpointReadback::clear() {
+        if (fence)
+            glDeleteSync(fence);
+        if (buffer) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            glDeleteBuffers(1, &buffer);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+        buffer = 0;
+        bytes = 0;
+        mapping = nullptr;
+        fence = nullptr;
+    }
+}
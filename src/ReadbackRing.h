@@ -0,0 +1,99 @@
+﻿#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Checkpoint.h"
+#include "RenderTargets.h"
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+using namespace glm;
+
+namespace raytracer {
+    // Reads images back from the GPU without waiting for them. Every read goes into the next of a ring
+    // of persistently mapped pixel buffers, behind a fence; poll() hands it out frames later, once the
+    // fence has signalled, and its pixels stay valid until release(), which any thread may call when
+    // it is done with them. A read with every buffer still in use is dropped instead of waited for.
+    // Everything but release() is for the thread with the GL context.
+    class ReadbackRing {
+    public:
+        static constexpr uint32_t slotCount = 4;
+
+        // A texture and what its texels are read as, RenderTargets::rgba32f for the float images
+        // whatever they are stored in.
+        struct Image {
+            GLuint texture;
+            RenderTargets::Format format;
+        };
+
+        struct Readback {
+            uvec2 size;
+            uint64_t tag;                   // the caller's, a frame number say
+            std::vector<const void*> images; // in the order read() was given them, size of them each
+        };
+
+        ReadbackRing() = default;
+        ReadbackRing(const ReadbackRing&) = delete;
+        ReadbackRing& operator=(const ReadbackRing&) = delete;
+
+        // Starts reading the bottom left size of the images, false if every buffer is busy.
+        bool read(uvec2 size, const std::vector<Image>& images, uint64_t tag);
+        // The oldest read the GPU has finished, nullptr if there is none yet; with wait it waits for
+        // the oldest one in flight, if any.
+        Readback* poll(bool wait = false);
+        void release(const Readback* readback);
+        // Deletes the buffers; nothing handed out may be in use any more.
+        void clear();
+
+        uint64_t getDroppedReads() const { return droppedReads; }
+    private:
+        enum State { Free, Reading, HandedOut };
+
+        struct Slot {
+            GLuint buffer = 0;
+            size_t bytes = 0;
+            const char* mapping = nullptr;
+            GLsync fence = nullptr;
+            std::atomic<int> state = Free;
+            Readback readback;
+        };
+
+        std::array<Slot, slotCount> slots;
+        uint32_t next = 0;          // the slot the next read goes to
+        uint32_t oldest = 0;        // the one poll() looks at
+        uint64_t droppedReads = 0;
+    };
+
+    // Reads a checkpoint of a render on the GPU back without waiting for it: start() has the GPU copy
+    // the accumulation, the statistics and the adaptive sample counter into a persistently mapped
+    // buffer, and save() hands them to the CheckpointWriter once a fence says the copy is done, which
+    // saves straight from the mapping. One is read at a time, for the thread with the GL context.
+    class CheckpointReadback {
+    public:
+        explicit CheckpointReadback(CheckpointWriter& writer): writer(writer) { }
+        CheckpointReadback(const CheckpointReadback&) = delete;
+        CheckpointReadback& operator=(const CheckpointReadback&) = delete;
+
+        // Starts copying checkpoint.resolution of accumulation, and of variance with hasVariance. With a
+        // counter its 64 bit sample count at counterOffset replaces the checkpoint's totalSamples.
+        void start(const Checkpoint& checkpoint, GLuint accumulation, GLuint variance, GLuint counter = 0,
+                   GLintptr counterOffset = 0);
+        // Hands the copy to the writer for path once it is done, or waits for it; false while it isn't,
+        // or if nothing was started.
+        bool save(const std::string& path, bool wait);
+        bool isReading() const { return fence != nullptr; }
+        // Deletes the buffer; the writer must be done with it.
+        void clear();
+    private:
+        CheckpointWriter& writer;
+        Checkpoint checkpoint;      // of the images being copied
+        bool hasCounter = false;
+        GLuint buffer = 0;
+        size_t bytes = 0;
+        const char* mapping = nullptr;
+        GLsync fence = nullptr;     // signalled once the copy is done
+    };
+}
@@ -0,0 +1,73 @@
+﻿#include "RenderTargets.h"
+
+#include <algorithm>
+
+namespace raytracer {
+    GLuint RenderTargets::acquire(uvec2 size, const Format& format) {
+        for (Target& target : targets) {
+            if (!target.used && target.size == size && target.format == format) {
+                target.used = true;
+                return target.texture;
+            }
+        }
+
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, format.internalFormat, static_cast<GLsizei>(size.x), static_cast<GLsizei>(size.y),
+                     0, format.format, format.type, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        targets.push_back({ texture, size, format, true });
+        return texture;
+    }
+
+    void RenderTargets::release(GLuint texture) {
+        for (Target& target : targets) {
+            if (target.texture == texture)
+                target.used = false;
+        }
+    }
+
+    void RenderTargets::resize(GLuint& texture, uvec2 size, const Format& format) {
+        const auto current = std::find_if(targets.begin(), targets.end(),
+                                          [&](const Target& target) { return target.texture == texture; });
+        if (texture && current != targets.end() && current->size == size && current->format == format)
+            return;
+        // acquired first, so it isn't handed back the texture it replaces
+        const GLuint replacement = acquire(size, format);
+        release(texture);
+        texture = replacement;
+    }
+
+    void RenderTargets::trim() {
+        for (const Target& target : targets) {
+            if (!target.used)
+                glDeleteTextures(1, &target.texture);
+        }
+        targets.erase(std::remove_if(targets.begin(), targets.end(), [](const Target& target) { return !target.used; }),
+                      targets.end());
+    }
+
+    void RenderTargets::clear() {
+        for (const Target& target : targets)
+            glDeleteTextures(1, &target.texture);
+        targets.clear();
+    }
+
+    size_t RenderTargets::getUsedBytes() const {
+        size_t bytes = 0;
+        for (const Target& target : targets)
+            bytes += target.used ? target.getBytes() : 0;
+        return bytes;
+    }
+
+    size_t RenderTargets::getPooledBytes() const {
+        size_t bytes = 0;
+        for (const Target& target : targets)
+            bytes += target.used ? 0 : target.getBytes();
+        return bytes;
+    }
+}
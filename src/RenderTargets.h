@@ -0,0 +1,59 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+using namespace glm;
+
+namespace raytracer {
+    // Owns the 2D images the passes render into. A texture handed back goes to a pool keyed by size
+    // and format, and the next request for the same kind takes it from there instead of allocating,
+    // so images that come and go with features or swap roles, like the reprojection history, cost
+    // nothing after the first time. resize() keeps a texture that already has the size it is asked
+    // for. Textures are cleared by whoever uses them, not here.
+    class RenderTargets {
+    public:
+        struct Format {
+            GLint internalFormat;
+            GLenum format;      // and type, what glTexImage2D is told of the (absent) data
+            GLenum type;
+            uint32_t bytesPerPixel;
+
+            bool operator==(const Format& other) const { return internalFormat == other.internalFormat; }
+        };
+
+        static constexpr Format rgba32f = { GL_RGBA32F, GL_RGBA, GL_FLOAT, 16 };
+        static constexpr Format rgba16f = { GL_RGBA16F, GL_RGBA, GL_FLOAT, 8 };
+        static constexpr Format r11g11b10f = { GL_R11F_G11F_B10F, GL_RGB, GL_FLOAT, 4 };
+        static constexpr Format rg32ui = { GL_RG32UI, GL_RG_INTEGER, GL_UNSIGNED_INT, 8 };
+
+        // A texture of the size and format with nearest filtering, from the pool if it has one.
+        GLuint acquire(uvec2 size, const Format& format);
+        // Puts a texture acquire() handed out back in the pool; 0 is ignored.
+        void release(GLuint texture);
+        // Makes texture, 0 or one from acquire(), one of the size and format, keeping it if it is.
+        void resize(GLuint& texture, uvec2 size, const Format& format);
+        // Deletes what is in the pool, after a resize nobody asks for the old size again.
+        void trim();
+        // Deletes every texture, whoever holds them.
+        void clear();
+
+        // Of the textures handed out and of the ones waiting in the pool.
+        size_t getUsedBytes() const;
+        size_t getPooledBytes() const;
+        size_t getTextureCount() const { return targets.size(); }
+    private:
+        struct Target {
+            GLuint texture;
+            uvec2 size;
+            Format format;
+            bool used;
+
+            size_t getBytes() const { return static_cast<size_t>(size.x) * size.y * format.bytesPerPixel; }
+        };
+
+        std::vector<Target> targets;
+    };
+}
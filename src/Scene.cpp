@@ -0,0 +1,127 @@
+﻿#include "Scene.h"
+
+namespace raytracer {
+    // An axis-aligned box around the origin with its normals facing inwards.
+    static Model createRoom(vec3 halfExtent, Transform transform, Material material) {
+        std::vector<vec3> vertices, normals;
+        std::vector<uint32_t> indices;
+        for (int axis = 0; axis < 3; ++axis) {
+            for (const float side : { -1.0f, 1.0f }) {
+                vec3 normal(0.0f);
+                normal[axis] = -side;
+                const int u = (axis + 1) % 3, v = (axis + 2) % 3;
+                const auto first = static_cast<uint32_t>(vertices.size());
+                for (int corner = 0; corner < 4; ++corner) {
+                    vec3 position(0.0f);
+                    position[axis] = side * halfExtent[axis];
+                    position[u] = (corner & 1 ? 1.0f : -1.0f) * halfExtent[u];
+                    position[v] = (corner & 2 ? 1.0f : -1.0f) * halfExtent[v];
+                    vertices.push_back(position);
+                    normals.push_back(normal);
+                }
+                indices.insert(indices.end(), { first, first + 1, first + 3, first, first + 3, first + 2 });
+            }
+        }
+        return Model(std::move(vertices), std::move(normals), std::move(indices), transform, material);
+    }
+
+    void Scene::addModel(const Model& model) {
+        const auto firstTriangle = static_cast<uint32_t>(triangles.size());
+        const auto firstNode = static_cast<uint32_t>(nodes.size());
+
+        model.addTriangles(triangles);
+        model.addNodes(nodes);
+        model.addMesh(meshes);
+
+        // every mesh builds its BVH on its own, starting at triangle 0 and node 0
+        for (size_t i = firstNode; i < nodes.size(); ++i) {
+            auto& node = nodes[i].triIndex_triCount_childIndex;
+            if (node.y > 0)
+                node.x += firstTriangle;
+            else
+                node.z += firstNode;
+        }
+        meshes.back().firstTriangleIndex = firstTriangle;
+        meshes.back().rootNodeIndex = firstNode;
+    }
+
+    static bool isEmissive(const vec4& emissiveStrength) {
+        return emissiveStrength.w > 0.0f && vec3(emissiveStrength) != vec3(0.0f);
+    }
+
+    uint32_t Scene::getFeatures() const {
+        uint32_t features = 0;
+        auto addMaterial = [&features](const vec4& colorSmoothness, const vec4& emissiveStrength) {
+            if (colorSmoothness.w > 0.0f)
+                features |= SceneHasSmoothness;
+            if (isEmissive(emissiveStrength))
+                features |= SceneHasEmission;
+        };
+
+        for (const Sphere& sphere : spheres) {
+            features |= SceneHasSpheres;
+            addMaterial(sphere.color_smoothness, sphere.emissiveColor_strength);
+        }
+        for (const MeshInfo& mesh : meshes) {
+            if (mesh.numTriangles == 0)
+                continue;
+            features |= SceneHasMeshes;
+            addMaterial(mesh.color_smoothness, mesh.emissiveColor_strength);
+        }
+        if (environment.isLoaded())
+            features |= SceneHasEmission;
+        return features;
+    }
+
+    float Scene::getEnvironmentSampleProbability() const {
+        if (!environment.isLoaded())
+            return 0.0f;
+        return lights.totalWeight > 0.0f ? 0.5f : 1.0f;
+    }
+
+    void Scene::buildLights() {
+        lights = {};
+        for (const Sphere& sphere : spheres)
+            lights.lights.push_back(LightSet::makeSphereLight(sphere));
+        for (MeshInfo& mesh : meshes) {
+            mesh.firstLightIndex = static_cast<uint32_t>(lights.lights.size());
+            if (!isEmissive(mesh.emissiveColor_strength))
+                continue;
+            for (uint32_t i = 0; i < mesh.numTriangles; ++i)
+                lights.lights.push_back(LightSet::makeTriangleLight(mesh, triangles[mesh.firstTriangleIndex + i]));
+        }
+        lights.build();
+    }
+
+    Scene Scene::createDefault() {
+        Scene scene;
+        scene.spheres = {
+            {vec4(0.0, 0.0, 0.0, 1.0), vec4(1, 1, 1, 1), vec4(0)},
+            {vec4(0.0, 2.0, 2.0, 1.0), vec4(0, 0, 1, 0), vec4(1, 1, 1, 4)},
+            {vec4(0.0, -21.0, -1.0, 20.0), vec4(0.7, 0.2, 0.6, 0), vec4(0)}
+        };
+
+        const Material material {
+            vec3(1),
+            0,
+        };
+        const Model suzanne("resources/suzanne.glb", Transform { vec3(0, 2, -4), vec3(-45, 0, 0), vec3(1) }, material);
+        scene.addModel(suzanne);
+        scene.buildLights();
+        return scene;
+    }
+
+    Scene Scene::createEnclosed() {
+        Scene scene = createDefault();
+        // the ground sphere would poke through the walls, the room has a floor of its own
+        scene.spheres.pop_back();
+
+        const Material walls {
+            vec3(0.75f),
+            0,
+        };
+        scene.addModel(createRoom(vec3(6.0f, 3.0f, 10.0f), Transform { vec3(0, 2, 0), vec3(0), vec3(1) }, walls));
+        scene.buildLights();
+        return scene;
+    }
+}
@@ -0,0 +1,47 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "Environment.h"
+#include "Lights.h"
+#include "Model.h"
+
+namespace raytracer {
+    // Scene properties that stay fixed for a whole render. The CPU integrator is instantiated per
+    // combination, so a scene only pays for the features it actually uses.
+    enum SceneFeature : uint32_t {
+        SceneHasSpheres = 1 << 0,
+        SceneHasMeshes = 1 << 1,
+        SceneHasSmoothness = 1 << 2,
+        SceneHasEmission = 1 << 3,     // emissive surfaces or an environment map, anything to sample lights from
+        SceneFeatureCount = 4,
+        SceneAllFeatures = (1 << SceneFeatureCount) - 1,
+    };
+
+    // Everything the renderers trace against, in the layout of the shader storage buffers.
+    struct Scene {
+        std::vector<Sphere> spheres;
+        std::vector<Triangle> triangles;
+        std::vector<MeshInfo> meshes;
+        std::vector<BVHNode> nodes;
+        LightSet lights;
+        Environment environment;        // the sky gradient stands in if nothing is loaded
+
+        // Appends the model and rebases its triangle and node indices onto the shared buffers.
+        void addModel(const Model& model);
+
+        uint32_t getFeatures() const;
+
+        // Collects the emitters and builds the light tree. Has to run again after emission changes.
+        void buildLights();
+
+        // Share of light samples that go to the environment map rather than to the emitters.
+        float getEnvironmentSampleProbability() const;
+
+        // The spheres and suzanne the interactive renderer starts with.
+        static Scene createDefault();
+        // The default objects shut inside a grey room, lit only by the emissive sphere. No ray
+        // escapes, so path length is bounded by maxBounces and Russian roulette alone.
+        static Scene createEnclosed();
+    };
+}
@@ -21,13 +21,14 @@ namespace raytracer {
         glDeleteShader(fragmentShader);
     }
 
-    Shader::Shader(const char* vertexFilename, const char* fragmentFilename, const char* computeFilename)
+    Shader::Shader(const char* vertexFilename, const char* fragmentFilename, const char* computeFilename,
+                   const std::string& computeDefines)
     {
         shaderID = glCreateProgram();
         computeShaderID = glCreateProgram();
         const auto vertexShader = createShader(vertexFilename, GL_VERTEX_SHADER);
         const auto fragmentShader = createShader(fragmentFilename, GL_FRAGMENT_SHADER);
-        const auto computeShader = createShader(computeFilename, GL_COMPUTE_SHADER);
+        const auto computeShader = createShader(computeFilename, GL_COMPUTE_SHADER, computeDefines);
 
         glAttachShader(shaderID, vertexShader);
         glAttachShader(shaderID, fragmentShader);
@@ -40,9 +41,23 @@ namespace raytracer {
         glDeleteShader(computeShader);
     }
 
-    GLuint Shader::createShader(const char* filename, GLenum type) const
+    Shader::Shader(const char* computeFilename, const std::string& computeDefines)
     {
-        const std::string source = Utils::readFile(filename);
+        computeShaderID = glCreateProgram();
+        const auto computeShader = createShader(computeFilename, GL_COMPUTE_SHADER, computeDefines);
+
+        glAttachShader(computeShaderID, computeShader);
+        glLinkProgram(computeShaderID);
+
+        glDeleteShader(computeShader);
+    }
+
+    GLuint Shader::createShader(const char* filename, GLenum type, const std::string& defines) const
+    {
+        std::string source = Utils::readFile(filename);
+        // nothing may come before #version; errors keep the file's line numbers
+        if (!defines.empty())
+            source.insert(source.find('\n') + 1, defines + "#line 2\n");
         const char* shaderSource = source.c_str();
 
         GLint isCompiled = 0;
@@ -234,5 +249,6 @@ namespace raytracer {
     void Shader::del() const
     {
         glDeleteProgram(shaderID);
+        glDeleteProgram(computeShaderID);
     }
 }
\ No newline at end of file
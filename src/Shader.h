@@ -1,4 +1,5 @@
 ﻿#pragma once
+#include <string>
 #include <unordered_map>
 #include "glad/glad.h"
 #include "glm/vec2.hpp"
@@ -7,11 +8,15 @@ namespace raytracer {
     class Shader
     {
     public:
-        GLuint shaderID;
-        GLuint computeShaderID;
+        GLuint shaderID = 0;
+        GLuint computeShaderID = 0;
         Shader(const char* vertexFilename, const char* fragmentFilename);
-        Shader(const char* vertexFilename, const char* fragmentFilename, const char* computeFilename);
-        Shader(): shaderID(0) { }
+        // computeDefines go right after the compute shader's #version line, "#define NAME value" lines.
+        Shader(const char* vertexFilename, const char* fragmentFilename, const char* computeFilename,
+               const std::string& computeDefines = "");
+        // Only a compute program, set its uniforms with compute = true.
+        explicit Shader(const char* computeFilename, const std::string& computeDefines = "");
+        Shader() = default;
 
         void setMatrix4x4(const char* name, const float* matrix, bool compute = false);
         void setMatrix3x3(const char* name, const float* matrix, bool compute = false);
@@ -32,7 +37,7 @@ namespace raytracer {
     private:
         int getUniformLocation(const char* name);
         int getComputeUniformLocation(const char* name);
-        GLuint createShader(const char* filename, GLenum type) const;
+        GLuint createShader(const char* filename, GLenum type, const std::string& defines = "") const;
 
         std::unordered_map<const char*, int> cachedUniformLocations;
         std::unordered_map<const char*, int> cachedComputeUniformLocations;
@@ -0,0 +1,13 @@
+﻿#include "Termination.h"
+
+namespace raytracer {
+    const char* TerminationPolicy::check(double samples, double elapsed, float error) const {
+        if (samplesPerPixel > 0.0 && samples >= samplesPerPixel)
+            return "target samples per pixel";
+        if (noiseThreshold > 0.0f && error <= noiseThreshold)
+            return "noise threshold";
+        if (seconds > 0.0 && elapsed >= seconds)
+            return "time budget";
+        return nullptr;
+    }
+}
@@ -0,0 +1,44 @@
+﻿#pragma once
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+namespace raytracer {
+    // When a progressive render is done: once it has a number of samples per pixel, has run for a
+    // time, or its estimated error (Adaptive::estimateError) is below a threshold, whichever comes
+    // first. Nothing set means it never is.
+    struct TerminationPolicy {
+        double samplesPerPixel = 0.0;   // averaged over the pixels, 0 = no target
+        double seconds = 0.0;           // 0 = no budget
+        float noiseThreshold = 0.0f;    // 0 = no threshold, needs the pixel statistics otherwise
+
+        bool isSet() const { return samplesPerPixel > 0.0 || seconds > 0.0 || noiseThreshold > 0.0f; }
+
+        // What ended the render given how far it got, nullptr while it goes on.
+        const char* check(double samplesPerPixel, double seconds, float error) const;
+    };
+
+    // How far a progressive render got: what the policy is checked against, and the counters a
+    // checkpoint keeps to go on from.
+    struct RenderProgress {
+        uint32_t frameIndex = 0;        // numbers the next frame's samples, goes on through reprojection
+        uint32_t frameCount = 0;        // frames in the accumulation
+        uint64_t totalSamples = 0;      // camera samples since the accumulation was cleared
+        float estimatedError = INFINITY; // Adaptive::estimateError of the image, where the policy needs it
+        std::chrono::steady_clock::time_point start;
+        bool finished = false;          // the policy ended the render, nothing is traced until it restarts
+
+        double getSeconds() const {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        // Starts everything but frameIndex over, and the clock with it.
+        void restart() {
+            frameCount = 0;
+            totalSamples = 0;
+            estimatedError = INFINITY;
+            start = std::chrono::steady_clock::now();
+            finished = false;
+        }
+    };
+}
@@ -0,0 +1,70 @@
+﻿#include "TiledImageWriter.h"
+
+#include <cstdio>
+
+namespace raytracer {
+    TiledImageWriter::TiledImageWriter(ImageWriter& writer, const std::string& path, uvec2 resolution):
+        writer(writer), file(path, std::ios::binary | std::ios::trunc), resolution(resolution) {
+        char header[64];
+        const int length = std::snprintf(header, sizeof(header), "PF\n%u %u\n-1.0\n", resolution.x, resolution.y);
+        file.write(header, length);
+        headerBytes = length;
+        // writing the last byte makes the file as long as the image, the tiles only overwrite
+        const std::streamoff bytes = headerBytes + static_cast<std::streamoff>(resolution.x) * resolution.y * 3 * sizeof(float);
+        file.seekp(bytes - 1);
+        file.put('\0');
+        open = static_cast<bool>(file);
+    }
+
+    TiledImageWriter::~TiledImageWriter() {
+        finish();
+    }
+
+    void TiledImageWriter::write(uvec2 offset, uvec2 size, std::vector<vec4> pixels) {
+        {
+            std::lock_guard lock(pendingMutex);
+            ++pendingTiles;
+        }
+        // after a failure the tiles are still taken, only not written
+        writer.submit([this, offset, size, pixels = std::move(pixels)] {
+            if (failed || !writeTile(offset, size, pixels))
+                failed = true;
+            return !failed;
+        }, [this](bool) {
+            // notified under the lock, so finish() returns only once this is done with the object
+            std::lock_guard lock(pendingMutex);
+            --pendingTiles;
+            tileWritten.notify_all();
+        }, true);
+    }
+
+    bool TiledImageWriter::finish() {
+        if (open) {
+            std::unique_lock lock(pendingMutex);
+            tileWritten.wait(lock, [&] { return pendingTiles == 0; });
+            file.close();
+            failed = failed || file.fail();
+            open = false;
+        }
+        return !failed;
+    }
+
+    bool TiledImageWriter::writeTile(uvec2 offset, uvec2 size, const std::vector<vec4>& pixels) {
+        std::vector<float> row(static_cast<size_t>(size.x) * 3);
+        std::lock_guard lock(fileMutex);
+        for (uint32_t y = 0; y < size.y; ++y) {
+            const vec4* pixel = pixels.data() + static_cast<size_t>(y) * size.x;
+            for (uint32_t x = 0; x < size.x; ++x, ++pixel) {
+                row[x * 3 + 0] = pixel->r;
+                row[x * 3 + 1] = pixel->g;
+                row[x * 3 + 2] = pixel->b;
+            }
+            const std::streamoff first = static_cast<std::streamoff>(offset.y + y) * resolution.x + offset.x;
+            file.seekp(headerBytes + first * static_cast<std::streamoff>(3 * sizeof(float)));
+            file.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size() * sizeof(float)));
+            if (!file)
+                return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,50 @@
+﻿#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ImageWriter.h"
+#include "glm/glm.hpp"
+using namespace glm;
+
+namespace raytracer {
+    // Writes an image too large to hold in memory tile by tile, as a Portable Float Map like
+    // ImageFile::writePfm does. The file is sized for the whole image up front and every tile's rows
+    // are written where they belong by the ImageWriter's threads, so rendering goes on meanwhile.
+    // write() waits while the writer's queue is full, which bounds the memory whatever the size of
+    // the image.
+    class TiledImageWriter {
+    public:
+        TiledImageWriter(ImageWriter& writer, const std::string& path, uvec2 resolution);
+        ~TiledImageWriter();
+        TiledImageWriter(const TiledImageWriter&) = delete;
+        TiledImageWriter& operator=(const TiledImageWriter&) = delete;
+
+        // False if the file could not be created at its full size.
+        bool isOpen() const { return open; }
+
+        // Queues the colour of a tile, size pixels from offset with the bottom row first as the
+        // accumulation has them. The tiles may come in any order.
+        void write(uvec2 offset, uvec2 size, std::vector<vec4> pixels);
+        // Waits for the tiles queued so far, not for the writer's other jobs, and closes the file; false
+        // if any of it could not be written.
+        bool finish();
+    private:
+        bool writeTile(uvec2 offset, uvec2 size, const std::vector<vec4>& pixels);
+
+        ImageWriter& writer;
+        std::ofstream file;
+        std::streamoff headerBytes = 0;
+        uvec2 resolution;
+        bool open = false;
+        std::atomic<bool> failed = false;
+        std::mutex fileMutex;       // the workers take turns seeking and writing
+        uint32_t pendingTiles = 0;  // queued on the writer and not written yet
+        std::mutex pendingMutex;
+        std::condition_variable tileWritten;
+    };
+}
@@ -1,86 +1,87 @@
-﻿#include "Window.h"
-
-namespace raytracer {
-    static void windowSizeCallback(GLFWwindow* window, int width, int height);
-    static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
-    static void errorCallback(int error, const char* description);
-
-    Window::Window(int width, int height, const std::string& title, bool fullscreen) {
-        INFO("Initializing...");
-
-        glfwSetErrorCallback(errorCallback);
-
-        if (glfwInit() == GLFW_FALSE) {
-            ASSERT("Failed to initialize GLFW! Aborting...");
-            return;
-        }
-
-        GLFWmonitor* monitor = glfwGetPrimaryMonitor();
-        const GLFWvidmode* mode = glfwGetVideoMode(monitor);
-
-        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_COMPAT_PROFILE);
-        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
-        glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
-        glfwWindowHint(GLFW_DECORATED, GLFW_TRUE);
-        glfwWindowHint(GLFW_FOCUSED, GLFW_TRUE);
-        glfwWindowHint(GLFW_RED_BITS, mode->redBits);
-        glfwWindowHint(GLFW_GREEN_BITS, mode->greenBits);
-        glfwWindowHint(GLFW_BLUE_BITS, mode->blueBits);
-        glfwWindowHint(GLFW_REFRESH_RATE, mode->refreshRate);
-
-        width = fullscreen ? mode->width : width;
-        height = fullscreen ? mode->height : height;
-        window = glfwCreateWindow(width, height, title.c_str(), fullscreen ? monitor : nullptr, nullptr);
-        if (!window) {
-            ASSERT("Failed to create window! Aborting...");
-            glfwTerminate();
-            return;
-        }
-
-        DEBUG("Successfully Created Window.");
-
-        glfwSetKeyCallback(window, keyCallback);
-
-        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-        if (glfwRawMouseMotionSupported())
-            glfwSetInputMode(window, GLFW_RAW_MOUSE_MOTION, GLFW_TRUE);
-        DEBUG("Successfully Initialized GLFW.");
-
-        glfwMakeContextCurrent(window);
-
-        params.width = width;
-        params.height = height;
-        DEBUG("Successfully Fetched Window Size of: %d, %d", width, height);
-
-        if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress))) {
-            ASSERT("Failed to initialize OpenGL! Aborting...");
-            glfwDestroyWindow(window);
-            glfwTerminate();
-            return;
-        }
-        DEBUG("Successfully Initialized OpenGL.");
-
-        glViewport(0, 0, width, height);
-
-        INFO("Initialized Successfully.");
-    }
-
-    Window::~Window() {
-        glfwDestroyWindow(window);
-        glfwTerminate();
-    }
-
-    void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods) {
-        if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
-            glfwSetWindowShouldClose(window, GLFW_TRUE);
-    }
-
-    static void errorCallback(int error, const char* description) {
-        ERR("GLFW Error %d: %s", error, description);
-    }
-
-    GLFWwindow* Window::getWindow() const {
-        return window;
-    }
+﻿#include "Window.h"
+
+namespace raytracer {
+    static void windowSizeCallback(GLFWwindow* window, int width, int height);
+    static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
+    static void errorCallback(int error, const char* description);
+
+    Window::Window(int width, int height, const std::string& title, bool fullscreen, bool visible) {
+        INFO("Initializing...");
+
+        glfwSetErrorCallback(errorCallback);
+
+        if (glfwInit() == GLFW_FALSE) {
+            ASSERT("Failed to initialize GLFW! Aborting...");
+            return;
+        }
+
+        GLFWmonitor* monitor = glfwGetPrimaryMonitor();
+        const GLFWvidmode* mode = glfwGetVideoMode(monitor);
+
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_COMPAT_PROFILE);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+        glfwWindowHint(GLFW_DECORATED, GLFW_TRUE);
+        glfwWindowHint(GLFW_FOCUSED, visible ? GLFW_TRUE : GLFW_FALSE);
+        glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
+        glfwWindowHint(GLFW_RED_BITS, mode->redBits);
+        glfwWindowHint(GLFW_GREEN_BITS, mode->greenBits);
+        glfwWindowHint(GLFW_BLUE_BITS, mode->blueBits);
+        glfwWindowHint(GLFW_REFRESH_RATE, mode->refreshRate);
+
+        width = fullscreen ? mode->width : width;
+        height = fullscreen ? mode->height : height;
+        window = glfwCreateWindow(width, height, title.c_str(), fullscreen ? monitor : nullptr, nullptr);
+        if (!window) {
+            ASSERT("Failed to create window! Aborting...");
+            glfwTerminate();
+            return;
+        }
+
+        DEBUG("Successfully Created Window.");
+
+        glfwSetKeyCallback(window, keyCallback);
+
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+        if (glfwRawMouseMotionSupported())
+            glfwSetInputMode(window, GLFW_RAW_MOUSE_MOTION, GLFW_TRUE);
+        DEBUG("Successfully Initialized GLFW.");
+
+        glfwMakeContextCurrent(window);
+
+        params.width = width;
+        params.height = height;
+        DEBUG("Successfully Fetched Window Size of: %d, %d", width, height);
+
+        if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress))) {
+            ASSERT("Failed to initialize OpenGL! Aborting...");
+            glfwDestroyWindow(window);
+            glfwTerminate();
+            return;
+        }
+        DEBUG("Successfully Initialized OpenGL.");
+
+        glViewport(0, 0, width, height);
+
+        INFO("Initialized Successfully.");
+    }
+
+    Window::~Window() {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
+
+    void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods) {
+        if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
+            glfwSetWindowShouldClose(window, GLFW_TRUE);
+    }
+
+    static void errorCallback(int error, const char* description) {
+        ERR("GLFW Error %d: %s", error, description);
+    }
+
+    GLFWwindow* Window::getWindow() const {
+        return window;
+    }
 }
\ No newline at end of file
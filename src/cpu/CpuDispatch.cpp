@@ -0,0 +1,162 @@
+﻿#include "CpuDispatch.h"
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+
+#include "misc/Logger.h"
+
+#if TARGET_ARCH_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace raytracer {
+    namespace {
+        struct Features {
+            bool sse42 = false;
+            bool avx2 = false;
+            bool avx512 = false;
+        };
+
+#if TARGET_ARCH_X86
+        void cpuid(unsigned leaf, unsigned subleaf, unsigned regs[4]) {
+#if defined(_MSC_VER)
+            int r[4];
+            __cpuidex(r, static_cast<int>(leaf), static_cast<int>(subleaf));
+            for (int i = 0; i < 4; ++i)
+                regs[i] = static_cast<unsigned>(r[i]);
+#else
+            __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+        }
+
+        unsigned long long xgetbv() {
+#if defined(_MSC_VER)
+            return _xgetbv(0);
+#else
+            unsigned eax, edx;
+            __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+            return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+        }
+#endif
+
+        Features detect() {
+            Features features;
+#if TARGET_ARCH_X86
+            unsigned regs[4];
+            cpuid(0, 0, regs);
+            const unsigned maxLeaf = regs[0];
+
+            cpuid(1, 0, regs);
+            features.sse42 = regs[2] >> 20 & 1;
+            const bool osxsave = regs[2] >> 27 & 1;
+            const bool avx = regs[2] >> 28 & 1;
+            const bool fma = regs[2] >> 12 & 1;
+
+            // the OS has to save the wider registers on context switches, not just the CPU support them
+            const unsigned long long xcr0 = osxsave ? xgetbv() : 0;
+            const bool ymmState = (xcr0 & 0x6) == 0x6;
+            const bool zmmState = (xcr0 & 0xe6) == 0xe6;
+
+            if (maxLeaf >= 7) {
+                cpuid(7, 0, regs);
+                const unsigned ebx = regs[1];
+                features.avx2 = avx && fma && ymmState && (ebx >> 5 & 1);
+                // F, DQ, BW and VL: Skylake-SP and everything newer
+                features.avx512 = features.avx2 && zmmState && (ebx >> 16 & 1) && (ebx >> 17 & 1) &&
+                                  (ebx >> 30 & 1) && (ebx >> 31 & 1);
+            }
+#endif
+            return features;
+        }
+
+        const Features& getFeatures() {
+            static const Features features = detect();
+            return features;
+        }
+
+        std::atomic<const Kernels*> activeKernels{nullptr};
+        Isa activeIsa = Isa::Scalar;
+
+        const char* isaNames[] = { "scalar", "sse4.2", "avx2", "avx512" };
+    }
+
+    void CpuDispatch::init(std::optional<Isa> forced) {
+        const Features& features = getFeatures();
+
+        Isa best = Isa::Scalar;
+        for (int i = static_cast<int>(Isa::Count) - 1; i >= 0; --i) {
+            if (isSupported(static_cast<Isa>(i))) {
+                best = static_cast<Isa>(i);
+                break;
+            }
+        }
+
+        activeIsa = best;
+        if (forced) {
+            if (isSupported(*forced))
+                activeIsa = *forced;
+            else
+                WARN("Forced ISA %s is not supported by this CPU, using %s.", getName(*forced), getName(best));
+        }
+        activeKernels = &getKernels(activeIsa);
+
+        INFO("CPU kernels: %s%s (sse4.2=%d avx2=%d avx512=%d)", getName(activeIsa),
+             forced && activeIsa == *forced ? " (forced)" : "", features.sse42, features.avx2, features.avx512);
+    }
+
+    Isa CpuDispatch::getActiveIsa() {
+        return activeIsa;
+    }
+
+    bool CpuDispatch::isSupported(Isa isa) {
+        const Features& features = getFeatures();
+        switch (isa) {
+            case Isa::Scalar: return true;
+            case Isa::SSE42: return features.sse42;
+            case Isa::AVX2: return features.avx2;
+            case Isa::AVX512: return features.avx512;
+            default: return false;
+        }
+    }
+
+    const Kernels& CpuDispatch::getKernels(Isa isa) {
+#if TARGET_ARCH_X86
+        switch (isa) {
+            case Isa::SSE42: return getSSE42Kernels();
+            case Isa::AVX2: return getAVX2Kernels();
+            case Isa::AVX512: return getAVX512Kernels();
+            default: break;
+        }
+#endif
+        return getScalarKernels();
+    }
+
+    const char* CpuDispatch::getName(Isa isa) {
+        return isaNames[static_cast<int>(isa)];
+    }
+
+    std::optional<Isa> CpuDispatch::parse(const char* name) {
+        for (int i = 0; i < static_cast<int>(Isa::Count); ++i) {
+            if (!strcmp(name, isaNames[i]))
+                return static_cast<Isa>(i);
+        }
+        return std::nullopt;
+    }
+
+    const Kernels& Kernels::get() {
+        if (!activeKernels.load(std::memory_order_acquire)) {
+            static std::once_flag once;
+            std::call_once(once, [] {
+                if (!activeKernels.load())
+                    CpuDispatch::init();
+            });
+        }
+        return *activeKernels.load(std::memory_order_acquire);
+    }
+}
@@ -0,0 +1,21 @@
+﻿#pragma once
+#include <optional>
+
+#include "Kernels.h"
+
+namespace raytracer {
+    // Picks the kernel variants for the CPU the binary actually runs on, so the build no longer
+    // has to assume the features of the machine that compiled it.
+    class CpuDispatch {
+    public:
+        // Selects the best supported ISA, or the forced one if this CPU can run it.
+        static void init(std::optional<Isa> forced = std::nullopt);
+
+        static Isa getActiveIsa();
+        static bool isSupported(Isa isa);
+        static const Kernels& getKernels(Isa isa);
+
+        static const char* getName(Isa isa);
+        static std::optional<Isa> parse(const char* name);
+    };
+}
@@ -0,0 +1,151 @@
+﻿#include "Denoiser.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "JobSystem.h"
+
+namespace raytracer {
+    namespace {
+        constexpr float kernel[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+        float luminance(vec3 color) {
+            return dot(color, vec3(0.2126f, 0.7152f, 0.0722f));
+        }
+
+        vec3 demodulate(vec4 color, vec4 albedo) {
+            return vec3(color) / max(vec3(albedo), vec3(Denoiser::minAlbedo));
+        }
+
+        // cosine^normalPhi
+        float getNormalWeight(float cosine) {
+            static_assert(Denoiser::normalPhi == 64.0f);
+            float weight = std::max(cosine, 0.0f);
+            for (int i = 0; i < 6; ++i)
+                weight *= weight;
+            return weight;
+        }
+
+        // How much a tap offset pixels away shows the pixel's surface, from their AOVs, times exp(-exponent).
+        // Rays that left the scene have nothing to go by, and the sky they see has no noise to take out anyway.
+        float getSurfaceWeight(vec4 normalDepth, vec4 otherNormalDepth, vec3 albedo, vec3 otherAlbedo, float offset,
+                               float exponent = 0.0f) {
+            const float depth = normalDepth.w, otherDepth = otherNormalDepth.w;
+            if (depth <= 0.0f || otherDepth <= 0.0f)
+                return 0.0f;
+            const vec3 albedoDifference = albedo - otherAlbedo;
+            exponent += dot(albedoDifference, albedoDifference) / Denoiser::albedoPhi +
+                        std::abs(depth - otherDepth) / (Denoiser::depthPhi * depth * offset);
+            // the normals are averages, shorter than 1 where surfaces meet
+            const vec3 normal(normalDepth), otherNormal(otherNormalDepth);
+            const float cosine = dot(normal, otherNormal) /
+                                 std::sqrt(std::max(dot(normal, normal) * dot(otherNormal, otherNormal), 1e-12f));
+            return getNormalWeight(cosine) * std::exp(-exponent);
+        }
+
+        // The colour with the albedo divided out, and in w the variance of its luminance over the pixel's
+        // neighbours on the same surface. The sums are taken relative to the pixel, lights reach hundreds
+        // once divided by the smallest albedo.
+        void estimateVariance(const vec4* color, const AovBuffers& aovs, uvec2 resolution, vec4* output,
+                              size_t firstRow, size_t endRow) {
+            const ivec2 size(resolution);
+            for (size_t y = firstRow; y < endRow; ++y) {
+                for (int x = 0; x < size.x; ++x) {
+                    const size_t index = y * resolution.x + x;
+                    const vec4 normalDepth = aovs.normalDepth[index];
+                    const vec3 albedo(aovs.albedo[index]);
+                    const vec3 irradiance = demodulate(color[index], aovs.albedo[index]);
+                    const float centerLuminance = luminance(irradiance);
+                    float mean = 0.0f, square = 0.0f, total = 1.0f;
+                    for (int j = -1; j <= 1; ++j) {
+                        for (int i = -1; i <= 1; ++i) {
+                            const ivec2 tap(x + i, static_cast<int>(y) + j);
+                            if ((i == 0 && j == 0) || any(lessThan(tap, ivec2(0))) || any(greaterThanEqual(tap, size)))
+                                continue;
+                            const size_t tapIndex = static_cast<size_t>(tap.y) * resolution.x + tap.x;
+                            const float weight = getSurfaceWeight(normalDepth, aovs.normalDepth[tapIndex], albedo,
+                                                                  vec3(aovs.albedo[tapIndex]), std::sqrt(static_cast<float>(i * i + j * j)));
+                            const float value = luminance(demodulate(color[tapIndex], aovs.albedo[tapIndex])) - centerLuminance;
+                            mean += value * weight;
+                            square += value * value * weight;
+                            total += weight;
+                        }
+                    }
+                    mean /= total;
+                    output[index] = vec4(irradiance, std::max(square / total - mean * mean, 0.0f));
+                }
+            }
+        }
+
+        // One iteration, with taps step pixels apart. The variance goes along with the colour, weighed by
+        // the squares of the weights, so later iterations know how much noise the earlier ones left. The
+        // last iteration multiplies the albedo back in and puts the accumulation's samples back in w.
+        void filterRows(const vec4* input, const vec4* color, const AovBuffers& aovs, uvec2 resolution, int iteration,
+                        vec4* output, size_t firstRow, size_t endRow) {
+            const int step = 1 << iteration;
+            const ivec2 size(resolution);
+            float offsets[5][5];
+            for (int j = -2; j <= 2; ++j) {
+                for (int i = -2; i <= 2; ++i)
+                    offsets[j + 2][i + 2] = static_cast<float>(step) * std::sqrt(static_cast<float>(i * i + j * j));
+            }
+
+            for (size_t y = firstRow; y < endRow; ++y) {
+                for (int x = 0; x < size.x; ++x) {
+                    const size_t index = y * resolution.x + x;
+                    const vec4 center = input[index];
+                    const vec4 normalDepth = aovs.normalDepth[index];
+                    const vec3 albedo(aovs.albedo[index]);
+                    const float centerLuminance = luminance(vec3(center));
+                    const float colorScale = 1.0f / (Denoiser::colorPhi * std::sqrt(center.w) + 1e-4f);
+
+                    vec3 sum(0.0f);
+                    float total = 0.0f, variance = 0.0f;
+                    for (int j = -2; j <= 2; ++j) {
+                        const int tapY = static_cast<int>(y) + j * step;
+                        if (tapY < 0 || tapY >= size.y)
+                            continue;
+                        for (int i = -2; i <= 2; ++i) {
+                            const int tapX = x + i * step;
+                            if (tapX < 0 || tapX >= size.x)
+                                continue;
+                            const size_t tap = static_cast<size_t>(tapY) * resolution.x + tapX;
+                            const vec4 other = input[tap];
+                            float weight = kernel[i + 2] * kernel[j + 2];
+                            if (tap != index) {
+                                weight *= getSurfaceWeight(normalDepth, aovs.normalDepth[tap], albedo, vec3(aovs.albedo[tap]),
+                                                           offsets[j + 2][i + 2],
+                                                           std::abs(luminance(vec3(other)) - centerLuminance) * colorScale);
+                            }
+                            sum += vec3(other) * weight;
+                            variance += other.w * weight * weight;
+                            total += weight;
+                        }
+                    }
+                    const vec3 filtered = sum / total;
+                    output[index] = iteration == Denoiser::iterations - 1
+                                  ? vec4(filtered * max(albedo, vec3(Denoiser::minAlbedo)), color[index].w)
+                                  : vec4(filtered, variance / (total * total));
+                }
+            }
+        }
+    }
+
+    void Denoiser::denoise(const vec4* color, const AovBuffers& aovs, uvec2 resolution, vec4* output) {
+        const size_t pixelCount = static_cast<size_t>(resolution.x) * resolution.y;
+        for (std::vector<vec4>& buffer : scratch)
+            buffer.resize(pixelCount);
+        JobSystem::parallelForRange(0, resolution.y, 4, [&](size_t firstRow, size_t endRow) {
+            estimateVariance(color, aovs, resolution, scratch[0].data(), firstRow, endRow);
+        });
+        // every pass reads the one before around each pixel, so they take turns with the buffers
+        const vec4* input = scratch[0].data();
+        for (int iteration = 0; iteration < iterations; ++iteration) {
+            vec4* target = iteration == iterations - 1 ? output : scratch[(iteration + 1) & 1].data();
+            JobSystem::parallelForRange(0, resolution.y, 4, [&](size_t firstRow, size_t endRow) {
+                filterRows(input, color, aovs, resolution, iteration, target, firstRow, endRow);
+            });
+            input = target;
+        }
+    }
+}
@@ -0,0 +1,37 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "Integrator.h"
+#include "glm/glm.hpp"
+using namespace glm;
+
+namespace raytracer {
+    // Edge-avoiding à-trous wavelet filter (Dammertz et al., "Edge-Avoiding À-Trous Wavelet Transform for
+    // fast Global Illumination Filtering", 2010), with the luminance weight of Schied et al.,
+    // "Spatiotemporal Variance-Guided Filtering", 2017. Every iteration blurs with a 5x5 B3 spline kernel
+    // whose taps lie twice as far apart as the iteration's before, so five of them cover 125 pixels
+    // across at 25 taps a pixel each. Taps are weighed down where the AOVs say they show another surface,
+    // by their normal, their distance relative to the pixel's and their albedo, and where their luminance
+    // differs by more than the noise the pixel has left, estimated from its neighbours and carried through
+    // the iterations. Colour is filtered with the albedo divided out and multiplied back in at the end,
+    // which keeps the edges between materials as sharp as the AOVs have them.
+    //
+    // denoise.comp runs the same filter before the display pass, this one is for renders without a window.
+    class Denoiser {
+    public:
+        // Values shared with denoise.comp.
+        static constexpr int iterations = 5;
+        static constexpr float colorPhi = 2.0f;         // luminance difference, in standard deviations
+        static constexpr float normalPhi = 64.0f;       // exponent of the cosine between the normals
+        static constexpr float depthPhi = 0.02f;        // relative distance difference per pixel of offset
+        static constexpr float albedoPhi = 0.01f;       // squared albedo difference
+        static constexpr float minAlbedo = 0.01f;       // what colour is divided by at the least
+
+        // Filters color, an accumulation, guided by its AOVs into output, which may not be color. Both
+        // have resolution.x * resolution.y pixels, and the samples in w are kept.
+        void denoise(const vec4* color, const AovBuffers& aovs, uvec2 resolution, vec4* output);
+    private:
+        std::vector<vec4> scratch[2];
+    };
+}
@@ -0,0 +1,1237 @@
+﻿#include "Integrator.h"
+
+#include <array>
+#include <bit>
+#include <cmath>
+#include <utility>
+
+#include "JobSystem.h"
+#include "Kernels.h"
+#include "Sampler.h"
+
+namespace raytracer {
+    namespace {
+        struct Ray {
+            vec3 origin;
+            vec3 direction;
+        };
+
+        struct Hit {
+            float distance;
+            vec3 position;
+            vec3 normal;
+            vec3 color;
+            float smoothness;
+            vec3 emission;
+            uint32_t lightIndex;    // only set if emission isn't zero
+            uvec2 id;               // object and primitive, see AovBuffers
+        };
+
+        // The surface a camera ray shows, seen through perfect mirrors: their colours times its albedo,
+        // and the distance along the way. A ray that leaves the scene has distance 0, no normal and ID 0.
+        struct FirstHit {
+            vec3 albedo;
+            vec3 normal;
+            float distance;
+            uvec2 id;
+        };
+
+        struct LightSample {
+            vec3 direction;
+            float distance;
+            float pdf;      // solid angle, without the selection probability until the integrator adds it
+        };
+
+        constexpr float pi = 3.14159265359f;
+
+        vec3 uniformDirection(vec2 u) {
+            const float z = 1.0f - 2.0f * u.x;
+            const float a = 6.28318530718f * u.y;
+            const float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+            return vec3(r * std::cos(a), r * std::sin(a), z);
+        }
+
+        template<typename Sampler>
+        vec3 randomDirection(Sampler& sampler) {
+            const float u = sampler.next();
+            return uniformDirection(vec2(u, sampler.next()));
+        }
+
+        // Cosine-weighted around normal. The one uniform direction opposite the normal would leave nothing
+        // to normalize, it takes the normal instead.
+        vec3 cosineDirection(vec3 normal, vec3 uniform) {
+            const vec3 direction = normal + uniform;
+            return dot(direction, direction) > 0.0f ? normalize(direction) : normal;
+        }
+
+        vec3 getEnvironmentLight(const Ray& ray) {
+            const float a = 0.5f * (ray.direction.y + 1.0f);
+            return mix(vec3(1.0f), vec3(0.5f, 0.7f, 1.0f), a);
+        }
+
+        bool intersectSphere(const Ray& ray, const vec4& sphere, float& distance) {
+            const vec3 oc = vec3(sphere) - ray.origin;
+            const float a = dot(ray.direction, ray.direction);
+            const float b = -2.0f * dot(ray.direction, oc);
+            const float c = dot(oc, oc) - sphere.w * sphere.w;
+            const float discriminant = b * b - 4.0f * a * c;
+            if (discriminant < 0.0f)
+                return false;
+
+            distance = (-b - std::sqrt(discriminant)) / (2.0f * a);
+            return distance > 0.0f;
+        }
+
+        bool intersectBox(const KernelRay& ray, const BVHNode& node, float maxDistance) {
+            float tNear = 0.0f, tFar = maxDistance;
+            for (int c = 0; c < 3; ++c) {
+                const float t0 = (node.min[c] - ray.origin[c]) * ray.invDirection[c];
+                const float t1 = (node.max[c] - ray.origin[c]) * ray.invDirection[c];
+                tNear = std::max(tNear, std::min(t0, t1));
+                tFar = std::min(tFar, std::max(t0, t1));
+            }
+            return tNear <= tFar;
+        }
+
+        // Closest hit below rootNode, in the mesh's local space. Children are visited near to far and
+        // skipped once a closer triangle is known.
+        bool intersectMesh(const Scene& scene, const Kernels& kernels, const KernelRay& ray, uint32_t rootNode,
+                           TriangleHit& hit) {
+            const BVHNode* nodes = scene.nodes.data();
+            if (!intersectBox(ray, nodes[rootNode], hit.distance))
+                return false;
+
+            struct Entry {
+                uint32_t node;
+                float distance;
+            };
+            Entry stack[64];
+            int size = 0;
+            stack[size++] = { rootNode, 0.0f };
+            bool found = false;
+
+            while (size > 0) {
+                const Entry entry = stack[--size];
+                if (entry.distance >= hit.distance)
+                    continue;
+
+                const uvec4& node = nodes[entry.node].triIndex_triCount_childIndex;
+                if (node.y > 0) {
+                    TriangleHit leafHit = hit;
+                    if (kernels.intersectTriangles(ray, &scene.triangles[node.x], node.y, 1e-4f, leafHit)) {
+                        hit = leafHit;
+                        hit.index += node.x;
+                        found = true;
+                    }
+                    continue;
+                }
+
+                float entries[2];
+                kernels.intersectBoxPair(ray, &nodes[node.z], hit.distance, entries);
+                const uint32_t nearChild = entries[1] < entries[0] ? 1 : 0;
+                const uint32_t farChild = 1 - nearChild;
+                if (entries[farChild] < hit.distance && size < 64)
+                    stack[size++] = { node.z + farChild, entries[farChild] };
+                if (entries[nearChild] < hit.distance && size < 64)
+                    stack[size++] = { node.z + nearChild, entries[nearChild] };
+            }
+            return found;
+        }
+
+        // Whether anything below rootNode is closer than maxDistance. Stops at the first hit, so the
+        // order children are visited in doesn't matter.
+        bool isMeshOccluded(const Scene& scene, const Kernels& kernels, const KernelRay& ray, uint32_t rootNode,
+                            float maxDistance) {
+            const BVHNode* nodes = scene.nodes.data();
+            if (!intersectBox(ray, nodes[rootNode], maxDistance))
+                return false;
+
+            uint32_t stack[64];
+            int size = 0;
+            stack[size++] = rootNode;
+            while (size > 0) {
+                const uvec4& node = nodes[stack[--size]].triIndex_triCount_childIndex;
+                if (node.y > 0) {
+                    TriangleHit hit = { maxDistance, 0.0f, 0.0f, 0 };
+                    if (kernels.intersectTriangles(ray, &scene.triangles[node.x], node.y, 1e-4f, hit))
+                        return true;
+                    continue;
+                }
+
+                float entries[2];
+                kernels.intersectBoxPair(ray, &nodes[node.z], maxDistance, entries);
+                for (uint32_t child = 0; child < 2; ++child) {
+                    if (entries[child] < maxDistance && size < 64)
+                        stack[size++] = node.z + child;
+                }
+            }
+            return false;
+        }
+
+        template<uint32_t Features>
+        bool isOccluded(const Scene& scene, const Kernels& kernels, const Ray& ray, float maxDistance) {
+            if constexpr ((Features & SceneHasSpheres) != 0) {
+                for (const Sphere& sphere : scene.spheres) {
+                    float distance;
+                    if (intersectSphere(ray, sphere.pos_radius, distance) && distance < maxDistance)
+                        return true;
+                }
+            }
+
+            if constexpr ((Features & SceneHasMeshes) != 0) {
+                for (const MeshInfo& mesh : scene.meshes) {
+                    if (mesh.numTriangles == 0)
+                        continue;
+
+                    const mat3 invRotation(mesh.invRotation);
+                    const vec3 localOrigin = invRotation * (ray.origin - vec3(mesh.pos));
+                    const vec3 localDirection = normalize(invRotation * ray.direction);
+                    if (isMeshOccluded(scene, kernels, KernelRay::make(localOrigin, localDirection), mesh.rootNodeIndex,
+                                       maxDistance))
+                        return true;
+                }
+            }
+            return false;
+        }
+
+        // Orthonormal basis around n (Duff et al., "Building an Orthonormal Basis, Revisited").
+        void makeBasis(vec3 n, vec3& tangent, vec3& bitangent) {
+            const float sign = n.z >= 0.0f ? 1.0f : -1.0f;
+            const float a = -1.0f / (sign + n.z);
+            const float b = n.x * n.y * a;
+            tangent = vec3(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+            bitangent = vec3(b, sign + n.y * n.y * a, -n.y);
+        }
+
+        // Solid angle pdf of sampleLight picking point on light as seen from origin.
+        float getLightPdf(const Light& light, vec3 origin, vec3 point) {
+            if (light.posA_radius.w > 0.0f) {
+                const vec3 toCenter = vec3(light.posA_radius) - origin;
+                const float sinSquared = light.posA_radius.w * light.posA_radius.w / dot(toCenter, toCenter);
+                if (sinSquared >= 1.0f)
+                    return 0.0f;
+                const float oneMinusCos = sinSquared / (1.0f + std::sqrt(1.0f - sinSquared));
+                return 1.0f / (2.0f * pi * oneMinusCos);
+            }
+
+            const vec3 normal = cross(vec3(light.posB_cdf) - vec3(light.posA_radius), vec3(light.posC_trail) - vec3(light.posA_radius));
+            const vec3 toPoint = point - origin;
+            const float distanceSquared = dot(toPoint, toPoint);
+            const float cosine = std::abs(dot(normal, toPoint)) / std::sqrt(distanceSquared);
+            // normal is twice the area long
+            return cosine > 0.0f ? 2.0f * distanceSquared / cosine : 0.0f;
+        }
+
+        // Spheres are sampled in the cone they subtend, triangles uniformly by area.
+        bool sampleLight(const Light& light, vec3 origin, vec2 u, LightSample& sample) {
+            if (light.posA_radius.w > 0.0f) {
+                const vec3 toCenter = vec3(light.posA_radius) - origin;
+                const float distanceSquared = dot(toCenter, toCenter);
+                const float sinSquared = light.posA_radius.w * light.posA_radius.w / distanceSquared;
+                if (sinSquared >= 1.0f)
+                    return false;
+                const float oneMinusCos = sinSquared / (1.0f + std::sqrt(1.0f - sinSquared));
+                const float cosTheta = 1.0f - u.x * oneMinusCos;
+                const float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+                const float phi = 2.0f * pi * u.y;
+
+                const vec3 axis = toCenter / std::sqrt(distanceSquared);
+                vec3 tangent, bitangent;
+                makeBasis(axis, tangent, bitangent);
+                sample.direction = normalize(tangent * (sinTheta * std::cos(phi)) + bitangent * (sinTheta * std::sin(phi)) +
+                                             axis * cosTheta);
+                if (!intersectSphere({ origin, sample.direction }, light.posA_radius, sample.distance))
+                    sample.distance = dot(toCenter, sample.direction);
+                sample.pdf = 1.0f / (2.0f * pi * oneMinusCos);
+                return true;
+            }
+
+            const float su = std::sqrt(u.x);
+            const vec3 point = vec3(light.posA_radius) * (1.0f - su) + vec3(light.posB_cdf) * (su * (1.0f - u.y)) +
+                               vec3(light.posC_trail) * (su * u.y);
+            const vec3 toPoint = point - origin;
+            sample.distance = std::sqrt(dot(toPoint, toPoint));
+            sample.direction = toPoint / sample.distance;
+            sample.pdf = getLightPdf(light, origin, point);
+            return sample.pdf > 0.0f;
+        }
+
+        // Index of the first light whose cumulative probability is above u.
+        uint32_t pickLightByWeight(const LightSet& lights, float u) {
+            uint32_t first = 0, last = static_cast<uint32_t>(lights.lights.size()) - 1;
+            while (first < last) {
+                const uint32_t middle = (first + last) / 2;
+                if (lights.lights[middle].posB_cdf.w > u)
+                    last = middle;
+                else
+                    first = middle + 1;
+            }
+            return first;
+        }
+
+        // Upper bound on what the lights below node add at a point with the given normal, relative to
+        // other nodes: weight over squared distance, scaled by the best emitter and receiver cosines
+        // any point inside the bounds could have.
+        float getNodeImportance(const LightNode& node, vec3 point, vec3 normal) {
+            const float weight = node.min_weight.w;
+            if (weight <= 0.0f)
+                return 0.0f;
+
+            const vec3 min(node.min_weight), max(node.max_coneAngle);
+            const vec3 toCenter = 0.5f * (min + max) - point;
+            const float distanceSquared = dot(toCenter, toCenter);
+            const float radiusSquared = 0.25f * dot(max - min, max - min);
+            // inside the bounds every direction is possible
+            if (distanceSquared <= radiusSquared)
+                return weight / std::max(radiusSquared, 1e-6f);
+
+            const vec3 direction = toCenter / std::sqrt(distanceSquared);
+            const float uncertainty = std::asin(std::sqrt(radiusSquared / distanceSquared));
+            const float emitterAngle = std::acos(std::min(1.0f, std::abs(dot(vec3(node.axis), direction))));
+            const float emitter = std::max(0.0f, emitterAngle - node.max_coneAngle.w - uncertainty);
+            const float receiverAngle = std::acos(std::clamp(dot(normal, direction), -1.0f, 1.0f));
+            const float receiver = std::max(0.0f, receiverAngle - uncertainty);
+            if (emitter >= 0.5f * pi || receiver >= 0.5f * pi)
+                return 0.0f;
+            return weight * std::cos(emitter) * std::cos(receiver) / distanceSquared;
+        }
+
+        // Probability of taking the second child, or -1 if nothing below node can light the point.
+        float getSecondChildProbability(const LightSet& lights, const LightNode& node, vec3 point, vec3 normal) {
+            const float first = getNodeImportance(lights.nodes[node.child_light.x], point, normal);
+            const float second = getNodeImportance(lights.nodes[node.child_light.x + 1], point, normal);
+            return first + second > 0.0f ? second / (first + second) : -1.0f;
+        }
+
+        // Walks down the light tree, picking children by importance. u is rescaled after every
+        // choice and reused for the next. Returns false if no light can reach the point.
+        bool pickLightFromTree(const LightSet& lights, vec3 point, vec3 normal, float u, uint32_t& lightIndex, float& pdf) {
+            const LightNode* node = &lights.nodes[0];
+            pdf = 1.0f;
+            while (node->child_light.y == 0) {
+                const float second = getSecondChildProbability(lights, *node, point, normal);
+                if (second < 0.0f)
+                    return false;
+                if (u < 1.0f - second) {
+                    u = std::min(u / (1.0f - second), 0x1.fffffep-1f);
+                    pdf *= 1.0f - second;
+                    node = &lights.nodes[node->child_light.x];
+                } else {
+                    u = std::min((u - (1.0f - second)) / second, 0x1.fffffep-1f);
+                    pdf *= second;
+                    node = &lights.nodes[node->child_light.x + 1];
+                }
+            }
+            lightIndex = node->child_light.y - 1;
+            return true;
+        }
+
+        // Probability of pickLightFromTree choosing the light, following its trail from the root.
+        float getTreePdf(const LightSet& lights, vec3 point, vec3 normal, uint32_t lightIndex) {
+            const uint32_t trail = std::bit_cast<uint32_t>(lights.lights[lightIndex].posC_trail.w);
+            const LightNode* node = &lights.nodes[0];
+            float pdf = 1.0f;
+            for (int depth = 0; node->child_light.y == 0; ++depth) {
+                const float second = getSecondChildProbability(lights, *node, point, normal);
+                if (second < 0.0f)
+                    return 0.0f;
+                const uint32_t branch = trail >> depth & 1u;
+                pdf *= branch ? second : 1.0f - second;
+                node = &lights.nodes[node->child_light.x + branch];
+            }
+            return pdf;
+        }
+
+        float getPickPdf(const LightSet& lights, bool useTree, vec3 point, vec3 normal, uint32_t lightIndex) {
+            if (useTree)
+                return getTreePdf(lights, point, normal, lightIndex);
+            return LightSet::getWeight(lights.lights[lightIndex]) / lights.totalWeight;
+        }
+
+        // One light sample for next-event estimation. The environment takes the bottom of uLight, the
+        // emitters the rest of it, and pdf includes the choice. lightIndex is environmentLight for the
+        // environment.
+        constexpr uint32_t environmentLight = ~0u;
+
+        bool sampleDirectLight(const Scene& scene, bool useTree, vec3 origin, vec3 normal, float uLight, vec2 uPoint,
+                               LightSample& sample, vec3& radiance, uint32_t& lightIndex) {
+            const LightSet& lights = scene.lights;
+            const float environmentProbability = scene.getEnvironmentSampleProbability();
+            if (uLight < environmentProbability) {
+                lightIndex = environmentLight;
+                sample.distance = INFINITY;
+                if (!scene.environment.sample(uPoint, sample.direction, radiance, sample.pdf))
+                    return false;
+                sample.pdf *= environmentProbability;
+                return true;
+            }
+
+            const float uPick = std::min((uLight - environmentProbability) / (1.0f - environmentProbability), 0x1.fffffep-1f);
+            float pickPdf = 0.0f;
+            if (useTree) {
+                if (!pickLightFromTree(lights, origin, normal, uPick, lightIndex, pickPdf))
+                    return false;
+            } else {
+                lightIndex = pickLightByWeight(lights, uPick);
+                pickPdf = LightSet::getWeight(lights.lights[lightIndex]) / lights.totalWeight;
+            }
+
+            const Light& light = lights.lights[lightIndex];
+            if (pickPdf <= 0.0f || !sampleLight(light, origin, uPoint, sample))
+                return false;
+            radiance = vec3(light.emission);
+            sample.pdf *= (1.0f - environmentProbability) * pickPdf;
+            return true;
+        }
+
+        float powerHeuristic(float pdf, float otherPdf) {
+            return pdf * pdf / (pdf * pdf + otherPdf * otherPdf);
+        }
+
+        template<uint32_t Features>
+        bool intersectScene(const Scene& scene, const Kernels& kernels, const Ray& ray, Hit& hit) {
+            hit.distance = INFINITY;
+            const Sphere* closestSphere = nullptr;
+            const MeshInfo* closestMesh = nullptr;
+            TriangleHit closestTriangle{};
+
+            if constexpr ((Features & SceneHasSpheres) != 0) {
+                for (const Sphere& sphere : scene.spheres) {
+                    float distance;
+                    if (intersectSphere(ray, sphere.pos_radius, distance) && distance < hit.distance) {
+                        hit.distance = distance;
+                        closestSphere = &sphere;
+                    }
+                }
+            }
+
+            if constexpr ((Features & SceneHasMeshes) != 0) {
+                for (const MeshInfo& mesh : scene.meshes) {
+                    if (mesh.numTriangles == 0)
+                        continue;
+
+                    const mat3 invRotation(mesh.invRotation);
+                    const vec3 localOrigin = invRotation * (ray.origin - vec3(mesh.pos));
+                    const vec3 localDirection = normalize(invRotation * ray.direction);
+
+                    TriangleHit triangleHit = { hit.distance, 0.0f, 0.0f, 0 };
+                    if (intersectMesh(scene, kernels, KernelRay::make(localOrigin, localDirection), mesh.rootNodeIndex,
+                                      triangleHit)) {
+                        hit.distance = triangleHit.distance;
+                        closestMesh = &mesh;
+                        closestTriangle = triangleHit;
+                    }
+                }
+            }
+
+            if (!closestMesh && !closestSphere)
+                return false;
+
+            // the surface is only worked out for the closest hit
+            hit.position = ray.origin + ray.direction * hit.distance;
+            vec4 colorSmoothness, emission;
+            if (closestMesh) {
+                const Triangle& tri = scene.triangles[closestTriangle.index];
+                const float w = 1.0f - closestTriangle.u - closestTriangle.v;
+                const vec3 localNormal = normalize(vec3(tri.normalA) * w + vec3(tri.normalB) * closestTriangle.u +
+                                                   vec3(tri.normalC) * closestTriangle.v);
+                hit.normal = normalize(mat3(closestMesh->rotation) * localNormal);
+                colorSmoothness = closestMesh->color_smoothness;
+                emission = closestMesh->emissiveColor_strength;
+            } else {
+                hit.normal = normalize(hit.position - vec3(closestSphere->pos_radius));
+                colorSmoothness = closestSphere->color_smoothness;
+                emission = closestSphere->emissiveColor_strength;
+            }
+
+            hit.color = vec3(colorSmoothness);
+            hit.id = closestMesh
+                ? uvec2(scene.spheres.size() + (closestMesh - scene.meshes.data()) + 1,
+                        closestTriangle.index - closestMesh->firstTriangleIndex)
+                : uvec2(closestSphere - scene.spheres.data() + 1, 0);
+            if constexpr ((Features & SceneHasSmoothness) != 0)
+                hit.smoothness = colorSmoothness.w;
+            if constexpr ((Features & SceneHasEmission) != 0) {
+                hit.emission = vec3(emission) * emission.w;
+                hit.lightIndex = closestMesh
+                    ? closestMesh->firstLightIndex + closestTriangle.index - closestMesh->firstTriangleIndex
+                    : static_cast<uint32_t>(closestSphere - scene.spheres.data());
+            }
+            return true;
+        }
+
+        float luminance(vec3 color) {
+            return dot(color, vec3(0.2126f, 0.7152f, 0.0722f));
+        }
+
+        // Diffuse vertices of a path on their way into the radiance cache, each with what the path gathered
+        // after it, relative to the throughput on arrival there.
+        struct CacheVertices {
+            vec3 position[RadianceCache::pathVertices];
+            vec3 normal[RadianceCache::pathVertices];
+            vec3 throughput[RadianceCache::pathVertices];
+            vec3 radiance[RadianceCache::pathVertices];
+            int size = 0;
+        };
+
+        // Diffuse vertices of a path on their way into the path guide. Unlike CacheVertices the throughput
+        // starts after the vertex's own bounce, so what they gather is the radiance arriving along direction.
+        struct GuideVertices {
+            uint32_t leaf[PathGuide::pathVertices];
+            vec3 direction[PathGuide::pathVertices];
+            float pdf[PathGuide::pathVertices];
+            vec3 throughput[PathGuide::pathVertices];
+            vec3 radiance[PathGuide::pathVertices];
+            int size = 0;
+        };
+
+        // With a reservoir, the direct light at a diffuse first hit is left to resampling: the
+        // reservoir gets the surface and neither next-event estimation nor the bounce count it here.
+        // With a cache, diffuse vertices add to it, and from radianceCacheDepth on the first one whose
+        // cell has an average takes it and ends the path. With a guide, diffuse bounces sample the mix of
+        // the cosine lobe and the distribution learned around them, and record what arrived along it.
+        // firstHit gets the surface the path shows, for the AOVs.
+        template<uint32_t Features, typename Sampler>
+        vec3 traceRay(const Scene& scene, const Kernels& kernels, Ray ray, Sampler& sampler, const FrameSettings& settings,
+                      uint64_t& segments, Reservoir* reservoir = nullptr, RadianceCache* cache = nullptr,
+                      PathGuide* guide = nullptr, FirstHit* firstHit = nullptr) {
+            const LightSet& lights = scene.lights;
+            const Environment& environment = scene.environment;
+            const float environmentProbability = scene.getEnvironmentSampleProbability();
+            const bool sampleLights = (Features & SceneHasEmission) != 0 && settings.nextEventEstimation &&
+                                      (lights.totalWeight > 0.0f || environment.isLoaded());
+            const vec3 camera = ray.origin;
+            vec3 inLight(0.0f);
+            vec3 rayColor(1.0f);
+            CacheVertices vertices;
+            GuideVertices guided;
+            auto gather = [&](vec3 radiance, float weight) {
+                inLight += radiance * rayColor * weight;
+                for (int k = 0; k < vertices.size; ++k)
+                    vertices.radiance[k] += radiance * vertices.throughput[k] * weight;
+                for (int k = 0; k < guided.size; ++k)
+                    guided.radiance[k] += radiance * guided.throughput[k] * weight;
+            };
+
+            // pdf of the last bounce direction if the light was also sampled there, 0 if emission counts in
+            // full, negative if it counts nothing because a reservoir has it
+            float bouncePdf = 0.0f;
+            vec3 bounceNormal(0.0f);
+            bool findingFirstHit = firstHit != nullptr;
+            if (firstHit)
+                *firstHit = { vec3(1.0f), vec3(0.0f), 0.0f, uvec2(0) };
+            for (int i = 0; i <= settings.maxBounces; ++i) {
+                ++segments;
+                Hit hit;
+                const bool found = intersectScene<Features>(scene, kernels, ray, hit);
+                if (findingFirstHit) {
+                    bool isMirror = false;
+                    if constexpr ((Features & SceneHasSmoothness) != 0)
+                        isMirror = found && hit.smoothness >= 1.0f;
+                    if (found) {
+                        firstHit->albedo *= hit.color;
+                        firstHit->distance += hit.distance;
+                        firstHit->normal = isMirror ? vec3(0.0f) : hit.normal;
+                        firstHit->id = hit.id;
+                    } else {
+                        firstHit->distance = 0.0f;
+                        firstHit->id = uvec2(0);
+                    }
+                    findingFirstHit = isMirror;
+                }
+                if (!found) {
+                    if (environment.isLoaded()) {
+                        float weight = bouncePdf < 0.0f ? 0.0f : 1.0f;
+                        if (bouncePdf > 0.0f)
+                            weight = powerHeuristic(bouncePdf, environmentProbability * environment.getPdf(ray.direction));
+                        gather(environment.lookup(ray.direction), weight);
+                    } else {
+                        gather(getEnvironmentLight(ray), 1.0f);
+                    }
+                    break;
+                }
+
+                if constexpr ((Features & SceneHasEmission) != 0) {
+                    float weight = bouncePdf < 0.0f ? 0.0f : 1.0f;
+                    if (bouncePdf > 0.0f && hit.emission != vec3(0.0f)) {
+                        const float lightPdf = (1.0f - environmentProbability) *
+                                               getPickPdf(lights, settings.lightTree, ray.origin, bounceNormal, hit.lightIndex) *
+                                               getLightPdf(lights.lights[hit.lightIndex], ray.origin, hit.position);
+                        weight = powerHeuristic(bouncePdf, lightPdf);
+                    }
+                    gather(hit.emission, weight);
+                }
+
+                bool isDiffuse = true;
+                if constexpr ((Features & SceneHasSmoothness) != 0)
+                    isDiffuse = hit.smoothness <= 0.0f;
+                const bool useReservoir = reservoir && i == 0 && sampleLights && isDiffuse && settings.maxBounces > 0;
+                if (cache && isDiffuse) {
+                    vec3 cached;
+                    if (i >= settings.radianceCacheDepth && cache->lookup(hit.position, hit.normal, camera, cached)) {
+                        gather(cached, 1.0f);
+                        break;
+                    }
+                    // the last bounce and a reservoir's surface leave out light that belongs to the cell
+                    if (i < settings.maxBounces && !useReservoir && vertices.size < RadianceCache::pathVertices) {
+                        vertices.position[vertices.size] = hit.position;
+                        vertices.normal[vertices.size] = hit.normal;
+                        vertices.throughput[vertices.size] = vec3(1.0f);
+                        vertices.radiance[vertices.size] = vec3(0.0f);
+                        ++vertices.size;
+                    }
+                }
+
+                // a leaf that hasn't learned anything yet leaves every bounce to the cosine lobe
+                const DirectionalTree* distribution = nullptr;
+                uint32_t guideLeaf = 0;
+                float guideFraction = 0.0f;
+                if (guide && isDiffuse && i < settings.maxBounces) {
+                    guideLeaf = guide->getLeaf(hit.position, hit.normal);
+                    distribution = &guide->getDistribution(guideLeaf);
+                    guideFraction = distribution->isEmpty() ? 0.0f : 1.0f - PathGuide::bsdfFraction;
+                }
+
+                sampler.startBounce(i);
+                ray.origin = hit.position + 1e-5f * hit.normal;
+                float guidedPdf = 0.0f;
+                if (distribution) {
+                    const float uX = sampler.next();
+                    const vec2 u(uX, sampler.next());
+                    sampler.startBounce(i, Sampling::guideDimension);
+                    if (sampler.next() < guideFraction)
+                        ray.direction = distribution->sample(u);
+                    else
+                        ray.direction = cosineDirection(hit.normal, uniformDirection(u));
+                    guidedPdf = (1.0f - guideFraction) * std::max(0.0f, dot(hit.normal, ray.direction)) / pi;
+                    if (guideFraction > 0.0f)
+                        guidedPdf += guideFraction * distribution->getPdf(ray.direction);
+                } else {
+                    const vec3 diffuseDir = cosineDirection(hit.normal, randomDirection(sampler));
+                    if constexpr ((Features & SceneHasSmoothness) != 0) {
+                        const vec3 specularDir = reflect(normalize(ray.direction), hit.normal);
+                        ray.direction = normalize(mix(diffuseDir, specularDir, clamp(hit.smoothness, 0.0f, 1.0f)));
+                    } else {
+                        ray.direction = diffuseDir;
+                    }
+                }
+                rayColor *= hit.color;
+                for (int k = 0; k < vertices.size; ++k)
+                    vertices.throughput[k] *= hit.color;
+                for (int k = 0; k < guided.size; ++k)
+                    guided.throughput[k] *= hit.color;
+
+                // Next-event estimation. Only diffuse bounces have a pdf to weigh against, the blend with
+                // the mirror direction doesn't, so smooth surfaces keep finding lights by chance. The light
+                // sample stands in for the next segment, so there is none after the last bounce.
+                bouncePdf = 0.0f;
+                if (useReservoir) {
+                    reservoir->position_depth = vec4(ray.origin, hit.distance);
+                    reservoir->normal_weight = vec4(hit.normal, 0.0f);
+                    reservoir->albedo_count = vec4(hit.color, 0.0f);
+                    bouncePdf = -1.0f;
+                } else if (sampleLights && isDiffuse && i < settings.maxBounces) {
+                    sampler.startBounce(i, Sampling::lightDimension);
+                    const float uLight = sampler.next();
+                    const float uPointX = sampler.next();
+                    const float uPointY = sampler.next();
+
+                    LightSample sample;
+                    vec3 radiance;
+                    uint32_t lightIndex;
+                    const bool sampled = sampleDirectLight(scene, settings.lightTree, ray.origin, hit.normal, uLight,
+                                                           vec2(uPointX, uPointY), sample, radiance, lightIndex);
+                    if (sampled) {
+                        const float cosine = dot(hit.normal, sample.direction);
+                        if (cosine > 0.0f) {
+                            ++segments;
+                            const Ray shadowRay = { ray.origin, sample.direction };
+                            if (!isOccluded<Features>(scene, kernels, shadowRay, sample.distance * (1.0f - 1e-4f))) {
+                                const float weight = powerHeuristic(sample.pdf, cosine / pi);
+                                gather(radiance, cosine / pi / sample.pdf * weight);
+                            }
+                        }
+                    }
+                    bouncePdf = std::max(0.0f, dot(hit.normal, ray.direction)) / pi;
+                    bounceNormal = hit.normal;
+                }
+
+                // The light sample above is weighed by the albedo alone, a guided bounce by the cosine over the
+                // pdf of the mix as well. MIS against the lights keeps to the cosine lobe: the weights still
+                // sum to one, and no light sample has to look up the guide.
+                if (distribution) {
+                    const float cosine = dot(hit.normal, ray.direction);
+                    const float scale = cosine > 0.0f && guidedPdf > 0.0f ? cosine / pi / guidedPdf : 0.0f;
+                    rayColor *= scale;
+                    for (int k = 0; k < vertices.size; ++k)
+                        vertices.throughput[k] *= scale;
+                    for (int k = 0; k < guided.size; ++k)
+                        guided.throughput[k] *= scale;
+                    if (guided.size < PathGuide::pathVertices) {
+                        guided.leaf[guided.size] = guideLeaf;
+                        guided.direction[guided.size] = ray.direction;
+                        guided.pdf[guided.size] = guidedPdf;
+                        guided.throughput[guided.size] = vec3(1.0f);
+                        guided.radiance[guided.size] = vec3(0.0f);
+                        ++guided.size;
+                    }
+                    if (scale <= 0.0f)
+                        break;
+                }
+
+                // Russian roulette: past rouletteDepth a path survives with a probability that follows its
+                // throughput, and survivors are scaled up so the estimate stays unbiased
+                if (i >= settings.rouletteDepth) {
+                    sampler.startBounce(i, Sampling::rouletteDimension);
+                    const float survival = std::min(1.0f, std::max(rayColor.r, std::max(rayColor.g, rayColor.b)));
+                    if (sampler.next() >= survival)
+                        break;
+                    rayColor /= survival;
+                    for (int k = 0; k < vertices.size; ++k)
+                        vertices.throughput[k] /= survival;
+                    for (int k = 0; k < guided.size; ++k)
+                        guided.throughput[k] /= survival;
+                }
+            }
+
+            for (int k = 0; k < vertices.size; ++k)
+                cache->add(vertices.position[k], vertices.normal[k], camera, vertices.radiance[k]);
+            for (int k = 0; k < guided.size; ++k)
+                guide->record(guided.leaf[k], guided.direction[k], luminance(guided.radiance[k]) / guided.pdf[k]);
+            return inLight;
+        }
+
+        // Resampling settings, the same as in raytracer.comp.
+        constexpr int restirCandidates = 8;         // light samples a reservoir starts from
+        constexpr float restirHistoryLimit = 4.0f;  // cap on the previous frame's M, relative to this frame's
+        constexpr int restirNeighbours = 5;
+        constexpr float restirRadius = 30.0f;       // in pixels
+
+        // Independent numbers for one resampling pass of a pixel, whatever the frame's sampler is.
+        IndependentSampler createResampler(uvec2 pixel, uint32_t frameIndex, uint32_t pass) {
+            IndependentSampler resampler = IndependentSampler::create(pixel, frameIndex);
+            resampler.dimension = Sampling::resamplingDimension + pass * Sampling::resamplingPassDimensions;
+            return resampler;
+        }
+
+        // Cosine at a point on light toward direction, which points away from the light. Triangles emit
+        // from both sides, the far side of a sphere is hidden behind the sphere itself.
+        float getLightCosine(const Light& light, vec3 point, vec3 direction) {
+            if (light.posA_radius.w > 0.0f)
+                return std::max(0.0f, dot(normalize(point - vec3(light.posA_radius)), direction));
+            const vec3 normal = cross(vec3(light.posB_cdf) - vec3(light.posA_radius), vec3(light.posC_trail) - vec3(light.posA_radius));
+            return std::abs(dot(normalize(normal), direction));
+        }
+
+        // A reservoir sample seen from the surface of a reservoir, possibly another one than it came
+        // from. contribution is what it adds there without shadowing, in the measure it is kept in: area
+        // on a light, solid angle for the environment. Its luminance is the target function.
+        struct SampleEvaluation {
+            vec3 contribution;
+            vec3 direction;
+            float distance;
+            float geometry;     // area per solid angle at the light, 1 for the environment
+        };
+
+        SampleEvaluation evaluateSample(const Scene& scene, const Reservoir& reservoir, vec4 sample) {
+            SampleEvaluation result;
+            const uint32_t light = std::bit_cast<uint32_t>(sample.w);
+            vec3 radiance;
+            if (light == 0) {
+                result.direction = vec3(sample);
+                result.distance = INFINITY;
+                result.geometry = 1.0f;
+                radiance = scene.environment.lookup(result.direction);
+            } else {
+                const Light& emitter = scene.lights.lights[light - 1];
+                const vec3 toPoint = vec3(sample) - vec3(reservoir.position_depth);
+                const float distanceSquared = dot(toPoint, toPoint);
+                result.distance = std::sqrt(distanceSquared);
+                result.direction = toPoint / result.distance;
+                result.geometry = getLightCosine(emitter, vec3(sample), -result.direction) / distanceSquared;
+                radiance = vec3(emitter.emission);
+            }
+            const float cosine = std::max(0.0f, dot(vec3(reservoir.normal_weight), result.direction));
+            result.contribution = radiance * vec3(reservoir.albedo_count) * (cosine / pi * result.geometry);
+            return result;
+        }
+
+        // Running weighted pick over reservoirs merged into one.
+        struct ReservoirMerge {
+            vec4 sample = vec4(0.0f);
+            float target = 0.0f;
+            float weightSum = 0.0f;
+            float count = 0.0f;
+
+            void add(vec4 candidate, float candidateTarget, float weight, float candidateCount, float u) {
+                weightSum += weight;
+                count += candidateCount;
+                if (weight > 0.0f && u * weightSum < weight) {
+                    sample = candidate;
+                    target = candidateTarget;
+                }
+            }
+
+            // validCount: how many of the candidates could have been the kept sample, see mergeReservoirs.
+            void store(Reservoir& reservoir, float validCount) const {
+                reservoir.sample_light = sample;
+                reservoir.normal_weight.w = target > 0.0f ? weightSum / (validCount * target) : 0.0f;
+                reservoir.albedo_count.w = count;
+            }
+        };
+
+        // Merges reservoirs, their candidate counts given separately, at the surface of the first one.
+        // The kept sample is only divided by the candidates of reservoirs whose surface could have drawn
+        // it too, so neighbours it is behind or below the horizon of don't darken the result (Z in
+        // Bitterli et al.). Occluders in between still do, that would take a shadow ray per neighbour.
+        void mergeReservoirs(const Scene& scene, const Reservoir* const* reservoirs, const float* counts, int size,
+                             IndependentSampler& resampler, Reservoir& result) {
+            const Reservoir& surface = *reservoirs[0];
+            ReservoirMerge merge;
+            for (int i = 0; i < size; ++i) {
+                const Reservoir& other = *reservoirs[i];
+                float target = 0.0f;
+                if (other.normal_weight.w > 0.0f)
+                    target = luminance(evaluateSample(scene, surface, other.sample_light).contribution);
+                merge.add(other.sample_light, target, target * other.normal_weight.w * counts[i], counts[i], resampler.next());
+            }
+
+            float validCount = 0.0f;
+            if (merge.target > 0.0f) {
+                for (int i = 0; i < size; ++i) {
+                    if (i == 0 || luminance(evaluateSample(scene, *reservoirs[i], merge.sample).contribution) > 0.0f)
+                        validCount += counts[i];
+                }
+            }
+            result = surface;
+            merge.store(result, validCount);
+        }
+
+        // Whether the surfaces of two reservoirs are close enough to share samples.
+        bool isSimilar(const Reservoir& reservoir, const Reservoir& other) {
+            return other.position_depth.w > 0.0f &&
+                   dot(vec3(reservoir.normal_weight), vec3(other.normal_weight)) > 0.9f &&
+                   std::abs(other.position_depth.w - reservoir.position_depth.w) < 0.1f * reservoir.position_depth.w;
+        }
+
+        // Pass 1: resampled importance sampling over next-event estimation candidates, then one shadow
+        // ray so a sample that can't be seen doesn't spread to the neighbours.
+        template<uint32_t Features>
+        void sampleReservoir(const Scene& scene, const Kernels& kernels, const FrameSettings& settings, uvec2 pixel,
+                             Reservoir& reservoir, uint64_t& segments) {
+            IndependentSampler resampler = createResampler(pixel, settings.frameIndex, 0);
+            const vec3 origin(reservoir.position_depth), normal(reservoir.normal_weight);
+            // Candidates are picked by weight alone, resampling does what the light tree would at a
+            // fraction of the cost.
+            ReservoirMerge merge;
+            for (int i = 0; i < restirCandidates; ++i) {
+                const float uLight = resampler.next();
+                const float uPointX = resampler.next();
+                const float uPointY = resampler.next();
+                const float uPick = resampler.next();
+
+                LightSample sample;
+                vec3 radiance;
+                uint32_t lightIndex;
+                if (!sampleDirectLight(scene, false, origin, normal, uLight, vec2(uPointX, uPointY), sample,
+                                       radiance, lightIndex)) {
+                    merge.add(vec4(0.0f), 0.0f, 0.0f, 1.0f, uPick);
+                    continue;
+                }
+
+                const vec4 candidate = lightIndex == environmentLight
+                    ? vec4(sample.direction, std::bit_cast<float>(0u))
+                    : vec4(origin + sample.direction * sample.distance, std::bit_cast<float>(lightIndex + 1));
+                const SampleEvaluation evaluation = evaluateSample(scene, reservoir, candidate);
+                const float target = luminance(evaluation.contribution);
+                const float weight = target > 0.0f ? target / (sample.pdf * evaluation.geometry) : 0.0f;
+                merge.add(candidate, target, weight, 1.0f, uPick);
+            }
+            merge.store(reservoir, merge.count);
+
+            if (reservoir.normal_weight.w > 0.0f) {
+                const SampleEvaluation evaluation = evaluateSample(scene, reservoir, reservoir.sample_light);
+                ++segments;
+                if (isOccluded<Features>(scene, kernels, { origin, evaluation.direction }, evaluation.distance * (1.0f - 1e-4f)))
+                    reservoir.normal_weight.w = 0.0f;
+            }
+        }
+
+        // Blends a frame's estimate into the pixel. Pixels sit frames out with adaptive sampling and come
+        // with history of their own after reprojection, so the weight follows the samples in w rather than
+        // the frame index.
+        void accumulate(const FrameSettings& settings, vec3 color, vec4& pixel, vec4* variance) {
+            const auto samples = static_cast<float>(settings.samplesPerPixel);
+            if (variance)
+                *variance = Adaptive::add(*variance, luminance(color), samples);
+            pixel = vec4(mix(vec3(pixel), color, samples / (pixel.w + samples)), pixel.w + samples);
+        }
+
+        // Blends the first hits of a pixel's camera samples, summed, into its AOVs, which count samples of
+        // their own. The ID is only set by the first.
+        void accumulateAovs(const FrameSettings& settings, vec3 albedo, vec4 normalDepth, uvec2 id, AovBuffers& aovs,
+                            size_t index) {
+            const auto samples = static_cast<float>(settings.samplesPerPixel);
+            vec4& pixelAlbedo = aovs.albedo[index];
+            if (pixelAlbedo.w == 0.0f)
+                aovs.id[index] = id;
+            const float weight = samples / (pixelAlbedo.w + samples);
+            pixelAlbedo = vec4(mix(vec3(pixelAlbedo), albedo / samples, weight), pixelAlbedo.w + samples);
+            aovs.normalDepth[index] = mix(aovs.normalDepth[index], normalDepth / samples, weight);
+        }
+
+        template<uint32_t Features, typename Sampler>
+        RenderStats renderRows(const Scene& scene, const View& view, const FrameSettings& settings, vec4* accumulation,
+                               ReservoirBuffers* reservoirs, RadianceCache* cache, PathGuide* guide, vec4* variance,
+                               AovBuffers* aovs, size_t firstRow, size_t endRow) {
+            const Kernels& kernels = Kernels::get();
+            RenderStats stats;
+
+            for (size_t y = firstRow; y < endRow; ++y) {
+                for (uint32_t x = 0; x < view.resolution.x; ++x) {
+                    const size_t index = y * view.resolution.x + x;
+                    vec4* pixelVariance = variance ? &variance[index] : nullptr;
+                    // a converged pixel keeps its reservoir too, neighbours may still merge it
+                    if (pixelVariance && Adaptive::isConverged(*pixelVariance, settings))
+                        continue;
+                    Reservoir* reservoir = reservoirs ? &reservoirs->current[index] : nullptr;
+                    if (reservoir)
+                        *reservoir = {};
+
+                    // numbered per pixel with adaptive sampling, so that no pixel skips part of its sequence
+                    const uint32_t firstSample = pixelVariance && settings.adaptiveSampling
+                                               ? static_cast<uint32_t>(pixelVariance->w)
+                                               : settings.frameIndex * settings.samplesPerPixel;
+                    const uvec2 pixel = view.tileOffset + uvec2(x, static_cast<uint32_t>(y));
+                    vec3 color(0.0f), albedo(0.0f);
+                    vec4 normalDepth(0.0f);
+                    uvec2 id(0);
+                    FirstHit firstHit;
+                    for (int sample = 0; sample < settings.samplesPerPixel; ++sample) {
+                        Sampler sampler = Sampler::create(pixel, firstSample + sample);
+                        const float jitterX = sampler.next();
+                        const float jitterY = sampler.next();
+                        const vec2 pixelCenter = vec2(static_cast<float>(pixel.x) + jitterX, static_cast<float>(pixel.y) + jitterY);
+                        const vec2 ndc = pixelCenter - vec2(view.getImageSize()) * 0.5f;
+                        const Ray ray = { view.position, view.rotation * normalize(vec3(ndc, view.focalLength)) };
+                        color += traceRay<Features>(scene, kernels, ray, sampler, settings, stats.segments,
+                                                    sample == 0 ? reservoir : nullptr, cache, guide,
+                                                    aovs ? &firstHit : nullptr);
+                        albedo += firstHit.albedo;
+                        normalDepth += vec4(firstHit.normal, firstHit.distance);
+                        if (sample == 0)
+                            id = firstHit.id;
+                    }
+                    stats.paths += settings.samplesPerPixel;
+                    color /= static_cast<float>(settings.samplesPerPixel);
+                    if (aovs)
+                        accumulateAovs(settings, albedo, normalDepth, id, *aovs, index);
+
+                    // with reservoirs the pixel is only finished after resampling
+                    if (reservoir) {
+                        reservoir->pending = vec4(color, 0.0f);
+                        if (reservoir->position_depth.w > 0.0f)
+                            sampleReservoir<Features>(scene, kernels, settings, pixel, *reservoir, stats.segments);
+                        continue;
+                    }
+                    accumulate(settings, color, accumulation[index], pixelVariance);
+                }
+            }
+            return stats;
+        }
+
+        // Pass 2: merges the reservoir of the last frame at the same pixel into this frame's.
+        void resampleTemporal(const Scene& scene, const View& view, const FrameSettings& settings,
+                              ReservoirBuffers& reservoirs, const vec4* variance, size_t firstRow, size_t endRow) {
+            for (size_t y = firstRow; y < endRow; ++y) {
+                for (uint32_t x = 0; x < view.resolution.x; ++x) {
+                    const size_t index = y * view.resolution.x + x;
+                    Reservoir& reservoir = reservoirs.current[index];
+                    const Reservoir& previous = reservoirs.history[index];
+                    if ((variance && Adaptive::isConverged(variance[index], settings)) ||
+                        reservoir.position_depth.w <= 0.0f || !isSimilar(reservoir, previous))
+                        continue;
+
+                    IndependentSampler resampler = createResampler(view.tileOffset + uvec2(x, y), settings.frameIndex, 1);
+                    const Reservoir* merged[] = { &reservoir, &previous };
+                    const float counts[] = {
+                        reservoir.albedo_count.w, std::min(previous.albedo_count.w, restirHistoryLimit * reservoir.albedo_count.w)
+                    };
+                    mergeReservoirs(scene, merged, counts, 2, resampler, reservoir);
+                }
+            }
+        }
+
+        // Pass 3: merges reservoirs of similar neighbours, keeps the result as the next frame's history
+        // and shades the kept sample, which takes the pixel's one shadow ray of this pass.
+        template<uint32_t Features>
+        uint64_t resampleSpatial(const Scene& scene, const View& view, const FrameSettings& settings, vec4* accumulation,
+                                 ReservoirBuffers& reservoirs, vec4* variance, size_t firstRow, size_t endRow) {
+            const Kernels& kernels = Kernels::get();
+            uint64_t segments = 0;
+            for (size_t y = firstRow; y < endRow; ++y) {
+                for (uint32_t x = 0; x < view.resolution.x; ++x) {
+                    const size_t index = y * view.resolution.x + x;
+                    vec4* pixelVariance = variance ? &variance[index] : nullptr;
+                    if (pixelVariance && Adaptive::isConverged(*pixelVariance, settings))
+                        continue;
+                    Reservoir reservoir = reservoirs.current[index];
+                    vec3 color(reservoir.pending);
+                    if (reservoir.position_depth.w > 0.0f) {
+                        IndependentSampler resampler = createResampler(view.tileOffset + uvec2(x, y), settings.frameIndex, 2);
+                        const Reservoir* merged[restirNeighbours + 1] = { &reservoirs.current[index] };
+                        float counts[restirNeighbours + 1] = { reservoir.albedo_count.w };
+                        int size = 1;
+                        for (int i = 0; i < restirNeighbours; ++i) {
+                            const float radius = restirRadius * std::sqrt(resampler.next());
+                            const float angle = 2.0f * pi * resampler.next();
+                            const ivec2 neighbour = clamp(ivec2(x, y) + ivec2(floor(radius * vec2(std::cos(angle), std::sin(angle)) + 0.5f)),
+                                                          ivec2(0), ivec2(view.resolution) - 1);
+                            const Reservoir& other = reservoirs.current[neighbour.y * view.resolution.x + neighbour.x];
+                            if (neighbour != ivec2(x, y) && isSimilar(reservoir, other)) {
+                                merged[size] = &other;
+                                counts[size++] = other.albedo_count.w;
+                            }
+                        }
+                        mergeReservoirs(scene, merged, counts, size, resampler, reservoir);
+
+                        if (reservoir.normal_weight.w > 0.0f) {
+                            const SampleEvaluation evaluation = evaluateSample(scene, reservoir, reservoir.sample_light);
+                            const Ray shadowRay = { vec3(reservoir.position_depth), evaluation.direction };
+                            ++segments;
+                            if (!isOccluded<Features>(scene, kernels, shadowRay, evaluation.distance * (1.0f - 1e-4f)))
+                                color += evaluation.contribution * (reservoir.normal_weight.w / static_cast<float>(settings.samplesPerPixel));
+                        }
+                    }
+                    reservoirs.history[index] = reservoir;
+                    accumulate(settings, color, accumulation[index], pixelVariance);
+                }
+            }
+            return segments;
+        }
+
+        // Whether two texels of reprojection geometry show the same surface: both the sky, or diffuse
+        // surfaces at about the same distance facing about the same way.
+        bool isSameSurface(vec4 surface, vec4 other) {
+            if (surface.w == 0.0f || other.w == 0.0f)
+                return surface.w == other.w;
+            return surface.w > 0.0f && other.w > 0.0f &&
+                   std::abs(other.w - surface.w) < ReprojectionBuffers::depthTolerance * surface.w &&
+                   dot(vec3(surface), vec3(other)) > ReprojectionBuffers::minNormalCosine;
+        }
+
+        // Whether a texel of the last view's geometry is next to another surface. Its camera samples
+        // then averaged both, and carrying it over would drag one's light across the other.
+        bool isEdge(const ReprojectionBuffers& buffers, ivec2 texel) {
+            const ivec2 size(buffers.view.resolution);
+            const vec4 surface = buffers.historyGeometry[static_cast<size_t>(texel.y) * size.x + texel.x];
+            constexpr ivec2 offsets[] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+            for (const ivec2 offset : offsets) {
+                const ivec2 neighbour = clamp(texel + offset, ivec2(0), size - 1);
+                if (!isSameSurface(surface, buffers.historyGeometry[static_cast<size_t>(neighbour.y) * size.x + neighbour.x]))
+                    return true;
+            }
+            return false;
+        }
+
+        // Finds the surface at each pixel's centre and, with a history, carries the last view's average over.
+        template<uint32_t Features>
+        void reprojectRows(const Scene& scene, const View& view, vec4* accumulation, ReprojectionBuffers& buffers,
+                           size_t firstRow, size_t endRow) {
+            const Kernels& kernels = Kernels::get();
+            const View& previous = buffers.view;
+            const mat3 toPrevious = transpose(previous.rotation);
+            for (size_t y = firstRow; y < endRow; ++y) {
+                for (uint32_t x = 0; x < view.resolution.x; ++x) {
+                    const size_t index = y * view.resolution.x + x;
+                    const vec2 ndc = vec2(static_cast<float>(x) + 0.5f, static_cast<float>(y) + 0.5f) - vec2(view.resolution) * 0.5f;
+                    const Ray ray = { view.position, view.rotation * normalize(vec3(ndc, view.focalLength)) };
+                    Hit hit;
+                    const bool found = intersectScene<Features>(scene, kernels, ray, hit);
+                    bool isDiffuse = true;
+                    if constexpr ((Features & SceneHasSmoothness) != 0)
+                        isDiffuse = !found || hit.smoothness <= 0.0f;
+                    buffers.geometry[index] = found ? vec4(hit.normal, isDiffuse ? hit.distance : -hit.distance) : vec4(0.0f);
+                    if (!buffers.valid)
+                        continue;
+                    // what a mirror shows moves with the camera, not with the mirror
+                    if (!isDiffuse) {
+                        accumulation[index] = vec4(0.0f);
+                        continue;
+                    }
+
+                    // where the last view saw the surface, or the direction for the sky
+                    const vec3 local = toPrevious * (found ? hit.position - previous.position : ray.direction);
+                    const vec4 surface = found ? vec4(hit.normal, length(hit.position - previous.position)) : vec4(0.0f);
+                    vec4 carried(0.0f);
+                    if (local.z > 0.0f) {
+                        const vec2 point = vec2(local) * (previous.focalLength / local.z) + vec2(previous.resolution) * 0.5f - 0.5f;
+                        const vec2 base = floor(point), fraction = point - base;
+                        vec3 color(0.0f);
+                        float samples = 0.0f, total = 0.0f;
+                        for (int tap = 0; tap < 4; ++tap) {
+                            const ivec2 texel = ivec2(base) + ivec2(tap & 1, tap >> 1);
+                            if (texel.x < 0 || texel.y < 0 || texel.x >= static_cast<int>(previous.resolution.x) ||
+                                texel.y >= static_cast<int>(previous.resolution.y))
+                                continue;
+                            const size_t tapIndex = static_cast<size_t>(texel.y) * previous.resolution.x + texel.x;
+                            if (!isSameSurface(buffers.historyGeometry[tapIndex], surface) || isEdge(buffers, texel))
+                                continue;
+                            const float weight = (tap & 1 ? fraction.x : 1.0f - fraction.x) * (tap >> 1 ? fraction.y : 1.0f - fraction.y);
+                            const vec4 pixel = buffers.history[tapIndex];
+                            color += vec3(pixel) * (pixel.w * weight);
+                            samples += pixel.w * weight;
+                            total += weight;
+                        }
+                        // taps count by their samples too, so ones that only just started over don't dim the
+                        // rest; a sliver of one tap is more noise than history
+                        if (total > 0.05f && samples > 0.0f)
+                            carried = vec4(color / samples, samples / total);
+                    }
+                    accumulation[index] = vec4(vec3(carried), std::min(carried.w, ReprojectionBuffers::maxSamples));
+                }
+            }
+        }
+
+        using ReprojectRowsFn = void (*)(const Scene&, const View&, vec4*, ReprojectionBuffers&, size_t, size_t);
+
+        using RenderRowsFn = RenderStats (*)(const Scene&, const View&, const FrameSettings&, vec4*, ReservoirBuffers*,
+                                             RadianceCache*, PathGuide*, vec4*, AovBuffers*, size_t, size_t);
+        using ResampleRowsFn = uint64_t (*)(const Scene&, const View&, const FrameSettings&, vec4*, ReservoirBuffers&,
+                                            vec4*, size_t, size_t);
+
+        template<typename Sampler, uint32_t... Features>
+        constexpr std::array<RenderRowsFn, sizeof...(Features)> makeRenderTable(std::integer_sequence<uint32_t, Features...>) {
+            return { &renderRows<Features, Sampler>... };
+        }
+
+        template<uint32_t... Features>
+        constexpr std::array<ResampleRowsFn, sizeof...(Features)> makeResampleTable(std::integer_sequence<uint32_t, Features...>) {
+            return { &resampleSpatial<Features>... };
+        }
+
+        template<uint32_t... Features>
+        constexpr std::array<ReprojectRowsFn, sizeof...(Features)> makeReprojectTable(std::integer_sequence<uint32_t, Features...>) {
+            return { &reprojectRows<Features>... };
+        }
+
+        using FeatureSequence = std::make_integer_sequence<uint32_t, SceneAllFeatures + 1>;
+
+        // indexed by SamplerType, then by the SceneFeature mask
+        constexpr std::array<RenderRowsFn, SceneAllFeatures + 1> renderTables[] = {
+            makeRenderTable<IndependentSampler>(FeatureSequence()),
+            makeRenderTable<SobolSampler>(FeatureSequence()),
+            makeRenderTable<BlueNoiseSampler>(FeatureSequence()),
+        };
+        static_assert(std::size(renderTables) == static_cast<size_t>(SamplerType::Count));
+
+        // indexed by the SceneFeature mask
+        constexpr std::array<ResampleRowsFn, SceneAllFeatures + 1> spatialTable = makeResampleTable(FeatureSequence());
+        constexpr std::array<ReprojectRowsFn, SceneAllFeatures + 1> reprojectTable = makeReprojectTable(FeatureSequence());
+    }
+
+    float Adaptive::estimateError(const vec4* statistics, size_t pixelCount) {
+        if (pixelCount == 0)
+            return INFINITY;
+        const double sum = JobSystem::parallelReduce(0, pixelCount, 4096, 0.0, [&](size_t first, size_t end) {
+            double partial = 0.0;
+            for (size_t i = first; i < end; ++i) {
+                const double error = getError(statistics[i]);
+                partial += error * error;
+            }
+            return partial;
+        }, [](double a, double b) { return a + b; });
+        return static_cast<float>(std::sqrt(sum / static_cast<double>(pixelCount)));
+    }
+
+    void AovBuffers::resize(uvec2 resolution) {
+        const size_t size = static_cast<size_t>(resolution.x) * resolution.y;
+        if (albedo.size() == size)
+            return;
+        albedo.assign(size, vec4(0.0f));
+        normalDepth.assign(size, vec4(0.0f));
+        id.assign(size, uvec2(0));
+    }
+
+    void AovBuffers::clear() {
+        std::fill(albedo.begin(), albedo.end(), vec4(0.0f));
+        std::fill(normalDepth.begin(), normalDepth.end(), vec4(0.0f));
+        std::fill(id.begin(), id.end(), uvec2(0));
+    }
+
+    void ReservoirBuffers::resize(uvec2 resolution) {
+        const size_t size = static_cast<size_t>(resolution.x) * resolution.y;
+        if (current.size() == size)
+            return;
+        current.assign(size, {});
+        history.assign(size, {});
+        historyValid = false;
+    }
+
+    Integrator::Integrator(const Scene& scene, bool specialize): scene(scene),
+        features(specialize ? scene.getFeatures() : SceneAllFeatures) {
+    }
+
+    RenderStats Integrator::render(const View& view, const FrameSettings& settings, vec4* accumulation,
+                                   const RenderBuffers& buffers) const {
+        ReservoirBuffers* const reservoirs = settings.restir ? buffers.reservoirs : nullptr;
+        RadianceCache* const cache = settings.radianceCache ? buffers.cache : nullptr;
+        PathGuide* const guide = settings.pathGuiding ? buffers.guide : nullptr;
+        vec4* const variance = buffers.variance;
+        AovBuffers* const aovs = buffers.aovs;
+        if (reservoirs)
+            reservoirs->resize(view.resolution);
+        if (aovs)
+            aovs->resize(view.resolution);
+
+        const RenderRowsFn renderRows = renderTables[static_cast<int>(settings.sampler)][features];
+        RenderStats stats = JobSystem::parallelReduce(0, view.resolution.y, 4, RenderStats{},
+            [&](size_t firstRow, size_t endRow) {
+                return renderRows(scene, view, settings, accumulation, reservoirs, cache, guide, variance, aovs,
+                                  firstRow, endRow);
+            },
+            [](const RenderStats& a, const RenderStats& b) {
+                return RenderStats{ a.paths + b.paths, a.segments + b.segments };
+            });
+        // this frame's samples only show in lookups from the next one on, as on the GPU
+        if (cache)
+            cache->resolve();
+        if (guide)
+            guide->finishFrame(stats.paths);
+        if (!reservoirs)
+            return stats;
+
+        // every pass reads what the one before wrote for other pixels, so they can't be fused
+        if (reservoirs->historyValid) {
+            JobSystem::parallelForRange(0, view.resolution.y, 4, [&](size_t firstRow, size_t endRow) {
+                resampleTemporal(scene, view, settings, *reservoirs, variance, firstRow, endRow);
+            });
+        }
+        const ResampleRowsFn resampleRows = spatialTable[features];
+        stats.segments += JobSystem::parallelReduce(0, view.resolution.y, 4, uint64_t(0),
+            [&](size_t firstRow, size_t endRow) {
+                return resampleRows(scene, view, settings, accumulation, *reservoirs, variance, firstRow, endRow);
+            },
+            [](uint64_t a, uint64_t b) { return a + b; });
+        reservoirs->historyValid = true;
+        return stats;
+    }
+
+    void Integrator::reproject(const View& view, vec4* accumulation, ReprojectionBuffers& buffers) const {
+        const size_t pixelCount = static_cast<size_t>(view.resolution.x) * view.resolution.y;
+        if (buffers.valid && buffers.view.resolution != view.resolution)
+            buffers.valid = false;
+        // the geometry just found becomes the history, the accumulation is copied since it is written in place
+        std::swap(buffers.geometry, buffers.historyGeometry);
+        buffers.geometry.resize(pixelCount);
+        if (buffers.valid)
+            buffers.history.assign(accumulation, accumulation + pixelCount);
+
+        const ReprojectRowsFn reprojectRows = reprojectTable[features];
+        JobSystem::parallelForRange(0, view.resolution.y, 4, [&](size_t firstRow, size_t endRow) {
+            reprojectRows(scene, view, accumulation, buffers, firstRow, endRow);
+        });
+        buffers.view = view;
+        buffers.valid = true;
+    }
+}
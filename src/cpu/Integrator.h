@@ -0,0 +1,184 @@
+﻿#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "PathGuide.h"
+#include "RadianceCache.h"
+#include "Sampler.h"
+#include "Scene.h"
+#include "glm/glm.hpp"
+
+namespace raytracer {
+    // Camera state for one frame, the same values main.cpp hands to raytracer.comp.
+    struct View {
+        vec3 position;
+        mat3 rotation;
+        float focalLength;
+        uvec2 resolution;
+        // Where the pixels are when the view is a tile of a larger image, and that image's size, 0 when
+        // the view is the whole image. Rays and sample sequences follow the pixels of the image, so the
+        // tiles put together are the image rendered in one go.
+        uvec2 tileOffset = uvec2(0);
+        uvec2 imageSize = uvec2(0);
+
+        uvec2 getImageSize() const { return imageSize == uvec2(0) ? resolution : imageSize; }
+    };
+
+    struct FrameSettings {
+        uint32_t frameIndex = 0;
+        int samplesPerPixel = 2;
+        int maxBounces = 48;
+        SamplerType sampler = SamplerType::Sobol;
+        int rouletteDepth = 3;      // bounces before Russian roulette may end a path, > maxBounces turns it off
+        bool nextEventEstimation = true; // shadow rays toward the lights from diffuse surfaces, weighted by MIS
+        bool lightTree = true;      // pick lights by their estimated contribution instead of by weight alone
+        bool restir = false;        // resample the direct light at first hits across pixels and frames, see Reservoir
+        bool radianceCache = false; // end paths in the radiance cache once they are radianceCacheDepth bounces deep
+        int radianceCacheDepth = 2;
+        bool pathGuiding = false;   // sample diffuse bounces from a PathGuide as well as the cosine lobe, CPU only
+        bool adaptiveSampling = false; // stop tracing pixels once their statistics say they converged, see Adaptive
+        float adaptiveThreshold = 0.02f; // relative standard error of a converged pixel
+        uint32_t adaptiveMinSamples = 16; // camera samples every pixel takes before it may stop
+        bool reprojection = false;  // carry the accumulation over when the camera moves, see Integrator::reproject
+    };
+
+    // Running statistics of every pixel, the layout of varianceImage in raytracer.comp. x and y are
+    // Welford's mean and sum of squared deviations of the luminance of the pixel's frame estimates, z
+    // counts the estimates and w the camera samples they took. A pixel has converged once the standard
+    // error of its mean is below the threshold relative to the mean.
+    namespace Adaptive {
+        constexpr float minLuminance = 0.01f;   // dark pixels are judged against this instead of their mean
+
+        inline vec4 add(vec4 statistics, float luminance, float samples) {
+            const float count = statistics.z + 1.0f;
+            const float delta = luminance - statistics.x;
+            const float mean = statistics.x + delta / count;
+            return vec4(mean, statistics.y + delta * (luminance - mean), count, statistics.w + samples);
+        }
+
+        // Standard error of the mean over the mean, infinite until there are two estimates.
+        inline float getError(vec4 statistics) {
+            if (statistics.z < 2.0f)
+                return INFINITY;
+            const float variance = statistics.y / (statistics.z - 1.0f);
+            return std::sqrt(variance / statistics.z) / std::max(statistics.x, minLuminance);
+        }
+
+        inline bool isConverged(vec4 statistics, const FrameSettings& settings) {
+            return settings.adaptiveSampling && statistics.w >= static_cast<float>(settings.adaptiveMinSamples) &&
+                   getError(statistics) < settings.adaptiveThreshold;
+        }
+
+        // Root mean square of getError over the pixels, an estimate of the relative error of the image.
+        float estimateError(const vec4* statistics, size_t pixelCount);
+    }
+
+    // Direct light at the first diffuse hit of a pixel, resampled from light samples of its own and of
+    // its neighbours in space and time (Bitterli et al., "Spatiotemporal Reservoir Resampling for
+    // Real-Time Ray Tracing with Dynamic Direct Lighting", 2020). Layout of the reservoir buffers.
+    struct Reservoir {
+        vec4 position_depth;    // shadow ray origin, w: distance from the camera, 0 if the pixel has no reservoir
+        vec4 normal_weight;     // w: contribution weight W of the kept sample
+        vec4 albedo_count;      // w: candidates the reservoir stands for (M)
+        vec4 sample_light;      // point on a light or direction to the environment, w: uint bits, light index + 1 or 0
+        vec4 pending;           // the pixel's radiance this frame apart from the resampled light, w unused
+    };
+
+    // Reservoirs of this frame and the last one, one per pixel.
+    struct ReservoirBuffers {
+        std::vector<Reservoir> current, history;
+        bool historyValid = false;  // to be cleared whenever the camera moves
+
+        // Drops the history if the resolution changed.
+        void resize(uvec2 resolution);
+    };
+
+    // What Integrator::reproject keeps between views. geometry is the layout of geometryImage in
+    // raytracer.comp: the normal at the first hit of the ray through each pixel's centre and, in w, its
+    // distance from the camera, negated for smooth surfaces and 0 where the ray leaves the scene.
+    struct ReprojectionBuffers {
+        static constexpr float maxSamples = 64.0f;      // of history a pixel carries over, so lighting that
+                                                        // changes with the view catches up
+        static constexpr float depthTolerance = 0.1f;   // relative, as for reservoirs
+        static constexpr float minNormalCosine = 0.9f;
+
+        std::vector<vec4> geometry, history, historyGeometry;
+        View view;
+        bool valid = false;     // whether geometry belongs to view, to be cleared along with the accumulation
+    };
+
+    // The surface each pixel's camera rays show, averaged over them like the accumulation: the layout
+    // of albedoImage, normalDepthImage and idImage in raytracer.comp. Perfect mirrors are looked
+    // through, their colour multiplying the albedo and the distance running on, since what they show is
+    // what the image has there. albedo.w counts the samples on its own, so the buffers can start over
+    // while a reprojected accumulation goes on; normalDepth.w is the distance along the ray, not the
+    // depth along the view axis. Rays that leave the scene count as albedo 1, or the mirrors', and
+    // normal and distance 0.
+    //
+    // An ID can't be averaged, so id has the object and primitive the first sample of the pixel hit:
+    // x is 0 for the sky, 1 + i for sphere i and 1 + spheres + i for mesh i, y the triangle within the mesh.
+    struct AovBuffers {
+        std::vector<vec4> albedo, normalDepth;
+        std::vector<uvec2> id;
+
+        // Clears the buffers if the resolution changed.
+        void resize(uvec2 resolution);
+        // To be called whenever the camera moves.
+        void clear();
+    };
+
+    // What Integrator::render keeps from one frame to the next besides the accumulation, each the
+    // caller's and each optional: what needs a buffer that isn't given goes without it.
+    struct RenderBuffers {
+        ReservoirBuffers* reservoirs = nullptr; // needed by FrameSettings::restir
+        RadianceCache* cache = nullptr;         // needed by FrameSettings::radianceCache
+        PathGuide* guide = nullptr;             // needed by FrameSettings::pathGuiding
+        vec4* variance = nullptr;               // pixel statistics (see Adaptive), needed by adaptive sampling
+        AovBuffers* aovs = nullptr;             // the first hits are averaged into these
+    };
+
+    struct RenderStats {
+        uint64_t paths = 0;         // camera samples traced
+        uint64_t segments = 0;      // rays cast along them, camera and shadow rays included
+
+        double getAveragePathLength() const {
+            return paths ? static_cast<double>(segments) / static_cast<double>(paths) : 0.0;
+        }
+    };
+
+    // CPU port of traceRay. Every combination of SceneFeature flags and sampler is its own
+    // instantiation, so checks that are constant for the whole render (spheres, meshes,
+    // smoothness, emission) compile out of the hot loop instead of being tested per bounce.
+    class Integrator {
+    public:
+        // Picks the instantiation matching the scene's features, or the one with every feature
+        // enabled if specialize is false.
+        explicit Integrator(const Scene& scene, bool specialize = true);
+
+        // Traces one progressive frame and blends it into accumulation (resolution.x * resolution.y
+        // pixels) the same way raytracer.comp blends into accumImage: w holds the camera samples a
+        // pixel's average stands for, so clearing a pixel to 0 restarts it. FrameSettings::restir runs
+        // the same three passes as main.cpp over the reservoirs. The radiance cache and the path guide
+        // are kept for as long as the scene doesn't change; the guide learns from every frame it is
+        // given. The pixel statistics are cleared along with accumulation; adaptive sampling skips the
+        // pixels they say converged.
+        RenderStats render(const View& view, const FrameSettings& settings, vec4* accumulation,
+                           const RenderBuffers& buffers = {}) const;
+
+        // Moves the accumulation over to a new view (temporal reprojection). The ray through each pixel's
+        // centre finds its surface, which is looked up in the last view with a bilinear filter over the
+        // taps whose depth and normal match; pixels with none, newly uncovered, start over at 0, as do
+        // smooth surfaces, whose reflections move with the camera. Carried
+        // pixels keep at most ReprojectionBuffers::maxSamples of weight. Without valid buffers it only
+        // finds the surfaces, over an accumulation assumed to be clear. Every camera move needs a call,
+        // as does the first frame.
+        void reproject(const View& view, vec4* accumulation, ReprojectionBuffers& buffers) const;
+
+        uint32_t getFeatures() const { return features; }
+    private:
+        const Scene& scene;
+        uint32_t features;
+    };
+}
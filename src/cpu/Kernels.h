@@ -0,0 +1,73 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include "BVH.h"
+#include "Model.h"
+#include "misc/Target.h"
+
+namespace raytracer {
+    enum class Isa {
+        Scalar,
+        SSE42,
+        AVX2,
+        AVX512,
+        Count
+    };
+
+    // Ray in the layout the kernels load directly. w components stay zero.
+    struct KernelRay {
+        vec4 origin;
+        vec4 direction;
+        vec4 invDirection;
+
+        static KernelRay make(const vec3& origin, const vec3& direction) {
+            return { vec4(origin, 0.0f), vec4(direction, 0.0f), vec4(1.0f / direction, 0.0f) };
+        }
+    };
+
+    struct TriangleHit {
+        float distance;
+        float u;
+        float v;
+        uint32_t index;
+    };
+
+    // Hot CPU loops, compiled once per ISA and picked at startup by CpuDispatch. Every variant
+    // evaluates the same operations in the same order, so they all return bit-identical results.
+    struct Kernels {
+        // Union of triMins/triMaxs over the triangles listed in ids.
+        void (*triangleBounds)(const vec4* triMins, const vec4* triMaxs, const uint32_t* ids, size_t count,
+                               vec4& outMin, vec4& outMax);
+        // Slab test against two sibling nodes. Writes the entry distance of each box, or +inf on a miss.
+        void (*intersectBoxPair)(const KernelRay& ray, const BVHNode* pair, float maxDistance, float* entry);
+        // Closest Moller-Trumbore hit in (minDistance, hit.distance). Same tests as intersectRayTriangle in
+        // raytracer.comp; ties go to the lower index.
+        bool (*intersectTriangles)(const KernelRay& ray, const Triangle* triangles, uint32_t count,
+                                   float minDistance, TriangleHit& hit);
+        // RGBA32F to RGBA8 with the display.frag gamma curve, alpha forced to opaque.
+        void (*convertToRgba8)(const float* rgba, uint8_t* out, size_t pixelCount);
+
+        static const Kernels& get();
+    };
+
+    // The gamma curve as a piecewise linear table over the float bit pattern: 16 segments per
+    // octave from 2^-20 up to 1, within a few hundredths of an 8-bit step of the exact curve.
+    struct GammaTable {
+        static constexpr int minExponent = 127 - 20;
+        static constexpr int segmentBits = 4;
+        static constexpr int size = 20 << segmentBits;
+
+        float base[size];
+        float slope[size];
+
+        static const GammaTable& get();
+    };
+
+    const Kernels& getScalarKernels();
+#if TARGET_ARCH_X86
+    const Kernels& getSSE42Kernels();
+    const Kernels& getAVX2Kernels();
+    const Kernels& getAVX512Kernels();
+#endif
+}
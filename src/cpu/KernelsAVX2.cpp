@@ -0,0 +1,194 @@
+﻿#include "Kernels.h"
+
+#if TARGET_ARCH_X86
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <immintrin.h>
+
+// Compiled with AVX2 enabled. Only intrinsics and plain loads in here: any inline function
+// instantiated in this file (glm, std) could be merged with the baseline copy by the linker.
+
+namespace raytracer {
+    namespace {
+        inline __m128 load(const vec4& v) {
+            return _mm_loadu_ps(&v.x);
+        }
+
+        inline __m256 load2(const vec4& a, const vec4& b) {
+            return _mm256_insertf128_ps(_mm256_castps128_ps256(load(a)), load(b), 1);
+        }
+
+        void triangleBounds(const vec4* triMins, const vec4* triMaxs, const uint32_t* ids, size_t count,
+                            vec4& outMin, vec4& outMax) {
+            __m256 min = _mm256_set1_ps(FLT_MAX), max = _mm256_set1_ps(-FLT_MAX);
+            size_t i = 0;
+            for (; i + 2 <= count; i += 2) {
+                min = _mm256_min_ps(load2(triMins[ids[i]], triMins[ids[i + 1]]), min);
+                max = _mm256_max_ps(load2(triMaxs[ids[i]], triMaxs[ids[i + 1]]), max);
+            }
+
+            __m128 min128 = _mm_min_ps(_mm256_castps256_ps128(min), _mm256_extractf128_ps(min, 1));
+            __m128 max128 = _mm_max_ps(_mm256_castps256_ps128(max), _mm256_extractf128_ps(max, 1));
+            if (i < count) {
+                min128 = _mm_min_ps(load(triMins[ids[i]]), min128);
+                max128 = _mm_max_ps(load(triMaxs[ids[i]]), max128);
+            }
+            _mm_storeu_ps(&outMin.x, min128);
+            _mm_storeu_ps(&outMax.x, max128);
+        }
+
+        void intersectBoxPair(const KernelRay& ray, const BVHNode* pair, float maxDistance, float* entry) {
+            const __m256 origin = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&ray.origin.x));
+            const __m256 invDirection = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&ray.invDirection.x));
+
+            // both boxes side by side, one per 128-bit half
+            const __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(load2(pair[0].min, pair[1].min), origin), invDirection);
+            const __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(load2(pair[0].max, pair[1].max), origin), invDirection);
+            const __m256 lo = _mm256_min_ps(t0, t1);
+            const __m256 hi = _mm256_max_ps(t1, t0);
+
+            __m256 tNear = _mm256_max_ps(lo, _mm256_setzero_ps());
+            __m256 tFar = _mm256_min_ps(hi, _mm256_set1_ps(maxDistance));
+            tNear = _mm256_max_ps(_mm256_permute_ps(lo, _MM_SHUFFLE(1, 1, 1, 1)), tNear);
+            tFar = _mm256_min_ps(_mm256_permute_ps(hi, _MM_SHUFFLE(1, 1, 1, 1)), tFar);
+            tNear = _mm256_max_ps(_mm256_permute_ps(lo, _MM_SHUFFLE(2, 2, 2, 2)), tNear);
+            tFar = _mm256_min_ps(_mm256_permute_ps(hi, _MM_SHUFFLE(2, 2, 2, 2)), tFar);
+
+            const __m256 result = _mm256_blendv_ps(_mm256_set1_ps(INFINITY), tNear, _mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ));
+            entry[0] = _mm_cvtss_f32(_mm256_castps256_ps128(result));
+            entry[1] = _mm_cvtss_f32(_mm256_extractf128_ps(result, 1));
+        }
+
+        inline __m256 cross(__m256 ay, __m256 az, __m256 by, __m256 bz) {
+            return _mm256_sub_ps(_mm256_mul_ps(ay, bz), _mm256_mul_ps(by, az));
+        }
+
+        inline __m256 dot(__m256 ax, __m256 ay, __m256 az, __m256 bx, __m256 by, __m256 bz) {
+            return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax, bx), _mm256_mul_ps(ay, by)), _mm256_mul_ps(az, bz));
+        }
+
+        bool intersectTriangles(const KernelRay& ray, const Triangle* triangles, uint32_t count, float minDistance,
+                                TriangleHit& hit) {
+            const __m256 ox = _mm256_set1_ps(ray.origin.x), oy = _mm256_set1_ps(ray.origin.y), oz = _mm256_set1_ps(ray.origin.z);
+            const __m256 dx = _mm256_set1_ps(ray.direction.x), dy = _mm256_set1_ps(ray.direction.y), dz = _mm256_set1_ps(ray.direction.z);
+            const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+            const __m256 epsilon = _mm256_set1_ps(1e-8f);
+            const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+            const __m256 minT = _mm256_set1_ps(minDistance);
+            const float* base = &triangles[0].posA.x;
+            constexpr int stride = sizeof(Triangle) / sizeof(float);
+            bool found = false;
+
+            for (uint32_t first = 0; first < count; first += 8) {
+                const __m256i laneIds = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(first)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+                const __m256i clamped = _mm256_min_epi32(laneIds, _mm256_set1_epi32(static_cast<int>(count) - 1));
+                const __m256i offsets = _mm256_mullo_epi32(clamped, _mm256_set1_epi32(stride));
+
+                const __m256 ax = _mm256_i32gather_ps(base + 0, offsets, 4);
+                const __m256 ay = _mm256_i32gather_ps(base + 1, offsets, 4);
+                const __m256 az = _mm256_i32gather_ps(base + 2, offsets, 4);
+                const __m256 bx = _mm256_i32gather_ps(base + 4, offsets, 4);
+                const __m256 by = _mm256_i32gather_ps(base + 5, offsets, 4);
+                const __m256 bz = _mm256_i32gather_ps(base + 6, offsets, 4);
+                const __m256 cx = _mm256_i32gather_ps(base + 8, offsets, 4);
+                const __m256 cy = _mm256_i32gather_ps(base + 9, offsets, 4);
+                const __m256 cz = _mm256_i32gather_ps(base + 10, offsets, 4);
+
+                const __m256 e1x = _mm256_sub_ps(bx, ax), e1y = _mm256_sub_ps(by, ay), e1z = _mm256_sub_ps(bz, az);
+                const __m256 e2x = _mm256_sub_ps(cx, ax), e2y = _mm256_sub_ps(cy, ay), e2z = _mm256_sub_ps(cz, az);
+
+                const __m256 px = cross(dy, dz, e2y, e2z);
+                const __m256 py = cross(dz, dx, e2z, e2x);
+                const __m256 pz = cross(dx, dy, e2x, e2y);
+                const __m256 det = dot(e1x, e1y, e1z, px, py, pz);
+                __m256 valid = _mm256_cmp_ps(_mm256_and_ps(det, absMask), epsilon, _CMP_GE_OQ);
+
+                const __m256 invDet = _mm256_div_ps(one, det);
+                const __m256 tx = _mm256_sub_ps(ox, ax), ty = _mm256_sub_ps(oy, ay), tz = _mm256_sub_ps(oz, az);
+                const __m256 u = _mm256_mul_ps(dot(tx, ty, tz, px, py, pz), invDet);
+                valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_GE_OQ), _mm256_cmp_ps(u, one, _CMP_LE_OQ)));
+
+                const __m256 qx = cross(ty, tz, e1y, e1z);
+                const __m256 qy = cross(tz, tx, e1z, e1x);
+                const __m256 qz = cross(tx, ty, e1x, e1y);
+                const __m256 v = _mm256_mul_ps(dot(dx, dy, dz, qx, qy, qz), invDet);
+                valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(v, zero, _CMP_GE_OQ),
+                                                           _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ)));
+
+                const __m256 t = _mm256_mul_ps(dot(e2x, e2y, e2z, qx, qy, qz), invDet);
+                valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(t, minT, _CMP_GT_OQ),
+                                                           _mm256_cmp_ps(t, _mm256_set1_ps(hit.distance), _CMP_LT_OQ)));
+
+                int mask = _mm256_movemask_ps(valid);
+                if (first + 8 > count)
+                    mask &= (1 << (count - first)) - 1;
+                if (!mask)
+                    continue;
+
+                alignas(32) float ts[8], us[8], vs[8];
+                _mm256_store_ps(ts, t);
+                _mm256_store_ps(us, u);
+                _mm256_store_ps(vs, v);
+                for (int l = 0; l < 8; ++l) {
+                    if ((mask >> l & 1) && ts[l] < hit.distance) {
+                        hit = { ts[l], us[l], vs[l], first + l };
+                        found = true;
+                    }
+                }
+            }
+            return found;
+        }
+
+        // Two RGBA pixels per register.
+        inline void convertPair(const GammaTable& table, const float* rgba, uint8_t* out) {
+            const __m256 x = _mm256_loadu_ps(rgba);
+            const __m256 one = _mm256_set1_ps(1.0f);
+            const __m256i bits = _mm256_castps_si256(x);
+
+            const __m256 inRange = _mm256_and_ps(_mm256_cmp_ps(x, _mm256_set1_ps(0x1p-20f), _CMP_GE_OQ), _mm256_cmp_ps(x, one, _CMP_LT_OQ));
+            __m256i index = _mm256_sub_epi32(_mm256_srli_epi32(bits, 23 - GammaTable::segmentBits),
+                                             _mm256_set1_epi32(GammaTable::minExponent << GammaTable::segmentBits));
+            index = _mm256_and_si256(index, _mm256_castps_si256(inRange));
+            const __m256 t = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(bits, _mm256_set1_epi32((1 << (23 - GammaTable::segmentBits)) - 1))),
+                                           _mm256_set1_ps(1.0f / (1 << (23 - GammaTable::segmentBits))));
+
+            const __m256 base = _mm256_i32gather_ps(table.base, index, 4);
+            const __m256 slope = _mm256_i32gather_ps(table.slope, index, 4);
+            __m256 value = _mm256_add_ps(base, _mm256_mul_ps(slope, t));
+            value = _mm256_and_ps(value, inRange);
+            value = _mm256_blendv_ps(value, _mm256_set1_ps(255.0f), _mm256_cmp_ps(x, one, _CMP_GE_OQ));
+
+            __m256i result = _mm256_cvttps_epi32(_mm256_add_ps(value, _mm256_set1_ps(0.5f)));
+            result = _mm256_blend_epi32(result, _mm256_set1_epi32(255), 0x88);
+            result = _mm256_packus_epi32(result, result);
+            result = _mm256_packus_epi16(result, result);
+
+            const int first = _mm_cvtsi128_si32(_mm256_castsi256_si128(result));
+            const int second = _mm_cvtsi128_si32(_mm256_extracti128_si256(result, 1));
+            std::memcpy(out, &first, 4);
+            std::memcpy(out + 4, &second, 4);
+        }
+
+        void convertToRgba8(const float* rgba, uint8_t* out, size_t pixelCount) {
+            const GammaTable& table = GammaTable::get();
+            size_t i = 0;
+            for (; i + 2 <= pixelCount; i += 2)
+                convertPair(table, rgba + 4 * i, out + 4 * i);
+
+            if (i < pixelCount) {
+                alignas(32) float last[8] = {};
+                uint8_t lastOut[8];
+                std::memcpy(last, rgba + 4 * i, 4 * sizeof(float));
+                convertPair(table, last, lastOut);
+                std::memcpy(out + 4 * i, lastOut, 4);
+            }
+        }
+    }
+
+    const Kernels& getAVX2Kernels() {
+        static const Kernels kernels = { triangleBounds, intersectBoxPair, intersectTriangles, convertToRgba8 };
+        return kernels;
+    }
+}
+#endif
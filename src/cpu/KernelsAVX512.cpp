@@ -0,0 +1,209 @@
+﻿#include "Kernels.h"
+
+#if TARGET_ARCH_X86
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <immintrin.h>
+
+// Compiled with AVX-512 F/BW/DQ/VL enabled. Only intrinsics and plain loads in here: any inline
+// function instantiated in this file (glm, std) could be merged with the baseline copy by the linker.
+
+namespace raytracer {
+    namespace {
+        inline __m128 load(const vec4& v) {
+            return _mm_loadu_ps(&v.x);
+        }
+
+        inline __m256 load2(const vec4& a, const vec4& b) {
+            return _mm256_insertf128_ps(_mm256_castps128_ps256(load(a)), load(b), 1);
+        }
+
+        inline __m512 load4(const vec4& a, const vec4& b, const vec4& c, const vec4& d) {
+            __m512 v = _mm512_zextps128_ps512(load(a));
+            v = _mm512_insertf32x4(v, load(b), 1);
+            v = _mm512_insertf32x4(v, load(c), 2);
+            return _mm512_insertf32x4(v, load(d), 3);
+        }
+
+// GCC 12 warns about the _mm512_undefined_* its own headers pass to min, max, the casts, shifts,
+// conversions and gathers once they are inlined at -O2 (GCC bug 105593); the values are never read.
+// Only the functions that use those are exempt.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+        void triangleBounds(const vec4* triMins, const vec4* triMaxs, const uint32_t* ids, size_t count,
+                            vec4& outMin, vec4& outMax) {
+            __m512 min = _mm512_set1_ps(FLT_MAX), max = _mm512_set1_ps(-FLT_MAX);
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4) {
+                min = _mm512_min_ps(load4(triMins[ids[i]], triMins[ids[i + 1]], triMins[ids[i + 2]], triMins[ids[i + 3]]), min);
+                max = _mm512_max_ps(load4(triMaxs[ids[i]], triMaxs[ids[i + 1]], triMaxs[ids[i + 2]], triMaxs[ids[i + 3]]), max);
+            }
+
+            __m256 min256 = _mm256_min_ps(_mm512_castps512_ps256(min), _mm512_extractf32x8_ps(min, 1));
+            __m256 max256 = _mm256_max_ps(_mm512_castps512_ps256(max), _mm512_extractf32x8_ps(max, 1));
+            __m128 min128 = _mm_min_ps(_mm256_castps256_ps128(min256), _mm256_extractf128_ps(min256, 1));
+            __m128 max128 = _mm_max_ps(_mm256_castps256_ps128(max256), _mm256_extractf128_ps(max256, 1));
+            for (; i < count; ++i) {
+                min128 = _mm_min_ps(load(triMins[ids[i]]), min128);
+                max128 = _mm_max_ps(load(triMaxs[ids[i]]), max128);
+            }
+            _mm_storeu_ps(&outMin.x, min128);
+            _mm_storeu_ps(&outMax.x, max128);
+        }
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+        // Only two boxes per call, so this stays at 256 bits and uses AVX-512VL masks for the select.
+        void intersectBoxPair(const KernelRay& ray, const BVHNode* pair, float maxDistance, float* entry) {
+            const __m256 origin = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&ray.origin.x));
+            const __m256 invDirection = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&ray.invDirection.x));
+
+            const __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(load2(pair[0].min, pair[1].min), origin), invDirection);
+            const __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(load2(pair[0].max, pair[1].max), origin), invDirection);
+            const __m256 lo = _mm256_min_ps(t0, t1);
+            const __m256 hi = _mm256_max_ps(t1, t0);
+
+            __m256 tNear = _mm256_max_ps(lo, _mm256_setzero_ps());
+            __m256 tFar = _mm256_min_ps(hi, _mm256_set1_ps(maxDistance));
+            tNear = _mm256_max_ps(_mm256_permute_ps(lo, _MM_SHUFFLE(1, 1, 1, 1)), tNear);
+            tFar = _mm256_min_ps(_mm256_permute_ps(hi, _MM_SHUFFLE(1, 1, 1, 1)), tFar);
+            tNear = _mm256_max_ps(_mm256_permute_ps(lo, _MM_SHUFFLE(2, 2, 2, 2)), tNear);
+            tFar = _mm256_min_ps(_mm256_permute_ps(hi, _MM_SHUFFLE(2, 2, 2, 2)), tFar);
+
+            const __mmask8 hits = _mm256_cmp_ps_mask(tNear, tFar, _CMP_LE_OQ);
+            const __m256 result = _mm256_mask_blend_ps(hits, _mm256_set1_ps(INFINITY), tNear);
+            entry[0] = _mm_cvtss_f32(_mm256_castps256_ps128(result));
+            entry[1] = _mm_cvtss_f32(_mm256_extractf128_ps(result, 1));
+        }
+
+        inline __m512 cross(__m512 ay, __m512 az, __m512 by, __m512 bz) {
+            return _mm512_sub_ps(_mm512_mul_ps(ay, bz), _mm512_mul_ps(by, az));
+        }
+
+        inline __m512 dot(__m512 ax, __m512 ay, __m512 az, __m512 bx, __m512 by, __m512 bz) {
+            return _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(ax, bx), _mm512_mul_ps(ay, by)), _mm512_mul_ps(az, bz));
+        }
+
+        bool intersectTriangles(const KernelRay& ray, const Triangle* triangles, uint32_t count, float minDistance,
+                                TriangleHit& hit) {
+            const __m512 ox = _mm512_set1_ps(ray.origin.x), oy = _mm512_set1_ps(ray.origin.y), oz = _mm512_set1_ps(ray.origin.z);
+            const __m512 dx = _mm512_set1_ps(ray.direction.x), dy = _mm512_set1_ps(ray.direction.y), dz = _mm512_set1_ps(ray.direction.z);
+            const __m512 zero = _mm512_setzero_ps(), one = _mm512_set1_ps(1.0f);
+            const __m512 epsilon = _mm512_set1_ps(1e-8f);
+            const __m512 minT = _mm512_set1_ps(minDistance);
+            const float* base = &triangles[0].posA.x;
+            constexpr int stride = sizeof(Triangle) / sizeof(float);
+            bool found = false;
+
+            for (uint32_t first = 0; first < count; first += 16) {
+                const __mmask16 live = first + 16 <= count ? 0xffff : static_cast<__mmask16>((1u << (count - first)) - 1);
+                const __m512i laneIds = _mm512_add_epi32(_mm512_set1_epi32(static_cast<int>(first)),
+                                                         _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+                const __m512i offsets = _mm512_mullo_epi32(laneIds, _mm512_set1_epi32(stride));
+
+                const __m512 ax = _mm512_mask_i32gather_ps(zero, live, offsets, base + 0, 4);
+                const __m512 ay = _mm512_mask_i32gather_ps(zero, live, offsets, base + 1, 4);
+                const __m512 az = _mm512_mask_i32gather_ps(zero, live, offsets, base + 2, 4);
+                const __m512 bx = _mm512_mask_i32gather_ps(zero, live, offsets, base + 4, 4);
+                const __m512 by = _mm512_mask_i32gather_ps(zero, live, offsets, base + 5, 4);
+                const __m512 bz = _mm512_mask_i32gather_ps(zero, live, offsets, base + 6, 4);
+                const __m512 cx = _mm512_mask_i32gather_ps(zero, live, offsets, base + 8, 4);
+                const __m512 cy = _mm512_mask_i32gather_ps(zero, live, offsets, base + 9, 4);
+                const __m512 cz = _mm512_mask_i32gather_ps(zero, live, offsets, base + 10, 4);
+
+                const __m512 e1x = _mm512_sub_ps(bx, ax), e1y = _mm512_sub_ps(by, ay), e1z = _mm512_sub_ps(bz, az);
+                const __m512 e2x = _mm512_sub_ps(cx, ax), e2y = _mm512_sub_ps(cy, ay), e2z = _mm512_sub_ps(cz, az);
+
+                const __m512 px = cross(dy, dz, e2y, e2z);
+                const __m512 py = cross(dz, dx, e2z, e2x);
+                const __m512 pz = cross(dx, dy, e2x, e2y);
+                const __m512 det = dot(e1x, e1y, e1z, px, py, pz);
+                __mmask16 valid = _mm512_mask_cmp_ps_mask(live, _mm512_abs_ps(det), epsilon, _CMP_GE_OQ);
+
+                const __m512 invDet = _mm512_div_ps(one, det);
+                const __m512 tx = _mm512_sub_ps(ox, ax), ty = _mm512_sub_ps(oy, ay), tz = _mm512_sub_ps(oz, az);
+                const __m512 u = _mm512_mul_ps(dot(tx, ty, tz, px, py, pz), invDet);
+                valid = _mm512_mask_cmp_ps_mask(valid, u, zero, _CMP_GE_OQ);
+                valid = _mm512_mask_cmp_ps_mask(valid, u, one, _CMP_LE_OQ);
+
+                const __m512 qx = cross(ty, tz, e1y, e1z);
+                const __m512 qy = cross(tz, tx, e1z, e1x);
+                const __m512 qz = cross(tx, ty, e1x, e1y);
+                const __m512 v = _mm512_mul_ps(dot(dx, dy, dz, qx, qy, qz), invDet);
+                valid = _mm512_mask_cmp_ps_mask(valid, v, zero, _CMP_GE_OQ);
+                valid = _mm512_mask_cmp_ps_mask(valid, _mm512_add_ps(u, v), one, _CMP_LE_OQ);
+
+                const __m512 t = _mm512_mul_ps(dot(e2x, e2y, e2z, qx, qy, qz), invDet);
+                valid = _mm512_mask_cmp_ps_mask(valid, t, minT, _CMP_GT_OQ);
+                valid = _mm512_mask_cmp_ps_mask(valid, t, _mm512_set1_ps(hit.distance), _CMP_LT_OQ);
+                if (!valid)
+                    continue;
+
+                alignas(64) float ts[16], us[16], vs[16];
+                _mm512_store_ps(ts, t);
+                _mm512_store_ps(us, u);
+                _mm512_store_ps(vs, v);
+                for (int l = 0; l < 16; ++l) {
+                    if ((valid >> l & 1) && ts[l] < hit.distance) {
+                        hit = { ts[l], us[l], vs[l], first + l };
+                        found = true;
+                    }
+                }
+            }
+            return found;
+        }
+
+// The shifts, conversions and gathers of the conversion, as for triangleBounds.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+        // Four RGBA pixels per register; lanes outside the mask are neither read nor written.
+        inline void convertQuad(const GammaTable& table, const float* rgba, uint8_t* out, __mmask16 live) {
+            const __m512 x = _mm512_maskz_loadu_ps(live, rgba);
+            const __m512 one = _mm512_set1_ps(1.0f);
+            const __m512i bits = _mm512_castps_si512(x);
+
+            const __mmask16 inRange = _mm512_cmp_ps_mask(x, _mm512_set1_ps(0x1p-20f), _CMP_GE_OQ) &
+                                      _mm512_cmp_ps_mask(x, one, _CMP_LT_OQ);
+            const __m512i index = _mm512_maskz_sub_epi32(inRange, _mm512_srli_epi32(bits, 23 - GammaTable::segmentBits),
+                                                         _mm512_set1_epi32(GammaTable::minExponent << GammaTable::segmentBits));
+            const __m512 t = _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_and_si512(bits, _mm512_set1_epi32((1 << (23 - GammaTable::segmentBits)) - 1))),
+                                           _mm512_set1_ps(1.0f / (1 << (23 - GammaTable::segmentBits))));
+
+            const __m512 base = _mm512_i32gather_ps(index, table.base, 4);
+            const __m512 slope = _mm512_i32gather_ps(index, table.slope, 4);
+            __m512 value = _mm512_maskz_mov_ps(inRange, _mm512_add_ps(base, _mm512_mul_ps(slope, t)));
+            value = _mm512_mask_mov_ps(value, _mm512_cmp_ps_mask(x, one, _CMP_GE_OQ), _mm512_set1_ps(255.0f));
+
+            __m512i result = _mm512_cvttps_epi32(_mm512_add_ps(value, _mm512_set1_ps(0.5f)));
+            result = _mm512_mask_mov_epi32(result, 0x8888, _mm512_set1_epi32(255));
+            _mm_mask_storeu_epi8(out, live, _mm512_cvtusepi32_epi8(result));
+        }
+
+        void convertToRgba8(const float* rgba, uint8_t* out, size_t pixelCount) {
+            const GammaTable& table = GammaTable::get();
+            size_t i = 0;
+            for (; i + 4 <= pixelCount; i += 4)
+                convertQuad(table, rgba + 4 * i, out + 4 * i, 0xffff);
+            if (i < pixelCount)
+                convertQuad(table, rgba + 4 * i, out + 4 * i, static_cast<__mmask16>((1u << (4 * (pixelCount - i))) - 1));
+        }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+    }
+
+    const Kernels& getAVX512Kernels() {
+        static const Kernels kernels = { triangleBounds, intersectBoxPair, intersectTriangles, convertToRgba8 };
+        return kernels;
+    }
+}
+#endif
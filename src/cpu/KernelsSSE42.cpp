@@ -0,0 +1,186 @@
+﻿#include "Kernels.h"
+
+#if TARGET_ARCH_X86
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <nmmintrin.h>
+
+// Compiled with SSE4.2 enabled. Only intrinsics and plain loads in here: any inline function
+// instantiated in this file (glm, std) could be merged with the baseline copy by the linker.
+
+namespace raytracer {
+    namespace {
+        inline __m128 load(const vec4& v) {
+            return _mm_loadu_ps(&v.x);
+        }
+
+        void triangleBounds(const vec4* triMins, const vec4* triMaxs, const uint32_t* ids, size_t count,
+                            vec4& outMin, vec4& outMax) {
+            __m128 min0 = _mm_set1_ps(FLT_MAX), max0 = _mm_set1_ps(-FLT_MAX);
+            __m128 min1 = min0, max1 = max0;
+            size_t i = 0;
+            for (; i + 2 <= count; i += 2) {
+                min0 = _mm_min_ps(load(triMins[ids[i]]), min0);
+                max0 = _mm_max_ps(load(triMaxs[ids[i]]), max0);
+                min1 = _mm_min_ps(load(triMins[ids[i + 1]]), min1);
+                max1 = _mm_max_ps(load(triMaxs[ids[i + 1]]), max1);
+            }
+            if (i < count) {
+                min0 = _mm_min_ps(load(triMins[ids[i]]), min0);
+                max0 = _mm_max_ps(load(triMaxs[ids[i]]), max0);
+            }
+            _mm_storeu_ps(&outMin.x, _mm_min_ps(min0, min1));
+            _mm_storeu_ps(&outMax.x, _mm_max_ps(max0, max1));
+        }
+
+        inline float slabEntry(__m128 origin, __m128 invDirection, const BVHNode& node, float maxDistance) {
+            const __m128 t0 = _mm_mul_ps(_mm_sub_ps(load(node.min), origin), invDirection);
+            const __m128 t1 = _mm_mul_ps(_mm_sub_ps(load(node.max), origin), invDirection);
+            const __m128 lo = _mm_min_ps(t0, t1);
+            const __m128 hi = _mm_max_ps(t1, t0);
+
+            __m128 tNear = _mm_setzero_ps();
+            __m128 tFar = _mm_set_ss(maxDistance);
+            tNear = _mm_max_ss(lo, tNear);
+            tFar = _mm_min_ss(hi, tFar);
+            tNear = _mm_max_ss(_mm_shuffle_ps(lo, lo, _MM_SHUFFLE(1, 1, 1, 1)), tNear);
+            tFar = _mm_min_ss(_mm_shuffle_ps(hi, hi, _MM_SHUFFLE(1, 1, 1, 1)), tFar);
+            tNear = _mm_max_ss(_mm_shuffle_ps(lo, lo, _MM_SHUFFLE(2, 2, 2, 2)), tNear);
+            tFar = _mm_min_ss(_mm_shuffle_ps(hi, hi, _MM_SHUFFLE(2, 2, 2, 2)), tFar);
+
+            const float nearDistance = _mm_cvtss_f32(tNear);
+            return nearDistance <= _mm_cvtss_f32(tFar) ? nearDistance : INFINITY;
+        }
+
+        void intersectBoxPair(const KernelRay& ray, const BVHNode* pair, float maxDistance, float* entry) {
+            const __m128 origin = load(ray.origin);
+            const __m128 invDirection = load(ray.invDirection);
+            entry[0] = slabEntry(origin, invDirection, pair[0], maxDistance);
+            entry[1] = slabEntry(origin, invDirection, pair[1], maxDistance);
+        }
+
+        inline __m128 cross(__m128 ay, __m128 az, __m128 by, __m128 bz) {
+            return _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(by, az));
+        }
+
+        inline __m128 dot(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz) {
+            return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+        }
+
+        // Loads one position of four triangles and transposes them into x, y, z registers.
+        inline void loadPositions(const Triangle* tris, const uint32_t* lanes, int vertex, __m128& x, __m128& y, __m128& z) {
+            __m128 r0 = load((&tris[lanes[0]].posA)[vertex]);
+            __m128 r1 = load((&tris[lanes[1]].posA)[vertex]);
+            __m128 r2 = load((&tris[lanes[2]].posA)[vertex]);
+            __m128 r3 = load((&tris[lanes[3]].posA)[vertex]);
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            x = r0;
+            y = r1;
+            z = r2;
+        }
+
+        bool intersectTriangles(const KernelRay& ray, const Triangle* triangles, uint32_t count, float minDistance,
+                                TriangleHit& hit) {
+            const __m128 ox = _mm_set1_ps(ray.origin.x), oy = _mm_set1_ps(ray.origin.y), oz = _mm_set1_ps(ray.origin.z);
+            const __m128 dx = _mm_set1_ps(ray.direction.x), dy = _mm_set1_ps(ray.direction.y), dz = _mm_set1_ps(ray.direction.z);
+            const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+            const __m128 epsilon = _mm_set1_ps(1e-8f);
+            const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+            const __m128 minT = _mm_set1_ps(minDistance);
+            bool found = false;
+
+            for (uint32_t first = 0; first < count; first += 4) {
+                uint32_t lanes[4];
+                for (uint32_t l = 0; l < 4; ++l)
+                    lanes[l] = first + l < count ? first + l : count - 1;
+
+                __m128 ax, ay, az, bx, by, bz, cx, cy, cz;
+                loadPositions(triangles, lanes, 0, ax, ay, az);
+                loadPositions(triangles, lanes, 1, bx, by, bz);
+                loadPositions(triangles, lanes, 2, cx, cy, cz);
+
+                const __m128 e1x = _mm_sub_ps(bx, ax), e1y = _mm_sub_ps(by, ay), e1z = _mm_sub_ps(bz, az);
+                const __m128 e2x = _mm_sub_ps(cx, ax), e2y = _mm_sub_ps(cy, ay), e2z = _mm_sub_ps(cz, az);
+
+                const __m128 px = cross(dy, dz, e2y, e2z);
+                const __m128 py = cross(dz, dx, e2z, e2x);
+                const __m128 pz = cross(dx, dy, e2x, e2y);
+                const __m128 det = dot(e1x, e1y, e1z, px, py, pz);
+                __m128 valid = _mm_cmpge_ps(_mm_and_ps(det, absMask), epsilon);
+
+                const __m128 invDet = _mm_div_ps(one, det);
+                const __m128 tx = _mm_sub_ps(ox, ax), ty = _mm_sub_ps(oy, ay), tz = _mm_sub_ps(oz, az);
+                const __m128 u = _mm_mul_ps(dot(tx, ty, tz, px, py, pz), invDet);
+                valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+
+                const __m128 qx = cross(ty, tz, e1y, e1z);
+                const __m128 qy = cross(tz, tx, e1z, e1x);
+                const __m128 qz = cross(tx, ty, e1x, e1y);
+                const __m128 v = _mm_mul_ps(dot(dx, dy, dz, qx, qy, qz), invDet);
+                valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(_mm_add_ps(u, v), one)));
+
+                const __m128 t = _mm_mul_ps(dot(e2x, e2y, e2z, qx, qy, qz), invDet);
+                valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpgt_ps(t, minT), _mm_cmplt_ps(t, _mm_set1_ps(hit.distance))));
+
+                int mask = _mm_movemask_ps(valid);
+                if (first + 4 > count)
+                    mask &= (1 << (count - first)) - 1;
+                if (!mask)
+                    continue;
+
+                alignas(16) float ts[4], us[4], vs[4];
+                _mm_store_ps(ts, t);
+                _mm_store_ps(us, u);
+                _mm_store_ps(vs, v);
+                for (int l = 0; l < 4; ++l) {
+                    if ((mask >> l & 1) && ts[l] < hit.distance) {
+                        hit = { ts[l], us[l], vs[l], first + l };
+                        found = true;
+                    }
+                }
+            }
+            return found;
+        }
+
+        void convertToRgba8(const float* rgba, uint8_t* out, size_t pixelCount) {
+            const GammaTable& table = GammaTable::get();
+            const __m128 lowest = _mm_set1_ps(0x1p-20f), one = _mm_set1_ps(1.0f);
+            const __m128i segmentBase = _mm_set1_epi32(GammaTable::minExponent << GammaTable::segmentBits);
+            const __m128i fractionMask = _mm_set1_epi32((1 << (23 - GammaTable::segmentBits)) - 1);
+            const __m128 fractionScale = _mm_set1_ps(1.0f / (1 << (23 - GammaTable::segmentBits)));
+            const __m128i alpha = _mm_set_epi32(255, 0, 0, 0);
+            const __m128i colorMask = _mm_set_epi32(0, -1, -1, -1);
+
+            for (size_t i = 0; i < pixelCount; ++i) {
+                const __m128 x = _mm_loadu_ps(rgba + 4 * i);
+                const __m128i bits = _mm_castps_si128(x);
+                __m128i index = _mm_sub_epi32(_mm_srli_epi32(bits, 23 - GammaTable::segmentBits), segmentBase);
+                const __m128 inRange = _mm_and_ps(_mm_cmpge_ps(x, lowest), _mm_cmplt_ps(x, one));
+                index = _mm_and_si128(index, _mm_castps_si128(inRange));
+                const __m128 t = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(bits, fractionMask)), fractionScale);
+
+                alignas(16) int32_t lanes[4];
+                _mm_store_si128(reinterpret_cast<__m128i*>(lanes), index);
+                const __m128 base = _mm_setr_ps(table.base[lanes[0]], table.base[lanes[1]], table.base[lanes[2]], table.base[lanes[3]]);
+                const __m128 slope = _mm_setr_ps(table.slope[lanes[0]], table.slope[lanes[1]], table.slope[lanes[2]], table.slope[lanes[3]]);
+
+                __m128 value = _mm_add_ps(base, _mm_mul_ps(slope, t));
+                value = _mm_and_ps(value, inRange);
+                value = _mm_blendv_ps(value, _mm_set1_ps(255.0f), _mm_cmpge_ps(x, one));
+
+                __m128i result = _mm_cvttps_epi32(_mm_add_ps(value, _mm_set1_ps(0.5f)));
+                result = _mm_or_si128(_mm_and_si128(result, colorMask), alpha);
+                result = _mm_packus_epi16(_mm_packus_epi32(result, result), result);
+                const int packed = _mm_cvtsi128_si32(result);
+                std::memcpy(out + 4 * i, &packed, 4);
+            }
+        }
+    }
+
+    const Kernels& getSSE42Kernels() {
+        static const Kernels kernels = { triangleBounds, intersectBoxPair, intersectTriangles, convertToRgba8 };
+        return kernels;
+    }
+}
+#endif
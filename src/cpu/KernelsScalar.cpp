@@ -0,0 +1,126 @@
+﻿#include "Kernels.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+namespace raytracer {
+    const GammaTable& GammaTable::get() {
+        static const GammaTable table = [] {
+            GammaTable t{};
+            for (int i = 0; i < size; ++i) {
+                const float lo = std::ldexp(1.0f + static_cast<float>(i & ((1 << segmentBits) - 1)) / (1 << segmentBits),
+                                            (i >> segmentBits) + minExponent - 127);
+                const float hi = std::ldexp(1.0f + static_cast<float>((i & ((1 << segmentBits) - 1)) + 1) / (1 << segmentBits),
+                                            (i >> segmentBits) + minExponent - 127);
+                t.base[i] = 255.0f * std::pow(lo, 1.0f / 2.2f);
+                t.slope[i] = 255.0f * std::pow(hi, 1.0f / 2.2f) - t.base[i];
+            }
+            return t;
+        }();
+        return table;
+    }
+
+    namespace {
+        void triangleBounds(const vec4* triMins, const vec4* triMaxs, const uint32_t* ids, size_t count,
+                            vec4& outMin, vec4& outMax) {
+            vec4 min(FLT_MAX), max(-FLT_MAX);
+            for (size_t i = 0; i < count; ++i) {
+                const vec4& a = triMins[ids[i]];
+                const vec4& b = triMaxs[ids[i]];
+                for (int c = 0; c < 4; ++c) {
+                    min[c] = a[c] < min[c] ? a[c] : min[c];
+                    max[c] = b[c] > max[c] ? b[c] : max[c];
+                }
+            }
+            outMin = min;
+            outMax = max;
+        }
+
+        void intersectBoxPair(const KernelRay& ray, const BVHNode* pair, float maxDistance, float* entry) {
+            for (int n = 0; n < 2; ++n) {
+                float tNear = 0.0f, tFar = maxDistance;
+                for (int c = 0; c < 3; ++c) {
+                    const float t0 = (pair[n].min[c] - ray.origin[c]) * ray.invDirection[c];
+                    const float t1 = (pair[n].max[c] - ray.origin[c]) * ray.invDirection[c];
+                    const float lo = t0 < t1 ? t0 : t1;
+                    const float hi = t0 < t1 ? t1 : t0;
+                    tNear = lo > tNear ? lo : tNear;
+                    tFar = hi < tFar ? hi : tFar;
+                }
+                entry[n] = tNear <= tFar ? tNear : INFINITY;
+            }
+        }
+
+        bool intersectTriangles(const KernelRay& ray, const Triangle* triangles, uint32_t count, float minDistance,
+                                TriangleHit& hit) {
+            const float ox = ray.origin.x, oy = ray.origin.y, oz = ray.origin.z;
+            const float dx = ray.direction.x, dy = ray.direction.y, dz = ray.direction.z;
+            bool found = false;
+
+            for (uint32_t i = 0; i < count; ++i) {
+                const Triangle& tri = triangles[i];
+                const float e1x = tri.posB.x - tri.posA.x, e1y = tri.posB.y - tri.posA.y, e1z = tri.posB.z - tri.posA.z;
+                const float e2x = tri.posC.x - tri.posA.x, e2y = tri.posC.y - tri.posA.y, e2z = tri.posC.z - tri.posA.z;
+
+                const float px = dy * e2z - e2y * dz;
+                const float py = dz * e2x - e2z * dx;
+                const float pz = dx * e2y - e2x * dy;
+                const float det = e1x * px + e1y * py + e1z * pz;
+                if (std::fabs(det) < 1e-8f)
+                    continue;
+
+                const float invDet = 1.0f / det;
+                const float tx = ox - tri.posA.x, ty = oy - tri.posA.y, tz = oz - tri.posA.z;
+                const float u = (tx * px + ty * py + tz * pz) * invDet;
+                if (u < 0.0f || u > 1.0f)
+                    continue;
+
+                const float qx = ty * e1z - e1y * tz;
+                const float qy = tz * e1x - e1z * tx;
+                const float qz = tx * e1y - e1x * ty;
+                const float v = (dx * qx + dy * qy + dz * qz) * invDet;
+                if (v < 0.0f || u + v > 1.0f)
+                    continue;
+
+                const float distance = (e2x * qx + e2y * qy + e2z * qz) * invDet;
+                if (distance <= minDistance || !(distance < hit.distance))
+                    continue;
+
+                hit = { distance, u, v, i };
+                found = true;
+            }
+            return found;
+        }
+
+        void convertToRgba8(const float* rgba, uint8_t* out, size_t pixelCount) {
+            const GammaTable& table = GammaTable::get();
+            for (size_t i = 0; i < pixelCount; ++i) {
+                for (int c = 0; c < 3; ++c) {
+                    const float x = rgba[4 * i + c];
+                    float value;
+                    if (!(x >= 0x1p-20f)) {
+                        value = 0.0f;
+                    } else if (x >= 1.0f) {
+                        value = 255.0f;
+                    } else {
+                        uint32_t bits;
+                        std::memcpy(&bits, &x, sizeof(bits));
+                        const int index = static_cast<int>(bits >> (23 - GammaTable::segmentBits)) -
+                                          (GammaTable::minExponent << GammaTable::segmentBits);
+                        const float t = static_cast<float>(bits & ((1u << (23 - GammaTable::segmentBits)) - 1)) *
+                                        (1.0f / (1 << (23 - GammaTable::segmentBits)));
+                        value = table.base[index] + table.slope[index] * t;
+                    }
+                    out[4 * i + c] = static_cast<uint8_t>(value + 0.5f);
+                }
+                out[4 * i + 3] = 255;
+            }
+        }
+    }
+
+    const Kernels& getScalarKernels() {
+        static const Kernels kernels = { triangleBounds, intersectBoxPair, intersectTriangles, convertToRgba8 };
+        return kernels;
+    }
+}
@@ -0,0 +1,249 @@
+﻿#include "PathGuide.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#include "JobSystem.h"
+
+namespace raytracer {
+    namespace {
+        constexpr float pi = 3.14159265359f;
+        constexpr float fixedPointScale = 65536.0f;
+        constexpr float maxRecorded = 1e6f;     // per sample, so sums of millions of them fit
+        constexpr uint32_t noNode = ~0u;
+
+        // (cos theta, phi) over the unit square, the same parametrization as the integrator's uniform directions.
+        vec2 toSquare(vec3 direction) {
+            float phi = std::atan2(direction.y, direction.x);
+            if (phi < 0.0f)
+                phi += 2.0f * pi;
+            return clamp(vec2(0.5f * (direction.z + 1.0f), phi / (2.0f * pi)), vec2(0.0f), vec2(0x1.fffffep-1f));
+        }
+
+        vec3 toDirection(vec2 point) {
+            const float z = 2.0f * point.x - 1.0f;
+            const float a = 2.0f * pi * point.y;
+            const float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+            return vec3(r * std::cos(a), r * std::sin(a), z);
+        }
+
+        uint32_t getQuadrant(vec2& point) {
+            const uint32_t x = point.x >= 0.5f ? 1 : 0, y = point.y >= 0.5f ? 1 : 0;
+            point = point * 2.0f - vec2(x, y);
+            return x + 2 * y;
+        }
+
+        // Picks the lower or upper part of [0, 1) by their weights and rescales u into it.
+        uint32_t pickHalf(float lower, float upper, float& u) {
+            const float probability = lower / (lower + upper);
+            if (u < probability) {
+                u = std::min(u / probability, 0x1.fffffep-1f);
+                return 0;
+            }
+            u = std::min((u - probability) / (1.0f - probability), 0x1.fffffep-1f);
+            return 1;
+        }
+    }
+
+    DirectionalTree::DirectionalTree(): nodes(1, Node{}) {
+    }
+
+    float DirectionalTree::getPdf(vec3 direction) const {
+        if (isEmpty())
+            return 0.0f;
+        vec2 point = toSquare(direction);
+        float density = 1.0f;
+        for (uint32_t index = 0;;) {
+            const Node& node = nodes[index];
+            const float sum = node.energy[0] + node.energy[1] + node.energy[2] + node.energy[3];
+            const uint32_t quadrant = getQuadrant(point);
+            if (node.energy[quadrant] <= 0.0f)
+                return 0.0f;
+            density *= 4.0f * node.energy[quadrant] / sum;
+            if (!node.children[quadrant])
+                return density / (4.0f * pi);
+            index = node.children[quadrant];
+        }
+    }
+
+    // Columns first, then the quadrant within the column, then on into it with u rescaled.
+    vec3 DirectionalTree::sample(vec2 u) const {
+        vec2 origin(0.0f);
+        float size = 1.0f;
+        for (uint32_t index = 0;;) {
+            const Node& node = nodes[index];
+            const float* energy = node.energy;
+            const uint32_t x = pickHalf(energy[0] + energy[2], energy[1] + energy[3], u.x);
+            const uint32_t y = pickHalf(energy[x], energy[x + 2], u.y);
+            size *= 0.5f;
+            origin += vec2(x, y) * size;
+            const uint32_t child = node.children[x + 2 * y];
+            if (!child)
+                return toDirection(origin + u * size);
+            index = child;
+        }
+    }
+
+    void DirectionalTree::record(vec3 direction, float value) {
+        if (!(value > 0.0f))
+            return;
+        const auto fixed = static_cast<uint64_t>(std::min(value, maxRecorded) * fixedPointScale + 0.5f);
+        vec2 point = toSquare(direction);
+        for (uint32_t index = 0;;) {
+            Node& node = nodes[index];
+            const uint32_t quadrant = getQuadrant(point);
+            if (!node.children[quadrant]) {
+                std::atomic_ref(node.recorded[quadrant]).fetch_add(fixed, std::memory_order_relaxed);
+                return;
+            }
+            index = node.children[quadrant];
+        }
+    }
+
+    void DirectionalTree::build() {
+        total = buildNode(0);
+    }
+
+    float DirectionalTree::buildNode(uint32_t index) {
+        float sum = 0.0f;
+        for (int quadrant = 0; quadrant < 4; ++quadrant) {
+            const uint32_t child = nodes[index].children[quadrant];
+            const float energy = child ? buildNode(child) : static_cast<float>(nodes[index].recorded[quadrant]) / fixedPointScale;
+            nodes[index].energy[quadrant] = energy;
+            sum += energy;
+        }
+        return sum;
+    }
+
+    DirectionalTree DirectionalTree::refine(float threshold) const {
+        DirectionalTree result;
+        if (isEmpty()) {
+            result.nodes = nodes;
+            for (Node& node : result.nodes)
+                std::fill(std::begin(node.recorded), std::end(node.recorded), 0);
+            return result;
+        }
+        result.refineNode(*this, 0, total, 0, 1, threshold * total);
+        return result;
+    }
+
+    // Where the source has no node, its leaf's energy is taken to be spread evenly over the quadrants.
+    void DirectionalTree::refineNode(const DirectionalTree& source, uint32_t sourceIndex, float sourceEnergy,
+                                     uint32_t index, int depth, float threshold) {
+        for (int quadrant = 0; quadrant < 4; ++quadrant) {
+            float energy = 0.25f * sourceEnergy;
+            uint32_t sourceChild = noNode;
+            if (sourceIndex != noNode) {
+                const Node& node = source.nodes[sourceIndex];
+                energy = node.energy[quadrant];
+                if (node.children[quadrant])
+                    sourceChild = node.children[quadrant];
+            }
+            if (energy <= threshold || depth >= maxDepth)
+                continue;
+
+            const auto child = static_cast<uint32_t>(nodes.size());
+            nodes.push_back({});
+            nodes[index].children[quadrant] = child;
+            refineNode(source, sourceChild, energy, child, depth + 1, threshold);
+        }
+    }
+
+    PathGuide::PathGuide(const Scene& scene): leaves(sideCount) {
+        for (uint32_t side = 0; side < sideCount; ++side)
+            nodes.push_back({ 0, side, 0 });
+
+        vec3 min(INFINITY), max(-INFINITY);
+        for (const Sphere& sphere : scene.spheres) {
+            min = glm::min(min, vec3(sphere.pos_radius) - sphere.pos_radius.w);
+            max = glm::max(max, vec3(sphere.pos_radius) + sphere.pos_radius.w);
+        }
+        for (const MeshInfo& mesh : scene.meshes) {
+            if (mesh.numTriangles == 0)
+                continue;
+            const BVHNode& root = scene.nodes[mesh.rootNodeIndex];
+            for (int corner = 0; corner < 8; ++corner) {
+                const vec3 local(corner & 1 ? root.max.x : root.min.x, corner & 2 ? root.max.y : root.min.y,
+                                 corner & 4 ? root.max.z : root.min.z);
+                const vec3 world = mat3(mesh.rotation) * local + vec3(mesh.pos);
+                min = glm::min(min, world);
+                max = glm::max(max, world);
+            }
+        }
+        if (min.x > max.x)
+            min = vec3(-1.0f), max = vec3(1.0f);
+
+        // a cube, so that splitting the axes in turn keeps the cells close to cubes too
+        const float size = 1.01f * std::max(max.x - min.x, std::max(max.y - min.y, max.z - min.z)) + 1e-3f;
+        boundsMin = 0.5f * (min + max) - 0.5f * size;
+        boundsSize = vec3(size);
+    }
+
+    uint32_t PathGuide::getLeaf(vec3 position, vec3 normal) const {
+        const vec3 magnitude = abs(normal);
+        const int axis = magnitude.x >= magnitude.y && magnitude.x >= magnitude.z ? 0 : magnitude.y >= magnitude.z ? 1 : 2;
+        const SpatialNode* node = &nodes[axis * 2 + (normal[axis] < 0.0f ? 1 : 0)];
+
+        vec3 point = clamp((position - boundsMin) / boundsSize, vec3(0.0f), vec3(0x1.fffffep-1f));
+        while (node->children) {
+            const int axis = static_cast<int>(node->depth % 3);
+            const uint32_t side = point[axis] >= 0.5f ? 1 : 0;
+            point[axis] = point[axis] * 2.0f - static_cast<float>(side);
+            node = &nodes[node->children + side];
+        }
+        return node->leaf;
+    }
+
+    void PathGuide::record(uint32_t leaf, vec3 direction, float value) {
+        std::atomic_ref(leaves[leaf].samples).fetch_add(1, std::memory_order_relaxed);
+        if (std::isfinite(value))
+            leaves[leaf].building.record(direction, value);
+    }
+
+    void PathGuide::finishFrame(uint64_t paths) {
+        if (firstIterationPaths == 0)
+            firstIterationPaths = paths;
+        iterationPaths += paths;
+        if (iterationPaths < firstIterationPaths << std::min(iteration, 32u))
+            return;
+        refine();
+        ++iteration;
+        iterationPaths = 0;
+    }
+
+    size_t PathGuide::getDirectionalNodeCount() const {
+        size_t count = 0;
+        for (const Leaf& leaf : leaves)
+            count += leaf.sampling.getNodeCount();
+        return count;
+    }
+
+    // Leaves split in two until each half would hold fewer samples than the threshold, the halves both
+    // starting out with what the whole recorded. Then every leaf samples from what it recorded and
+    // records into a tree refined by it.
+    void PathGuide::refine() {
+        const float threshold = spatialThreshold * std::sqrt(std::exp2(static_cast<float>(iteration)));
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            const SpatialNode node = nodes[i];
+            if (node.children || node.depth >= maxSpatialDepth || static_cast<float>(leaves[node.leaf].samples) <= threshold)
+                continue;
+
+            leaves[node.leaf].samples /= 2;
+            const Leaf copy = leaves[node.leaf];
+            const auto secondLeaf = static_cast<uint32_t>(leaves.size());
+            leaves.push_back(copy);
+            nodes[i].children = static_cast<uint32_t>(nodes.size());
+            nodes.push_back({ 0, node.leaf, node.depth + 1 });
+            nodes.push_back({ 0, secondLeaf, node.depth + 1 });
+        }
+
+        JobSystem::parallelFor(0, leaves.size(), 16, [&](size_t i) {
+            Leaf& leaf = leaves[i];
+            leaf.building.build();
+            leaf.sampling = leaf.building;
+            leaf.building = leaf.sampling.refine(energyThreshold);
+            leaf.samples = 0;
+        });
+    }
+}
@@ -0,0 +1,110 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "Scene.h"
+#include "glm/glm.hpp"
+using namespace glm;
+
+namespace raytracer {
+    // Distribution of incident radiance over the sphere at one region of space: a quadtree over the
+    // square of (cos theta, phi), which maps to the sphere with equal area. A quadrant is split while it
+    // holds more than a share of the energy, so the tree is deep where the light comes from.
+    class DirectionalTree {
+    public:
+        struct Node {
+            uint32_t children[4];   // 0 where the quadrant is a leaf, the root is never anyone's child
+            float energy[4];        // the sampling distribution, set by build()
+            uint64_t recorded[4];   // fixed-point sums of what record() was given, leaves only
+        };
+
+        static constexpr int maxDepth = 20;
+
+        DirectionalTree();
+
+        // Solid angle pdf of sample(), 0 everywhere while the tree has no energy.
+        float getPdf(vec3 direction) const;
+        vec3 sample(vec2 u) const;
+        bool isEmpty() const { return total <= 0.0f; }
+
+        // Adds an estimate of the radiance arriving from direction over the pdf it was sampled with.
+        // Safe from any number of threads.
+        void record(vec3 direction, float value);
+
+        // Turns what was recorded into energies, summed up to the root.
+        void build();
+        // A tree for the next iteration: quadrants holding more than threshold of the energy are split,
+        // the rest merged, and nothing is recorded yet. Keeps the structure if there is no energy.
+        DirectionalTree refine(float threshold) const;
+
+        size_t getNodeCount() const { return nodes.size(); }
+    private:
+        float buildNode(uint32_t index);
+        void refineNode(const DirectionalTree& source, uint32_t sourceIndex, float sourceEnergy, uint32_t index,
+                        int depth, float threshold);
+
+        std::vector<Node> nodes;
+        float total = 0.0f;
+    };
+
+    // Practical path guiding (Müller et al., "Practical Path Guiding for Efficient Light-Transport
+    // Simulation", 2017): binary trees over the scene bounds, split along x, y and z in turn, with a
+    // DirectionalTree in every leaf. There is one tree per axis the normal is closest to, as in the
+    // radiance cache, so a floor and the wall next to it don't share a distribution that sends half the
+    // samples of each below the other's surface. Diffuse bounces pick their direction from the leaf's distribution
+    // or the cosine lobe, half and half, weighted by the pdf of the mix, so the image stays unbiased
+    // whatever was learned.
+    //
+    // Learning runs in iterations that double in length. During one, paths sample from the trees
+    // built by the one before and record into a second set; finishFrame() closes it once enough paths
+    // went by, splitting leaves that saw many samples and quadrants that saw much energy. Records are
+    // integers added with atomics, so a frame's result doesn't depend on how rows were spread over
+    // threads. Only the CPU integrator guides paths.
+    class PathGuide {
+    public:
+        static constexpr float bsdfFraction = 0.5f;         // of the guided bounces that sample the cosine lobe
+        static constexpr float spatialThreshold = 4000.0f;  // samples in a leaf before it splits, times sqrt(2^iteration)
+        static constexpr float energyThreshold = 0.01f;     // share of a leaf's energy before a quadrant splits
+        static constexpr int maxSpatialDepth = 48;
+        static constexpr int pathVertices = 16;             // diffuse vertices per path that record
+
+        explicit PathGuide(const Scene& scene);
+
+        // Leaf around position, clamped to the scene bounds, in the tree for the normal.
+        uint32_t getLeaf(vec3 position, vec3 normal) const;
+        // What paths sample from in the leaf.
+        const DirectionalTree& getDistribution(uint32_t leaf) const { return leaves[leaf].sampling; }
+        // Records a sample taken in the leaf, see DirectionalTree::record.
+        void record(uint32_t leaf, vec3 direction, float value);
+
+        // Called after each frame with the camera paths it traced; ends the iteration once it has had
+        // its share of them.
+        void finishFrame(uint64_t paths);
+
+        uint32_t getIteration() const { return iteration; }
+        size_t getLeafCount() const { return leaves.size(); }
+        size_t getDirectionalNodeCount() const;
+    private:
+        struct SpatialNode {
+            uint32_t children;  // first of two, 0 for a leaf
+            uint32_t leaf;
+            uint32_t depth;
+        };
+
+        struct Leaf {
+            DirectionalTree sampling, building;
+            uint64_t samples = 0;
+        };
+
+        static constexpr uint32_t sideCount = 6;
+
+        void refine();
+
+        vec3 boundsMin, boundsSize;
+        std::vector<SpatialNode> nodes;
+        std::vector<Leaf> leaves;
+        uint32_t iteration = 0;
+        uint64_t iterationPaths = 0;
+        uint64_t firstIterationPaths = 0;
+    };
+}
@@ -0,0 +1,113 @@
+﻿#include "RadianceCache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+
+#include "JobSystem.h"
+#include "Sampler.h"
+
+namespace raytracer {
+    RadianceCache::RadianceCache(): entries(capacity) {
+    }
+
+    void RadianceCache::getCell(vec3 position, vec3 normal, vec3 camera, uint32_t& slot, uint32_t& key) {
+        // the largest power of two below distance * cellScale, read off the exponent so that the GPU,
+        // whose log2 is approximate, picks the same one
+        const float size = std::max(length(position - camera), 1e-4f) * cellScale;
+        const int level = std::clamp(static_cast<int>(std::bit_cast<uint32_t>(size) >> 23 & 0xffu) - 127, -16, 16);
+        const float cellSize = std::bit_cast<float>(static_cast<uint32_t>(level + 127) << 23);
+        // nudged off the surface, or walls lying on a cell boundary would be split between two cells at random
+        const ivec3 cell(floor((position + normal * (cellSize / 64.0f)) / cellSize));
+
+        const vec3 magnitude = abs(normal);
+        const uint32_t axis = magnitude.x >= magnitude.y && magnitude.x >= magnitude.z ? 0 : magnitude.y >= magnitude.z ? 1 : 2;
+        const uint32_t side = axis * 2 + (normal[static_cast<int>(axis)] < 0.0f ? 1 : 0);
+
+        uint32_t hash = Sampling::hash(static_cast<uint32_t>(level + 16));
+        hash = Sampling::hash(hash ^ static_cast<uint32_t>(cell.x));
+        hash = Sampling::hash(hash ^ static_cast<uint32_t>(cell.y));
+        hash = Sampling::hash(hash ^ static_cast<uint32_t>(cell.z));
+        hash = Sampling::hash(hash ^ side);
+        slot = hash & (capacity - 1);
+        key = std::max(Sampling::hash(hash ^ 0x9e3779b9u), 1u);
+    }
+
+    // Cells are searched over all probeCount slots even past free ones, which eviction leaves behind.
+    bool RadianceCache::lookup(vec3 position, vec3 normal, vec3 camera, vec3& radiance) const {
+        uint32_t slot, key;
+        getCell(position, normal, camera, slot, key);
+        for (uint32_t i = 0; i < probeCount; ++i) {
+            const RadianceCacheEntry& entry = entries[(slot + i) & (capacity - 1)];
+            if (std::atomic_ref(const_cast<uint32_t&>(entry.key)).load(std::memory_order_relaxed) != key)
+                continue;
+            if (entry.radiance_count.w < minSamples)
+                return false;
+            radiance = vec3(entry.radiance_count);
+            return true;
+        }
+        return false;
+    }
+
+    void RadianceCache::add(vec3 position, vec3 normal, vec3 camera, vec3 radiance) {
+        if (!std::isfinite(radiance.r + radiance.g + radiance.b))
+            return;
+        uint32_t slot, key;
+        getCell(position, normal, camera, slot, key);
+
+        // the cell's own slot if it has one, else the first free one
+        RadianceCacheEntry* found = nullptr;
+        for (uint32_t i = 0; i < probeCount && !found; ++i) {
+            RadianceCacheEntry& entry = entries[(slot + i) & (capacity - 1)];
+            if (std::atomic_ref(entry.key).load(std::memory_order_relaxed) == key)
+                found = &entry;
+        }
+        for (uint32_t i = 0; i < probeCount && !found; ++i) {
+            RadianceCacheEntry& entry = entries[(slot + i) & (capacity - 1)];
+            uint32_t expected = 0;
+            if (std::atomic_ref(entry.key).compare_exchange_strong(expected, key, std::memory_order_relaxed) || expected == key)
+                found = &entry;
+        }
+        if (!found)
+            return;
+
+        const uvec3 fixed(min(radiance, vec3(maxRadiance)) * fixedPointScale + 0.5f);
+        for (int c = 0; c < 3; ++c)
+            std::atomic_ref(found->accumulation[c]).fetch_add(fixed[c], std::memory_order_relaxed);
+        std::atomic_ref(found->accumulation.w).fetch_add(1u, std::memory_order_relaxed);
+    }
+
+    void RadianceCache::resolve() {
+        JobSystem::parallelForRange(0, capacity, 4096, [&](size_t first, size_t end) {
+            for (size_t i = first; i < end; ++i) {
+                RadianceCacheEntry& entry = entries[i];
+                if (entry.key == 0)
+                    continue;
+                const uvec4 accumulation = entry.accumulation;
+                if (accumulation.w == 0) {
+                    if (++entry.age > maxAge)
+                        entry = {};
+                    continue;
+                }
+
+                const float history = entry.radiance_count.w;
+                const float count = history + static_cast<float>(accumulation.w);
+                const vec3 sum = vec3(uvec3(accumulation)) / fixedPointScale;
+                entry.radiance_count = vec4((vec3(entry.radiance_count) * history + sum) / count, std::min(count, maxSamples));
+                entry.accumulation = uvec4(0);
+                entry.age = 0;
+            }
+        });
+    }
+
+    void RadianceCache::clear() {
+        std::fill(entries.begin(), entries.end(), RadianceCacheEntry{});
+    }
+
+    size_t RadianceCache::getCellCount() const {
+        return static_cast<size_t>(std::count_if(entries.begin(), entries.end(), [](const RadianceCacheEntry& entry) {
+            return entry.key != 0 && entry.radiance_count.w > 0.0f;
+        }));
+    }
+}
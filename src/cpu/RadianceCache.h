@@ -0,0 +1,59 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "glm/glm.hpp"
+using namespace glm;
+
+namespace raytracer {
+    // One slot of the radiance cache, the layout of the cache buffer in raytracer.comp.
+    struct RadianceCacheEntry {
+        uint32_t key;           // fingerprint of the cell, 0 while the slot is free
+        uint32_t age;           // frames since the cell last got a sample
+        uint32_t padding[2];
+        uvec4 accumulation;     // this frame's samples: fixed-point radiance sums, count in w
+        vec4 radiance_count;    // average over earlier frames, w: samples it stands for
+    };
+
+    // World-space radiance cache for ending long paths early (Binder et al., "Massively Parallel Path
+    // Space Filtering", 2019, and Gautron, "Real-Time Ray-Traced Ambient Occlusion of Complex Scenes
+    // using Spatial Hashing", 2020). Cells are keyed by position, quantized more coarsely the farther
+    // they are from the camera, and by the axis the normal is closest to.
+    //
+    // Diffuse path vertices add what their path gathered after them while a frame is traced; a path
+    // that reaches a cell with enough samples at radianceCacheDepth or deeper takes its average and
+    // stops. resolve() runs between frames: it blends the frame's samples into the averages, which
+    // keep at most maxSamples of history, and frees cells nothing added to for maxAge frames.
+    //
+    // The table is a fixed number of slots probed linearly, claimed and summed into with atomics, so
+    // add() and lookup() may run from any number of threads during a frame. Sums are integers to keep
+    // them exact in any order, the same as on the GPU, which has no float atomics.
+    class RadianceCache {
+    public:
+        // Values shared with raytracer.comp.
+        static constexpr uint32_t capacity = 1u << 18;
+        static constexpr uint32_t probeCount = 8;
+        static constexpr float cellScale = 1.0f / 8.0f;     // cell size over distance from the camera
+        static constexpr float fixedPointScale = 1024.0f;
+        static constexpr float maxRadiance = 256.0f;        // samples are clamped, so 16K of them fit a sum
+        static constexpr float minSamples = 16.0f;          // before a cell can end paths
+        static constexpr float maxSamples = 1024.0f;
+        static constexpr uint32_t maxAge = 64;
+        static constexpr int pathVertices = 4;              // diffuse vertices per path that add samples
+
+        RadianceCache();
+
+        bool lookup(vec3 position, vec3 normal, vec3 camera, vec3& radiance) const;
+        void add(vec3 position, vec3 normal, vec3 camera, vec3 radiance);
+        void resolve();
+        void clear();
+
+        // Cells holding an average, for statistics.
+        size_t getCellCount() const;
+
+        // Slot and nonzero fingerprint of the cell around position.
+        static void getCell(vec3 position, vec3 normal, vec3 camera, uint32_t& slot, uint32_t& key);
+    private:
+        std::vector<RadianceCacheEntry> entries;
+    };
+}
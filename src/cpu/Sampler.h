@@ -0,0 +1,171 @@
+﻿#pragma once
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+
+#include "BlueNoise.h"
+#include "glm/glm.hpp"
+
+namespace raytracer {
+    enum class SamplerType {
+        Independent,
+        Sobol,
+        BlueNoise,
+        Count
+    };
+
+    // Shared pieces of the samplers. All of it is integer math, so the CPU integrator and
+    // raytracer.comp draw exactly the same sample values.
+    class Sampling {
+    public:
+        // dimensions 0 and 1 jitter the camera ray, then every bounce gets a fixed block
+        static constexpr uint32_t cameraDimensions = 2;
+        static constexpr uint32_t bounceDimensions = 8;
+        // offsets into a bounce's block: the direction takes two, the light sample a selection and a point,
+        // path guiding one more to choose between the cosine lobe and what it learned
+        static constexpr uint32_t directionDimension = 0;
+        static constexpr uint32_t rouletteDimension = 2;
+        static constexpr uint32_t lightDimension = 3;
+        static constexpr uint32_t guideDimension = 6;
+        // reservoir resampling draws independent numbers far above any bounce, 64 per pass
+        static constexpr uint32_t resamplingDimension = 1u << 20;
+        static constexpr uint32_t resamplingPassDimensions = 64;
+
+        // PCG output permutation (Jarzynski and Olano, "Hash Functions for GPU Rendering")
+        static uint32_t hash(uint32_t x) {
+            const uint32_t state = x * 747796405u + 2891336453u;
+            const uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+            return (word >> 22u) ^ word;
+        }
+
+        static uint32_t hashCombine(uint32_t seed, uint32_t value) {
+            return seed ^ (value + (seed << 6) + (seed >> 2));
+        }
+
+        static uint32_t getPixelSeed(glm::uvec2 pixel) {
+            return hash(hash(pixel.x) ^ pixel.y);
+        }
+
+        // Later bounces keep their dimensions even if an earlier one used fewer than its block.
+        static uint32_t getBounceDimension(int bounce, uint32_t offset) {
+            return cameraDimensions + static_cast<uint32_t>(bounce) * bounceDimensions + offset;
+        }
+
+        // The top 23 bits as a float in [0, 1).
+        static float toFloat(uint32_t bits) {
+            return std::bit_cast<float>((bits >> 9) | 0x3f800000u) - 1.0f;
+        }
+
+        static uint32_t reverseBits(uint32_t x) {
+            x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+            x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+            x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+            x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+            return (x >> 16) | (x << 16);
+        }
+
+        // Owen scrambling as a hash (Burley, "Practical Hash-based Owen Scrambling", 2020).
+        static uint32_t nestedUniformScramble(uint32_t x, uint32_t seed) {
+            x = reverseBits(x);
+            x += seed;
+            x ^= x * 0x6c50b47cu;
+            x ^= x * 0xb82f1e52u;
+            x ^= x * 0xc7afe638u;
+            x ^= x * 0x8d22f6e6u;
+            return reverseBits(x);
+        }
+
+        // Second Sobol dimension; the first one is just reverseBits(index).
+        static uint32_t sobolSecondAxis(uint32_t index) {
+            uint32_t result = 0;
+            for (uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1) {
+                if (index & 1)
+                    result ^= v;
+            }
+            return result;
+        }
+
+        static const char* getName(SamplerType type) {
+            constexpr const char* names[] = { "independent", "sobol", "bluenoise" };
+            return names[static_cast<int>(type)];
+        }
+
+        static std::optional<SamplerType> parse(const char* name) {
+            for (int i = 0; i < static_cast<int>(SamplerType::Count); ++i) {
+                if (!strcmp(name, getName(static_cast<SamplerType>(i))))
+                    return static_cast<SamplerType>(i);
+            }
+            return std::nullopt;
+        }
+    };
+
+    // Uncorrelated random numbers: a hash of (pixel, sample index, dimension).
+    struct IndependentSampler {
+        uint32_t seed;
+        uint32_t dimension;
+
+        static IndependentSampler create(glm::uvec2 pixel, uint32_t sampleIndex) {
+            return { Sampling::hash(Sampling::getPixelSeed(pixel) ^ sampleIndex), 0 };
+        }
+
+        void startBounce(int bounce, uint32_t offset = Sampling::directionDimension) {
+            dimension = Sampling::getBounceDimension(bounce, offset);
+        }
+
+        float next() {
+            return Sampling::toFloat(Sampling::hash(seed ^ Sampling::hash(dimension++)));
+        }
+    };
+
+    // Owen-scrambled Sobol points, padded to any number of dimensions with independently
+    // shuffled 2D sets. Every pair of dimensions (camera jitter, bounce direction) is a
+    // stratified 2D pattern over the samples of a pixel.
+    struct SobolSampler {
+        uint32_t seed;
+        uint32_t index;
+        uint32_t dimension;
+
+        static SobolSampler create(glm::uvec2 pixel, uint32_t sampleIndex) {
+            return { Sampling::getPixelSeed(pixel), sampleIndex, 0 };
+        }
+
+        void startBounce(int bounce, uint32_t offset = Sampling::directionDimension) {
+            dimension = Sampling::getBounceDimension(bounce, offset);
+        }
+
+        float next() {
+            const uint32_t pairSeed = Sampling::hash(seed ^ Sampling::hash(dimension >> 1));
+            const uint32_t shuffled = Sampling::nestedUniformScramble(index, pairSeed);
+            const uint32_t axis = dimension++ & 1;
+            const uint32_t value = axis == 0 ? Sampling::reverseBits(shuffled) : Sampling::sobolSecondAxis(shuffled);
+            return Sampling::toFloat(Sampling::nestedUniformScramble(value, Sampling::hashCombine(pairSeed, axis)));
+        }
+    };
+
+    // The tiled blue-noise mask, shifted per dimension and advanced per sample along an R2
+    // (plastic number) sequence, so the error stays blue in screen space at every sample count.
+    struct BlueNoiseSampler {
+        const uint32_t* mask;
+        glm::uvec2 pixel;
+        uint32_t index;
+        uint32_t dimension;
+
+        static BlueNoiseSampler create(glm::uvec2 pixel, uint32_t sampleIndex) {
+            return { BlueNoise::get().data(), pixel, sampleIndex, 0 };
+        }
+
+        void startBounce(int bounce, uint32_t offset = Sampling::directionDimension) {
+            dimension = Sampling::getBounceDimension(bounce, offset);
+        }
+
+        float next() {
+            constexpr uint32_t wrap = BlueNoise::size - 1;
+            const uint32_t offset = Sampling::hash(dimension);
+            const uint32_t x = (pixel.x + offset) & wrap;
+            const uint32_t y = (pixel.y + (offset >> 16)) & wrap;
+            const uint32_t step = dimension++ & 1 ? 2447445413u : 3242174889u;
+            return Sampling::toFloat(mask[y * BlueNoise::size + x] + index * step);
+        }
+    };
+}
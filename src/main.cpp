@@ -1,165 +1,687 @@
-﻿#include <chrono>
-
+﻿#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <memory>
+
+#include "Benchmark.h"
 #include "Camera.h"
+#include "Checkpoint.h"
+#include "DynamicResolution.h"
+#include "FrameBudget.h"
+#include "GpuState.h"
+#include "ImageWriter.h"
+#include "JobSystem.h"
 #include "Model.h"
+#include "Offline.h"
+#include "ReadbackRing.h"
+#include "Scene.h"
 #include "Window.h"
 #include "Shader.h"
+#include "Termination.h"
+#include "cpu/CpuDispatch.h"
+#include "cpu/Denoiser.h"
+#include "cpu/Integrator.h"
 #include "glm/gtc/type_ptr.inl"
+#include "misc/Options.h"
 using raytracer::Window;
 using raytracer::Shader;
-using raytracer::Sphere;
-using raytracer::Triangle;
-using raytracer::MeshInfo;
+using raytracer::Scene;
+using raytracer::GpuState;
+using raytracer::RenderProgress;
 
 void renderQuad();
 
 Shader *defaultShader;
 Shader *displayShader;
-int frameCount = 0;
+Shader *denoiseShader;
 int frames = 0;
-GLuint fbo;
-GLuint accumTexture;
+bool resizePending = false;     // the window changed size since, the next frame catches up
 GLuint quadVAO = 0;
-GLuint sphereSSBO = 0;
-GLuint triangleSSBO = 0;
-GLuint meshSSBO = 0;
-GLuint nodeSSBO = 0;
+bool useReprojection = false;
+bool reprojectionValid = false; // whether geometryTexture belongs to reprojectionPosition and reprojectionRotation
+vec3 reprojectionPosition;
+mat3 reprojectionRotation;
+bool trackVariance = false;
 double accTime = 0.0;
+std::vector<vec4> cpuAccumulation;
+raytracer::ReservoirBuffers cpuReservoirs;
+std::unique_ptr<raytracer::RadianceCache> cpuRadianceCache;
+std::unique_ptr<raytracer::PathGuide> cpuPathGuide;
+std::vector<vec4> cpuVariance;
+raytracer::AovBuffers cpuAovs;
+raytracer::ReprojectionBuffers cpuReprojection;
+raytracer::ImageWriter imageWriter; // saves captures, tiles and checkpoints off the render thread
+raytracer::CheckpointWriter checkpointWriter(imageWriter);
+std::vector<vec4> checkpointAccumulation, checkpointVariance; // the CPU's images while the writer saves them
+raytracer::ReadbackRing readbackRing; // captured frames on their way to the image writer
 
 raytracer::Camera camera = raytracer::Camera(10, 0.08f);
 
-void resetAccumulation() {
-    frameCount = 0;
-    const float zero[4] = {0,0,0,0};
-    glClearTexImage(accumTexture, 0, GL_RGBA, GL_FLOAT, zero);
+// Starts the render over from what the accumulation holds: the statistics, counters and the
+// termination policy's clock. The image itself stays, see resetAccumulation.
+void restartRender(const GpuState& gpu, RenderProgress& progress) {
+    progress.restart();
+    gpu.clearStatistics();
+    std::fill(cpuVariance.begin(), cpuVariance.end(), vec4(0));
+    // the AOVs count their own samples, so they start over even where the image is carried on
+    cpuAovs.clear();
+}
+
+void resetAccumulation(const GpuState& gpu, RenderProgress& progress) {
+    restartRender(gpu, progress);
+    progress.frameIndex = 0;
+    gpu.clearAccumulation();
+    std::fill(cpuAccumulation.begin(), cpuAccumulation.end(), vec4(0));
+    reprojectionValid = false;
+    cpuReprojection.valid = false;
+}
+
+// Sizes everything per pixel for the window, see GpuState::resize.
+static void resizeTargets(GpuState& gpu, RenderProgress& progress) {
+    const uvec2 size(Window::params.width, Window::params.height);
+    resizePending = false;
+    if (!gpu.resize(size))
+        return;
+    if (!cpuAccumulation.empty())
+        cpuAccumulation.resize(static_cast<size_t>(size.x) * size.y);
+    if (!cpuVariance.empty())
+        cpuVariance.resize(static_cast<size_t>(size.x) * size.y);
+    if (!cpuAovs.albedo.empty())
+        cpuAovs.resize(size);
+    resetAccumulation(gpu, progress);
+    gpu.logRenderTargets();
 }
 
+// Dragging a window edge sends a size after every few pixels; the images catch up once a frame.
 static void windowSizeCallback(GLFWwindow *window, int width, int height) {
+    // minimized, there is nothing to draw into
+    if (width <= 0 || height <= 0)
+        return;
     glViewport(0, 0, width, height);
     Window::params.width = width;
     Window::params.height = height;
-    glGenTextures(1, &accumTexture);
-    glBindTexture(GL_TEXTURE_2D, accumTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    resetAccumulation();
+    resizePending = true;
 }
 
 
-std::vector<Sphere> spheres = {
-    {vec4(0.0, 0.0, 0.0, 1.0), vec4(1, 1, 1, 1), vec4(0)},
-    {vec4(0.0, 2.0, 2.0, 1.0), vec4(0, 0, 1, 0), vec4(1, 1, 1, 4)},
-    {vec4(0.0, -21.0, -1.0, 20.0), vec4(0.7, 0.2, 0.6, 0), vec4(0)}
-};
-
-std::vector<Triangle> triangles;
-std::vector<MeshInfo> meshes;
-std::vector<raytracer::BVHNode> nodes;
-raytracer::Material material {
-    vec3(1),
-    0,
-};
-raytracer::Model suzanne = raytracer::Model("resources/suzanne.glb", raytracer::Transform { vec3(0, 2, -4), vec3(-45, 0, 0), vec3(1) }, material);
-
 double deltaTime = 0.0f;
 std::chrono::time_point<std::chrono::system_clock> startFrame;
 
-int main() {
-    Window window(800, 600);
-    glfwSetFramebufferSizeCallback(window.getWindow(), windowSizeCallback);
+static Scene createScene(const raytracer::Options& options) {
+    Scene scene = Scene::createDefault();
+    if (!options.environment.empty())
+        scene.environment.load(options.environment);
+    return scene;
+}
 
-    defaultShader = new Shader("resources/shaders/default.vert", "resources/shaders/default.frag",
-                               "resources/shaders/raytracer.comp");
-    displayShader = new Shader("resources/shaders/display.vert", "resources/shaders/display.frag");
+static raytracer::FrameSettings createFrameSettings(const raytracer::Options& options, bool cpuBackend) {
+    raytracer::FrameSettings settings;
+    if (!options.sampler.empty()) {
+        if (const auto sampler = raytracer::Sampling::parse(options.sampler.c_str()))
+            settings.sampler = *sampler;
+        else
+            WARN("Unknown sampler '%s', using %s.", options.sampler.c_str(), raytracer::Sampling::getName(settings.sampler));
+    }
+    if (options.rouletteDepth >= 0)
+        settings.rouletteDepth = options.rouletteDepth;
+    settings.nextEventEstimation = !options.noNextEventEstimation;
+    settings.lightTree = !options.noLightTree;
+    settings.restir = options.restir;
+    settings.radianceCache = options.radianceCacheDepth >= 0;
+    settings.radianceCacheDepth = std::max(options.radianceCacheDepth, 0);
+    if (options.pathGuiding && !cpuBackend)
+        WARN("Path guiding runs on the CPU backend only, ignoring --guide.");
+    settings.pathGuiding = options.pathGuiding && cpuBackend;
+    settings.adaptiveSampling = options.adaptiveThreshold > 0.0f;
+    if (settings.adaptiveSampling)
+        settings.adaptiveThreshold = options.adaptiveThreshold;
+    settings.reprojection = options.reprojection;
+    return settings;
+}
 
-    suzanne.addTriangles(triangles);
-    suzanne.addMesh(meshes);
-    suzanne.addNodes(nodes);
+static void finishRender(RenderProgress& progress, const char* reason, size_t pixelCount) {
+    progress.finished = true;
+    INFO("Render finished (%s): %.1f samples per pixel in %.1f s, estimated error %.3f%%.", reason,
+         static_cast<double>(progress.totalSamples) / static_cast<double>(pixelCount), progress.getSeconds(),
+         100.0 * progress.estimatedError);
+}
 
-    printf("tris=%zu nodes=%zu\n", triangles.size(), nodes.size());
+// Starts saving the render so far. The CPU backend's images are copied for the writer to save from,
+// the GPU's are read back without waiting, see CheckpointReadback.
+static void startCheckpoint(const std::string& path, uvec2 size, const raytracer::FrameSettings& settings,
+                            const raytracer::Checkpoint::Source& source, const GpuState& gpu, const RenderProgress& progress,
+                            raytracer::CheckpointReadback& readback) {
+    const bool hasVariance = source.gpu ? trackVariance : !cpuVariance.empty();
+    const raytracer::Checkpoint checkpoint =
+        raytracer::Offline::describeCheckpoint(progress, camera, size, settings, source, hasVariance);
+    if (source.gpu) {
+        // adaptive frames are counted by the GPU, see GpuState::clearStatistics
+        readback.start(checkpoint, gpu.accumTexture, gpu.varianceTexture, settings.adaptiveSampling ? gpu.tileSSBO : 0,
+                       3 * sizeof(uint32_t));
+        return;
+    }
+    checkpointAccumulation = cpuAccumulation;
+    checkpointVariance = cpuVariance;
+    checkpointWriter.save(path, checkpoint, checkpointAccumulation.data(), checkpointVariance.data());
+}
+
+// Runs the filter of denoise.comp over the traced part of accumTexture into denoiseTextures[1],
+// guided by the AOVs.
+static void denoise(const GpuState& gpu, uvec2 size) {
+    denoiseShader->useCompute();
+    denoiseShader->setUIVector2("uResolution", size.x, size.y, true);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, gpu.accumTexture);
+    denoiseShader->setInt("colorTexture", 0, true);
+    glBindImageTexture(3, gpu.albedoTexture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+    glBindImageTexture(4, gpu.normalDepthTexture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+    // -1 estimates the variance into the first image, every iteration after reads what the one before wrote
+    for (int iteration = -1; iteration < raytracer::Denoiser::iterations; ++iteration) {
+        glBindImageTexture(1, gpu.denoiseTextures[iteration & 1], 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+        glBindImageTexture(2, gpu.denoiseTextures[(iteration + 1) & 1], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+        denoiseShader->setInt("iteration", iteration, true);
+        glDispatchCompute((size.x + 7u) / 8u, (size.y + 7u) / 8u, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    }
+}
+
+int main(int argc, char** argv) {
+    const auto options = raytracer::Options::parse(argc, argv);
+    raytracer::JobSystem::init(options.threads);
+
+    std::optional<raytracer::Isa> forcedIsa;
+    if (!options.isa.empty() && !(forcedIsa = raytracer::CpuDispatch::parse(options.isa.c_str())))
+        WARN("Unknown ISA '%s', picking one automatically.", options.isa.c_str());
+    raytracer::CpuDispatch::init(forcedIsa);
 
-    glGenBuffers(1, &sphereSSBO);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sphereSSBO);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, spheres.size() * sizeof(Sphere), spheres.data(), GL_DYNAMIC_DRAW);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sphereSSBO);
+    if (!options.benchmark.empty()) {
+        const int result = raytracer::Benchmark::run(options.benchmark);
+        raytracer::JobSystem::shutdown();
+        return result;
+    }
 
-    glGenBuffers(1, &triangleSSBO);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, triangleSSBO);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, triangles.size() * sizeof(Triangle), triangles.data(), GL_DYNAMIC_DRAW);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, triangleSSBO);
+    const raytracer::TerminationPolicy policy = { options.targetSamples, options.timeBudget, options.noiseThreshold };
+    if (options.headless) {
+        // only tiled renders go to the GPU
+        const bool cpuBackend = options.backend == "cpu" || options.tileSize == 0;
+        const int result = raytracer::Offline::render(createScene(options), createFrameSettings(options, cpuBackend), policy,
+                                                      options, imageWriter);
+        raytracer::JobSystem::shutdown();
+        return result;
+    }
 
-    glGenBuffers(1, &meshSSBO);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshSSBO);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, meshes.size() * sizeof(MeshInfo), meshes.data(), GL_DYNAMIC_DRAW);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, meshSSBO);
+    Window window(800, 600);
+    glfwSetFramebufferSizeCallback(window.getWindow(), windowSizeCallback);
 
-    glGenBuffers(1, &nodeSSBO);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, nodeSSBO);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, nodes.size() * sizeof(raytracer::BVHNode), nodes.data(), GL_STATIC_DRAW);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, nodeSSBO);
+    GpuState gpu;
+    RenderProgress progress;
+    raytracer::CheckpointReadback checkpointReadback(checkpointWriter);
+    defaultShader = new Shader("resources/shaders/default.vert", "resources/shaders/default.frag",
+                               "resources/shaders/raytracer.comp", gpu.selectAccumulationFormat(options.accumFormat, options.reprojection));
+    displayShader = new Shader("resources/shaders/display.vert", "resources/shaders/display.frag");
+    denoiseShader = new Shader("resources/shaders/denoise.comp");
 
-    defaultShader->useCompute();
-    defaultShader->setInt("maxBounces", 48, true);
-    defaultShader->setInt("samplesPerPixel", 2, true);
+    Scene scene = createScene(options);
+    printf("tris=%zu nodes=%zu\n", scene.triangles.size(), scene.nodes.size());
+
+    const bool cpuBackend = options.backend == "cpu";
+    const raytracer::Integrator integrator(scene);
+    if (cpuBackend) {
+        cpuAccumulation.resize(static_cast<size_t>(Window::params.width) * Window::params.height);
+        INFO("Rendering on the CPU (scene features 0x%x).", integrator.getFeatures());
+    }
+
+    gpu.uploadScene(scene);
+
+    raytracer::FrameSettings frameSettings = createFrameSettings(options, cpuBackend);
+    const uvec2 windowSize(Window::params.width, Window::params.height);
+    gpu.pixelReservoirs = frameSettings.restir;
+    gpu.createBuffers(frameSettings);
+    gpu.resizeReservoirs(windowSize);
+
+    // the cache is in world space, so it outlives camera moves; cells the camera left age out
+    if (frameSettings.radianceCache && cpuBackend)
+        cpuRadianceCache = std::make_unique<raytracer::RadianceCache>();
+    // like the cache, what the guide learned stays valid wherever the camera goes
+    if (frameSettings.pathGuiding)
+        cpuPathGuide = std::make_unique<raytracer::PathGuide>(scene);
+    // statistics are kept whenever something reads them: adaptive sampling, the sample count view or
+    // a noise threshold
+    // display.frag's displayMode for each view, the AOVs from 2 on
+    constexpr const char* views[] = { "color", "samples", "albedo", "normal", "depth", "id" };
+    const auto view = std::find(std::begin(views), std::end(views), options.view);
+    if (view == std::end(views))
+        WARN("Unknown view '%s', showing the image.", options.view.c_str());
+    const int displayMode = view == std::end(views) ? 0 : static_cast<int>(view - std::begin(views));
+    const bool showSamples = displayMode == 1;
+    trackVariance = frameSettings.adaptiveSampling || showSamples || policy.noiseThreshold > 0.0f;
+    if (trackVariance && cpuBackend)
+        cpuVariance.resize(static_cast<size_t>(Window::params.width) * Window::params.height);
+    gpu.resizeVariance(windowSize);
+    useReprojection = frameSettings.reprojection;
+    if (useReprojection && !cpuBackend)
+        gpu.resizeReprojection(windowSize);
+    // the AOVs are traced for the denoiser and the views that show them; the CPU backend fills them in
+    // memory and uploads them, so both go through the same filter
+    const bool useDenoiser = options.denoise;
+    const bool useAovs = useDenoiser || displayMode >= 2;
+    if (useAovs) {
+        gpu.resizeAovs(windowSize);
+        if (cpuBackend)
+            cpuAovs.resize(windowSize);
+    }
+    if (useDenoiser)
+        gpu.resizeDenoiser(windowSize);
+    gpu.resizeAccumulation(windowSize);
+    gpu.targetSize = windowSize;
+    resetAccumulation(gpu, progress);
+    gpu.logRenderTargets();
+    gpu.setUniforms(*defaultShader, scene, frameSettings, trackVariance, useAovs);
+    const raytracer::Checkpoint::Source checkpointSource = {
+        raytracer::Checkpoint::getSceneKey(scene, options.environment), !cpuBackend,
+        cpuBackend ? 0u : static_cast<uint32_t>(gpu.accumFormat.internalFormat)
+    };
 
     glfwSwapInterval(0);
 
+    // traces part of the window while the camera moves and the display pass scales it up; linear
+    // filtering is only wanted then, the image is read texel for texel otherwise
+    raytracer::DynamicResolution dynamicResolution(options.targetFrameMilliseconds * 1e-3);
+    GLuint upscaleSampler;
+    glGenSamplers(1, &upscaleSampler);
+    glSamplerParameteri(upscaleSampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glSamplerParameteri(upscaleSampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glSamplerParameteri(upscaleSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glSamplerParameteri(upscaleSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    float renderScale = 1.0f;
+    uint32_t lastPasses = 0;
+    // traces as many passes before presenting as fit in the budget; on the GPU they are timed by
+    // queries read back frames later, once they are done, so nothing waits for them
+    raytracer::FrameBudget frameBudget(options.frameBudgetMilliseconds * 1e-3);
+    constexpr uint32_t passQueryCount = 4;
+    GLuint passQueries[passQueryCount] = {};
+    uint32_t queryPasses[passQueryCount] = {};
+    uint32_t firstPendingQuery = 0, endPendingQuery = 0;
+    if (frameBudget.isEnabled() && !cpuBackend)
+        glGenQueries(passQueryCount, passQueries);
+
+    // the images go where they were, the camera and the counters follow
+    if (options.resume) {
+        raytracer::Checkpoint checkpoint;
+        std::vector<vec4> accumulation, variance;
+        if (raytracer::Offline::loadCheckpoint(options, gpu.targetSize, frameSettings, checkpointSource, checkpoint, accumulation,
+                                               variance, progress, camera, window.getWindow())) {
+            if (trackVariance && !checkpoint.hasVariance)
+                WARN("%s has no pixel statistics, they start over.", options.checkpoint.c_str());
+            const bool hasVariance = trackVariance && checkpoint.hasVariance;
+            if (cpuBackend) {
+                cpuAccumulation.swap(accumulation);
+                if (hasVariance)
+                    cpuVariance.swap(variance);
+            } else {
+                const uvec2 size = gpu.targetSize;
+                glBindTexture(GL_TEXTURE_2D, gpu.accumTexture);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size.x, size.y, GL_RGBA, GL_FLOAT, accumulation.data());
+                if (hasVariance) {
+                    glBindTexture(GL_TEXTURE_2D, gpu.varianceTexture);
+                    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size.x, size.y, GL_RGBA, GL_FLOAT, variance.data());
+                }
+                if (frameSettings.adaptiveSampling) {
+                    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gpu.tileSSBO);
+                    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 3 * sizeof(uint32_t), sizeof(uint64_t), &progress.totalSamples);
+                }
+            }
+        } else {
+            WARN("Starting the render over.");
+        }
+    }
+    auto lastCheckpoint = std::chrono::steady_clock::now();
+
+    // frames are read back without waiting and saved by the writer's threads, which hand the buffers
+    // back to the ring; reads finish in the order they were made, and so do the paths they are saved as
+    std::deque<std::string> capturePaths;
+    const std::filesystem::path captureDirectory = options.capture.empty() ? "." : options.capture;
+    if (!options.capture.empty())
+        std::filesystem::create_directories(captureDirectory);
+    auto captureFormat = raytracer::ImageWriter::getFormat("." + options.captureFormat);
+    if (!captureFormat) {
+        WARN("Ignoring --capture-format '%s', expected pfm, exr, png or qoi.", options.captureFormat.c_str());
+        captureFormat = raytracer::ImageWriter::Format::Pfm;
+    }
+    uint64_t capturedFrames = 0, screenshots = 0, rejectedCaptures = 0;
+    std::atomic<uint64_t> savedCaptures = 0;
+    // a frame the writer has no room for is dropped like one the ring has no buffer for, but at the end
+    const auto saveCapture = [&](const raytracer::ReadbackRing::Readback* readback, bool wait) {
+        const auto& images = readback->images;
+        raytracer::ImageWriter::Image image = { capturePaths.front(), readback->size, static_cast<const float*>(images[0]) };
+        capturePaths.pop_front();
+        if (images.size() >= 4) {
+            image.albedo = static_cast<const vec4*>(images[1]);
+            image.normalDepth = static_cast<const vec4*>(images[2]);
+            image.id = static_cast<const uvec2*>(images[3]);
+        }
+        image.done = [readback, path = image.path, &savedCaptures](bool written) {
+            if (written)
+                ++savedCaptures;
+            else
+                ERR("Could not write %s.", path.c_str());
+            readbackRing.release(readback);
+        };
+        if (!imageWriter.write(std::move(image), wait)) {
+            readbackRing.release(readback);
+            ++rejectedCaptures;
+        }
+    };
+    bool screenshotKeyDown = false;
+
+    std::vector<vec4> gpuVariance;
+    uint64_t lastCheckedSamples = 0;
     while (!glfwWindowShouldClose(window.getWindow())) {
+        // a finished render only wakes up for input, which may move the camera and start it over
+        if (progress.finished)
+            glfwWaitEvents();
         startFrame = std::chrono::high_resolution_clock::now();
+        if (resizePending)
+            resizeTargets(gpu, progress);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         camera.update(deltaTime, window.getWindow());
-        if (camera.hasMoved)
-            resetAccumulation();
-
-        // accumulate pass
-        defaultShader->useCompute();
-        glBindImageTexture(0, accumTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sphereSSBO);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, triangleSSBO);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, meshSSBO);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, nodeSSBO);
-
-        defaultShader->setUInt("renderedFrames", frameCount, true);
-        defaultShader->setMatrix3x3("cameraRotation", glm::value_ptr(camera.getViewMatrix()), true);
-        defaultShader->setVector3("cameraPosition", camera.getPosition().x, camera.getPosition().y,
-                                  camera.getPosition().z, true);
-        defaultShader->setUIVector2("uResolution", Window::params.width, Window::params.height, true);
-        defaultShader->setFloat("uFocalLength",
-                                static_cast<float>(tan(45.0 / 180.0 * std::numbers::pi)) * 0.5f * static_cast<float>(
-                                    Window::params.height), true);
-        //defaultShader->setBool("shouldAccumulate", !camera.hasMoved, true);
-
-        GLuint gx = (Window::params.width + 7u) / 8u;
-        GLuint gy = (Window::params.height + 7u) / 8u;
-        glDispatchCompute(gx, gy, 1);
-        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+        const float lastRenderScale = renderScale;
+        // as long as the last frame would have taken with a single pass
+        renderScale = dynamicResolution.update(camera.hasMoved, lastPasses ? deltaTime / lastPasses : 0.0);
+        if (renderScale != lastRenderScale) {
+            // a new scale puts the pixels elsewhere, nothing carries over
+            resetAccumulation(gpu, progress);
+        } else if (camera.hasMoved) {
+            // the image is carried over below, only what was measured about it starts over
+            if (useReprojection)
+                restartRender(gpu, progress);
+            else
+                resetAccumulation(gpu, progress);
+        }
+        if (camera.hasMoved || renderScale != lastRenderScale) {
+            // last frame's reservoirs belong to other surfaces now
+            gpu.reservoirHistoryValid = false;
+            cpuReservoirs.historyValid = false;
+        }
+
+        // accumulate pass, over the bottom left renderSize of the images
+        const uvec2 renderSize = dynamicResolution.apply(uvec2(Window::params.width, Window::params.height));
+        const float focalLength = raytracer::Camera::getFocalLength(renderSize.y);
+        const size_t pixelCount = static_cast<size_t>(renderSize.x) * renderSize.y;
+        const bool tracing = !progress.finished;
+        // a frame with a moving camera shows it as soon as it can
+        uint32_t passes = tracing ? frameBudget.getPasses(camera.hasMoved || renderScale < 1.0f) : 0;
+        if (passes > 1 && policy.samplesPerPixel > 0.0 && !frameSettings.adaptiveSampling) {
+            // no more than the sample target still needs
+            const double needed = policy.samplesPerPixel * static_cast<double>(pixelCount) - static_cast<double>(progress.totalSamples);
+            const double passSamples = static_cast<double>(pixelCount) * frameSettings.samplesPerPixel;
+            passes = static_cast<uint32_t>(std::clamp(std::ceil(needed / passSamples), 1.0, static_cast<double>(passes)));
+        }
+        if (tracing && cpuBackend) {
+            const raytracer::View view = { camera.getPosition(), camera.getViewMatrix(), focalLength,
+                                           renderSize };
+            if (useReprojection && (camera.hasMoved || !cpuReprojection.valid))
+                integrator.reproject(view, cpuAccumulation.data(), cpuReprojection);
+            const auto passesStart = std::chrono::steady_clock::now();
+            for (uint32_t pass = 0; pass < passes && !progress.finished; ++pass) {
+                frameSettings.frameIndex = progress.frameIndex;
+                const raytracer::RenderBuffers buffers = { &cpuReservoirs, cpuRadianceCache.get(), cpuPathGuide.get(),
+                                                           cpuVariance.empty() ? nullptr : cpuVariance.data(),
+                                                           useAovs ? &cpuAovs : nullptr };
+                const uint64_t paths = integrator.render(view, frameSettings, cpuAccumulation.data(), buffers).paths;
+                progress.totalSamples += paths;
+                progress.frameCount++;
+                progress.frameIndex++;
+                if (paths == 0)
+                    finishRender(progress, "every pixel converged", pixelCount);
+            }
+            frameBudget.addPassTime(passes, std::chrono::duration<double>(std::chrono::steady_clock::now() - passesStart).count());
+            if (policy.noiseThreshold > 0.0f)
+                progress.estimatedError = raytracer::Adaptive::estimateError(cpuVariance.data(), pixelCount);
+            if (gpu.accumTexture) {
+                glBindTexture(GL_TEXTURE_2D, gpu.accumTexture);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, renderSize.x, renderSize.y, GL_RGBA, GL_FLOAT,
+                                cpuAccumulation.data());
+            }
+            if (showSamples) {
+                glBindTexture(GL_TEXTURE_2D, gpu.varianceTexture);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, renderSize.x, renderSize.y, GL_RGBA, GL_FLOAT,
+                                cpuVariance.data());
+            }
+            if (useAovs) {
+                glBindTexture(GL_TEXTURE_2D, gpu.albedoTexture);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, renderSize.x, renderSize.y, GL_RGBA, GL_FLOAT,
+                                cpuAovs.albedo.data());
+                glBindTexture(GL_TEXTURE_2D, gpu.normalDepthTexture);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, renderSize.x, renderSize.y, GL_RGBA, GL_FLOAT,
+                                cpuAovs.normalDepth.data());
+                glBindTexture(GL_TEXTURE_2D, gpu.idTexture);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, renderSize.x, renderSize.y, GL_RG_INTEGER,
+                                GL_UNSIGNED_INT, cpuAovs.id.data());
+            }
+        } else if (tracing) {
+            defaultShader->useCompute();
+            gpu.bind();
+
+            defaultShader->setMatrix3x3("cameraRotation", glm::value_ptr(camera.getViewMatrix()), true);
+            defaultShader->setVector3("cameraPosition", camera.getPosition().x, camera.getPosition().y,
+                                      camera.getPosition().z, true);
+            defaultShader->setUIVector2("uResolution", renderSize.x, renderSize.y, true);
+            defaultShader->setFloat("uFocalLength", focalLength, true);
+            //defaultShader->setBool("shouldAccumulate", !camera.hasMoved, true);
+
+            if (useReprojection && (camera.hasMoved || !reprojectionValid)) {
+                // the live images become the history, and the pass fills the live ones again
+                if (reprojectionValid) {
+                    std::swap(gpu.accumTexture, gpu.historyTexture);
+                    std::swap(gpu.geometryTexture, gpu.historyGeometryTexture);
+                }
+                glBindImageTexture(0, gpu.accumTexture, 0, GL_FALSE, 0, GL_READ_WRITE, gpu.accumFormat.internalFormat);
+                glBindImageTexture(2, gpu.historyTexture, 0, GL_FALSE, 0, GL_READ_ONLY, gpu.accumFormat.internalFormat);
+                glBindImageTexture(3, gpu.geometryTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+                glBindImageTexture(4, gpu.historyGeometryTexture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+                defaultShader->setBool("reprojectHistory", reprojectionValid, true);
+                defaultShader->setVector3("previousCameraPosition", reprojectionPosition.x, reprojectionPosition.y,
+                                          reprojectionPosition.z, true);
+                defaultShader->setMatrix3x3("previousCameraRotation", glm::value_ptr(reprojectionRotation), true);
+                defaultShader->setBool("reproject", true, true);
+                glDispatchCompute((renderSize.x + 7u) / 8u, (renderSize.y + 7u) / 8u, 1);
+                glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+                defaultShader->setBool("reproject", false, true);
+                reprojectionPosition = camera.getPosition();
+                reprojectionRotation = camera.getViewMatrix();
+                reprojectionValid = true;
+            }
+
+            const bool timed = passQueries[0] && endPendingQuery - firstPendingQuery < passQueryCount;
+            if (timed) {
+                queryPasses[endPendingQuery % passQueryCount] = passes;
+                glBeginQuery(GL_TIME_ELAPSED, passQueries[endPendingQuery % passQueryCount]);
+            }
+            for (uint32_t pass = 0; pass < passes; ++pass) {
+                gpu.traceFrame(*defaultShader, frameSettings, renderSize, progress.frameIndex, progress.frameCount);
+                if (!frameSettings.adaptiveSampling)
+                    progress.totalSamples += static_cast<uint64_t>(renderSize.x) * renderSize.y * frameSettings.samplesPerPixel;
+                progress.frameCount++;
+                progress.frameIndex++;
+            }
+            if (timed) {
+                glEndQuery(GL_TIME_ELAPSED);
+                ++endPendingQuery;
+            }
+            // the oldest first, a query is done once the passes it timed are
+            for (; firstPendingQuery != endPendingQuery; ++firstPendingQuery) {
+                const GLuint query = passQueries[firstPendingQuery % passQueryCount];
+                GLuint available = 0;
+                glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+                if (!available)
+                    break;
+                GLuint64 nanoseconds = 0;
+                glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+                frameBudget.addPassTime(queryPasses[firstPendingQuery % passQueryCount], static_cast<double>(nanoseconds) * 1e-9);
+            }
+        }
+
+        if (tracing && useDenoiser && gpu.accumTexture)
+            denoise(gpu, renderSize);
+
+        // every so often while the whole image is traced for a camera that stands still
+        if (!options.checkpoint.empty()) {
+            if (!cpuBackend)
+                checkpointReadback.save(options.checkpoint, false);
+            const auto now = std::chrono::steady_clock::now();
+            if (tracing && renderScale == 1.0f && !camera.hasMoved && !checkpointReadback.isReading() && !checkpointWriter.isBusy() &&
+                std::chrono::duration<double>(now - lastCheckpoint).count() >= options.checkpointSeconds) {
+                startCheckpoint(options.checkpoint, renderSize, frameSettings, checkpointSource, gpu, progress, checkpointReadback);
+                lastCheckpoint = now;
+            }
+        }
+
+        // what is shown, every traced frame with --capture and on F12
+        const bool screenshotKey = glfwGetKey(window.getWindow(), GLFW_KEY_F12) == GLFW_PRESS;
+        const bool screenshot = screenshotKey && !screenshotKeyDown;
+        screenshotKeyDown = screenshotKey;
+        if ((tracing && !options.capture.empty()) || screenshot) {
+            std::vector<raytracer::ReadbackRing::Image> images = {
+                { useDenoiser ? gpu.denoiseTextures[1] : gpu.accumTexture, raytracer::RenderTargets::rgba32f }
+            };
+            if (useAovs) {
+                images.push_back({ gpu.albedoTexture, raytracer::RenderTargets::rgba32f });
+                images.push_back({ gpu.normalDepthTexture, raytracer::RenderTargets::rgba32f });
+                images.push_back({ gpu.idTexture, raytracer::RenderTargets::rg32ui });
+            }
+            char name[32];
+            const char* extension = raytracer::ImageWriter::getExtension(*captureFormat);
+            if (screenshot)
+                std::snprintf(name, sizeof(name), "screenshot_%03llu%s", static_cast<unsigned long long>(screenshots++), extension);
+            else
+                std::snprintf(name, sizeof(name), "frame_%06llu%s", static_cast<unsigned long long>(capturedFrames++), extension);
+            if (readbackRing.read(renderSize, images, progress.frameIndex))
+                capturePaths.push_back((captureDirectory / name).string());
+        }
+        while (const raytracer::ReadbackRing::Readback* readback = readbackRing.poll())
+            saveCapture(readback, false);
 
         // display pass
         displayShader->use();
+        displayShader->setInt("displayMode", displayMode);
+        displayShader->setInt("uVariance", 1);
+        displayShader->setFloat("maxSamples", static_cast<float>(progress.frameCount * frameSettings.samplesPerPixel));
+        displayShader->setVector2("uRenderScale", static_cast<float>(renderSize.x) / static_cast<float>(Window::params.width),
+                                  static_cast<float>(renderSize.y) / static_cast<float>(Window::params.height));
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, gpu.varianceTexture);
+        // set even without AOVs: an integer sampler may not share unit 0 with uTexture
+        displayShader->setInt("uAlbedo", 2);
+        displayShader->setInt("uNormalDepth", 3);
+        displayShader->setInt("uId", 4);
+        if (useAovs) {
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, gpu.albedoTexture);
+            glActiveTexture(GL_TEXTURE3);
+            glBindTexture(GL_TEXTURE_2D, gpu.normalDepthTexture);
+            glActiveTexture(GL_TEXTURE4);
+            glBindTexture(GL_TEXTURE_2D, gpu.idTexture);
+        }
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, accumTexture);
+        glBindTexture(GL_TEXTURE_2D, useDenoiser ? gpu.denoiseTextures[1] : gpu.accumTexture);
+        glBindSampler(0, renderScale < 1.0f ? upscaleSampler : 0);
 
         renderQuad();
+        glBindSampler(0, 0);
 
         glfwSwapBuffers(window.getWindow());
         glfwPollEvents();
-        frameCount++;
         deltaTime = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startFrame).count();
+        if (tracing)
+            frameBudget.finishFrame(passes, deltaTime);
+        lastPasses = passes;
         accTime += deltaTime;
         frames++;
 
         if (accTime >= 1.0) {
+            // the GPU counts the samples of adaptive frames itself and keeps the statistics the noise
+            // threshold needs, both read back once a second; a counter that stood still means every
+            // pixel converged
+            if (tracing && !cpuBackend) {
+                if (frameSettings.adaptiveSampling) {
+                    uint32_t samples[2];
+                    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gpu.tileSSBO);
+                    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 3 * sizeof(uint32_t), sizeof(samples), samples);
+                    progress.totalSamples = samples[0] | static_cast<uint64_t>(samples[1]) << 32;
+                    if (progress.totalSamples == lastCheckedSamples && progress.frameCount > 1)
+                        finishRender(progress, "every pixel converged", pixelCount);
+                    lastCheckedSamples = progress.totalSamples;
+                }
+                // the statistics are only read back whole, a partial image has stale ones around it
+                if (policy.noiseThreshold > 0.0f && renderScale == 1.0f) {
+                    gpuVariance.resize(pixelCount);
+                    glBindTexture(GL_TEXTURE_2D, gpu.varianceTexture);
+                    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, gpuVariance.data());
+                    progress.estimatedError = raytracer::Adaptive::estimateError(gpuVariance.data(), pixelCount);
+                }
+            }
             double fps = frames / accTime;
-            std::string title = "Raytracer - " + std::to_string(static_cast<int>(fps)) + " FPS";
+            std::string title = "Raytracer - " + std::to_string(static_cast<int>(fps)) + " FPS - " +
+                                std::to_string(progress.totalSamples / 1000000) + "M samples";
+            if (dynamicResolution.isEnabled()) {
+                char frameTimes[64];
+                std::snprintf(frameTimes, sizeof(frameTimes), " - %.1f / %.1f ms at %.0f%%",
+                              dynamicResolution.getFrameSeconds() * 1e3, dynamicResolution.getTargetSeconds() * 1e3,
+                              100.0f * renderScale);
+                title += frameTimes;
+            }
+            if (frameBudget.isEnabled()) {
+                char budget[96];
+                std::snprintf(budget, sizeof(budget), " - %u passes of %.1f ms, %.1f / %.1f ms a frame",
+                              frameBudget.getPasses(false), frameBudget.getPassSeconds() * 1e3,
+                              frameBudget.getFrameSeconds() * 1e3, frameBudget.getBudgetSeconds() * 1e3);
+                title += budget;
+            }
+            if (progress.finished)
+                title += " - done";
             glfwSetWindowTitle(window.getWindow(), title.c_str());
             accTime = 0.0;
             frames = 0;
         }
+
+        if (!progress.finished && policy.isSet()) {
+            if (const char* reason = policy.check(static_cast<double>(progress.totalSamples) / static_cast<double>(pixelCount),
+                                                  progress.getSeconds(), progress.estimatedError))
+                finishRender(progress, reason, pixelCount);
+        }
+    }
+
+    // and where the render got to, unless that is a part of the image
+    if (!options.checkpoint.empty() && progress.frameCount > 0 && renderScale == 1.0f) {
+        checkpointWriter.wait();
+        checkpointReadback.save(options.checkpoint, true);
+        checkpointWriter.wait();
+        startCheckpoint(options.checkpoint, gpu.targetSize, frameSettings, checkpointSource, gpu, progress, checkpointReadback);
+        checkpointReadback.save(options.checkpoint, true);
+        if (!checkpointWriter.wait())
+            ERR("Could not save the checkpoint %s.", options.checkpoint.c_str());
     }
+
+    while (const raytracer::ReadbackRing::Readback* readback = readbackRing.poll(true))
+        saveCapture(readback, true);
+    imageWriter.wait();
+    readbackRing.clear();
+    checkpointReadback.clear();
+    if (capturedFrames + screenshots > 0) {
+        INFO("Saved %llu of %llu captured frames to %s, %llu came while every readback buffer was busy and %llu while "
+             "the writer's queue was full.", static_cast<unsigned long long>(savedCaptures.load()),
+             static_cast<unsigned long long>(capturedFrames + screenshots), captureDirectory.string().c_str(),
+             static_cast<unsigned long long>(readbackRing.getDroppedReads()),
+             static_cast<unsigned long long>(rejectedCaptures));
+    }
+
+    gpu.renderTargets.clear();
+    raytracer::JobSystem::shutdown();
 }
 
 GLuint quadVBO = 0;
@@ -198,14 +720,6 @@ void renderQuad() {
 
         glBindBuffer(GL_ARRAY_BUFFER, 0);
         glBindVertexArray(0);
-
-        glGenTextures(1, &accumTexture);
-        glBindTexture(GL_TEXTURE_2D, accumTexture);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, 800, 600, 0, GL_RGBA, GL_FLOAT, nullptr);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     }
 
     glBindVertexArray(quadVAO);
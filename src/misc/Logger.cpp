@@ -51,7 +51,7 @@ void log_inner(const char* message, unsigned char color, bool newline, va_list a
         // Set color corresponding to specified logging level
         printf("\e[%dm", level_colors[color]);
         
-        printf(message, message, args);
+        vprintf(message, args);
         
         // Reset to default text formatting
         printf("\e[0m");
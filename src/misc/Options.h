@@ -0,0 +1,152 @@
+﻿#pragma once
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "Logger.h"
+
+namespace raytracer {
+    // Command line switches. Anything not given keeps the interactive defaults.
+    struct Options {
+        unsigned threads = 0;       // --threads <n>, 0 = one per hardware thread
+        std::string benchmark;      // --bench <suite>
+        std::string isa;            // --isa scalar|sse4.2|avx2|avx512, forces the CPU kernel variant
+        std::string backend = "gpu"; // --backend gpu|cpu, what traces the interactive view and headless tiles
+        std::string sampler;        // --sampler independent|sobol|bluenoise
+        std::string environment;    // --env <file>, equirectangular HDR (or LDR) map instead of the sky gradient
+        int rouletteDepth = -1;     // --roulette-depth <n>, bounces before Russian roulette, -1 = default
+        bool noNextEventEstimation = false; // --no-nee, only find lights by bouncing into them
+        bool noLightTree = false;   // --no-light-tree, pick lights by weight alone
+        bool restir = false;        // --restir, resample the direct light at first hits across pixels and frames
+        int radianceCacheDepth = -1; // --radiance-cache <depth>, end paths in the world-space cache from this bounce on, -1 = off
+        bool pathGuiding = false;   // --guide, learn where light comes from and sample diffuse bounces toward it, CPU only
+        float adaptiveThreshold = 0.0f; // --adaptive <error>, stop tracing pixels once their relative standard error is below it, 0 = off
+        bool reprojection = false;  // --reproject, carry the image over when the camera moves instead of clearing it
+        double targetFrameMilliseconds = 0.0; // --frame-time <ms>, trace fewer pixels while the camera moves to keep frames this short, 0 = off
+        double frameBudgetMilliseconds = 0.0; // --frame-budget <ms>, trace as many passes before presenting a frame as fit in this, 0 = one
+        std::string accumFormat = "rgba32f"; // --accum-format rgba32f|rgba16f|r11g11b10f, what the GPU accumulates in
+        bool denoise = false;       // --denoise, filter the image guided by first-hit albedo, normal and distance
+        std::string view = "color"; // --view color|samples|albedo|normal|depth|id, the image, how many camera samples each pixel took, or an AOV
+        double targetSamples = 0.0; // --spp <n>, stop once the pixels average this many samples
+        double timeBudget = 0.0;    // --time <seconds>, stop after this long
+        float noiseThreshold = 0.0f; // --noise <error>, stop once the estimated relative error of the image is below it
+        bool headless = false;      // --headless, render on the CPU without a window until one of the above says stop
+        std::string output;         // --output <file>, where a headless render saves its image, as .pfm, .exr, .png or .qoi
+        unsigned width = 800, height = 600; // --size <width>x<height>, of a headless render
+        unsigned tileSize = 0;      // --tile <pixels>, render headless in square tiles of this size, each to the end, streaming them to --output, 0 = in one go
+        std::string checkpoint;     // --checkpoint <file>, save the render there every so often and when it ends
+        double checkpointSeconds = 60.0; // --checkpoint-every <seconds>
+        bool resume = false;        // --resume, go on from --checkpoint instead of starting over
+        bool saveAovs = false;      // --aovs, save the first-hit AOVs next to the output as <name>.albedo.pfm and so on
+        std::string capture;        // --capture <directory>, save every traced frame there, and F12 screenshots
+        std::string captureFormat = "pfm"; // --capture-format pfm|exr|png|qoi, of what --capture and F12 save
+
+        static Options parse(int argc, char** argv) {
+            Options options;
+            for (int i = 1; i < argc; ++i) {
+                const char* arg = argv[i];
+                const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+                if (!strcmp(arg, "--threads") && value) {
+                    options.threads = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+                    ++i;
+                } else if (!strcmp(arg, "--bench") && value) {
+                    options.benchmark = value;
+                    ++i;
+                } else if (!strcmp(arg, "--isa") && value) {
+                    options.isa = value;
+                    ++i;
+                } else if (!strcmp(arg, "--backend") && value) {
+                    options.backend = value;
+                    ++i;
+                } else if (!strcmp(arg, "--sampler") && value) {
+                    options.sampler = value;
+                    ++i;
+                } else if (!strcmp(arg, "--env") && value) {
+                    options.environment = value;
+                    ++i;
+                } else if (!strcmp(arg, "--no-nee")) {
+                    options.noNextEventEstimation = true;
+                } else if (!strcmp(arg, "--no-light-tree")) {
+                    options.noLightTree = true;
+                } else if (!strcmp(arg, "--restir")) {
+                    options.restir = true;
+                } else if (!strcmp(arg, "--guide")) {
+                    options.pathGuiding = true;
+                } else if (!strcmp(arg, "--adaptive") && value) {
+                    options.adaptiveThreshold = std::strtof(value, nullptr);
+                    ++i;
+                } else if (!strcmp(arg, "--reproject")) {
+                    options.reprojection = true;
+                } else if (!strcmp(arg, "--frame-time") && value) {
+                    options.targetFrameMilliseconds = std::strtod(value, nullptr);
+                    ++i;
+                } else if (!strcmp(arg, "--frame-budget") && value) {
+                    options.frameBudgetMilliseconds = std::strtod(value, nullptr);
+                    ++i;
+                } else if (!strcmp(arg, "--accum-format") && value) {
+                    options.accumFormat = value;
+                    ++i;
+                } else if (!strcmp(arg, "--denoise")) {
+                    options.denoise = true;
+                } else if (!strcmp(arg, "--view") && value) {
+                    options.view = value;
+                    ++i;
+                } else if (!strcmp(arg, "--spp") && value) {
+                    options.targetSamples = std::strtod(value, nullptr);
+                    ++i;
+                } else if (!strcmp(arg, "--time") && value) {
+                    options.timeBudget = std::strtod(value, nullptr);
+                    ++i;
+                } else if (!strcmp(arg, "--noise") && value) {
+                    options.noiseThreshold = std::strtof(value, nullptr);
+                    ++i;
+                } else if (!strcmp(arg, "--headless")) {
+                    options.headless = true;
+                } else if (!strcmp(arg, "--output") && value) {
+                    options.output = value;
+                    ++i;
+                } else if (!strcmp(arg, "--size") && value) {
+                    char* end = nullptr;
+                    const unsigned long width = std::strtoul(value, &end, 10);
+                    const unsigned long height = *end == 'x' ? std::strtoul(end + 1, nullptr, 10) : 0;
+                    if (width > 0 && height > 0) {
+                        options.width = static_cast<unsigned>(width);
+                        options.height = static_cast<unsigned>(height);
+                    } else {
+                        WARN("Ignoring --size '%s', expected <width>x<height>.", value);
+                    }
+                    ++i;
+                } else if (!strcmp(arg, "--tile") && value) {
+                    options.tileSize = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+                    ++i;
+                } else if (!strcmp(arg, "--checkpoint") && value) {
+                    options.checkpoint = value;
+                    ++i;
+                } else if (!strcmp(arg, "--checkpoint-every") && value) {
+                    options.checkpointSeconds = std::strtod(value, nullptr);
+                    ++i;
+                } else if (!strcmp(arg, "--resume")) {
+                    options.resume = true;
+                } else if (!strcmp(arg, "--capture") && value) {
+                    options.capture = value;
+                    ++i;
+                } else if (!strcmp(arg, "--capture-format") && value) {
+                    options.captureFormat = value;
+                    ++i;
+                } else if (!strcmp(arg, "--aovs")) {
+                    options.saveAovs = true;
+                } else if (!strcmp(arg, "--radiance-cache") && value) {
+                    options.radianceCacheDepth = static_cast<int>(std::strtol(value, nullptr, 10));
+                    ++i;
+                } else if (!strcmp(arg, "--roulette-depth") && value) {
+                    options.rouletteDepth = static_cast<int>(std::strtol(value, nullptr, 10));
+                    ++i;
+                } else {
+                    WARN("Ignoring unknown argument '%s'.", arg);
+                }
+            }
+            return options;
+        }
+    };
+}
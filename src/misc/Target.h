@@ -16,3 +16,12 @@
 
 #endif
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+
+#define TARGET_ARCH_X86 1
+
+#else
+
+#define TARGET_ARCH_X86 0
+
+#endif
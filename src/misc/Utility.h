@@ -30,13 +30,13 @@ public:
         return "";
     }
 
-    static void writeFile(const char* filename, const char* contents, size_t size) {
+    // Replaces the file with size bytes of contents. False if it could not be opened or not all of
+    // it was written; the caller says so, this runs on the writer's threads too.
+    static bool writeFile(const char* filename, const char* contents, size_t size) {
         std::ofstream out(filename, std::ios::binary);
-        if(out.is_open()) {
-            out.write(contents, size);
-        }
-        else
-            ASSERT(("Unable to open file with the name of '" + std::string(filename) + "'").c_str());
+        out.write(contents, static_cast<std::streamsize>(size));
+        out.close();
+        return !out.fail();
     }
 
     static bool fileExists(const char* filename) {